@@ -22,12 +22,16 @@
 
 #include <cstddef>
 #include <cstring>
+#include <set>
 #include <string>
 #include <vector>
 
 #include "catalog/CatalogAttribute.hpp"
 #include "catalog/CatalogDatabase.hpp"
+#include "catalog/SharedCompressionDictionary.hpp"
+#include "storage/StorageBlockInfo.hpp"
 #include "storage/StorageBlockLayout.hpp"
+#include "threading/Mutex.hpp"
 #include "types/Type.hpp"
 
 using std::size_t;
@@ -115,6 +119,52 @@ attribute_id CatalogRelation::getMaxAttributeId() const {
   }
 }
 
+std::size_t CatalogRelation::getBlocksSnapshot(std::vector<block_id> *snapshot) const {
+  MutexLock lock(blocks_mutex_);
+  snapshot->assign(blocks_.begin(), blocks_.end());
+  return blocks_epoch_;
+}
+
+std::size_t CatalogRelation::beginBlocksRead(std::vector<block_id> *snapshot) const {
+  MutexLock lock(blocks_mutex_);
+  snapshot->assign(blocks_.begin(), blocks_.end());
+  blocks_reader_epochs_.insert(blocks_epoch_);
+  return blocks_epoch_;
+}
+
+void CatalogRelation::endBlocksRead(const std::size_t epoch) const {
+  MutexLock lock(blocks_mutex_);
+  std::multiset<std::size_t>::iterator epoch_it = blocks_reader_epochs_.find(epoch);
+  DEBUG_ASSERT(epoch_it != blocks_reader_epochs_.end());
+  blocks_reader_epochs_.erase(epoch_it);
+}
+
+std::size_t CatalogRelation::getOldestBlocksReaderEpoch() const {
+  MutexLock lock(blocks_mutex_);
+  if (blocks_reader_epochs_.empty()) {
+    return blocks_epoch_;
+  } else {
+    return *blocks_reader_epochs_.begin();
+  }
+}
+
+bool CatalogRelation::replaceBlocks(const std::vector<block_id> &old_blocks,
+                                    const std::vector<block_id> &new_blocks) {
+  MutexLock lock(blocks_mutex_);
+  for (vector<block_id>::const_iterator it = old_blocks.begin(); it != old_blocks.end(); ++it) {
+    if (blocks_.find(*it) == blocks_.end()) {
+      return false;
+    }
+  }
+
+  for (vector<block_id>::const_iterator it = old_blocks.begin(); it != old_blocks.end(); ++it) {
+    blocks_.erase(*it);
+  }
+  blocks_.insert(new_blocks.begin(), new_blocks.end());
+  ++blocks_epoch_;
+  return true;
+}
+
 void CatalogRelation::setDefaultStorageBlockLayout(StorageBlockLayout *default_layout) {
   DEBUG_ASSERT(&(default_layout->getRelation()) == this);
   default_layout_.reset(default_layout);
@@ -128,4 +178,10 @@ const StorageBlockLayout& CatalogRelation::getDefaultStorageBlockLayout() const
   return *default_layout_;
 }
 
+void CatalogRelation::createSharedCompressionDictionary(const attribute_id id) {
+  if (!hasSharedCompressionDictionary(id)) {
+    shared_dictionaries_.insert(id, new SharedCompressionDictionary(getAttributeById(id).getType()));
+  }
+}
+
 }  // namespace quickstep
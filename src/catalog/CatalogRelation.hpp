@@ -21,18 +21,23 @@
 #ifndef QUICKSTEP_CATALOG_CATALOG_RELATION_HPP_
 #define QUICKSTEP_CATALOG_CATALOG_RELATION_HPP_
 
+#include <cstddef>
 #include <map>
+#include <set>
 #include <sstream>
 #include <string>
 #include <vector>
 
 #include "catalog/CatalogAttribute.hpp"
 #include "catalog/CatalogTypedefs.hpp"
+#include "catalog/SharedCompressionDictionary.hpp"
 #include "storage/StorageBlockInfo.hpp"
 #include "storage/StorageBlockLayout.hpp"
+#include "threading/Mutex.hpp"
 #include "types/AllowedTypeConversion.hpp"
 #include "utility/ContainerCompat.hpp"
 #include "utility/Macros.hpp"
+#include "utility/PtrMap.hpp"
 #include "utility/PtrVector.hpp"
 #include "utility/ScopedPtr.hpp"
 
@@ -81,6 +86,7 @@ class CatalogRelation {
         max_variable_byte_length_(0),
         min_variable_byte_length_(0),
         estimated_variable_byte_length_(0),
+        blocks_epoch_(0),
         default_layout_(NULL) {
   }
 
@@ -335,7 +341,10 @@ class CatalogRelation {
    * @param block the ID of the block to add.
    **/
   void addBlock(const block_id block) {
-    blocks_.insert(block);
+    MutexLock lock(blocks_mutex_);
+    if (blocks_.insert(block).second) {
+      ++blocks_epoch_;
+    }
   }
 
   /**
@@ -344,14 +353,94 @@ class CatalogRelation {
    * @param block the ID of the block to remove.
    **/
   void removeBlock(const block_id block) {
-    blocks_.erase(block);
+    MutexLock lock(blocks_mutex_);
+    if (blocks_.erase(block) > 0) {
+      ++blocks_epoch_;
+    }
   };
 
   /**
    * @brief Remove all StorageBlocks from this relation.
    **/
   void clearBlocks() {
-    blocks_.clear();
+    MutexLock lock(blocks_mutex_);
+    if (!blocks_.empty()) {
+      blocks_.clear();
+      ++blocks_epoch_;
+    }
+  }
+
+  /**
+   * @brief Atomically replace some StorageBlocks of this relation with
+   *        others (e.g. to swap in blocks which a BlockCompactor has merged).
+   *        A snapshot from getBlocksSnapshot() sees either all of the old
+   *        blocks or all of the new ones, never a mix.
+   * @note If any of old_blocks no longer belongs to this relation (e.g.
+   *       because another thread removed it), nothing is changed.
+   *
+   * @param old_blocks The IDs of the blocks to remove.
+   * @param new_blocks The IDs of the blocks to add in their place.
+   * @return Whether the blocks were replaced.
+   **/
+  bool replaceBlocks(const std::vector<block_id> &old_blocks,
+                     const std::vector<block_id> &new_blocks);
+
+  /**
+   * @brief Take a snapshot of the child blocks, which may safely be used
+   *        while other threads add or remove blocks (e.g. by inserting into
+   *        this relation).
+   * @warning Blocks are not guaranteed to be in any particular order.
+   *
+   * @param snapshot A vector which is overwritten with the IDs of the child
+   *        blocks.
+   * @return The blocks epoch as of the snapshot (see getBlocksEpoch()).
+   **/
+  std::size_t getBlocksSnapshot(std::vector<block_id> *snapshot) const;
+
+  /**
+   * @brief Take a snapshot of the child blocks as getBlocksSnapshot() does,
+   *        and register as a reader of them until endBlocksRead() is called.
+   *        Blocks which are replaced in the meantime (see replaceBlocks())
+   *        must not be freed while the reader may still be reading them (see
+   *        getOldestBlocksReaderEpoch()).
+   *
+   * @param snapshot A vector which is overwritten with the IDs of the child
+   *        blocks.
+   * @return The blocks epoch as of the snapshot, which must be passed to
+   *         endBlocksRead().
+   **/
+  std::size_t beginBlocksRead(std::vector<block_id> *snapshot) const;
+
+  /**
+   * @brief End a read of the child blocks registered by beginBlocksRead().
+   *
+   * @param epoch The blocks epoch returned by beginBlocksRead().
+   **/
+  void endBlocksRead(const std::size_t epoch) const;
+
+  /**
+   * @brief Get the blocks epoch of the oldest reader registered with
+   *        beginBlocksRead() which has not yet ended its read. A block which
+   *        was removed from this relation no later than this epoch (i.e. the
+   *        blocks epoch just after it was removed is at most this epoch) can
+   *        no longer be read by any registered reader, and may be freed.
+   *
+   * @return The blocks epoch of the oldest registered reader, or the current
+   *         blocks epoch if there are none.
+   **/
+  std::size_t getOldestBlocksReaderEpoch() const;
+
+  /**
+   * @brief Get the blocks epoch, which is incremented every time a block is
+   *        added to or removed from this relation. A snapshot from
+   *        getBlocksSnapshot() is up to date so long as the epoch is the same
+   *        as when it was taken.
+   *
+   * @return The current blocks epoch.
+   **/
+  std::size_t getBlocksEpoch() const {
+    MutexLock lock(blocks_mutex_);
+    return blocks_epoch_;
   }
 
   /**
@@ -404,12 +493,16 @@ class CatalogRelation {
    * @return The number of child blocks.
    **/
   size_type_blocks size_blocks() const {
+    MutexLock lock(blocks_mutex_);
     return blocks_.size();
   }
 
   /**
    * @brief Get an iterator at the beginning of the child blocks.
    * @warning Blocks are not guaranteed to be in any particular order.
+   * @warning Iterating over the child blocks is not safe if other threads may
+   *          add or remove blocks in the meantime. Use getBlocksSnapshot()
+   *          instead in that case.
    *
    * @return An iterator on the first child block.
    **/
@@ -445,6 +538,48 @@ class CatalogRelation {
    **/
   const StorageBlockLayout& getDefaultStorageBlockLayout() const;
 
+  /**
+   * @brief Determine whether an attribute has a relation-wide
+   *        SharedCompressionDictionary.
+   *
+   * @param id The ID of the attribute to check.
+   * @return Whether the attribute has a SharedCompressionDictionary.
+   **/
+  bool hasSharedCompressionDictionary(const attribute_id id) const {
+    return (shared_dictionaries_.find(id) != shared_dictionaries_.end());
+  }
+
+  /**
+   * @brief Get the relation-wide SharedCompressionDictionary for an
+   *        attribute.
+   * @note SharedCompressionDictionary is internally synchronized, so blocks
+   *       being built may extend it through a const CatalogRelation.
+   *
+   * @param id The ID of an attribute for which
+   *        hasSharedCompressionDictionary() is true.
+   * @return The attribute's SharedCompressionDictionary.
+   **/
+  SharedCompressionDictionary* getSharedCompressionDictionary(const attribute_id id) const {
+    PtrMap<attribute_id, SharedCompressionDictionary>::const_iterator it = shared_dictionaries_.find(id);
+    if (it == shared_dictionaries_.end()) {
+      FATAL_ERROR("No SharedCompressionDictionary for attribute with id " << id
+                  << " in relation " << name_);
+    }
+    return it->second;
+  }
+
+  /**
+   * @brief Create an empty relation-wide SharedCompressionDictionary for an
+   *        attribute (idempotent). Compressed blocks which are built after
+   *        this is called will dictionary-compress the attribute (if it is
+   *        compressed at all) using the shared dictionary instead of storing
+   *        a dictionary of their own.
+   * @warning Do not call this while blocks of this relation are being built.
+   *
+   * @param id The ID of the attribute to create a shared dictionary for.
+   **/
+  void createSharedCompressionDictionary(const attribute_id id);
+
  private:
   /**
    * @brief Set the parent CatalogDatabase of this relation. Used by
@@ -502,10 +637,18 @@ class CatalogRelation {
   // This actually needs to be kept in order, so we use std::map
   std::map<attribute_id, unsigned int> nullable_attribute_indexes_;
 
+  // Protects 'blocks_', 'blocks_epoch_', and 'blocks_reader_epochs_' against
+  // concurrent modification.
+  mutable Mutex blocks_mutex_;
   CompatUnorderedSet<block_id>::unordered_set blocks_;
+  std::size_t blocks_epoch_;
+  // The blocks epochs of readers registered with beginBlocksRead().
+  mutable std::multiset<std::size_t> blocks_reader_epochs_;
 
   mutable ScopedPtr<StorageBlockLayout> default_layout_;
 
+  PtrMap<attribute_id, SharedCompressionDictionary> shared_dictionaries_;
+
   friend class CatalogDatabase;
 
   DISALLOW_COPY_AND_ASSIGN(CatalogRelation);
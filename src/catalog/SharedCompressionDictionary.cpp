@@ -0,0 +1,140 @@
+/*
+   This file copyright (c) 2011-2013, the Quickstep authors.
+   See file CREDITS.txt for details.
+  
+   This file is part of Quickstep.
+
+   Quickstep is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+  
+   Quickstep is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Quickstep.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "catalog/SharedCompressionDictionary.hpp"
+
+#include <cstddef>
+#include <vector>
+
+#include "threading/Mutex.hpp"
+#include "types/CompressionDictionary.hpp"
+#include "types/CompressionDictionaryBuilder.hpp"
+#include "types/Type.hpp"
+#include "utility/CstdintCompat.hpp"
+#include "utility/Macros.hpp"
+#include "utility/ScopedBuffer.hpp"
+#include "utility/ScopedPtr.hpp"
+
+using std::size_t;
+using std::uint8_t;
+using std::uint32_t;
+using std::vector;
+
+namespace quickstep {
+
+SharedCompressionDictionary::SharedCompressionDictionary(const Type &type)
+    : type_(type),
+      total_size_bytes_(0) {
+}
+
+SharedCompressionDictionary::~SharedCompressionDictionary() {
+}
+
+const CompressionDictionary& SharedCompressionDictionary::getVersion(const std::uint32_t version) const {
+  MutexLock lock(mutex_);
+  if ((version == 0) || (version > versions_.size())) {
+    FATAL_ERROR("Requested nonexistent version " << version << " of a SharedCompressionDictionary.");
+  }
+  return versions_[version - 1];
+}
+
+std::uint32_t SharedCompressionDictionary::getVersionContainingValues(
+    const std::vector<const void*> &values,
+    const std::uint32_t base_version,
+    const std::uint8_t max_code_length_bits) {
+  MutexLock lock(mutex_);
+  DEBUG_ASSERT(base_version <= versions_.size());
+
+  if (!versions_.empty()) {
+    const CompressionDictionary &latest = versions_.back();
+    const size_t num_new_values = countValuesNotInDictionary(latest, values);
+    if (CompressionDictionaryBuilder::CodeLengthBitsForEntries(latest.numberOfCodes() + num_new_values)
+        <= max_code_length_bits) {
+      if (num_new_values == 0) {
+        return versions_.size();
+      } else {
+        return createVersion(versions_.size(), values);
+      }
+    }
+
+    // The latest version has grown too large for the caller (this can only
+    // happen if other blocks extended it after the caller chose
+    // base_version), so fall back to base_version.
+    if ((base_version != 0)
+        && (countValuesNotInDictionary(versions_[base_version - 1], values) == 0)) {
+      return base_version;
+    }
+  }
+
+  return createVersion(base_version, values);
+}
+
+std::size_t SharedCompressionDictionary::countValuesNotInDictionary(
+    const CompressionDictionary &dictionary,
+    const std::vector<const void*> &values) const {
+  size_t num_missing = 0;
+  for (vector<const void*>::const_iterator value_it = values.begin();
+       value_it != values.end();
+       ++value_it) {
+    if (dictionary.getCodeForUntypedValue(*value_it) == dictionary.numberOfCodes()) {
+      ++num_missing;
+    }
+  }
+  return num_missing;
+}
+
+std::uint32_t SharedCompressionDictionary::createVersion(const std::uint32_t from_version,
+                                                         const std::vector<const void*> &values) {
+  ScopedPtr<CompressionDictionaryBuilder> builder;
+  const bool build_lookup_tables = CompressionDictionaryBuilder::LookupTablesRecommendedForType(type_);
+  if (type_.isVariableLength()) {
+    builder.reset(new VariableLengthTypeCompressionDictionaryBuilder(type_, build_lookup_tables));
+  } else {
+    builder.reset(new FixedLengthTypeCompressionDictionaryBuilder(type_, build_lookup_tables));
+  }
+
+  vector<const void*> entries(values);
+  if (from_version != 0) {
+    const CompressionDictionary &from_dictionary = versions_[from_version - 1];
+    for (uint32_t code = 0; code < from_dictionary.numberOfCodes(); ++code) {
+      entries.push_back(from_dictionary.getUntypedValueForCode(code));
+    }
+  }
+  builder->insertEntriesByReference(&entries);
+
+  ScopedBuffer *memory = new ScopedBuffer(builder->dictionarySizeBytes());
+  version_memory_.push_back(memory);
+  builder->buildDictionary(memory->get());
+  total_size_bytes_ += builder->dictionarySizeBytes();
+
+  if (type_.isVariableLength()) {
+    versions_.push_back(new VariableLengthTypeCompressionDictionary(type_,
+                                                                    memory->get(),
+                                                                    builder->dictionarySizeBytes()));
+  } else {
+    versions_.push_back(new FixedLengthTypeCompressionDictionary(type_,
+                                                                 memory->get(),
+                                                                 builder->dictionarySizeBytes()));
+  }
+
+  return versions_.size();
+}
+
+}  // namespace quickstep
@@ -0,0 +1,156 @@
+/*
+   This file copyright (c) 2011-2013, the Quickstep authors.
+   See file CREDITS.txt for details.
+  
+   This file is part of Quickstep.
+
+   Quickstep is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+  
+   Quickstep is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Quickstep.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICKSTEP_CATALOG_SHARED_COMPRESSION_DICTIONARY_HPP_
+#define QUICKSTEP_CATALOG_SHARED_COMPRESSION_DICTIONARY_HPP_
+
+#include <cstddef>
+#include <vector>
+
+#include "threading/Mutex.hpp"
+#include "utility/CstdintCompat.hpp"
+#include "utility/Macros.hpp"
+#include "utility/PtrVector.hpp"
+#include "utility/ScopedBuffer.hpp"
+
+namespace quickstep {
+
+class CompressionDictionary;
+class Type;
+
+/** \addtogroup Catalog
+ *  @{
+ */
+
+/**
+ * @brief A relation-wide, order-preserving compression dictionary for a
+ *        single attribute, which compressed blocks reference instead of
+ *        storing a dictionary of their own.
+ * @note A SharedCompressionDictionary is a sequence of immutable versions,
+ *       numbered from 1. A new version is created when a block contains
+ *       values which are not in the latest version, and normally contains
+ *       every value in the latest version plus the block's new values.
+ *       Codes are only comparable between blocks which reference the same
+ *       version (see
+ *       CompressedTupleStorageSubBlock::compressedGetSharedDictionaryVersion()).
+ * @note All methods are thread-safe, so blocks may be built concurrently.
+ *       Versions are never modified or deleted once created.
+ **/
+class SharedCompressionDictionary {
+ public:
+  /**
+   * @brief Constructor. Creates a dictionary with no versions.
+   *
+   * @param type The Type of values in the dictionary.
+   **/
+  explicit SharedCompressionDictionary(const Type &type);
+
+  /**
+   * @brief Destructor.
+   **/
+  ~SharedCompressionDictionary();
+
+  /**
+   * @brief Get the Type of values in this dictionary.
+   *
+   * @return The Type of values in this dictionary.
+   **/
+  const Type& getType() const {
+    return type_;
+  }
+
+  /**
+   * @brief Get the number of the latest version of this dictionary.
+   *
+   * @return The latest version number, or 0 if no version exists yet.
+   **/
+  std::uint32_t getLatestVersion() const {
+    MutexLock lock(mutex_);
+    return versions_.size();
+  }
+
+  /**
+   * @brief Get the total size of all versions of this dictionary.
+   *
+   * @return The total size, in bytes, of the physical dictionaries for all
+   *         versions.
+   **/
+  std::size_t getTotalSizeBytes() const {
+    MutexLock lock(mutex_);
+    return total_size_bytes_;
+  }
+
+  /**
+   * @brief Get a particular version of this dictionary.
+   *
+   * @param version The number of the version to get, which must be between 1
+   *        and getLatestVersion().
+   * @return The specified version of this dictionary.
+   **/
+  const CompressionDictionary& getVersion(const std::uint32_t version) const;
+
+  /**
+   * @brief Get a version of this dictionary which contains all of the
+   *        specified values, creating a new version if necessary.
+   * @note The latest version is used (or extended) if possible, so that as
+   *       many blocks as possible share a version. If the latest version has
+   *       grown too large since base_version, the new version is built from
+   *       base_version instead.
+   *
+   * @param values Untyped pointers to distinct values of this dictionary's
+   *        Type, in sorted order.
+   * @param base_version A version of this dictionary (or 0 for none) which
+   *        max_code_length_bits was computed from.
+   * @param max_code_length_bits The maximum length of codes, in bits, which
+   *        the returned version may have. This must be at least enough to
+   *        represent codes for the union of base_version and values.
+   * @return The number of a version which contains all of values and whose
+   *         codes are no longer than max_code_length_bits.
+   **/
+  std::uint32_t getVersionContainingValues(const std::vector<const void*> &values,
+                                           const std::uint32_t base_version,
+                                           const std::uint8_t max_code_length_bits);
+
+ private:
+  // Count how many of 'values' are not in 'dictionary'.
+  std::size_t countValuesNotInDictionary(const CompressionDictionary &dictionary,
+                                         const std::vector<const void*> &values) const;
+
+  // Create a new version containing every value in 'from_version' (if not 0)
+  // and in 'values', and return its number. Caller must hold 'mutex_'.
+  std::uint32_t createVersion(const std::uint32_t from_version,
+                              const std::vector<const void*> &values);
+
+  const Type &type_;
+
+  PtrVector<ScopedBuffer> version_memory_;
+  PtrVector<CompressionDictionary> versions_;
+  std::size_t total_size_bytes_;
+
+  mutable Mutex mutex_;
+
+  DISALLOW_COPY_AND_ASSIGN(SharedCompressionDictionary);
+};
+
+/** @} */
+
+}  // namespace quickstep
+
+#endif  // QUICKSTEP_CATALOG_SHARED_COMPRESSION_DICTIONARY_HPP_
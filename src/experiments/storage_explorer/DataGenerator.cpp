@@ -25,9 +25,11 @@
 
 #include "experiments/storage_explorer/DataGenerator.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <sstream>
 #include <vector>
@@ -44,6 +46,7 @@
 #include "storage/StorageBlockInfo.hpp"
 #include "storage/StorageBlockLayout.hpp"
 #include "storage/StorageBlockLayout.pb.h"
+#include "storage/TupleBatch.hpp"
 #include "storage/TupleStorageSubBlock.hpp"
 #include "types/CharType.hpp"
 #include "types/Comparison.hpp"
@@ -51,10 +54,14 @@
 #include "types/Tuple.hpp"
 #include "types/Type.hpp"
 #include "types/TypeInstance.hpp"
+#include "utility/Macros.hpp"
+#include "utility/ScopedBuffer.hpp"
 #include "utility/ScopedPtr.hpp"
 
 using std::cerr;
 using std::fabs;
+using std::memcpy;
+using std::min;
 using std::ostringstream;
 using std::pow;
 using std::rand;
@@ -65,26 +72,78 @@ using std::vector;
 namespace quickstep {
 namespace storage_explorer {
 
+namespace {
+
+// Add a CSBTree index to the layout described by 'layout_desc' for each column
+// in 'index_on_columns'. If 'index_node_sizes' is not empty, it should be the
+// same length as 'index_on_columns', and specifies the node size for each
+// index.
+void AddCSBTreeIndexDescriptions(const vector<attribute_id> &index_on_columns,
+                                 const vector<size_t> &index_node_sizes,
+                                 StorageBlockLayoutDescription *layout_desc) {
+  DEBUG_ASSERT(index_node_sizes.empty() || (index_node_sizes.size() == index_on_columns.size()));
+  for (size_t index_num = 0; index_num < index_on_columns.size(); ++index_num) {
+    IndexSubBlockDescription *index_desc = layout_desc->add_index_description();
+    index_desc->set_sub_block_type(IndexSubBlockDescription::CSB_TREE);
+    index_desc->AddExtension(CSBTreeIndexSubBlockDescription::indexed_attribute_id,
+                             index_on_columns[index_num]);
+    if (!index_node_sizes.empty()) {
+      index_desc->SetExtension(CSBTreeIndexSubBlockDescription::node_size_bytes,
+                               index_node_sizes[index_num]);
+    }
+  }
+}
+
+// Put 'full_block' into a "correct" state (unless 'defer_rebuild' is true),
+// return it to 'destination', and get another block to insert into.
+StorageBlock* ReplaceFullBlock(StorageBlock *full_block,
+                               InsertDestination *destination,
+                               const bool defer_rebuild) {
+  if (!defer_rebuild) {
+    if (!full_block->rebuild()) {
+      FATAL_ERROR("DataGenerator::generateData() failed to rebuild a full StorageBlock.");
+    }
+  }
+
+  destination->returnBlock(full_block, true);
+  return destination->getBlockForInsertion();
+}
+
+}  // namespace
+
 void DataGenerator::generateData(const std::size_t num_tuples,
                                  InsertDestination *destination,
                                  bool defer_rebuild) const {
   const CatalogRelation &relation = destination->getRelation();
   StorageBlock *current_block = destination->getBlockForInsertion();
 
-  for (size_t tuple_num = 0; tuple_num < num_tuples; ++tuple_num) {
-    ScopedPtr<Tuple> tuple(new Tuple(relation));
-    generateValuesInTuple(tuple.get());
+  if (relation.isVariableLength()) {
+    for (size_t tuple_num = 0; tuple_num < num_tuples; ++tuple_num) {
+      ScopedPtr<Tuple> tuple(new Tuple(relation));
+      generateValuesInTuple(tuple.get());
 
-    while (!current_block->insertTupleInBatch(*tuple, kNone)) {
-      // Block is full, so put it into "correct" state:
-      if (!defer_rebuild) {
-        if (!current_block->rebuild()) {
-          FATAL_ERROR("DataGenerator::generateData() failed to rebuild a full StorageBlock.");
-        }
+      while (!current_block->insertTupleInBatch(*tuple, kNone)) {
+        current_block = ReplaceFullBlock(current_block, destination, defer_rebuild);
+      }
+    }
+  } else {
+    const size_t row_length = relation.getFixedByteLength();
+    ScopedBuffer rows(kRowsPerGeneratedBatch * row_length);
+
+    for (size_t tuple_num = 0; tuple_num < num_tuples; ) {
+      const tuple_id batch_size = static_cast<tuple_id>(
+          min(num_tuples - tuple_num, static_cast<size_t>(kRowsPerGeneratedBatch)));
+      for (tuple_id row_num = 0; row_num < batch_size; ++row_num) {
+        generateValuesInRow(relation, static_cast<char*>(rows.get()) + row_num * row_length);
       }
 
-      destination->returnBlock(current_block, true);
-      current_block = destination->getBlockForInsertion();
+      TupleBatch batch(relation, batch_size, rows.get(), NULL);
+      tuple_id num_inserted = current_block->bulkInsertTuples(batch, 0);
+      while (num_inserted < batch_size) {
+        current_block = ReplaceFullBlock(current_block, destination, defer_rebuild);
+        num_inserted += current_block->bulkInsertTuples(batch, num_inserted);
+      }
+      tuple_num += batch_size;
     }
   }
 
@@ -149,7 +208,8 @@ StorageBlockLayout* DataGenerator::generateColumnstoreLayout(
     const CatalogRelation &relation,
     const std::size_t num_slots,
     const attribute_id column_store_sort_column,
-    const std::vector<attribute_id> &index_on_columns) const {
+    const std::vector<attribute_id> &index_on_columns,
+    const std::vector<std::size_t> &index_node_sizes) const {
   ScopedPtr<StorageBlockLayout> layout(new StorageBlockLayout(relation));
   StorageBlockLayoutDescription *layout_desc = layout->getDescriptionMutable();
 
@@ -161,13 +221,7 @@ StorageBlockLayout* DataGenerator::generateColumnstoreLayout(
       ->SetExtension(BasicColumnStoreTupleStorageSubBlockDescription::sort_attribute_id,
                      column_store_sort_column);
 
-  for (vector<attribute_id>::const_iterator it = index_on_columns.begin();
-       it != index_on_columns.end();
-       ++it) {
-    IndexSubBlockDescription *index_desc = layout_desc->add_index_description();
-    index_desc->set_sub_block_type(IndexSubBlockDescription::CSB_TREE);
-    index_desc->AddExtension(CSBTreeIndexSubBlockDescription::indexed_attribute_id, *it);
-  }
+  AddCSBTreeIndexDescriptions(index_on_columns, index_node_sizes, layout_desc);
 
   layout->finalize();
   return layout.release();
@@ -177,6 +231,7 @@ StorageBlockLayout* DataGenerator::generateRowstoreLayout(
     const CatalogRelation &relation,
     const std::size_t num_slots,
     const std::vector<attribute_id> &index_on_columns,
+    const std::vector<std::size_t> &index_node_sizes,
 	const bool use_bloom_filter) const {
   ScopedPtr<StorageBlockLayout> layout(new StorageBlockLayout(relation));
   StorageBlockLayoutDescription *layout_desc = layout->getDescriptionMutable();
@@ -186,13 +241,7 @@ StorageBlockLayout* DataGenerator::generateRowstoreLayout(
   layout_desc->mutable_tuple_store_description()
       ->set_sub_block_type(TupleStorageSubBlockDescription::PACKED_ROW_STORE);
 
-  for (vector<attribute_id>::const_iterator it = index_on_columns.begin();
-       it != index_on_columns.end();
-       ++it) {
-    IndexSubBlockDescription *index_desc = layout_desc->add_index_description();
-    index_desc->set_sub_block_type(IndexSubBlockDescription::CSB_TREE);
-    index_desc->AddExtension(CSBTreeIndexSubBlockDescription::indexed_attribute_id, *it);
-  }
+  AddCSBTreeIndexDescriptions(index_on_columns, index_node_sizes, layout_desc);
 
   if (use_bloom_filter) {
 	  layout_desc->mutable_bloom_filter_description()
@@ -203,11 +252,78 @@ StorageBlockLayout* DataGenerator::generateRowstoreLayout(
   return layout.release();
 }
 
+StorageBlockLayout* DataGenerator::generatePaxLayout(
+    const CatalogRelation &relation,
+    const std::size_t num_slots,
+    const std::size_t minipage_size_bytes,
+    const std::vector<attribute_id> &index_on_columns,
+    const std::vector<std::size_t> &index_node_sizes,
+    const bool use_bloom_filter) const {
+  ScopedPtr<StorageBlockLayout> layout(new StorageBlockLayout(relation));
+  StorageBlockLayoutDescription *layout_desc = layout->getDescriptionMutable();
+
+  layout_desc->set_num_slots(num_slots);
+
+  layout_desc->mutable_tuple_store_description()
+      ->set_sub_block_type(TupleStorageSubBlockDescription::PAX_STORE);
+  layout_desc->mutable_tuple_store_description()
+      ->SetExtension(PaxTupleStorageSubBlockDescription::minipage_size_bytes,
+                     minipage_size_bytes);
+
+  AddCSBTreeIndexDescriptions(index_on_columns, index_node_sizes, layout_desc);
+
+  if (use_bloom_filter) {
+    layout_desc->mutable_bloom_filter_description()
+        ->set_sub_block_type(BloomFilterSubBlockDescription::DEFAULT);
+  }
+
+  layout->finalize();
+  return layout.release();
+}
+
+StorageBlockLayout* DataGenerator::generateColumnGroupLayout(
+    const CatalogRelation &relation,
+    const std::size_t num_slots,
+    const std::vector<std::vector<int> > &column_groups,
+    const std::vector<attribute_id> &index_on_columns,
+    const std::vector<std::size_t> &index_node_sizes,
+    const bool use_bloom_filter) const {
+  ScopedPtr<StorageBlockLayout> layout(new StorageBlockLayout(relation));
+  StorageBlockLayoutDescription *layout_desc = layout->getDescriptionMutable();
+
+  layout_desc->set_num_slots(num_slots);
+
+  TupleStorageSubBlockDescription *tuple_store_desc = layout_desc->mutable_tuple_store_description();
+  tuple_store_desc->set_sub_block_type(TupleStorageSubBlockDescription::COLUMN_GROUP_STORE);
+  for (std::vector<std::vector<int> >::const_iterator group_it = column_groups.begin();
+       group_it != column_groups.end();
+       ++group_it) {
+    ColumnGroupTupleStorageSubBlockDescription::ColumnGroup *group_desc
+        = tuple_store_desc->AddExtension(ColumnGroupTupleStorageSubBlockDescription::column_group);
+    for (std::vector<int>::const_iterator column_it = group_it->begin();
+         column_it != group_it->end();
+         ++column_it) {
+      group_desc->add_attribute_id(*column_it);
+    }
+  }
+
+  AddCSBTreeIndexDescriptions(index_on_columns, index_node_sizes, layout_desc);
+
+  if (use_bloom_filter) {
+    layout_desc->mutable_bloom_filter_description()
+        ->set_sub_block_type(BloomFilterSubBlockDescription::DEFAULT);
+  }
+
+  layout->finalize();
+  return layout.release();
+}
+
 StorageBlockLayout* DataGenerator::generateCompressedColumnstoreLayout(
     const CatalogRelation &relation,
     const std::size_t num_slots,
     const attribute_id column_store_sort_column,
-    const std::vector<attribute_id> &index_on_columns) const {
+    const std::vector<attribute_id> &index_on_columns,
+    const std::vector<std::size_t> &index_node_sizes) const {
   ScopedPtr<StorageBlockLayout> layout(new StorageBlockLayout(relation));
   StorageBlockLayoutDescription *layout_desc = layout->getDescriptionMutable();
 
@@ -228,13 +344,7 @@ StorageBlockLayout* DataGenerator::generateCompressedColumnstoreLayout(
         attr_it->getID());
   }
 
-  for (vector<attribute_id>::const_iterator it = index_on_columns.begin();
-       it != index_on_columns.end();
-       ++it) {
-    IndexSubBlockDescription *index_desc = layout_desc->add_index_description();
-    index_desc->set_sub_block_type(IndexSubBlockDescription::CSB_TREE);
-    index_desc->AddExtension(CSBTreeIndexSubBlockDescription::indexed_attribute_id, *it);
-  }
+  AddCSBTreeIndexDescriptions(index_on_columns, index_node_sizes, layout_desc);
 
   layout->finalize();
   return layout.release();
@@ -243,7 +353,8 @@ StorageBlockLayout* DataGenerator::generateCompressedColumnstoreLayout(
 StorageBlockLayout* DataGenerator::generateCompressedRowstoreLayout(
     const CatalogRelation &relation,
     const std::size_t num_slots,
-    const std::vector<attribute_id> &index_on_columns) const {
+    const std::vector<attribute_id> &index_on_columns,
+    const std::vector<std::size_t> &index_node_sizes) const {
   ScopedPtr<StorageBlockLayout> layout(new StorageBlockLayout(relation));
   StorageBlockLayoutDescription *layout_desc = layout->getDescriptionMutable();
 
@@ -261,13 +372,7 @@ StorageBlockLayout* DataGenerator::generateCompressedRowstoreLayout(
         attr_it->getID());
   }
 
-  for (vector<attribute_id>::const_iterator it = index_on_columns.begin();
-       it != index_on_columns.end();
-       ++it) {
-    IndexSubBlockDescription *index_desc = layout_desc->add_index_description();
-    index_desc->set_sub_block_type(IndexSubBlockDescription::CSB_TREE);
-    index_desc->AddExtension(CSBTreeIndexSubBlockDescription::indexed_attribute_id, *it);
-  }
+  AddCSBTreeIndexDescriptions(index_on_columns, index_node_sizes, layout_desc);
 
   layout->finalize();
   return layout.release();
@@ -277,6 +382,17 @@ void DataGenerator::AppendValueToTuple(Tuple* tuple, TypeInstance* value) {
   tuple->append(value);
 }
 
+void DataGenerator::generateValuesInRow(const CatalogRelation &relation, char *row) const {
+  Tuple tuple(relation);
+  generateValuesInTuple(&tuple);
+
+  CatalogRelation::const_iterator attr_it = relation.begin();
+  for (Tuple::const_iterator value_it = tuple.begin(); value_it != tuple.end(); ++value_it, ++attr_it) {
+    DEBUG_ASSERT(!value_it->isNull());
+    value_it->copyInto(row + relation.getFixedLengthAttributeOffset(attr_it->getID()));
+  }
+}
+
 void DataGenerator::SeedRandom() {
   srand(kRandomSeed);
 }
@@ -350,6 +466,15 @@ void NumericDataGenerator::generateValuesInTuple(Tuple* tuple) const {
   }
 }
 
+void NumericDataGenerator::generateValuesInRow(const CatalogRelation &relation, char *row) const {
+  for (attribute_id current_attr = 0;
+       static_cast<std::vector<int>::size_type>(current_attr) < column_ranges_.size();
+       ++current_attr) {
+    const int value = GenerateRandomInt(column_ranges_[current_attr]);
+    memcpy(row + relation.getFixedLengthAttributeOffset(current_attr), &value, sizeof(value));
+  }
+}
+
 void NumericDataGenerator::generateValuesInTupleForPartition(Tuple* tuple,
                                                              const attribute_id partition_value_column,
                                                              const std::size_t partition_num,
@@ -26,6 +26,7 @@
 #include <vector>
 
 #include "catalog/CatalogTypedefs.hpp"
+#include "storage/StorageBlockInfo.hpp"
 #include "utility/Macros.hpp"
 
 namespace quickstep {
@@ -63,13 +64,18 @@ class DataGenerator {
 
   /**
    * @brief Randomly generate tuples into the specified destination.
+   * @note For a fixed-length table, tuples are generated into a buffer of
+   *       rows and bulk-inserted (see StorageBlock::bulkInsertTuples()),
+   *       rather than being built and inserted one Tuple at a time. The
+   *       generated values are the same either way.
    *
    * @param num_tuples The total number of tuples to generate.
    * @param destination An InsertDestination which will be used to provide
    *        blocks which generated tuples are inserted into.
    * @param defer_rebuild If true, the rebuild() method will not be called on
    *        blocks that tuples are inserted into, leaving blocks in a
-   *        potentially inconsistent state.
+   *        potentially inconsistent state (or leaving it to destination to
+   *        rebuild them, as ParallelRebuildInsertDestination does).
    **/
   void generateData(const std::size_t num_tuples,
                     InsertDestination *destination,
@@ -117,13 +123,17 @@ class DataGenerator {
    * @param column_store_sort_column The ID of the column to sort on.
    * @param index_on_columns A vector of IDs of columns to build
    *        CSBTreeIndexSubBlocks on.
+   * @param index_node_sizes The node size, in bytes, of each index in
+   *        index_on_columns. May be empty to use the default node size for
+   *        all indices.
    * @return An uncompressed column-store layout.
    **/
   StorageBlockLayout* generateColumnstoreLayout(
       const CatalogRelation &relation,
       const std::size_t num_slots,
       const attribute_id column_store_sort_column,
-      const std::vector<attribute_id> &index_on_columns) const;
+      const std::vector<attribute_id> &index_on_columns,
+      const std::vector<std::size_t> &index_node_sizes) const;
 
   /**
    * @brief Generate an uncompressed row-store layout, optionally with indices.
@@ -133,14 +143,65 @@ class DataGenerator {
    * @param num_slots The number of StorageManager slots blocks should take up.
    * @param index_on_columns A vector of IDs of columns to build
    *        CSBTreeIndexSubBlocks on.
+   * @param index_node_sizes The node size, in bytes, of each index in
+   *        index_on_columns. May be empty to use the default node size for
+   *        all indices.
    * @return An uncompressed row-store layout.
    **/
   StorageBlockLayout* generateRowstoreLayout(
       const CatalogRelation &relation,
       const std::size_t num_slots,
       const std::vector<attribute_id> &index_on_columns,
+      const std::vector<std::size_t> &index_node_sizes,
 	  const bool use_bloom_filter) const;
 
+  /**
+   * @brief Generate a PAX layout, optionally with indices.
+   *
+   * @param relation The relation to generate a layout for, previously created
+   *        by generateRelation().
+   * @param num_slots The number of StorageManager slots blocks should take up.
+   * @param minipage_size_bytes The size of each PAX mini-page in bytes.
+   * @param index_on_columns A vector of IDs of columns to build
+   *        CSBTreeIndexSubBlocks on.
+   * @param index_node_sizes The node size, in bytes, of each index in
+   *        index_on_columns. May be empty to use the default node size for
+   *        all indices.
+   * @param use_bloom_filter Whether to add a BloomFilterSubBlock.
+   * @return A PAX layout.
+   **/
+  StorageBlockLayout* generatePaxLayout(
+      const CatalogRelation &relation,
+      const std::size_t num_slots,
+      const std::size_t minipage_size_bytes,
+      const std::vector<attribute_id> &index_on_columns,
+      const std::vector<std::size_t> &index_node_sizes,
+      const bool use_bloom_filter) const;
+
+  /**
+   * @brief Generate a column-group layout, optionally with indices.
+   *
+   * @param relation The relation to generate a layout for, previously created
+   *        by generateRelation().
+   * @param num_slots The number of StorageManager slots blocks should take up.
+   * @param column_groups The IDs of the columns in each column group. Columns
+   *        not in any group are each stored in a group by themselves.
+   * @param index_on_columns A vector of IDs of columns to build
+   *        CSBTreeIndexSubBlocks on.
+   * @param index_node_sizes The node size, in bytes, of each index in
+   *        index_on_columns. May be empty to use the default node size for
+   *        all indices.
+   * @param use_bloom_filter Whether to add a BloomFilterSubBlock.
+   * @return A column-group layout.
+   **/
+  StorageBlockLayout* generateColumnGroupLayout(
+      const CatalogRelation &relation,
+      const std::size_t num_slots,
+      const std::vector<std::vector<int> > &column_groups,
+      const std::vector<attribute_id> &index_on_columns,
+      const std::vector<std::size_t> &index_node_sizes,
+      const bool use_bloom_filter) const;
+
   /**
    * @brief Generate a compressed column-store layout, optionally with indices.
    *
@@ -150,13 +211,17 @@ class DataGenerator {
    * @param column_store_sort_column The ID of the column to sort on.
    * @param index_on_columns A vector of IDs of columns to build
    *        CSBTreeIndexSubBlocks on.
+   * @param index_node_sizes The node size, in bytes, of each index in
+   *        index_on_columns. May be empty to use the default node size for
+   *        all indices.
    * @return A compressed column-store layout.
    **/
   StorageBlockLayout* generateCompressedColumnstoreLayout(
       const CatalogRelation &relation,
       const std::size_t num_slots,
       const attribute_id column_store_sort_column,
-      const std::vector<attribute_id> &index_on_columns) const;
+      const std::vector<attribute_id> &index_on_columns,
+      const std::vector<std::size_t> &index_node_sizes) const;
 
   /**
    * @brief Generate a compressed row-store layout, optionally with indices.
@@ -166,12 +231,16 @@ class DataGenerator {
    * @param num_slots The number of StorageManager slots blocks should take up.
    * @param index_on_columns A vector of IDs of columns to build
    *        CSBTreeIndexSubBlocks on.
+   * @param index_node_sizes The node size, in bytes, of each index in
+   *        index_on_columns. May be empty to use the default node size for
+   *        all indices.
    * @return A compressed row-store layout.
    **/
   StorageBlockLayout* generateCompressedRowstoreLayout(
       const CatalogRelation &relation,
       const std::size_t num_slots,
-      const std::vector<attribute_id> &index_on_columns) const;
+      const std::vector<attribute_id> &index_on_columns,
+      const std::vector<std::size_t> &index_node_sizes) const;
 
   /**
    * @brief Generate a predicate which selects on the data generated by this
@@ -190,6 +259,11 @@ class DataGenerator {
  protected:
   static void AppendValueToTuple(Tuple* tuple, TypeInstance* value);
   virtual void generateValuesInTuple(Tuple* tuple) const = 0;
+  // Generate the same values as generateValuesInTuple() into 'row', in the
+  // fixed-length row format of 'relation' (which must not be
+  // variable-length). The default implementation builds a Tuple and copies
+  // its values.
+  virtual void generateValuesInRow(const CatalogRelation &relation, char *row) const;
   virtual void generateValuesInTupleForPartition(Tuple* tuple,
                                                  const attribute_id partition_value_column,
                                                  const std::size_t partition_num,
@@ -202,6 +276,10 @@ class DataGenerator {
   // We always use the same RNG seed so experiments are exactly repeatable.
   static const unsigned int kRandomSeed = 42;
 
+  // The number of rows generateData() generates at a time for a fixed-length
+  // table before bulk-inserting them.
+  static const tuple_id kRowsPerGeneratedBatch = 4096;
+
   DISALLOW_COPY_AND_ASSIGN(DataGenerator);
 };
 
@@ -223,6 +301,7 @@ class NumericDataGenerator : public DataGenerator {
 
  protected:
   void generateValuesInTuple(Tuple* tuple) const;
+  void generateValuesInRow(const CatalogRelation &relation, char *row) const;
   void generateValuesInTupleForPartition(Tuple* tuple,
                                          const attribute_id partition_value_column,
                                          const std::size_t partition_num,
@@ -20,6 +20,7 @@
 
 #include "experiments/storage_explorer/ExperimentConfiguration.hpp"
 
+#include <algorithm>
 #include <cmath>
 #include <cstddef>
 #include <cstring>
@@ -27,10 +28,12 @@
 #include <vector>
 
 #include "experiments/storage_explorer/StorageExplorerConfig.h"
+#include "storage/StorageConstants.hpp"
 #include "utility/Macros.hpp"
 
 #include "third_party/cJSON/cJSON.h"
 
+using std::find;
 using std::floor;
 using std::ostream;
 using std::size_t;
@@ -103,8 +106,71 @@ ExperimentConfiguration* ExperimentConfiguration::LoadFromJSON(cJSON *json) {
   if (json_layout_type->type != cJSON_String) {
     FATAL_ERROR("\"layout_type\" is not a string in experiment configuration.");
   }
+  configuration->use_pax_store_ = false;
+  configuration->use_column_group_store_ = false;
   if (strcmp("rowstore", json_layout_type->valuestring) == 0) {
     configuration->use_column_store_ = false;
+  } else if (strcmp("pax", json_layout_type->valuestring) == 0) {
+    configuration->use_column_store_ = false;
+    configuration->use_pax_store_ = true;
+    cJSON *json_minipage_size = cJSON_GetObjectItem(json, "minipage_size_bytes");
+    if (json_minipage_size == NULL) {
+      configuration->pax_minipage_size_bytes_ = kPaxMinipageSizeBytes;
+    } else {
+      if (json_minipage_size->type != cJSON_Number) {
+        FATAL_ERROR("\"minipage_size_bytes\" is not a number in experiment configuration.");
+      }
+      if (json_minipage_size->valuedouble < 1.0) {
+        FATAL_ERROR("\"minipage_size_bytes\" is not positive in experiment configuration.");
+      }
+      if (json_minipage_size->valuedouble != floor(json_minipage_size->valuedouble)) {
+        FATAL_ERROR("\"minipage_size_bytes\" is not an integer (it has a fractional part) "
+                    "in experiment configuration.");
+      }
+      configuration->pax_minipage_size_bytes_ = static_cast<size_t>(json_minipage_size->valuedouble);
+    }
+  } else if (strcmp("columngroups", json_layout_type->valuestring) == 0) {
+    configuration->use_column_store_ = false;
+    configuration->use_column_group_store_ = true;
+    cJSON *json_column_groups = cJSON_GetObjectItem(json, "column_groups");
+    if (json_column_groups == NULL) {
+      FATAL_ERROR("experiment configuration specifies \"layout_type\" of "
+                  "\"columngroups\" but no \"column_groups\".");
+    }
+    if (json_column_groups->type != cJSON_Array) {
+      FATAL_ERROR("\"column_groups\" is not an array in experiment configuration.");
+    }
+    const int max_column = (configuration->table_choice_ == kWideE) ? 49 : 9;
+    vector<bool> column_in_group(max_column + 1, false);
+    int num_column_groups = cJSON_GetArraySize(json_column_groups);
+    for (int group_idx = 0; group_idx < num_column_groups; ++group_idx) {
+      cJSON *json_column_group = cJSON_GetArrayItem(json_column_groups, group_idx);
+      if ((json_column_group->type != cJSON_Array) || (cJSON_GetArraySize(json_column_group) == 0)) {
+        FATAL_ERROR("\"column_groups\" array in experiment configuration contains something "
+                    "other than a nonempty array.");
+      }
+      configuration->column_groups_.push_back(vector<int>());
+      int group_size = cJSON_GetArraySize(json_column_group);
+      for (int column_idx = 0; column_idx < group_size; ++column_idx) {
+        cJSON *json_column = cJSON_GetArrayItem(json_column_group, column_idx);
+        if (json_column->type != cJSON_Number) {
+          FATAL_ERROR("\"column_groups\" in experiment configuration contains a non-number.");
+        }
+        if ((json_column->valuedouble < 0.0)
+            || (json_column->valuedouble > max_column)
+            || (json_column->valuedouble != floor(json_column->valuedouble))) {
+          FATAL_ERROR("\"column_groups\" in experiment configuration contains something other "
+                      "than a column ID for the specified table.");
+        }
+        const int column = static_cast<int>(json_column->valuedouble);
+        if (column_in_group[column]) {
+          FATAL_ERROR("\"column_groups\" in experiment configuration contains column "
+                      << column << " more than once.");
+        }
+        column_in_group[column] = true;
+        configuration->column_groups_.back().push_back(column);
+      }
+    }
   } else if (strcmp("columnstore", json_layout_type->valuestring) == 0) {
     configuration->use_column_store_ = true;
     cJSON *json_sort_column = cJSON_GetObjectItem(json, "sort_column");
@@ -132,7 +198,8 @@ ExperimentConfiguration* ExperimentConfiguration::LoadFromJSON(cJSON *json) {
                   "range 0-9 for the specified table.");
     }
   } else {
-    FATAL_ERROR("\"layout_type\" is not one of [\"rowstore\", \"columnstore\"] in experiment configuration.");
+    FATAL_ERROR("\"layout_type\" is not one of [\"rowstore\", \"columnstore\", \"pax\", "
+                "\"columngroups\"] in experiment configuration.");
   }
 
   cJSON *json_use_compression = cJSON_GetObjectItem(json, "use_compression");
@@ -148,6 +215,25 @@ ExperimentConfiguration* ExperimentConfiguration::LoadFromJSON(cJSON *json) {
   } else {
     configuration->use_compression_ = false;
   }
+  if (configuration->use_pax_store_ && configuration->use_compression_) {
+    FATAL_ERROR("\"use_compression\" is not supported with a \"layout_type\" of \"pax\" "
+                "in experiment configuration.");
+  }
+  if (configuration->use_column_group_store_ && configuration->use_compression_) {
+    FATAL_ERROR("\"use_compression\" is not supported with a \"layout_type\" of "
+                "\"columngroups\" in experiment configuration.");
+  }
+
+  cJSON *json_use_shared_dictionaries = cJSON_GetObjectItem(json, "use_shared_dictionaries");
+  if (json_use_shared_dictionaries == NULL) {
+    configuration->use_shared_dictionaries_ = false;
+  } else {
+    if ((json_use_shared_dictionaries->type != cJSON_False)
+        && (json_use_shared_dictionaries->type != cJSON_True)) {
+      FATAL_ERROR("\"use_shared_dictionaries\" is not a boolean in experiment configuration.");
+    }
+    configuration->use_shared_dictionaries_ = (json_use_shared_dictionaries->type == cJSON_True);
+  }
 
   cJSON *json_use_bloom_filter = cJSON_GetObjectItem(json, "use_bloom_filter");
   if (json_use_bloom_filter == NULL) {	// enable bloom filters by default
@@ -188,6 +274,21 @@ ExperimentConfiguration* ExperimentConfiguration::LoadFromJSON(cJSON *json) {
       FATAL_ERROR("\"index_column\" in experiment configuration must be in the "
                   "range 0-9 for the specified table.");
     }
+
+    cJSON *json_index_node_size = cJSON_GetObjectItem(json, "index_node_size_bytes");
+    if (json_index_node_size == NULL) {
+      configuration->index_node_sizes_.push_back(kCSBTreeNodeSizeBytes);
+    } else if (json_index_node_size->type == cJSON_Array) {
+      int num_node_sizes = cJSON_GetArraySize(json_index_node_size);
+      if (num_node_sizes == 0) {
+        FATAL_ERROR("\"index_node_size_bytes\" is an empty array in experiment configuration.");
+      }
+      for (int node_size_idx = 0; node_size_idx < num_node_sizes; ++node_size_idx) {
+        configuration->loadIndexNodeSizeFromJSON(cJSON_GetArrayItem(json_index_node_size, node_size_idx));
+      }
+    } else {
+      configuration->loadIndexNodeSizeFromJSON(json_index_node_size);
+    }
   }
 
   cJSON *json_num_runs = cJSON_GetObjectItem(json, "num_runs");
@@ -315,16 +416,49 @@ void ExperimentConfiguration::logConfiguration(std::ostream *output) const {
   *output << "    Tuple Storage: ";
   if (use_column_store_) {
     *output << "Column Store (Sort Column: " << column_store_sort_column_ << ")\n";
+  } else if (use_pax_store_) {
+    *output << "PAX Store (Mini-Page Size: " << pax_minipage_size_bytes_ << " bytes)\n";
+  } else if (use_column_group_store_) {
+    *output << "Column-Group Store (Groups:";
+    for (vector<vector<int> >::const_iterator group_it = column_groups_.begin();
+         group_it != column_groups_.end();
+         ++group_it) {
+      *output << " [";
+      for (vector<int>::const_iterator column_it = group_it->begin();
+           column_it != group_it->end();
+           ++column_it) {
+        if (column_it != group_it->begin()) {
+          *output << ", ";
+        }
+        *output << *column_it;
+      }
+      *output << "]";
+    }
+    *output << ")\n";
   } else {
     *output << "Row Store\n";
   }
   if (use_index_) {
-    *output << "    CSBTree Index On Column: " << index_column_ << "\n";
+    *output << "    CSBTree Index On Column: " << index_column_;
+    *output << " (Node Size: ";
+    for (vector<size_t>::const_iterator it = index_node_sizes_.begin();
+         it != index_node_sizes_.end();
+         ++it) {
+      if (it != index_node_sizes_.begin()) {
+        *output << ", ";
+      }
+      *output << *it;
+    }
+    *output << " bytes)\n";
   } else {
     *output << "    No Index\n";
   }
   if (use_compression_) {
-    *output << "    Compression Enabled\n";
+    *output << "    Compression Enabled";
+    if (use_shared_dictionaries_) {
+      *output << " (Shared Dictionaries)";
+    }
+    *output << "\n";
   } else {
     *output << "    Compression Not Enabled\n";
   }
@@ -406,6 +540,27 @@ void ExperimentConfiguration::loadTestParametersFromJSON(cJSON *test_params_json
     params.use_index = false;
   }
 
+  params.index_num = 0;
+  cJSON *json_index_node_size = cJSON_GetObjectItem(test_params_json, "index_node_size_bytes");
+  if (json_index_node_size != NULL) {
+    if (!params.use_index) {
+      FATAL_ERROR("A test in experiment configuration specified \"index_node_size_bytes\" "
+                  "but \"use_index\" is false.");
+    }
+    if (json_index_node_size->type != cJSON_Number) {
+      FATAL_ERROR("\"index_node_size_bytes\" is not a number in a test in experiment configuration.");
+    }
+    vector<size_t>::const_iterator node_size_it = find(index_node_sizes_.begin(),
+                                                       index_node_sizes_.end(),
+                                                       static_cast<size_t>(json_index_node_size->valuedouble));
+    if ((json_index_node_size->valuedouble != floor(json_index_node_size->valuedouble))
+        || (node_size_it == index_node_sizes_.end())) {
+      FATAL_ERROR("\"index_node_size_bytes\" in a test in experiment configuration "
+                  "is not one of the node sizes specified for the index.");
+    }
+    params.index_num = node_size_it - index_node_sizes_.begin();
+  }
+
   cJSON *json_sort_matches = cJSON_GetObjectItem(test_params_json, "sort_matches_before_projection");
   if (json_sort_matches == NULL) {
     FATAL_ERROR("A test in experiment configuration did not specify \"sort_matches_before_projection\"");
@@ -458,6 +613,30 @@ void ExperimentConfiguration::loadTestParametersFromJSON(cJSON *test_params_json
   test_params_.push_back(params);
 }
 
+void ExperimentConfiguration::loadIndexNodeSizeFromJSON(cJSON *json_node_size) {
+  if (json_node_size->type != cJSON_Number) {
+    FATAL_ERROR("\"index_node_size_bytes\" is not a number (or array of numbers) "
+                "in experiment configuration.");
+  }
+  if (json_node_size->valuedouble != floor(json_node_size->valuedouble)) {
+    FATAL_ERROR("\"index_node_size_bytes\" is not an integer (it has a fractional part) "
+                "in experiment configuration.");
+  }
+  if ((json_node_size->valuedouble < kCSBTreeMinNodeSizeBytes)
+      || (json_node_size->valuedouble > kCSBTreeMaxNodeSizeBytes)) {
+    FATAL_ERROR("\"index_node_size_bytes\" in experiment configuration must be "
+                "in the range " << kCSBTreeMinNodeSizeBytes << "-" << kCSBTreeMaxNodeSizeBytes << ".");
+  }
+  const size_t node_size = static_cast<size_t>(json_node_size->valuedouble);
+  if (node_size & (node_size - 1)) {
+    FATAL_ERROR("\"index_node_size_bytes\" in experiment configuration is not a power of two.");
+  }
+  if (find(index_node_sizes_.begin(), index_node_sizes_.end(), node_size) != index_node_sizes_.end()) {
+    FATAL_ERROR("\"index_node_size_bytes\" in experiment configuration contains a duplicate.");
+  }
+  index_node_sizes_.push_back(node_size);
+}
+
 void BlockBasedExperimentConfiguration::loadAdditionalConfigurationFromJSON(cJSON *json) {
   cJSON *json_block_size = cJSON_GetObjectItem(json, "block_size_mb");
   if (json_block_size == NULL) {
@@ -62,6 +62,9 @@ class ExperimentConfiguration {
     bool sort_matches;
     double selectivity;
     std::size_t projection_width;
+    // The position in index_node_sizes_ of the index to use if use_index is
+    // true.
+    int index_num;
   };
 
   virtual ~ExperimentConfiguration() {
@@ -114,9 +117,23 @@ class ExperimentConfiguration {
 
   bool use_column_store_;
   int column_store_sort_column_;
+  // If true (use_column_store_ is then false), tuples are stored in PAX
+  // mini-pages of pax_minipage_size_bytes_ instead of a row store.
+  bool use_pax_store_;
+  std::size_t pax_minipage_size_bytes_;
+  // If true (use_column_store_ is then false), tuples are stored in a
+  // column-group store with the attributes in each of column_groups_ stored
+  // together.
+  bool use_column_group_store_;
+  std::vector<std::vector<int> > column_groups_;
   bool use_compression_;
+  // If true (and use_compression_ is true), compressed attributes are coded
+  // with relation-wide shared dictionaries instead of per-block ones.
+  bool use_shared_dictionaries_;
   bool use_index_;
   int index_column_;
+  // One index is built on index_column_ for each node size.
+  std::vector<std::size_t> index_node_sizes_;
   bool use_bloom_filter_;
 
   std::size_t num_runs_;
@@ -129,6 +146,8 @@ class ExperimentConfiguration {
  private:
   void loadTestParametersFromJSON(cJSON *test_params_json);
 
+  void loadIndexNodeSizeFromJSON(cJSON *json_node_size);
+
   friend class ExperimentDriver;
   friend class BlockBasedExperimentDriver;
   friend class FileBasedExperimentDriver;
@@ -26,17 +26,22 @@
 
 #include "catalog/Catalog.hpp"
 #include "catalog/CatalogDatabase.hpp"
+#include "catalog/CatalogRelation.hpp"
 #include "catalog/CatalogTypedefs.hpp"
 #include "experiments/storage_explorer/DataGenerator.hpp"
 #include "experiments/storage_explorer/ExperimentConfiguration.hpp"
 #include "experiments/storage_explorer/TestRunner.hpp"
 #include "experiments/storage_explorer/Timer.hpp"
 #include "storage/BasicColumnStoreTupleStorageSubBlock.hpp"
+#include "storage/ColumnGroupTupleStorageSubBlock.hpp"
 #include "storage/CSBTreeIndexSubBlock.hpp"
 #include "storage/CompressedColumnStoreTupleStorageSubBlock.hpp"
 #include "storage/CompressedPackedRowStoreTupleStorageSubBlock.hpp"
 #include "storage/InsertDestination.hpp"
+#include "storage/LayoutAdvisor.hpp"
 #include "storage/PackedRowStoreTupleStorageSubBlock.hpp"
+#include "storage/PaxTupleStorageSubBlock.hpp"
+#include "storage/StorageBlock.hpp"
 #include "storage/StorageBlockLayout.hpp"
 #include "storage/StorageBlockLayout.pb.h"
 #include "storage/StorageConstants.hpp"
@@ -82,6 +87,14 @@ void ExperimentDriver::initialize() {
 
   relation_ = data_generator_->generateRelation();
   database_->addRelation(relation_);
+
+  if (configuration_.use_compression_ && configuration_.use_shared_dictionaries_) {
+    for (CatalogRelation::const_iterator attr_it = relation_->begin();
+         attr_it != relation_->end();
+         ++attr_it) {
+      relation_->createSharedCompressionDictionary(attr_it->getID());
+    }
+  }
 }
 
 void ExperimentDriver::logTestParameters(
@@ -90,7 +103,7 @@ void ExperimentDriver::logTestParameters(
   cout << "Predicate: " << params.selectivity << " selectivity on column " << params.predicate_column << "\n";
   cout << "Projection Width: " << params.projection_width << " columns\n";
   if (params.use_index) {
-    cout << "Using Index";
+    cout << "Using Index (Node Size: " << configuration_.index_node_sizes_[params.index_num] << " bytes)";
     if (params.sort_matches) {
       cout << " (Sorting Results Before Projection)";
     }
@@ -122,10 +135,52 @@ void ExperimentDriver::logTestResults(const TestRunner &runner) const {
   cout.flush();
 }
 
+void ExperimentDriver::logLayoutRecommendation(const LayoutAdvisor &advisor) const {
+  ScopedPtr<StorageBlockLayout> layout(advisor.recommendLayout());
+  const TupleStorageSubBlockDescription &tuple_store_description
+      = layout->getDescription().tuple_store_description();
+
+  cout << "===== RECOMMENDED LAYOUT =====\n";
+  cout << "Tuple Store: ";
+  switch (tuple_store_description.sub_block_type()) {
+    case TupleStorageSubBlockDescription::PACKED_ROW_STORE:
+      cout << "Packed Row Store";
+      break;
+    case TupleStorageSubBlockDescription::BASIC_COLUMN_STORE:
+      cout << "Column Store (Sorted On Column "
+           << tuple_store_description.GetExtension(
+                  BasicColumnStoreTupleStorageSubBlockDescription::sort_attribute_id)
+           << ")";
+      break;
+    case TupleStorageSubBlockDescription::COMPRESSED_PACKED_ROW_STORE:
+      cout << "Compressed Packed Row Store";
+      break;
+    case TupleStorageSubBlockDescription::COMPRESSED_COLUMN_STORE:
+      cout << "Compressed Column Store (Sorted On Column "
+           << tuple_store_description.GetExtension(
+                  CompressedColumnStoreTupleStorageSubBlockDescription::sort_attribute_id)
+           << ")";
+      break;
+    default:
+      cout << "Other (Type " << tuple_store_description.sub_block_type() << ")";
+      break;
+  }
+  cout << "\n";
+
+  for (int index_num = 0; index_num < layout->getDescription().index_description_size(); ++index_num) {
+    cout << "CSBTree Index On Column "
+         << layout->getDescription().index_description(index_num).GetExtension(
+                CSBTreeIndexSubBlockDescription::indexed_attribute_id, 0)
+         << "\n";
+  }
+  cout << "\n";
+  cout.flush();
+}
+
 void BlockBasedExperimentDriver::generateData() {
   vector<attribute_id> index_columns;
   if (configuration_.use_index_) {
-    index_columns.push_back(configuration_.index_column_);
+    index_columns.resize(configuration_.index_node_sizes_.size(), configuration_.index_column_);
   }
 
   ScopedPtr<StorageBlockLayout> layout;
@@ -135,35 +190,66 @@ void BlockBasedExperimentDriver::generateData() {
           *relation_,
           static_cast<const BlockBasedExperimentConfiguration&>(configuration_).block_size_slots_,
           configuration_.column_store_sort_column_,
-          index_columns));
+          index_columns,
+          configuration_.index_node_sizes_));
     } else {
       layout.reset(data_generator_->generateColumnstoreLayout(
           *relation_,
           static_cast<const BlockBasedExperimentConfiguration&>(configuration_).block_size_slots_,
           configuration_.column_store_sort_column_,
-          index_columns));
+          index_columns,
+          configuration_.index_node_sizes_));
     }
   } else {
     if (configuration_.use_compression_) {
       layout.reset(data_generator_->generateCompressedRowstoreLayout(
           *relation_,
           static_cast<const BlockBasedExperimentConfiguration&>(configuration_).block_size_slots_,
-          index_columns));
+          index_columns,
+          configuration_.index_node_sizes_));
+    } else if (configuration_.use_pax_store_) {
+      layout.reset(data_generator_->generatePaxLayout(
+          *relation_,
+          static_cast<const BlockBasedExperimentConfiguration&>(configuration_).block_size_slots_,
+          configuration_.pax_minipage_size_bytes_,
+          index_columns,
+          configuration_.index_node_sizes_,
+          configuration_.use_bloom_filter_));
+    } else if (configuration_.use_column_group_store_) {
+      layout.reset(data_generator_->generateColumnGroupLayout(
+          *relation_,
+          static_cast<const BlockBasedExperimentConfiguration&>(configuration_).block_size_slots_,
+          configuration_.column_groups_,
+          index_columns,
+          configuration_.index_node_sizes_,
+          configuration_.use_bloom_filter_));
     } else {
       layout.reset(data_generator_->generateRowstoreLayout(
           *relation_,
           static_cast<const BlockBasedExperimentConfiguration&>(configuration_).block_size_slots_,
           index_columns,
+          configuration_.index_node_sizes_,
 		  configuration_.use_bloom_filter_));
     }
   }
 
   cout << "Generating and organizing data in-memory... ";
   cout.flush();
-  AlwaysCreateBlockInsertDestination destination(&storage_manager_, relation_, layout.get());
   Timer gen_timer(false);
   gen_timer.start();
-  data_generator_->generateData(configuration_.num_tuples_, &destination);
+  if (configuration_.use_compression_ && (configuration_.num_threads_ > 1)) {
+    // Compressed blocks are built entirely by rebuild(), so build several of
+    // them at once while the next block is being filled.
+    ParallelRebuildInsertDestination destination(&storage_manager_,
+                                                 relation_,
+                                                 layout.get(),
+                                                 configuration_.num_threads_);
+    data_generator_->generateData(configuration_.num_tuples_, &destination, true);
+    destination.waitForRebuilds();
+  } else {
+    AlwaysCreateBlockInsertDestination destination(&storage_manager_, relation_, layout.get());
+    data_generator_->generateData(configuration_.num_tuples_, &destination);
+  }
   gen_timer.stop();
   cout << "Done (" << gen_timer.getElapsed() << " s)\n";
 
@@ -178,11 +264,47 @@ void BlockBasedExperimentDriver::generateData() {
   } else {
     cout << "Total data size: " << (block_memory_size / (1024.0 * 1024.0)) << " megabytes\n";
   }
+
+  if (configuration_.use_compression_ && configuration_.use_shared_dictionaries_) {
+    // Shared dictionaries are stored outside of blocks.
+    size_t shared_dictionary_size = 0;
+    for (CatalogRelation::const_iterator attr_it = relation_->begin();
+         attr_it != relation_->end();
+         ++attr_it) {
+      shared_dictionary_size += relation_->getSharedCompressionDictionary(attr_it->getID())->getTotalSizeBytes();
+    }
+    if (shared_dictionary_size < 1024) {
+      cout << "Shared dictionary size: " << shared_dictionary_size << " bytes\n";
+    } else if (shared_dictionary_size < 1024 * 1024) {
+      cout << "Shared dictionary size: " << (shared_dictionary_size / 1024.0) << " kilobytes\n";
+    } else {
+      cout << "Shared dictionary size: " << (shared_dictionary_size / (1024.0 * 1024.0)) << " megabytes\n";
+    }
+  }
+
+  if (configuration_.use_column_store_ && configuration_.use_compression_) {
+    // Report how much space run-length encoding the sort column saved.
+    size_t run_length_savings = 0;
+    for (CatalogRelation::const_iterator_blocks block_it = relation_->begin_blocks();
+         block_it != relation_->end_blocks();
+         ++block_it) {
+      run_length_savings += static_cast<const CompressedColumnStoreTupleStorageSubBlock&>(
+          storage_manager_.getBlock(*block_it).getTupleStorageSubBlock()).getSortColumnRunLengthSavingsBytes();
+    }
+    if (run_length_savings < 1024) {
+      cout << "Run-length encoding saved: " << run_length_savings << " bytes\n";
+    } else if (run_length_savings < 1024 * 1024) {
+      cout << "Run-length encoding saved: " << (run_length_savings / 1024.0) << " kilobytes\n";
+    } else {
+      cout << "Run-length encoding saved: " << (run_length_savings / (1024.0 * 1024.0)) << " megabytes\n";
+    }
+  }
   cout.flush();
 }
 
 void BlockBasedExperimentDriver::runExperiments() {
   ScopedPtr<TestRunner> runner;
+  LayoutAdvisor advisor(*relation_);
 
   for (vector<ExperimentConfiguration::TestParameters>::const_iterator
            test_it = configuration_.test_params_.begin();
@@ -192,7 +314,7 @@ void BlockBasedExperimentDriver::runExperiments() {
 
     int index_param = -1;
     if (test_it->use_index) {
-      index_param = 0;
+      index_param = test_it->index_num;
     }
 
     if (test_it->projection_width == 0) {
@@ -223,7 +345,13 @@ void BlockBasedExperimentDriver::runExperiments() {
 
     runner->doRuns(configuration_.num_runs_, configuration_.measure_cache_misses_);
     logTestResults(*runner);
+
+    advisor.recordSelection(vector<attribute_id>(1, test_it->predicate_column),
+                            test_it->selectivity,
+                            test_it->projection_width);
   }
+
+  logLayoutRecommendation(advisor);
 }
 
 void FileBasedExperimentDriver::generateData() {
@@ -299,17 +427,44 @@ void FileBasedExperimentDriver::generateData() {
             CompressedPackedRowStoreTupleStorageSubBlockDescription::compressed_attribute_id,
             compressed_column_id);
       }
+    } else if (configuration_.use_pax_store_) {
+      tuple_store_description.set_sub_block_type(
+          TupleStorageSubBlockDescription::PAX_STORE);
+      tuple_store_description.SetExtension(
+          PaxTupleStorageSubBlockDescription::minipage_size_bytes,
+          configuration_.pax_minipage_size_bytes_);
+    } else if (configuration_.use_column_group_store_) {
+      tuple_store_description.set_sub_block_type(
+          TupleStorageSubBlockDescription::COLUMN_GROUP_STORE);
+      for (vector<vector<int> >::const_iterator group_it = configuration_.column_groups_.begin();
+           group_it != configuration_.column_groups_.end();
+           ++group_it) {
+        ColumnGroupTupleStorageSubBlockDescription::ColumnGroup *group_description
+            = tuple_store_description.AddExtension(ColumnGroupTupleStorageSubBlockDescription::column_group);
+        for (vector<int>::const_iterator column_it = group_it->begin();
+             column_it != group_it->end();
+             ++column_it) {
+          group_description->add_attribute_id(*column_it);
+        }
+      }
     } else {
       tuple_store_description.set_sub_block_type(
           TupleStorageSubBlockDescription::PACKED_ROW_STORE);
     }
   }
 
-  IndexSubBlockDescription index_description;
+  // One index is built on each partition for each node size.
   if (configuration_.use_index_) {
-    index_description.set_sub_block_type(IndexSubBlockDescription::CSB_TREE);
-    index_description.AddExtension(CSBTreeIndexSubBlockDescription::indexed_attribute_id,
-                                   configuration_.index_column_);
+    for (vector<size_t>::const_iterator node_size_it = configuration_.index_node_sizes_.begin();
+         node_size_it != configuration_.index_node_sizes_.end();
+         ++node_size_it) {
+      index_descriptions_.push_back(new IndexSubBlockDescription());
+      index_descriptions_.back().set_sub_block_type(IndexSubBlockDescription::CSB_TREE);
+      index_descriptions_.back().AddExtension(CSBTreeIndexSubBlockDescription::indexed_attribute_id,
+                                             configuration_.index_column_);
+      index_descriptions_.back().SetExtension(CSBTreeIndexSubBlockDescription::node_size_bytes,
+                                             *node_size_it);
+    }
   }
 
   for (size_t partition_num = 0;
@@ -340,6 +495,20 @@ void FileBasedExperimentDriver::generateData() {
             true,
             tuple_store_buffers_.back().get(),
             main_file_size / configuration_.num_threads_));
+      } else if (configuration_.use_pax_store_) {
+        tuple_stores_.push_back(new PaxTupleStorageSubBlock(
+            *relation_,
+            tuple_store_description,
+            true,
+            tuple_store_buffers_.back().get(),
+            main_file_size / configuration_.num_threads_));
+      } else if (configuration_.use_column_group_store_) {
+        tuple_stores_.push_back(new ColumnGroupTupleStorageSubBlock(
+            *relation_,
+            tuple_store_description,
+            true,
+            tuple_store_buffers_.back().get(),
+            main_file_size / configuration_.num_threads_));
       } else {
         tuple_stores_.push_back(new PackedRowStoreTupleStorageSubBlock(
             *relation_,
@@ -350,10 +519,13 @@ void FileBasedExperimentDriver::generateData() {
       }
     }
 
-    if (configuration_.use_index_) {
+    for (PtrVector<IndexSubBlockDescription>::const_iterator index_description_it
+             = index_descriptions_.begin();
+         index_description_it != index_descriptions_.end();
+         ++index_description_it) {
       index_buffers_.push_back(new ScopedBuffer(index_file_size / configuration_.num_threads_));
       indices_.push_back(new CSBTreeIndexSubBlock(tuple_stores_.back(),
-                                                  index_description,
+                                                  *index_description_it,
                                                   true,
                                                   index_buffers_.back().get(),
                                                   index_file_size / configuration_.num_threads_));
@@ -367,14 +539,19 @@ void FileBasedExperimentDriver::generateData() {
     tuple_store_ptrs_.push_back(&(*tuple_store_it));
   }
 
-  index_ptrs_.resize(1);
   if (configuration_.use_index_) {
+    // indices_ is ordered by partition, then by node size, while index_ptrs_
+    // is indexed by node size, then by partition.
+    index_ptrs_.resize(index_descriptions_.size());
+    size_t index_position = 0;
     for (PtrVector<IndexSubBlock>::iterator index_it = indices_.begin();
          index_it != indices_.end();
          ++index_it) {
-      index_ptrs_[0].push_back(&(*index_it));
+      index_ptrs_[index_position % index_descriptions_.size()].push_back(&(*index_it));
+      ++index_position;
     }
   } else {
+    index_ptrs_.resize(1);
     for (size_t partition_num = 0;
        partition_num < configuration_.num_threads_;
        ++partition_num) {
@@ -432,7 +609,7 @@ void FileBasedExperimentDriver::runExperiments() {
 
     int index_param = -1;
     if (test_it->use_index) {
-      index_param = 0;
+      index_param = test_it->index_num;
     }
 
     if (test_it->projection_width == 0) {
@@ -27,6 +27,7 @@
 #include "experiments/storage_explorer/DataGenerator.hpp"
 #include "experiments/storage_explorer/ExperimentConfiguration.hpp"
 #include "storage/IndexSubBlock.hpp"
+#include "storage/StorageBlockLayout.pb.h"
 #include "storage/StorageManager.hpp"
 #include "storage/TupleStorageSubBlock.hpp"
 #include "utility/Macros.hpp"
@@ -38,6 +39,7 @@ namespace quickstep {
 
 class CatalogDatabase;
 class CatalogRelation;
+class LayoutAdvisor;
 
 namespace storage_explorer {
 
@@ -87,6 +89,7 @@ class ExperimentDriver {
 
   void logTestParameters(const ExperimentConfiguration::TestParameters &params) const;
   void logTestResults(const TestRunner &runner) const;
+  void logLayoutRecommendation(const LayoutAdvisor &advisor) const;
 
   const ExperimentConfiguration &configuration_;
   ScopedPtr<DataGenerator> data_generator_;
@@ -131,6 +134,7 @@ class FileBasedExperimentDriver : public ExperimentDriver {
       : ExperimentDriver(configuration) {
   }
 
+  PtrVector<IndexSubBlockDescription> index_descriptions_;
   PtrVector<ScopedBuffer> tuple_store_buffers_;
   PtrVector<ScopedBuffer> index_buffers_;
   PtrVector<TupleStorageSubBlock> tuple_stores_;
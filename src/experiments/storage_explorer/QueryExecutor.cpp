@@ -40,6 +40,7 @@
 #include "threading/Mutex.hpp"
 #include "threading/Thread.hpp"
 #include "types/Tuple.hpp"
+#include "utility/PtrVector.hpp"
 #include "utility/ScopedPtr.hpp"
 
 using std::random_shuffle;
@@ -68,18 +69,26 @@ class BlockBasedPredicateEvaluationThread : public Thread {
     }
     block_id current_block_id = parent_executor_->getNextInputBlock();
     while (current_block_id >= 0) {
-      if (parent_executor_->use_index_) {
-        const StorageBlock &block = parent_executor_->storage_manager_->getBlock(current_block_id);
-        ScopedPtr<TupleIdSequence> matches(parent_executor_->evaluatePredicateWithIndex(
-            parent_executor_->getIndex(block, parent_executor_->use_index_num_),
-            block.getTupleStorageSubBlock()));
-
-        if (parent_executor_->sort_index_matches_) {
-          matches->sort();
+      const StorageBlock &block = parent_executor_->storage_manager_->getBlock(current_block_id);
+      // Evaluate the predicate in a read section of the block, and start over
+      // if it turns out to be inconsistent.
+      ScopedPtr<TupleIdSequence> matches;
+      for (;;) {
+        const size_t version = block.beginRead();
+        if (parent_executor_->use_index_) {
+          matches.reset(parent_executor_->evaluatePredicateWithIndexes(
+              parent_executor_->getIndexes(block),
+              block.getTupleStorageSubBlock()));
+        } else {
+          matches.reset(parent_executor_->evaluatePredicateOnBlock(block));
+        }
+        if (block.endRead(version)) {
+          break;
         }
-      } else {
-        ScopedPtr<TupleIdSequence> matches(parent_executor_->evaluatePredicateOnBlock(
-                    parent_executor_->storage_manager_->getBlock(current_block_id)));
+      }
+
+      if (parent_executor_->use_index_ && parent_executor_->sort_index_matches_) {
+        matches->sort();
       }
 
       current_block_id = parent_executor_->getNextInputBlock();
@@ -109,21 +118,19 @@ class BlockBasedSelectionThread : public Thread {
     block_id current_block_id = parent_executor_->getNextInputBlock();
     while (current_block_id >= 0) {
       const StorageBlock &block = parent_executor_->storage_manager_->getBlock(current_block_id);
-
-      ScopedPtr<TupleIdSequence> matches;
-      if (parent_executor_->use_index_) {
-        matches.reset(parent_executor_->evaluatePredicateWithIndex(
-            parent_executor_->getIndex(block, parent_executor_->use_index_num_),
-            block.getTupleStorageSubBlock()));
-
-        if (parent_executor_->sort_index_matches_) {
-          matches->sort();
+      // Copy the projected tuples in a read section of the block (starting
+      // over if it turns out to be inconsistent), then insert them into the
+      // result once the section is over, since nothing may be written in it.
+      ScopedPtr<PtrVector<Tuple> > projected_tuples;
+      for (;;) {
+        const size_t version = block.beginRead();
+        projected_tuples.reset(parent_executor_->evaluatePredicateAndProject(block));
+        if (block.endRead(version)) {
+          break;
         }
-      } else {
-        matches.reset(parent_executor_->evaluatePredicateOnBlock(block));
       }
 
-      parent_executor_->doProjection(block, matches.get());
+      parent_executor_->doProjection(*projected_tuples);
       current_block_id = parent_executor_->getNextInputBlock();
     }
   }
@@ -151,8 +158,14 @@ class FileBasedPredicateEvaluationThread : public Thread {
       ThreadAffinity::BindThisThreadToCPU(bound_cpu_id_);
     }
     if (parent_executor_->use_index_) {
-      ScopedPtr<TupleIdSequence> matches(parent_executor_->evaluatePredicateWithIndex(
-          *(parent_executor_->indices_[parent_executor_->use_index_num_][partition_number_]),
+      vector<const IndexSubBlock*> indexes;
+      for (vector<size_t>::const_iterator index_num_it = parent_executor_->use_index_nums_.begin();
+           index_num_it != parent_executor_->use_index_nums_.end();
+           ++index_num_it) {
+        indexes.push_back(parent_executor_->indices_[*index_num_it][partition_number_]);
+      }
+      ScopedPtr<TupleIdSequence> matches(parent_executor_->evaluatePredicateWithIndexes(
+          indexes,
           *(parent_executor_->tuple_stores_[partition_number_])));
       if (parent_executor_->sort_index_matches_) {
         matches->sort();
@@ -189,8 +202,39 @@ class FileBasedSelectionThread : public Thread {
 
     ScopedPtr<TupleIdSequence> matches;
     if (parent_executor_->use_index_) {
-      matches.reset(parent_executor_->evaluatePredicateWithIndex(
-          *(parent_executor_->indices_[parent_executor_->use_index_num_][partition_number_]),
+      vector<const IndexSubBlock*> indexes;
+      for (vector<size_t>::const_iterator index_num_it = parent_executor_->use_index_nums_.begin();
+           index_num_it != parent_executor_->use_index_nums_.end();
+           ++index_num_it) {
+        indexes.push_back(parent_executor_->indices_[*index_num_it][partition_number_]);
+      }
+      // Only a single index can cover the projection by itself.
+      ScopedPtr<PtrVector<Tuple> > projected_tuples;
+      if (indexes.size() == 1) {
+        projected_tuples.reset(parent_executor_->evaluatePredicateAndProjectWithIndex(
+            *indexes.front(),
+            parent_executor_->projection_attributes_));
+      }
+      if (projected_tuples.get() != NULL) {
+        if (projected_tuples->size() > 0) {
+          ScopedBuffer result_buffer(parent_executor_->result_buffer_size_bytes_);
+          ScopedPtr<TupleStorageSubBlock> result_store(createResultStore(result_buffer.get()));
+
+          for (PtrVector<Tuple>::const_iterator it = projected_tuples->begin();
+               it != projected_tuples->end();
+               ++it) {
+            if (!result_store->insertTupleInBatch(*it, kNone)) {
+              FATAL_ERROR("Ran out of space in result buffer.\n");
+            }
+          }
+
+          result_store->rebuild();
+        }
+        return;
+      }
+
+      matches.reset(parent_executor_->evaluatePredicateWithIndexes(
+          indexes,
           *(parent_executor_->tuple_stores_[partition_number_])));
       if (parent_executor_->sort_index_matches_) {
         matches->sort();
@@ -202,13 +246,7 @@ class FileBasedSelectionThread : public Thread {
 
     if (matches->size() > 0) {
       ScopedBuffer result_buffer(parent_executor_->result_buffer_size_bytes_);
-      ScopedPtr<TupleStorageSubBlock> result_store;
-      result_store.reset(new PackedRowStoreTupleStorageSubBlock(
-          *(parent_executor_->result_relation_),
-          parent_executor_->result_store_description_,
-          true,
-          result_buffer.get(),
-          parent_executor_->result_buffer_size_bytes_));
+      ScopedPtr<TupleStorageSubBlock> result_store(createResultStore(result_buffer.get()));
 
       for (TupleIdSequence::const_iterator it = matches->begin(); it != matches->end(); ++it) {
         Tuple matched_tuple(*(parent_executor_->tuple_stores_[partition_number_]),
@@ -225,6 +263,14 @@ class FileBasedSelectionThread : public Thread {
   }
 
  private:
+  TupleStorageSubBlock* createResultStore(void *result_buffer) const {
+    return new PackedRowStoreTupleStorageSubBlock(*(parent_executor_->result_relation_),
+                                                  parent_executor_->result_store_description_,
+                                                  true,
+                                                  result_buffer,
+                                                  parent_executor_->result_buffer_size_bytes_);
+  }
+
   FileBasedSelectionQueryExecutor *parent_executor_;
   const size_t partition_number_;
   const int bound_cpu_id_;
@@ -245,8 +291,8 @@ TupleIdSequence* QueryExecutor::evaluatePredicateOnTupleStore(const TupleStorage
   }
 }
 
-TupleIdSequence* QueryExecutor::evaluatePredicateWithIndex(const IndexSubBlock &index,
-                                                           const TupleStorageSubBlock &tuple_store) const {
+TupleIdSequence* QueryExecutor::evaluatePredicateWithIndexes(const std::vector<const IndexSubBlock*> &indexes,
+                                                             const TupleStorageSubBlock &tuple_store) const {
   switch (predicate_.getPredicateType()) {
     case Predicate::kTrue:
       return tuple_store.getMatchesForPredicate(NULL);
@@ -254,20 +300,34 @@ TupleIdSequence* QueryExecutor::evaluatePredicateWithIndex(const IndexSubBlock &
       return new TupleIdSequence();
     default:
       {
-        IndexSearchResult result = index.getMatchesForPredicate(predicate_);
-        return result.sequence;
+        TupleIdSequence *matches = StorageBlock::GetMatchesForPredicateWithIndexes(tuple_store,
+                                                                                  indexes,
+                                                                                  predicate_);
+        if (matches == NULL) {
+          matches = tuple_store.getMatchesForPredicate(&predicate_);
+        }
+        return matches;
       }
   }
 }
 
-TupleIdSequence* QueryExecutor::evaluatePredicateOnBlock(const StorageBlock &block) const {
+PtrVector<Tuple>* QueryExecutor::evaluatePredicateAndProjectWithIndex(
+    const IndexSubBlock &index,
+    const std::vector<attribute_id> &projection_attributes) const {
+  if (!index.coversAttributes(projection_attributes)) {
+    return NULL;
+  }
+
   switch (predicate_.getPredicateType()) {
     case Predicate::kTrue:
-      return block.getTupleStorageSubBlock().getMatchesForPredicate(NULL);
+      return NULL;
     case Predicate::kFalse:
-      return new TupleIdSequence();
+      return new PtrVector<Tuple>();
     default:
-      return block.getMatchesForPredicate(&predicate_);
+      if (!index.canEvaluatePredicate(predicate_)) {
+        return NULL;
+      }
+      return index.getMatchingValuesForPredicate(predicate_, projection_attributes);
   }
 }
 
@@ -276,6 +336,29 @@ const IndexSubBlock& BlockBasedQueryExecutor::getIndex(const StorageBlock &block
   return block.indices_[index_num];
 }
 
+std::vector<const IndexSubBlock*> BlockBasedQueryExecutor::getIndexes(const StorageBlock &block) const {
+  vector<const IndexSubBlock*> indexes;
+  for (vector<size_t>::const_iterator index_num_it = use_index_nums_.begin();
+       index_num_it != use_index_nums_.end();
+       ++index_num_it) {
+    indexes.push_back(&getIndex(block, *index_num_it));
+  }
+  return indexes;
+}
+
+TupleIdSequence* BlockBasedQueryExecutor::evaluatePredicateOnBlock(const StorageBlock &block) const {
+  // StorageBlock::getMatchesForPredicate() begins a read section of its own,
+  // which must not be nested in the caller's, so use the same helper it does.
+  switch (predicate_.getPredicateType()) {
+    case Predicate::kTrue:
+      return block.getMatchesForPredicateHelper(NULL);
+    case Predicate::kFalse:
+      return new TupleIdSequence();
+    default:
+      return block.getMatchesForPredicateHelper(&predicate_);
+  }
+}
+
 BlockBasedPredicateEvaluationQueryExecutor::BlockBasedPredicateEvaluationQueryExecutor(
     const CatalogRelation &relation,
     const Predicate &predicate,
@@ -288,8 +371,10 @@ BlockBasedPredicateEvaluationQueryExecutor::BlockBasedPredicateEvaluationQueryEx
                               predicate_attribute_id,
                               thread_affinities,
                               num_threads,
-                              storage_manager),
-      next_block_iterator_(relation.begin_blocks()) {
+                              storage_manager) {
+  input_blocks_epoch_ = relation.beginBlocksRead(&input_blocks_);
+  next_block_iterator_ = input_blocks_.begin();
+
   if (thread_affinities_.empty()) {
     for (size_t thread_num = 0; thread_num < num_threads; ++thread_num) {
       threads_.push_back(new query_execution_threads::BlockBasedPredicateEvaluationThread(this));
@@ -305,7 +390,7 @@ BlockBasedPredicateEvaluationQueryExecutor::BlockBasedPredicateEvaluationQueryEx
 
 block_id BlockBasedPredicateEvaluationQueryExecutor::getNextInputBlock() {
   MutexLock lock(mutex_);
-  if (next_block_iterator_ == relation_.end_blocks()) {
+  if (next_block_iterator_ == input_blocks_.end()) {
     return -1;
   } else {
     block_id next_block = *next_block_iterator_;
@@ -341,8 +426,10 @@ BlockBasedSelectionQueryExecutor::BlockBasedSelectionQueryExecutor(
                               thread_affinities,
                               num_threads,
                               storage_manager),
-      database_(database),
-      next_block_iterator_(relation.begin_blocks()) {
+      database_(database) {
+  input_blocks_epoch_ = relation.beginBlocksRead(&input_blocks_);
+  next_block_iterator_ = input_blocks_.begin();
+
   // Choose attributes to project.
   assert(projection_attributes_num > 0);
   assert(static_cast<CatalogRelation::size_type>(projection_attributes_num) <= relation_.size());
@@ -418,11 +505,13 @@ BlockBasedSelectionQueryExecutor::~BlockBasedSelectionQueryExecutor() {
   }
 
   database_->dropRelationById(result_relation_->getID());
+
+  relation_.endBlocksRead(input_blocks_epoch_);
 }
 
 block_id BlockBasedSelectionQueryExecutor::getNextInputBlock() {
   MutexLock lock(mutex_);
-  if (next_block_iterator_ == relation_.end_blocks()) {
+  if (next_block_iterator_ == input_blocks_.end()) {
     return -1;
   } else {
     block_id next_block = *next_block_iterator_;
@@ -442,16 +531,51 @@ block_id PartitionedBlockBasedSelectionQueryExecutor::getNextInputBlock() {
   }
 }
 
-void BlockBasedSelectionQueryExecutor::doProjection(const StorageBlock &block,
-                                                    TupleIdSequence *matches) {
-  if (matches->size() > 0) {
-    const TupleStorageSubBlock &tuple_store = block.getTupleStorageSubBlock();
-    StorageBlock *result_block = result_destination_->getBlockForInsertion();
+PtrVector<Tuple>* BlockBasedSelectionQueryExecutor::evaluatePredicateAndProject(const StorageBlock &block) const {
+  // Only project tuples whose insertion finished before the read began, even
+  // if more are being appended concurrently.
+  const tuple_id visible_tuples = block.getVisibleTupleWatermark();
+
+  ScopedPtr<TupleIdSequence> matches;
+  if (use_index_) {
+    const vector<const IndexSubBlock*> indexes(getIndexes(block));
+    // Only a single index can cover the projection by itself.
+    if (indexes.size() == 1) {
+      PtrVector<Tuple> *projected_tuples = evaluatePredicateAndProjectWithIndex(*indexes.front(),
+                                                                                projection_attributes_);
+      if (projected_tuples != NULL) {
+        return projected_tuples;
+      }
+    }
+
+    matches.reset(evaluatePredicateWithIndexes(indexes, block.getTupleStorageSubBlock()));
+    if (sort_index_matches_) {
+      matches->sort();
+    }
+  } else {
+    matches.reset(evaluatePredicateOnBlock(block));
+  }
+  matches->removeAtOrAbove(visible_tuples);
+
+  const TupleStorageSubBlock &tuple_store = block.getTupleStorageSubBlock();
+  ScopedPtr<PtrVector<Tuple> > projected_tuples(new PtrVector<Tuple>());
+  for (TupleIdSequence::const_iterator it = matches->begin(); it != matches->end(); ++it) {
+    // Values in 'matched_tuple' may refer to memory in the block, so make a
+    // copy which outlives the read section.
+    Tuple matched_tuple(tuple_store, *it, projection_attributes_);
+    projected_tuples->push_back(matched_tuple.clone());
+  }
+  return projected_tuples.release();
+}
 
-    for (TupleIdSequence::const_iterator it = matches->begin(); it != matches->end(); ++it) {
-      Tuple matched_tuple(tuple_store, *it, projection_attributes_);
+void BlockBasedSelectionQueryExecutor::doProjection(const PtrVector<Tuple> &projected_tuples) {
+  if (projected_tuples.size() > 0) {
+    StorageBlock *result_block = result_destination_->getBlockForInsertion();
 
-      while (!result_block->insertTuple(matched_tuple, kNone)) {
+    for (PtrVector<Tuple>::const_iterator it = projected_tuples.begin();
+         it != projected_tuples.end();
+         ++it) {
+      while (!result_block->insertTuple(*it, kNone)) {
         result_destination_->returnBlock(result_block, true);
         result_block = result_destination_->getBlockForInsertion();
       }
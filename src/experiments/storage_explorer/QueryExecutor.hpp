@@ -46,6 +46,7 @@ class InsertDestination;
 class Predicate;
 class StorageBlock;
 class StorageManager;
+class Tuple;
 class TupleIdSequence;
 
 namespace storage_explorer {
@@ -81,7 +82,6 @@ class QueryExecutor {
         predicate_attribute_id_(predicate_attribute_id),
         thread_affinities_(thread_affinities),
         use_index_(false),
-        use_index_num_(0),
         sort_index_matches_(false) {
   }
 
@@ -105,8 +105,27 @@ class QueryExecutor {
    *        sorted into order before projection is performed.
    **/
   void executeWithIndex(const std::size_t index_num, const bool sort_matches) {
+    executeWithIndexes(std::vector<std::size_t>(1, index_num), sort_matches);
+  }
+
+  /**
+   * @brief Run the query using several indexes.
+   * @note Each part of the predicate (e.g. each conjunct of a
+   *       ConjunctionPredicate) is evaluated with the first of the indexes
+   *       that can evaluate it, and the results are intersected (or unioned
+   *       for a DisjunctionPredicate). Any remaining parts of the predicate
+   *       are checked only on the tuples which survive. See
+   *       StorageBlock::GetMatchesForPredicateWithIndexes().
+   *
+   * @param index_nums The numbers of the indexes to use for predicate
+   *        evaluation.
+   * @param sort_matches If true, the sequence of matching tuple IDs will be
+   *        sorted into order before projection is performed.
+   **/
+  void executeWithIndexes(const std::vector<std::size_t> &index_nums, const bool sort_matches) {
+    DEBUG_ASSERT(!index_nums.empty());
     use_index_ = true;
-    use_index_num_ = index_num;
+    use_index_nums_ = index_nums;
     sort_index_matches_ = sort_matches;
 
     runThreads();
@@ -114,9 +133,20 @@ class QueryExecutor {
 
  protected:
   TupleIdSequence* evaluatePredicateOnTupleStore(const TupleStorageSubBlock &tuple_store) const;
-  TupleIdSequence* evaluatePredicateWithIndex(const IndexSubBlock &index,
-                                              const TupleStorageSubBlock &tuple_store) const;
-  TupleIdSequence* evaluatePredicateOnBlock(const StorageBlock &block) const;
+  // Evaluate the predicate with as many of 'indexes' as possible, falling back
+  // to a scan of 'tuple_store' if none of them can evaluate any part of it.
+  TupleIdSequence* evaluatePredicateWithIndexes(const std::vector<const IndexSubBlock*> &indexes,
+                                                const TupleStorageSubBlock &tuple_store) const;
+
+  // Evaluate the predicate with 'index' and get the values of
+  // 'projection_attributes' for matching tuples directly from index entries,
+  // without accessing the base table. Returns NULL if 'index' doesn't cover
+  // 'projection_attributes' or can't evaluate the predicate (or the predicate
+  // is trivially true), in which case the caller should fall back to
+  // evaluatePredicateWithIndexes().
+  PtrVector<Tuple>* evaluatePredicateAndProjectWithIndex(
+      const IndexSubBlock &index,
+      const std::vector<attribute_id> &projection_attributes) const;
 
   const CatalogRelation &relation_;
   const Predicate &predicate_;
@@ -126,7 +156,7 @@ class QueryExecutor {
   PtrVector<Thread> threads_;
 
   bool use_index_;
-  std::size_t use_index_num_;
+  std::vector<std::size_t> use_index_nums_;
   bool sort_index_matches_;
 
  private:
@@ -185,6 +215,14 @@ class BlockBasedQueryExecutor : public QueryExecutor {
   const IndexSubBlock& getIndex(const StorageBlock &block,
                                 const std::size_t index_num) const;
 
+  // Get all of the indexes in 'block' with numbers in 'use_index_nums_'.
+  std::vector<const IndexSubBlock*> getIndexes(const StorageBlock &block) const;
+
+  // Evaluate the predicate on all the tuples in 'block'. Must be called in a
+  // read section of 'block' (see StorageBlock::beginRead()), so that writers
+  // don't modify or rebuild it underneath.
+  TupleIdSequence* evaluatePredicateOnBlock(const StorageBlock &block) const;
+
   StorageManager *storage_manager_;
 
   Mutex mutex_;
@@ -221,13 +259,21 @@ class BlockBasedPredicateEvaluationQueryExecutor : public BlockBasedQueryExecuto
                                              StorageManager *storage_manager);
 
   virtual ~BlockBasedPredicateEvaluationQueryExecutor() {
+    relation_.endBlocksRead(input_blocks_epoch_);
   }
 
  protected:
   virtual block_id getNextInputBlock();
 
  private:
-  CatalogRelation::const_iterator_blocks next_block_iterator_;
+  // A snapshot of the relation's blocks, taken when this executor is
+  // created, so that blocks added concurrently don't disturb iteration. This
+  // executor is registered as a reader of them (see
+  // CatalogRelation::beginBlocksRead()) until it is destroyed, so that
+  // blocks replaced meanwhile aren't freed.
+  std::vector<block_id> input_blocks_;
+  std::size_t input_blocks_epoch_;
+  std::vector<block_id>::const_iterator next_block_iterator_;
 
   friend class query_execution_threads::BlockBasedPredicateEvaluationThread;
 
@@ -322,13 +368,19 @@ class BlockBasedSelectionQueryExecutor : public BlockBasedQueryExecutor {
                                    const std::size_t result_block_size_slots,
                                    CatalogDatabase *database);
 
-  // Drops temporary result relation.
+  // Drops temporary result relation, and ends the read of the input
+  // relation's blocks.
   virtual ~BlockBasedSelectionQueryExecutor();
 
  protected:
   virtual block_id getNextInputBlock();
 
-  void doProjection(const StorageBlock &block, TupleIdSequence *matches);
+  // Evaluate the predicate on 'block' and copy the projected attributes of
+  // matching tuples whose insertion has finished. Must be called in a read
+  // section of 'block' (see StorageBlock::beginRead()).
+  PtrVector<Tuple>* evaluatePredicateAndProject(const StorageBlock &block) const;
+
+  void doProjection(const PtrVector<Tuple> &projected_tuples);
 
   std::vector<attribute_id> projection_attributes_;
 
@@ -339,7 +391,14 @@ class BlockBasedSelectionQueryExecutor : public BlockBasedQueryExecutor {
   ScopedPtr<InsertDestination> result_destination_;
 
  private:
-  CatalogRelation::const_iterator_blocks next_block_iterator_;
+  // A snapshot of the relation's blocks, taken when this executor is
+  // created, so that blocks added concurrently don't disturb iteration. This
+  // executor is registered as a reader of them (see
+  // CatalogRelation::beginBlocksRead()) until it is destroyed, so that
+  // blocks replaced meanwhile aren't freed.
+  std::vector<block_id> input_blocks_;
+  std::size_t input_blocks_epoch_;
+  std::vector<block_id>::const_iterator next_block_iterator_;
 
   friend class query_execution_threads::BlockBasedSelectionThread;
 
@@ -0,0 +1,66 @@
+/*
+   This file copyright (c) 2011-2013, the Quickstep authors.
+   See file CREDITS.txt for details.
+  
+   This file is part of Quickstep.
+
+   Quickstep is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+  
+   Quickstep is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Quickstep.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICKSTEP_EXPRESSIONS_CONJUNCTION_PREDICATE_HPP_
+#define QUICKSTEP_EXPRESSIONS_CONJUNCTION_PREDICATE_HPP_
+
+#include "expressions/Predicate.hpp"
+#include "expressions/PredicateWithList.hpp"
+#include "utility/Macros.hpp"
+
+namespace quickstep {
+
+/** \addtogroup Expressions
+ *  @{
+ */
+
+/**
+ * @brief A conjunction of other predicates, which matches a tuple if all of its
+ *        operands match it. A ConjunctionPredicate with no operands always
+ *        evaluates to true.
+ **/
+class ConjunctionPredicate : public PredicateWithList {
+ public:
+  ConjunctionPredicate()
+      : PredicateWithList(true) {
+  }
+
+  ~ConjunctionPredicate() {
+  }
+
+  Predicate* clone() const;
+
+  PredicateType getPredicateType() const {
+    return kConjunction;
+  }
+
+  bool matchesForSingleTuple(const TupleStorageSubBlock &tuple_store, const tuple_id tuple) const;
+
+  void addPredicate(Predicate *operand);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ConjunctionPredicate);
+};
+
+/** @} */
+
+}  // namespace quickstep
+
+#endif  // QUICKSTEP_EXPRESSIONS_CONJUNCTION_PREDICATE_HPP_
@@ -0,0 +1,72 @@
+/*
+   This file copyright (c) 2011-2013, the Quickstep authors.
+   See file CREDITS.txt for details.
+  
+   This file is part of Quickstep.
+
+   Quickstep is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+  
+   Quickstep is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Quickstep.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "expressions/DisjunctionPredicate.hpp"
+
+#include "expressions/Predicate.hpp"
+#include "utility/PtrList.hpp"
+
+namespace quickstep {
+
+Predicate* DisjunctionPredicate::clone() const {
+  DisjunctionPredicate *clone = new DisjunctionPredicate();
+  for (PtrList<Predicate>::const_iterator it = operand_list_.begin();
+       it != operand_list_.end();
+       ++it) {
+    clone->addPredicate(it->clone());
+  }
+  return clone;
+}
+
+bool DisjunctionPredicate::matchesForSingleTuple(const TupleStorageSubBlock &tuple_store,
+                                                 const tuple_id tuple) const {
+  if (has_static_result_) {
+    return static_result_;
+  }
+
+  for (PtrList<Predicate>::const_iterator it = operand_list_.begin();
+       it != operand_list_.end();
+       ++it) {
+    if (it->matchesForSingleTuple(tuple_store, tuple)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void DisjunctionPredicate::addPredicate(Predicate *operand) {
+  operand_list_.push_back(operand);
+
+  if (has_static_result_ && static_result_) {
+    // Already short-circuited by an earlier operand.
+    return;
+  }
+
+  if (operand->hasStaticResult()) {
+    if (operand->getStaticResult()) {
+      has_static_result_ = true;
+      static_result_ = true;
+    }
+  } else {
+    has_static_result_ = false;
+  }
+}
+
+}  // namespace quickstep
@@ -50,6 +50,8 @@ class Predicate {
     kTrue = 0,
     kFalse,
     kComparison,
+    kConjunction,
+    kDisjunction,
     kNumPredicateTypes  // Not a real PredicateType, exists for counting purposes.
   };
 
@@ -0,0 +1,99 @@
+/*
+   This file copyright (c) 2011-2013, the Quickstep authors.
+   See file CREDITS.txt for details.
+  
+   This file is part of Quickstep.
+
+   Quickstep is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+  
+   Quickstep is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Quickstep.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICKSTEP_EXPRESSIONS_PREDICATE_WITH_LIST_HPP_
+#define QUICKSTEP_EXPRESSIONS_PREDICATE_WITH_LIST_HPP_
+
+#include "expressions/Predicate.hpp"
+#include "utility/Macros.hpp"
+#include "utility/PtrList.hpp"
+
+namespace quickstep {
+
+/** \addtogroup Expressions
+ *  @{
+ */
+
+/**
+ * @brief Base class for predicates which combine a list of operand
+ *        predicates (i.e. conjunctions and disjunctions).
+ **/
+class PredicateWithList : public Predicate {
+ public:
+  virtual ~PredicateWithList() {
+  }
+
+  /**
+   * @brief Add a predicate to this one's list of operands.
+   *
+   * @param operand The predicate to add, becomes owned by this
+   *        PredicateWithList.
+   **/
+  virtual void addPredicate(Predicate *operand) = 0;
+
+  /**
+   * @brief Get the list of operand predicates.
+   *
+   * @return This predicate's operands, in the order they were added.
+   **/
+  const PtrList<Predicate>& getOperands() const {
+    return operand_list_;
+  }
+
+  bool hasStaticResult() const {
+    return has_static_result_;
+  }
+
+  bool getStaticResult() const {
+    if (!has_static_result_) {
+      FATAL_ERROR("Called getStaticResult() on a predicate which has no static result");
+    }
+    return static_result_;
+  }
+
+ protected:
+  /**
+   * @brief Constructor.
+   *
+   * @param empty_result The result of this predicate when it has no operands
+   *        (true for a conjunction, false for a disjunction).
+   **/
+  explicit PredicateWithList(const bool empty_result)
+      : has_static_result_(true),
+        static_result_(empty_result) {
+  }
+
+  PtrList<Predicate> operand_list_;
+
+  // A PredicateWithList has a static result if it has no operands, if all of
+  // its operands have static results, or if any operand's static result
+  // short-circuits the whole predicate.
+  bool has_static_result_;
+  bool static_result_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(PredicateWithList);
+};
+
+/** @} */
+
+}  // namespace quickstep
+
+#endif  // QUICKSTEP_EXPRESSIONS_PREDICATE_WITH_LIST_HPP_
@@ -21,6 +21,7 @@
 #include "storage/BasicColumnStoreTupleStorageSubBlock.hpp"
 
 #include <algorithm>
+#include <cmath>
 #include <cstddef>
 #include <cstring>
 #include <vector>
@@ -31,23 +32,32 @@
 #include "expressions/Predicate.hpp"
 #include "expressions/Scalar.hpp"
 #include "storage/ColumnStoreUtil.hpp"
+#include "storage/NullBitmaps.hpp"
 #include "storage/StorageBlockInfo.hpp"
 #include "storage/StorageBlockLayout.pb.h"
 #include "storage/StorageErrors.hpp"
+#include "storage/TupleBatch.hpp"
+#include "storage/TupleIdSequence.hpp"
 #include "types/Comparison.hpp"
 #include "types/Tuple.hpp"
 #include "types/Type.hpp"
 #include "types/TypeInstance.hpp"
+#include "utility/BitVector.hpp"
+#include "utility/CstdintCompat.hpp"
 #include "utility/Macros.hpp"
-#include "utility/PtrVector.hpp"
 #include "utility/ScopedBuffer.hpp"
 #include "utility/ScopedPtr.hpp"
 
 using std::lower_bound;
 using std::memcpy;
 using std::memmove;
+using std::int64_t;
+using std::min;
 using std::size_t;
 using std::sort;
+using std::sqrt;
+using std::uint32_t;
+using std::uint64_t;
 using std::upper_bound;
 using std::vector;
 
@@ -92,6 +102,55 @@ class SortColumnValueReferenceComparator {
   const UncheckedComparator &internal_comparator_;
 };
 
+// Below this many tuples, a comparison sort is used even for integer sort
+// columns.
+static const std::size_t kMinTuplesForRadixSort = 256;
+
+// Sort 'tuples' by their values in a column stripe of integers with a
+// least-significant-digit radix sort, one byte per pass. The sign bit is
+// flipped so that negative values sort before positive ones. Passes in which
+// every value has the same byte are skipped.
+template <typename SignedType, typename UnsignedType>
+void RadixSortTuplesByIntegerStripe(const void *stripe, vector<tuple_id> *tuples) {
+  const size_t num_tuples = tuples->size();
+  if (num_tuples == 0) {
+    return;
+  }
+
+  const UnsignedType sign_bit = static_cast<UnsignedType>(1) << ((sizeof(UnsignedType) << 3) - 1);
+  vector<UnsignedType> keys(num_tuples);
+  for (size_t position = 0; position < num_tuples; ++position) {
+    keys[position] = static_cast<UnsignedType>(static_cast<const SignedType*>(stripe)[(*tuples)[position]])
+                     ^ sign_bit;
+  }
+
+  vector<UnsignedType> scratch_keys(num_tuples);
+  vector<tuple_id> scratch_tuples(num_tuples);
+  for (size_t shift = 0; shift < (sizeof(UnsignedType) << 3); shift += 8) {
+    size_t bucket_starts[256] = {0};
+    for (size_t position = 0; position < num_tuples; ++position) {
+      ++bucket_starts[(keys[position] >> shift) & 0xFF];
+    }
+    if (bucket_starts[(keys[0] >> shift) & 0xFF] == num_tuples) {
+      continue;
+    }
+
+    size_t next_start = 0;
+    for (size_t bucket = 0; bucket < 256; ++bucket) {
+      const size_t bucket_size = bucket_starts[bucket];
+      bucket_starts[bucket] = next_start;
+      next_start += bucket_size;
+    }
+    for (size_t position = 0; position < num_tuples; ++position) {
+      const size_t destination = bucket_starts[(keys[position] >> shift) & 0xFF]++;
+      scratch_keys[destination] = keys[position];
+      scratch_tuples[destination] = (*tuples)[position];
+    }
+    keys.swap(scratch_keys);
+    tuples->swap(scratch_tuples);
+  }
+}
+
 }  // anonymous namespace
 
 
@@ -105,8 +164,7 @@ BasicColumnStoreTupleStorageSubBlock::BasicColumnStoreTupleStorageSubBlock(
                            description,
                            new_block,
                            sub_block_memory,
-                           sub_block_memory_size),
-      sorted_(true) {
+                           sub_block_memory_size) {
   if (!DescriptionIsValid(relation_, description_)) {
     FATAL_ERROR("Attempted to construct a BasicColumnStoreTupleStorageSubBlock from an invalid description.");
   }
@@ -121,24 +179,50 @@ BasicColumnStoreTupleStorageSubBlock::BasicColumnStoreTupleStorageSubBlock(
     throw BlockMemoryTooSmall("BasicColumnStoreTupleStorageSubBlock", sub_block_memory_size_);
   }
 
-  // Determine the amount of tuples this sub-block can hold.
-  max_tuples_ = (sub_block_memory_size_ - sizeof(BasicColumnStoreHeader)) / relation_.getFixedByteLength();
+  // Determine the amount of tuples this sub-block can hold (along with their
+  // delete bits and NULL bits, if there are nullable attributes).
+  max_tuples_ = NullBitmaps::MaxTuplesThatFit(relation_,
+                                              sub_block_memory_size_ - sizeof(BasicColumnStoreHeader),
+                                              relation_.getFixedByteLength(),
+                                              1);
   if (max_tuples_ == 0) {
     throw BlockMemoryTooSmall("BasicColumnStoreTupleStorageSubBlock", sub_block_memory_size_);
   }
 
+  // Merging the insert buffer moves O(N) values, so a buffer of sqrt(N)
+  // tuples bounds the cost of filling a block with insertTuple() to
+  // O(N * sqrt(N)), while keeping the buffer cheap to check in scans.
+  insert_buffer_capacity_ = static_cast<tuple_id>(sqrt(static_cast<double>(max_tuples_)));
+  if (insert_buffer_capacity_ == 0) {
+    insert_buffer_capacity_ = 1;
+  }
+
+  // The delete bitmap and NULL bitmaps (if any) are stored between the header
+  // and the column stripes.
+  char *stripes_start = static_cast<char*>(sub_block_memory_) + sizeof(BasicColumnStoreHeader);
+  deleted_tuples_.reset(new BitVector(stripes_start, max_tuples_));
+  if (new_block) {
+    deleted_tuples_->clear();
+  }
+  stripes_start += BitVector::BytesNeeded(max_tuples_);
+  if (relation_.hasNullableAttributes()) {
+    null_bitmaps_.reset(new NullBitmaps(relation_, stripes_start, max_tuples_, new_block));
+    stripes_start += NullBitmaps::BytesNeeded(relation_, max_tuples_);
+  }
+
   // Determine column stripe locations.
   column_stripes_.resize(relation_.getMaxAttributeId() +  1, NULL);
   for (CatalogRelation::const_iterator attr_it = relation_.begin();
        attr_it != relation_.end();
        ++attr_it) {
-    column_stripes_[attr_it->getID()] = static_cast<char*>(sub_block_memory_)
-                                        + sizeof(BasicColumnStoreHeader)
+    column_stripes_[attr_it->getID()] = stripes_start
                                         + max_tuples_ * relation_.getFixedLengthAttributeOffset(attr_it->getID());
   }
 
   if (new_block) {
     getHeaderPtr()->num_tuples = 0;
+    getHeaderPtr()->num_deleted_tuples = 0;
+    getHeaderPtr()->num_sorted_tuples = 0;
   }
 }
 
@@ -157,21 +241,22 @@ bool BasicColumnStoreTupleStorageSubBlock::DescriptionIsValid(
     return false;
   }
 
-  // Make sure relation is not variable-length and contains no nullable attributes.
+  // Make sure relation is not variable-length.
   if (relation.isVariableLength()) {
     return false;
   }
-  if (relation.hasNullableAttributes()) {
-    return false;
-  }
 
-  // Check that the specified sort attribute exists and can be ordered by LessComparison.
+  // Check that the specified sort attribute exists, is not nullable, and can
+  // be ordered by LessComparison.
   attribute_id sort_attribute_id = description.GetExtension(
       BasicColumnStoreTupleStorageSubBlockDescription::sort_attribute_id);
   if (!relation.hasAttributeWithId(sort_attribute_id)) {
     return false;
   }
   const Type &sort_attribute_type = relation.getAttributeById(sort_attribute_id).getType();
+  if (sort_attribute_type.isNullable()) {
+    return false;
+  }
   if (!Comparison::GetComparison(Comparison::kLess).canCompareTypes(sort_attribute_type,
                                                                     sort_attribute_type)) {
     return false;
@@ -194,47 +279,27 @@ TupleStorageSubBlock::InsertResult BasicColumnStoreTupleStorageSubBlock::insertT
 #ifdef QUICKSTEP_DEBUG
   paranoidInsertTypeCheck(tuple, atc);
 #endif
+  bool ids_mutated = false;
   if (!hasSpaceToInsert(1)) {
-    return InsertResult(-1, false);
-  }
-
-  // Binary search for the appropriate insert location.
-  tuple_id insert_position = 0;
-  {
-    // Coerce the sort column value from 'tuple' if necessary.
-    const void *sort_column_value = NULL;
-    ScopedPtr<TypeInstance> converted_sort_column_value;
-    if (atc == kNone) {
-      sort_column_value = tuple.getAttributeValue(sort_column_id_).getDataPtr();
-    } else {
-      if (relation_.getAttributeById(sort_column_id_).getType().equals(
-          tuple.getAttributeValue(sort_column_id_).getType())) {
-        sort_column_value = tuple.getAttributeValue(sort_column_id_).getDataPtr();
-      } else {
-        converted_sort_column_value.reset(tuple.getAttributeValue(sort_column_id_)
-            .makeCoercedCopy(relation_.getAttributeById(sort_column_id_).getType()));
-        sort_column_value = converted_sort_column_value->getDataPtr();
-      }
+    if (isPacked()) {
+      return InsertResult(-1, false);
     }
+    // Reclaim the space used by deleted tuples.
+    compact();
+    ids_mutated = true;
+  }
 
-    // Use std::upper_bound, which is a binary search when provided with
-    // random-access iterators.
-    ColumnStripeIterator insert_position_it
-        = upper_bound(ColumnStripeIterator(column_stripes_[sort_column_id_],
-                                           relation_.getAttributeById(sort_column_id_).getType().maximumByteLength(),
-                                           0),
-                      ColumnStripeIterator(column_stripes_[sort_column_id_],
-                                           relation_.getAttributeById(sort_column_id_).getType().maximumByteLength(),
-                                           getHeaderPtr()->num_tuples),
-                      sort_column_value,
-                      STLUncheckedComparatorWrapper(*sort_column_comparator_));
-    insert_position = insert_position_it.getTuplePosition();
+  if (getHeaderPtr()->num_tuples - getHeaderPtr()->num_sorted_tuples >= insert_buffer_capacity_) {
+    // The insert buffer is full, so merge it into the sorted tuples first.
+    compact();
+    mergeUnsortedTuples();
+    ids_mutated = true;
   }
 
-  InsertResult retval(insert_position, insert_position != getHeaderPtr()->num_tuples);
-  insertTupleAtPosition(tuple, atc, insert_position);
+  const tuple_id new_tuple = getHeaderPtr()->num_tuples;
+  appendTuple(tuple, atc);
 
-  return retval;
+  return InsertResult(new_tuple, ids_mutated);
 }
 
 bool BasicColumnStoreTupleStorageSubBlock::insertTupleInBatch(const Tuple &tuple,
@@ -243,18 +308,73 @@ bool BasicColumnStoreTupleStorageSubBlock::insertTupleInBatch(const Tuple &tuple
   paranoidInsertTypeCheck(tuple, atc);
 #endif
   if (!hasSpaceToInsert(1)) {
-    return false;
+    if (isPacked()) {
+      return false;
+    }
+    compact();
   }
 
-  insertTupleAtPosition(tuple, atc, getHeaderPtr()->num_tuples);
-  sorted_ = false;
+  appendTuple(tuple, atc);
   return true;
 }
 
+tuple_id BasicColumnStoreTupleStorageSubBlock::bulkInsertTuples(const TupleBatch &batch,
+                                                                const tuple_id first_tuple) {
+  DEBUG_ASSERT(&batch.getRelation() == &relation_);
+  if (!isPacked() && !hasSpaceToInsert(batch.size() - first_tuple)) {
+    // Reclaim the space used by deleted tuples, so that as much of the batch
+    // as possible fits.
+    compact();
+  }
+
+  const tuple_id num_tuples = min(batch.size() - first_tuple,
+                                  max_tuples_ - getHeaderPtr()->num_tuples);
+  if (num_tuples <= 0) {
+    return 0;
+  }
+
+  const tuple_id position = getHeaderPtr()->num_tuples;
+  for (CatalogRelation::const_iterator attr_it = relation_.begin();
+       attr_it != relation_.end();
+       ++attr_it) {
+    const size_t attr_length = attr_it->getType().maximumByteLength();
+    char *dest_ptr = static_cast<char*>(column_stripes_[attr_it->getID()]) + position * attr_length;
+    if (batch.isColumnMajor()) {
+      memcpy(dest_ptr,
+             batch.getColumnValues(attr_it->getID()) + first_tuple * attr_length,
+             num_tuples * attr_length);
+    } else {
+      const size_t tuple_length = relation_.getFixedByteLength();
+      const char *value_ptr = batch.getRows()
+                              + first_tuple * tuple_length
+                              + relation_.getFixedLengthAttributeOffset(attr_it->getID());
+      for (tuple_id tuple_num = 0; tuple_num < num_tuples; ++tuple_num) {
+        memcpy(dest_ptr, value_ptr, attr_length);
+        value_ptr += tuple_length;
+        dest_ptr += attr_length;
+      }
+    }
+
+    if ((null_bitmaps_.get() != NULL) && null_bitmaps_->hasNullBitmap(attr_it->getID())) {
+      for (tuple_id tuple_num = 0; tuple_num < num_tuples; ++tuple_num) {
+        null_bitmaps_->setNull(position + tuple_num,
+                               attr_it->getID(),
+                               batch.isNull(first_tuple + tuple_num, attr_it->getID()));
+      }
+    }
+  }
+
+  getHeaderPtr()->num_tuples += num_tuples;
+  return num_tuples;
+}
+
 const void* BasicColumnStoreTupleStorageSubBlock::getAttributeValue(const tuple_id tuple,
                                                                     const attribute_id attr) const {
   DEBUG_ASSERT(hasTupleWithID(tuple));
   DEBUG_ASSERT(relation_.hasAttributeWithId(attr));
+  if ((null_bitmaps_.get() != NULL) && null_bitmaps_->isNull(tuple, attr)) {
+    return NULL;
+  }
   return static_cast<const char*>(column_stripes_[attr])
          + (tuple * relation_.getAttributeById(attr).getType().maximumByteLength());
 }
@@ -264,21 +384,63 @@ TypeInstance* BasicColumnStoreTupleStorageSubBlock::getAttributeValueTyped(const
   return relation_.getAttributeById(attr).getType().makeReferenceTypeInstance(getAttributeValue(tuple, attr));
 }
 
+bool BasicColumnStoreTupleStorageSubBlock::canSetAttributeValuesInPlaceTyped(
+    const tuple_id tuple,
+    const PtrMap<attribute_id, LiteralTypeInstance> &new_values) const {
+  DEBUG_ASSERT(hasTupleWithID(tuple));
+  if ((tuple < getHeaderPtr()->num_sorted_tuples)
+      && (new_values.find(sort_column_id_) != new_values.end())) {
+    return false;
+  }
+  for (PtrMap<attribute_id, LiteralTypeInstance>::const_iterator value_it = new_values.begin();
+       value_it != new_values.end();
+       ++value_it) {
+    if (value_it->second->isNull()
+        && ((null_bitmaps_.get() == NULL) || !null_bitmaps_->hasNullBitmap(value_it->first))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void BasicColumnStoreTupleStorageSubBlock::setAttributeValueInPlaceTyped(const tuple_id tuple,
+                                                                         const attribute_id attr,
+                                                                         const TypeInstance &value) {
+  DEBUG_ASSERT(hasTupleWithID(tuple));
+  DEBUG_ASSERT(relation_.hasAttributeWithId(attr));
+  if (!value.isNull()) {
+    value.copyInto(static_cast<char*>(column_stripes_[attr])
+                   + (tuple * relation_.getAttributeById(attr).getType().maximumByteLength()));
+  }
+  if ((null_bitmaps_.get() != NULL) && null_bitmaps_->hasNullBitmap(attr)) {
+    null_bitmaps_->setNull(tuple, attr, value.isNull());
+  }
+}
+
 bool BasicColumnStoreTupleStorageSubBlock::deleteTuple(const tuple_id tuple) {
   DEBUG_ASSERT(hasTupleWithID(tuple));
 
   BasicColumnStoreHeader *header = getHeaderPtr();
 
   if (tuple == header->num_tuples - 1) {
-    // If deleting the last tuple, simply truncate.
+    // If deleting the last tuple, simply truncate, along with any deleted
+    // tuples which would otherwise be left at the end.
     --(header->num_tuples);
-    return false;
+    while ((header->num_tuples > 0) && deleted_tuples_->getBit(header->num_tuples - 1)) {
+      deleted_tuples_->setBit(header->num_tuples - 1, false);
+      --(header->num_tuples);
+      --(header->num_deleted_tuples);
+    }
+    if (header->num_sorted_tuples > header->num_tuples) {
+      header->num_sorted_tuples = header->num_tuples;
+    }
   } else {
-    // Pack each column stripe.
-    shiftTuples(tuple, tuple + 1, header->num_tuples - tuple - 1);
-    --(header->num_tuples);
-    return true;
+    // Leave a tombstone in place. The tuple's space is reclaimed by compact().
+    deleted_tuples_->setBit(tuple, true);
+    ++(header->num_deleted_tuples);
   }
+
+  return false;
 }
 
 TupleIdSequence* BasicColumnStoreTupleStorageSubBlock::getMatchesForPredicate(const Predicate *predicate) const {
@@ -287,32 +449,59 @@ TupleIdSequence* BasicColumnStoreTupleStorageSubBlock::getMatchesForPredicate(co
     return TupleStorageSubBlock::getMatchesForPredicate(predicate);
   }
 
+  const BasicColumnStoreHeader *header = getHeaderPtr();
   TupleIdSequence *matches = SortColumnPredicateEvaluator::EvaluatePredicateForUncompressedSortColumn(
       *predicate,
       relation_,
       sort_column_id_,
       column_stripes_[sort_column_id_],
-      getHeaderPtr()->num_tuples);
+      header->num_sorted_tuples);
 
-  if (matches == NULL) {
-    return TupleStorageSubBlock::getMatchesForPredicate(predicate);
-  } else {
+  if (matches != NULL) {
+    if ((header->num_sorted_tuples == header->num_tuples) && isPacked()) {
+      return matches;
+    }
+    // Drop deleted tuples from the range of matches.
+    ScopedPtr<TupleIdSequence> sorted_matches(matches);
+    matches = new TupleIdSequence();
+    for (TupleIdSequence::const_iterator it = sorted_matches->begin();
+         it != sorted_matches->end();
+         ++it) {
+      if (!deleted_tuples_->getBit(*it)) {
+        matches->append(*it);
+      }
+    }
+    // Check the unordered tuples individually.
+    for (tuple_id tid = header->num_sorted_tuples; tid < header->num_tuples; ++tid) {
+      if (!deleted_tuples_->getBit(tid) && predicate->matchesForSingleTuple(*this, tid)) {
+        matches->append(tid);
+      }
+    }
     return matches;
   }
+
+  if (predicate->isAttributeLiteralComparisonPredicate()) {
+    // Scan the attribute's column stripe.
+    const ComparisonPredicate &comparison_predicate = *static_cast<const ComparisonPredicate*>(predicate);
+    const attribute_id comparison_attribute_id = GetComparisonAttributeID(comparison_predicate);
+    return GetMatchesForComparisonOnStridedValues(
+        comparison_predicate,
+        column_stripes_[comparison_attribute_id],
+        relation_.getAttributeById(comparison_attribute_id).getType().maximumByteLength(),
+        getHeaderPtr()->num_tuples,
+        ((null_bitmaps_.get() != NULL) && null_bitmaps_->hasNullBitmap(comparison_attribute_id))
+            ? null_bitmaps_->getNullWords(comparison_attribute_id)
+            : NULL,
+        isPacked() ? NULL : deleted_tuples_->getWords());
+  }
+
+  return TupleStorageSubBlock::getMatchesForPredicate(predicate);
 }
 
-void BasicColumnStoreTupleStorageSubBlock::insertTupleAtPosition(
-    const Tuple &tuple,
-    const AllowedTypeConversion atc,
-    const tuple_id position) {
+void BasicColumnStoreTupleStorageSubBlock::appendTuple(const Tuple &tuple,
+                                                       const AllowedTypeConversion atc) {
   DEBUG_ASSERT(hasSpaceToInsert(1));
-  DEBUG_ASSERT(position >= 0);
-  DEBUG_ASSERT(position < max_tuples_);
-
-  if (position != getHeaderPtr()->num_tuples) {
-    // If not inserting in the last position, shift subsequent tuples back.
-    shiftTuples(position + 1, position, getHeaderPtr()->num_tuples - position);
-  }
+  const tuple_id position = getHeaderPtr()->num_tuples;
 
   // Copy attribute values into place in the column stripes.
   Tuple::const_iterator value_it = tuple.begin();
@@ -321,8 +510,10 @@ void BasicColumnStoreTupleStorageSubBlock::insertTupleAtPosition(
   switch (atc) {
     case kNone:
       while (value_it != tuple.end()) {
-        value_it->copyInto(static_cast<char*>(column_stripes_[attr_it->getID()])
-                           + position * attr_it->getType().maximumByteLength());
+        if (!value_it->isNull()) {
+          value_it->copyInto(static_cast<char*>(column_stripes_[attr_it->getID()])
+                             + position * attr_it->getType().maximumByteLength());
+        }
 
         ++value_it;
         ++attr_it;
@@ -331,7 +522,9 @@ void BasicColumnStoreTupleStorageSubBlock::insertTupleAtPosition(
     case kSafe:
     case kUnsafe:
       while (value_it != tuple.end()) {
-        if (value_it->getType().equals(attr_it->getType())) {
+        if (value_it->isNull()) {
+          // Nothing to copy, the NULL bitmap is set below.
+        } else if (value_it->getType().equals(attr_it->getType())) {
           value_it->copyInto(static_cast<char*>(column_stripes_[attr_it->getID()])
                              + position * attr_it->getType().maximumByteLength());
         } else {
@@ -346,6 +539,15 @@ void BasicColumnStoreTupleStorageSubBlock::insertTupleAtPosition(
       break;
   }
 
+  if (null_bitmaps_.get() != NULL) {
+    value_it = tuple.begin();
+    for (attr_it = relation_.begin(); attr_it != relation_.end(); ++attr_it, ++value_it) {
+      if (null_bitmaps_->hasNullBitmap(attr_it->getID())) {
+        null_bitmaps_->setNull(position, attr_it->getID(), value_it->isNull());
+      }
+    }
+  }
+
   ++(getHeaderPtr()->num_tuples);
 }
 
@@ -373,88 +575,203 @@ const BasicColumnStoreTupleStorageSubBlock::BasicColumnStoreHeader*
   return static_cast<const BasicColumnStoreHeader*>(sub_block_memory_);
 }
 
-// NOTE(chasseur): This implementation uses out-of-band memory up to the
-// total size of tuples contained in this sub-block. It could be done with
-// less memory, although the implementation would be more complex.
-bool BasicColumnStoreTupleStorageSubBlock::rebuildInternal() {
-  const tuple_id num_tuples = getHeaderPtr()->num_tuples;
-  // Immediately return if 1 or 0 tuples.
-  if (num_tuples <= 1) {
-    sorted_ = true;
-    return false;
-  }
+void BasicColumnStoreTupleStorageSubBlock::compact() {
+  BasicColumnStoreHeader *header = getHeaderPtr();
+  if (header->num_deleted_tuples == 0) {
+    return;
+  }
+
+  // Tuples before the first deleted one stay where they are. After that,
+  // each run of remaining tuples is moved forward in every column stripe.
+  tuple_id dest_position = deleted_tuples_->firstOne();
+  tuple_id run_start = dest_position;
+  tuple_id num_sorted_remaining = min(dest_position, header->num_sorted_tuples);
+  while (run_start < header->num_tuples) {
+    // The last tuple is never deleted, so every run of deleted tuples is
+    // followed by at least one remaining tuple.
+    run_start = deleted_tuples_->firstZero(run_start);
+    DEBUG_ASSERT(run_start < header->num_tuples);
+    tuple_id run_end = deleted_tuples_->firstOne(run_start);
+    if (run_end > header->num_tuples) {
+      run_end = header->num_tuples;
+    }
 
-  // Determine the properly-sorted order of tuples.
-  vector<SortColumnValueReference> sort_column_values;
-  for (tuple_id tid = 0; tid < num_tuples; ++tid) {
-    sort_column_values.push_back(SortColumnValueReference(getAttributeValue(tid, sort_column_id_),
-                                                          tid));
+    shiftTuples(dest_position, run_start, run_end - run_start);
+    if (null_bitmaps_.get() != NULL) {
+      null_bitmaps_->moveTuples(dest_position, run_start, run_end - run_start);
+    }
+    if (run_start < header->num_sorted_tuples) {
+      num_sorted_remaining += min(run_end, header->num_sorted_tuples) - run_start;
+    }
+
+    dest_position += run_end - run_start;
+    run_start = run_end;
   }
-  sort(sort_column_values.begin(),
-       sort_column_values.end(),
-       SortColumnValueReferenceComparator(*sort_column_comparator_));
 
-  // If a prefix of the total order of tuples is already sorted, don't bother
-  // copying it around.
-  tuple_id ordered_prefix_tuples = 0;
-  for (vector<SortColumnValueReference>::const_iterator it = sort_column_values.begin();
-       it != sort_column_values.end();
-       ++it) {
-    if (it->getTupleID() != ordered_prefix_tuples) {
-      break;
+  DEBUG_ASSERT(dest_position == header->num_tuples - header->num_deleted_tuples);
+  header->num_tuples = dest_position;
+  header->num_deleted_tuples = 0;
+  header->num_sorted_tuples = num_sorted_remaining;
+  deleted_tuples_->clear();
+}
+
+void BasicColumnStoreTupleStorageSubBlock::sortTuplesBySortColumn(vector<tuple_id> *tuples) const {
+  if (tuples->size() >= kMinTuplesForRadixSort) {
+    switch (relation_.getAttributeById(sort_column_id_).getType().getTypeID()) {
+      case Type::kInt:
+        RadixSortTuplesByIntegerStripe<int, uint32_t>(column_stripes_[sort_column_id_], tuples);
+        return;
+      case Type::kLong:
+        RadixSortTuplesByIntegerStripe<int64_t, uint64_t>(column_stripes_[sort_column_id_], tuples);
+        return;
+      default:
+        break;
     }
-    ++ordered_prefix_tuples;
   }
 
-  if (ordered_prefix_tuples == num_tuples) {
-    // Already sorted.
-    sorted_ = true;
-    return false;
+  vector<SortColumnValueReference> sort_column_values;
+  sort_column_values.reserve(tuples->size());
+  for (vector<tuple_id>::const_iterator it = tuples->begin(); it != tuples->end(); ++it) {
+    sort_column_values.push_back(SortColumnValueReference(getAttributeValue(*it, sort_column_id_), *it));
   }
-
-  // Allocate buffers for each resorted column stripe which can hold exactly as
-  // many values as needed.
-  PtrVector<ScopedBuffer, true> column_stripe_buffers;
-  for (attribute_id stripe_id = 0; stripe_id <= relation_.getMaxAttributeId(); ++stripe_id) {
-    if (relation_.hasAttributeWithId(stripe_id)) {
-      column_stripe_buffers.push_back(
-          new ScopedBuffer((num_tuples - ordered_prefix_tuples)
-                           * relation_.getAttributeById(stripe_id).getType().maximumByteLength()));
-    } else {
-      column_stripe_buffers.push_back(NULL);
-    }
+  sort(sort_column_values.begin(),
+       sort_column_values.end(),
+       SortColumnValueReferenceComparator(*sort_column_comparator_));
+  for (vector<tuple_id>::size_type position = 0; position < tuples->size(); ++position) {
+    (*tuples)[position] = sort_column_values[position].getTupleID();
   }
+}
 
-  // Copy attribute values into the column stripe buffers in properly-sorted
-  // order.
-  for (tuple_id unordered_tuple_num = 0;
-       unordered_tuple_num < num_tuples - ordered_prefix_tuples;
-       ++unordered_tuple_num) {
+// This implementation uses out-of-band memory proportional to the number of
+// unsorted tuples, not to the total size of tuples contained in this
+// sub-block.
+void BasicColumnStoreTupleStorageSubBlock::mergeUnsortedTuples() {
+  DEBUG_ASSERT(isPacked());
+  BasicColumnStoreHeader *header = getHeaderPtr();
+  const size_t sort_column_length = relation_.getAttributeById(sort_column_id_).getType().maximumByteLength();
+
+  // Unsorted tuples which already follow the sorted tuples in order (e.g. a
+  // batch which was inserted in sorted order) simply join the sorted prefix.
+  if (header->num_sorted_tuples == 0) {
+    header->num_sorted_tuples = 1;
+  }
+  while ((header->num_sorted_tuples < header->num_tuples)
+         && !sort_column_comparator_->compareDataPtrs(
+             getAttributeValue(header->num_sorted_tuples, sort_column_id_),
+             getAttributeValue(header->num_sorted_tuples - 1, sort_column_id_))) {
+    ++(header->num_sorted_tuples);
+  }
+  if (header->num_sorted_tuples >= header->num_tuples) {
+    header->num_sorted_tuples = header->num_tuples;
+    return;
+  }
+
+  // Sort only the unsorted suffix.
+  const tuple_id num_sorted = header->num_sorted_tuples;
+  const tuple_id num_unsorted = header->num_tuples - num_sorted;
+  vector<tuple_id> unsorted_tuples;
+  unsorted_tuples.reserve(num_unsorted);
+  for (tuple_id tid = num_sorted; tid < header->num_tuples; ++tid) {
+    unsorted_tuples.push_back(tid);
+  }
+  sortTuplesBySortColumn(&unsorted_tuples);
+
+  // Find the position among the sorted tuples which each unsorted tuple goes
+  // after. Positions never decrease, so each binary search is bounded by the
+  // result of the one before it.
+  vector<tuple_id> merge_positions(num_unsorted);
+  tuple_id search_end = num_sorted;
+  for (tuple_id unsorted_num = num_unsorted - 1; unsorted_num >= 0; --unsorted_num) {
+    search_end = upper_bound(ColumnStripeIterator(column_stripes_[sort_column_id_], sort_column_length, 0),
+                             ColumnStripeIterator(column_stripes_[sort_column_id_], sort_column_length, search_end),
+                             getAttributeValue(unsorted_tuples[unsorted_num], sort_column_id_),
+                             STLUncheckedComparatorWrapper(*sort_column_comparator_)).getTuplePosition();
+    merge_positions[unsorted_num] = search_end;
+  }
+
+  // Save the NULL bits of the unsorted tuples in sorted order, since the
+  // merge overwrites them.
+  vector<vector<bool> > unsorted_null_bits;
+  if (null_bitmaps_.get() != NULL) {
+    unsorted_null_bits.resize(relation_.getMaxAttributeId() + 1);
     for (CatalogRelation::const_iterator attr_it = relation_.begin();
          attr_it != relation_.end();
          ++attr_it) {
-      size_t attr_length = attr_it->getType().maximumByteLength();
-      memcpy(static_cast<char*>(column_stripe_buffers[attr_it->getID()].get())
-                 + unordered_tuple_num * attr_length,
-             getAttributeValue(sort_column_values[ordered_prefix_tuples + unordered_tuple_num].getTupleID(),
-                               attr_it->getID()),
-             attr_length);
+      if (null_bitmaps_->hasNullBitmap(attr_it->getID())) {
+        for (tuple_id unsorted_num = 0; unsorted_num < num_unsorted; ++unsorted_num) {
+          unsorted_null_bits[attr_it->getID()].push_back(
+              null_bitmaps_->isNull(unsorted_tuples[unsorted_num], attr_it->getID()));
+        }
+      }
     }
   }
 
-  // Overwrite the unsorted tails of the column stripes in this block with the
-  // sorted values from the buffers.
+  // Merge each column stripe in place from the back. For each unsorted tuple,
+  // starting with the largest, the run of sorted values which belongs after
+  // it is moved back with a single memmove, then the unsorted value is copied
+  // in front of them.
+  size_t max_attr_length = 0;
   for (CatalogRelation::const_iterator attr_it = relation_.begin();
        attr_it != relation_.end();
        ++attr_it) {
-    size_t attr_length = attr_it->getType().maximumByteLength();
-    memcpy(static_cast<char*>(column_stripes_[attr_it->getID()]) + ordered_prefix_tuples * attr_length,
-           column_stripe_buffers[attr_it->getID()].get(),
-           (num_tuples - ordered_prefix_tuples) * attr_length);
+    if (attr_it->getType().maximumByteLength() > max_attr_length) {
+      max_attr_length = attr_it->getType().maximumByteLength();
+    }
   }
+  ScopedBuffer unsorted_values(num_unsorted * max_attr_length);
+  for (CatalogRelation::const_iterator attr_it = relation_.begin();
+       attr_it != relation_.end();
+       ++attr_it) {
+    const size_t attr_length = attr_it->getType().maximumByteLength();
+    char *stripe = static_cast<char*>(column_stripes_[attr_it->getID()]);
+    for (tuple_id unsorted_num = 0; unsorted_num < num_unsorted; ++unsorted_num) {
+      memcpy(static_cast<char*>(unsorted_values.get()) + unsorted_num * attr_length,
+             stripe + unsorted_tuples[unsorted_num] * attr_length,
+             attr_length);
+    }
 
-  sorted_ = true;
-  return true;
+    tuple_id sorted_end = num_sorted;
+    tuple_id dest_end = header->num_tuples;
+    for (tuple_id unsorted_num = num_unsorted - 1; unsorted_num >= 0; --unsorted_num) {
+      const tuple_id run_length = sorted_end - merge_positions[unsorted_num];
+      if (run_length > 0) {
+        memmove(stripe + (dest_end - run_length) * attr_length,
+                stripe + merge_positions[unsorted_num] * attr_length,
+                run_length * attr_length);
+        dest_end -= run_length;
+        sorted_end = merge_positions[unsorted_num];
+      }
+      --dest_end;
+      memcpy(stripe + dest_end * attr_length,
+             static_cast<const char*>(unsorted_values.get()) + unsorted_num * attr_length,
+             attr_length);
+    }
+    DEBUG_ASSERT(dest_end == sorted_end);
+  }
+
+  // Merge the NULL bits in the same way.
+  if (null_bitmaps_.get() != NULL) {
+    tuple_id sorted_end = num_sorted;
+    tuple_id dest_end = header->num_tuples;
+    for (tuple_id unsorted_num = num_unsorted - 1; unsorted_num >= 0; --unsorted_num) {
+      const tuple_id run_length = sorted_end - merge_positions[unsorted_num];
+      if (run_length > 0) {
+        null_bitmaps_->moveTuples(dest_end - run_length, merge_positions[unsorted_num], run_length);
+        dest_end -= run_length;
+        sorted_end = merge_positions[unsorted_num];
+      }
+      --dest_end;
+      for (CatalogRelation::const_iterator attr_it = relation_.begin();
+           attr_it != relation_.end();
+           ++attr_it) {
+        if (null_bitmaps_->hasNullBitmap(attr_it->getID())) {
+          null_bitmaps_->setNull(dest_end, attr_it->getID(), unsorted_null_bits[attr_it->getID()][unsorted_num]);
+        }
+      }
+    }
+  }
+
+  header->num_sorted_tuples = header->num_tuples;
 }
 
 }  // namespace quickstep
@@ -24,9 +24,12 @@
 #include <vector>
 
 #include "catalog/CatalogTypedefs.hpp"
+#include "storage/NullBitmaps.hpp"
 #include "storage/TupleStorageSubBlock.hpp"
 #include "types/Comparison.hpp"
+#include "utility/BitVector.hpp"
 #include "utility/Macros.hpp"
+#include "utility/PtrMap.hpp"
 #include "utility/ScopedPtr.hpp"
 
 namespace quickstep {
@@ -40,10 +43,27 @@ class TupleStorageSubBlockDescription;
 /**
  * @brief An implementation of TupleStorageSubBlock as a simple column store
  *        with a single sort column and no compression or holes.
- * @warning This implementation does NOT support variable-length or nullable
- *          attributes. It is an error to attempt to construct a
- *          BasicColumnStoreTupleStorageSubBlock for a relation with any
- *          variable-length or nullable attributes.
+ * @note Nullable attributes other than the sort column are supported with a
+ *       NULL bitmap for each nullable attribute, stored between the header
+ *       and the column stripes.
+ * @note Deleting a tuple other than the last one only sets its bit in a
+ *       delete bitmap instead of shifting every subsequent value in every
+ *       column stripe. Deleted tuples stay in place (so the sort column
+ *       remains ordered) until they are compacted away by rebuild() or by an
+ *       insert which would not otherwise fit.
+ * @note Tuples inserted with insertTuple() are appended to an unsorted insert
+ *       buffer after the sorted tuples instead of being shifted into place,
+ *       so they do not mutate the IDs of other tuples. When the buffer holds
+ *       about sqrt(N) tuples (where N is the capacity of the block), it is
+ *       sorted and merged into the sorted tuples with a single linear pass.
+ *       rebuild() does the same for tuples from insertTupleInBatch(), so
+ *       only the newly inserted tuples are sorted.
+ *       Predicates on the sort column binary search the sorted tuples and
+ *       check the tuples in the buffer individually.
+ * @warning This implementation does NOT support variable-length attributes
+ *          or a nullable sort column. It is an error to attempt to construct
+ *          a BasicColumnStoreTupleStorageSubBlock for a relation with any
+ *          variable-length attributes, or with a nullable sort column.
  **/
 class BasicColumnStoreTupleStorageSubBlock : public TupleStorageSubBlock {
  public:
@@ -111,24 +131,52 @@ class BasicColumnStoreTupleStorageSubBlock : public TupleStorageSubBlock {
   }
 
   bool isPacked() const {
-    return true;
+    return (getHeaderPtr()->num_deleted_tuples == 0);
   }
 
   tuple_id getMaxTupleID() const {
     return getHeaderPtr()->num_tuples - 1;
   }
 
+  tuple_id numTuples() const {
+    return getHeaderPtr()->num_tuples - getHeaderPtr()->num_deleted_tuples;
+  }
+
   bool hasTupleWithID(const tuple_id tuple) const {
-    return ((tuple >=0) && (tuple < getHeaderPtr()->num_tuples));
+    return ((tuple >=0)
+            && (tuple < getHeaderPtr()->num_tuples)
+            && !deleted_tuples_->getBit(tuple));
   }
 
   InsertResult insertTuple(const Tuple &tuple, const AllowedTypeConversion atc);
 
   bool insertTupleInBatch(const Tuple &tuple, const AllowedTypeConversion atc);
 
+  // Copies whole runs of values from a column-major batch into each column
+  // stripe. As with insertTupleInBatch(), the new tuples are unordered until
+  // rebuild() is called.
+  tuple_id bulkInsertTuples(const TupleBatch &batch, const tuple_id first_tuple);
+
+  // Appending to the insert buffer is safe, but compacting deleted tuples or
+  // merging a full insert buffer moves existing tuples.
+  bool nextInsertAppends() const {
+    return (hasSpaceToInsert(1) || isPacked())
+           && (getHeaderPtr()->num_tuples - getHeaderPtr()->num_sorted_tuples < insert_buffer_capacity_);
+  }
+
+  tuple_id estimateTupleCapacity() const {
+    return max_tuples_;
+  }
+
   const void* getAttributeValue(const tuple_id tuple, const attribute_id attr) const;
   TypeInstance* getAttributeValueTyped(const tuple_id tuple, const attribute_id attr) const;
 
+  // Tuples in the sorted part of this block can not have their sort column
+  // changed in place.
+  bool canSetAttributeValuesInPlaceTyped(const tuple_id tuple,
+                                         const PtrMap<attribute_id, LiteralTypeInstance> &new_values) const;
+  void setAttributeValueInPlaceTyped(const tuple_id tuple, const attribute_id attr, const TypeInstance &value);
+
   bool deleteTuple(const tuple_id tuple);
 
   // This override can quickly evaluate comparisons between the sort column
@@ -136,14 +184,23 @@ class BasicColumnStoreTupleStorageSubBlock : public TupleStorageSubBlock {
   TupleIdSequence* getMatchesForPredicate(const Predicate *predicate) const;
 
   void rebuild() {
-    if (!sorted_) {
-      rebuildInternal();
+    if (!isPacked()) {
+      compact();
+    }
+    if (getHeaderPtr()->num_sorted_tuples < getHeaderPtr()->num_tuples) {
+      mergeUnsortedTuples();
     }
   }
 
  private:
   struct BasicColumnStoreHeader {
+    // Includes deleted tuples which have not yet been compacted away.
     tuple_id num_tuples;
+    tuple_id num_deleted_tuples;
+    // Tuples before this position are ordered by the sort column. Tuples
+    // from this position on were appended by insertTuple() (the insert
+    // buffer) or insertTupleInBatch(), and are unordered.
+    tuple_id num_sorted_tuples;
   };
 
   BasicColumnStoreHeader* getHeaderPtr();
@@ -154,12 +211,8 @@ class BasicColumnStoreTupleStorageSubBlock : public TupleStorageSubBlock {
   }
 
   // Copy attribute values from 'tuple' into the appropriate column stripes
-  // at the offset specified by 'position'. If 'position' is not at the current
-  // end of tuples in this block, subsequent tuples are shifted back to make
-  // room for the new tuple.
-  void insertTupleAtPosition(const Tuple &tuple,
-                             const AllowedTypeConversion atc,
-                             const tuple_id position);
+  // after the last tuple in this block.
+  void appendTuple(const Tuple &tuple, const AllowedTypeConversion atc);
 
   // Move 'num_tuples' values in each column from 'src_tuple' to
   // 'dest_position'.
@@ -167,17 +220,33 @@ class BasicColumnStoreTupleStorageSubBlock : public TupleStorageSubBlock {
                    const tuple_id src_tuple,
                    const tuple_id num_tuples);
 
-  // Sort all columns according to ascending order of values in the sort
-  // column. Returns true if any reordering occured.
-  bool rebuildInternal();
+  // Move all tuples which have not been deleted forward to fill the space
+  // left by deleted tuples, and clear the delete bitmap. The relative order
+  // of the remaining tuples is unchanged.
+  void compact();
+
+  // Sort the IDs in 'tuples' by their values in the sort column, using a
+  // radix sort for integer sort columns.
+  void sortTuplesBySortColumn(std::vector<tuple_id> *tuples) const;
+
+  // Sort the unordered tuples from 'num_sorted_tuples' on and merge them into
+  // the ordered tuples in place, one column stripe at a time, moving each run
+  // of ordered values at most once. There must not be any deleted tuples.
+  void mergeUnsortedTuples();
 
   tuple_id max_tuples_;
-  bool sorted_;
+  // Bit N is set if the tuple at position N has been deleted.
+  ScopedPtr<BitVector> deleted_tuples_;
+  // The number of unordered tuples which insertTuple() will allow before
+  // merging them with the ordered tuples.
+  tuple_id insert_buffer_capacity_;
 
   attribute_id sort_column_id_;
   ScopedPtr<UncheckedComparator> sort_column_comparator_;
 
   std::vector<void*> column_stripes_;
+  // NULL if the relation has no nullable attributes.
+  ScopedPtr<NullBitmaps> null_bitmaps_;
 
   DISALLOW_COPY_AND_ASSIGN(BasicColumnStoreTupleStorageSubBlock);
 };
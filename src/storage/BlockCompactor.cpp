@@ -0,0 +1,256 @@
+/*
+   This file copyright (c) 2011-2013, the Quickstep authors.
+   See file CREDITS.txt for details.
+
+   This file is part of Quickstep.
+
+   Quickstep is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Quickstep is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Quickstep.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "storage/BlockCompactor.hpp"
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "catalog/CatalogAttribute.hpp"
+#include "catalog/CatalogRelation.hpp"
+#include "storage/StorageBlock.hpp"
+#include "storage/StorageBlockLayout.hpp"
+#include "storage/StorageBlockLayout.pb.h"
+#include "storage/StorageErrors.hpp"
+#include "storage/StorageManager.hpp"
+#include "storage/TupleStorageSubBlock.hpp"
+#include "threading/Thread.hpp"
+#include "threading/VersionedLatch.hpp"
+#include "types/AllowedTypeConversion.hpp"
+#include "types/Tuple.hpp"
+#include "utility/Macros.hpp"
+#include "utility/PtrVector.hpp"
+
+using std::pair;
+using std::size_t;
+using std::vector;
+
+namespace quickstep {
+
+namespace block_compactor_internal {
+
+class CompactionThread : public Thread {
+ public:
+  explicit CompactionThread(BlockCompactor *compactor)
+      : compactor_(compactor),
+        num_replaced_blocks_(0) {
+  }
+
+  // Only valid once this thread has been joined.
+  std::size_t getNumReplacedBlocks() const {
+    return num_replaced_blocks_;
+  }
+
+ protected:
+  void run() {
+    num_replaced_blocks_ = compactor_->compact();
+  }
+
+ private:
+  BlockCompactor *compactor_;
+  std::size_t num_replaced_blocks_;
+
+  DISALLOW_COPY_AND_ASSIGN(CompactionThread);
+};
+
+}  // namespace block_compactor_internal
+
+BlockCompactor::BlockCompactor(StorageManager *storage_manager,
+                               CatalogRelation *relation,
+                               const StorageBlockLayout *layout,
+                               const double fill_threshold,
+                               const bool rewrite_other_layouts)
+    : storage_manager_(storage_manager),
+      relation_(relation),
+      fill_threshold_(fill_threshold),
+      rewrite_other_layouts_(rewrite_other_layouts) {
+  if (layout == NULL) {
+    layout_ = &(relation->getDefaultStorageBlockLayout());
+  } else {
+    layout_ = layout;
+  }
+  layout_serialized_ = layout_->getDescription().SerializeAsString();
+}
+
+BlockCompactor::~BlockCompactor() {
+  waitForCompaction();
+}
+
+size_t BlockCompactor::compact() {
+  vector<block_id> all_blocks;
+  relation_->getBlocksSnapshot(&all_blocks);
+
+  vector<block_id> replaced_blocks;
+  tuple_id replaced_tuples = 0;
+  bool any_other_layout = false;
+  for (vector<block_id>::const_iterator it = all_blocks.begin(); it != all_blocks.end(); ++it) {
+    const TupleStorageSubBlock &tuple_store = storage_manager_->getBlock(*it).getTupleStorageSubBlock();
+    const tuple_id num_tuples = tuple_store.numTuples();
+    if (rewrite_other_layouts_ && hasOtherLayout(*it)) {
+      any_other_layout = true;
+    } else if (num_tuples >= fill_threshold_ * tuple_store.estimateTupleCapacity()) {
+      continue;
+    }
+    replaced_blocks.push_back(*it);
+    replaced_tuples += num_tuples;
+  }
+
+  // A single block with the right layout can only be merged into fewer blocks
+  // if it is empty.
+  if (replaced_blocks.empty()
+      || (!any_other_layout && (replaced_blocks.size() == 1) && (replaced_tuples > 0))) {
+    return 0;
+  }
+
+  // Keep writers out of the blocks being replaced from before they are
+  // copied until they have been swapped out. The latches are held in append
+  // mode, so queries may still read the blocks meanwhile.
+  PtrVector<VersionedLatchAppendLock> replaced_block_locks;
+  for (vector<block_id>::const_iterator it = replaced_blocks.begin(); it != replaced_blocks.end(); ++it) {
+    replaced_block_locks.push_back(
+        new VersionedLatchAppendLock(*storage_manager_->getBlockMutable(*it)->getLatchMutable()));
+  }
+
+  vector<block_id> merged_blocks;
+  if (!mergeBlocks(replaced_blocks, &merged_blocks)
+      || (!any_other_layout && (merged_blocks.size() >= replaced_blocks.size()))
+      || !relation_->replaceBlocks(replaced_blocks, merged_blocks)) {
+    discardBlocks(merged_blocks);
+    return 0;
+  }
+
+  // Refuse any write which is waiting for the latch of a replaced block, since
+  // it would be lost. The latches are still held, so none can get in first.
+  for (vector<block_id>::const_iterator it = replaced_blocks.begin(); it != replaced_blocks.end(); ++it) {
+    storage_manager_->getBlockMutable(*it)->markRetired();
+  }
+
+  // Readers which register after the swap can't see the replaced blocks, so
+  // the current epoch is a safe (if conservative) time of retirement.
+  const size_t retired_epoch = relation_->getBlocksEpoch();
+  MutexLock lock(retired_blocks_mutex_);
+  for (vector<block_id>::const_iterator it = replaced_blocks.begin(); it != replaced_blocks.end(); ++it) {
+    retired_blocks_.push_back(pair<block_id, size_t>(*it, retired_epoch));
+  }
+  return replaced_blocks.size();
+}
+
+void BlockCompactor::startCompaction() {
+  DEBUG_ASSERT(compaction_thread_.empty());
+  compaction_thread_.reset(new block_compactor_internal::CompactionThread(this));
+  compaction_thread_->start();
+}
+
+size_t BlockCompactor::waitForCompaction() {
+  if (compaction_thread_.empty()) {
+    return 0;
+  }
+
+  compaction_thread_->join();
+  const size_t num_replaced_blocks = compaction_thread_->getNumReplacedBlocks();
+  compaction_thread_.reset();
+  return num_replaced_blocks;
+}
+
+size_t BlockCompactor::reclaimRetiredBlocks() {
+  const size_t oldest_reader_epoch = relation_->getOldestBlocksReaderEpoch();
+
+  MutexLock lock(retired_blocks_mutex_);
+  size_t num_reclaimed_blocks = 0;
+  vector<pair<block_id, size_t> >::iterator kept_it = retired_blocks_.begin();
+  for (vector<pair<block_id, size_t> >::const_iterator it = retired_blocks_.begin();
+       it != retired_blocks_.end();
+       ++it) {
+    if (it->second <= oldest_reader_epoch) {
+      storage_manager_->evictBlock(it->first);
+      ++num_reclaimed_blocks;
+    } else {
+      *kept_it = *it;
+      ++kept_it;
+    }
+  }
+  retired_blocks_.erase(kept_it, retired_blocks_.end());
+  return num_reclaimed_blocks;
+}
+
+bool BlockCompactor::mergeBlocks(const vector<block_id> &sources,
+                                 vector<block_id> *merged) {
+  vector<attribute_id> all_attributes;
+  for (CatalogRelation::const_iterator attr_it = relation_->begin();
+       attr_it != relation_->end();
+       ++attr_it) {
+    all_attributes.push_back(attr_it->getID());
+  }
+
+  // Tuples are inserted in batches, and each merged block is only rebuilt
+  // once it is full (rather than once per source block, as
+  // StorageBlock::selectSimple() would), since a rebuilt compressed block can
+  // not take any more batch inserts beyond its delta region.
+  StorageBlock *merged_block = NULL;
+  for (vector<block_id>::const_iterator block_it = sources.begin(); block_it != sources.end(); ++block_it) {
+    const TupleStorageSubBlock &source_store = storage_manager_->getBlock(*block_it).getTupleStorageSubBlock();
+    if (source_store.isEmpty()) {
+      continue;
+    }
+
+    const tuple_id max_tid = source_store.getMaxTupleID();
+    for (tuple_id tid = 0; tid <= max_tid; ++tid) {
+      if (!source_store.hasTupleWithID(tid)) {
+        continue;
+      }
+
+      Tuple tuple(source_store, tid, all_attributes);
+      if (merged_block == NULL) {
+        merged->push_back(storage_manager_->createBlock(*relation_, layout_));
+        merged_block = storage_manager_->getBlockMutable(merged->back());
+      }
+      try {
+        while (!merged_block->insertTupleInBatch(tuple, kNone)) {
+          // Don't swap in a block with an inconsistent index.
+          if (!merged_block->rebuild()) {
+            return false;
+          }
+          merged->push_back(storage_manager_->createBlock(*relation_, layout_));
+          merged_block = storage_manager_->getBlockMutable(merged->back());
+        }
+      } catch (const TupleTooLargeForBlock &e) {
+        // The tuple doesn't fit even in an empty block with 'layout_' (which
+        // may differ from the layout of the block it came from).
+        return false;
+      }
+    }
+  }
+
+  return (merged_block == NULL) || merged_block->rebuild();
+}
+
+bool BlockCompactor::hasOtherLayout(const block_id block) const {
+  return storage_manager_->getBlock(block).getLayoutDescription().SerializeAsString() != layout_serialized_;
+}
+
+void BlockCompactor::discardBlocks(const vector<block_id> &blocks) {
+  for (vector<block_id>::const_iterator it = blocks.begin(); it != blocks.end(); ++it) {
+    storage_manager_->evictBlock(*it);
+  }
+}
+
+}  // namespace quickstep
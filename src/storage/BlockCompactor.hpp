@@ -0,0 +1,205 @@
+/*
+   This file copyright (c) 2011-2013, the Quickstep authors.
+   See file CREDITS.txt for details.
+
+   This file is part of Quickstep.
+
+   Quickstep is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Quickstep is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Quickstep.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICKSTEP_STORAGE_BLOCK_COMPACTOR_HPP_
+#define QUICKSTEP_STORAGE_BLOCK_COMPACTOR_HPP_
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "storage/StorageBlockInfo.hpp"
+#include "threading/Mutex.hpp"
+#include "utility/Macros.hpp"
+#include "utility/ScopedPtr.hpp"
+
+namespace quickstep {
+
+class CatalogRelation;
+class StorageBlockLayout;
+class StorageManager;
+
+namespace block_compactor_internal {
+class CompactionThread;
+}  // namespace block_compactor_internal
+
+/** \addtogroup Storage
+ *  @{
+ */
+
+/**
+ * @brief Merges the under-filled blocks of a relation (e.g. the partially
+ *        filled result blocks left by StorageBlock::select(), or blocks with
+ *        holes left by deletes) into as few full blocks as possible, and
+ *        swaps the merged blocks into the relation in place of the originals.
+ * @note A block is under-filled if the ratio of
+ *       TupleStorageSubBlock::numTuples() to
+ *       TupleStorageSubBlock::estimateTupleCapacity() is below the fill
+ *       threshold. Merged blocks are rebuilt whenever they fill up (and once
+ *       more at the end), so they are re-sorted, re-compressed, and have
+ *       their indices rebuilt as their layout requires.
+ * @note A BlockCompactor may also rewrite blocks which have a different
+ *       layout than the one it uses for merged blocks, regardless of how full
+ *       they are (e.g. to move a relation to the layout recommended by a
+ *       LayoutAdvisor).
+ * @note The swap is done with CatalogRelation::replaceBlocks(), so queries
+ *       which take a snapshot of the relation's blocks see either all of the
+ *       original blocks or all of the merged ones. The original blocks are
+ *       only retired, not freed, since queries holding older snapshots may
+ *       still be reading them. reclaimRetiredBlocks() frees those which no
+ *       such query (registered with CatalogRelation::beginBlocksRead()) can
+ *       still be reading.
+ * @note The latches of the blocks being replaced are held in append mode
+ *       (see StorageBlock::getLatchMutable()) from before they are copied
+ *       until they have been swapped out, so queries may keep reading them,
+ *       and a concurrent write can not leave a merged block with a partial
+ *       copy of a tuple. The replaced blocks are marked as retired (see
+ *       StorageBlock::markRetired()) before their latches are released, so a
+ *       write which was waiting for one is refused rather than lost: inserts
+ *       fail as if the block were full, and deletes and updates throw
+ *       BlockRetired, and should be retried against the relation's current
+ *       blocks.
+ **/
+class BlockCompactor {
+ public:
+  /**
+   * @brief Constructor.
+   *
+   * @param storage_manager The StorageManager which holds the relation's
+   *        blocks.
+   * @param relation The relation whose blocks will be compacted.
+   * @param layout The layout to use for merged blocks. If NULL, defaults to
+   *        relation's default layout.
+   * @param fill_threshold Blocks which are less full than this fraction of
+   *        their estimated capacity are merged.
+   * @param rewrite_other_layouts If true, blocks whose layout differs from
+   *        layout are also rewritten into layout, however full they are.
+   **/
+  BlockCompactor(StorageManager *storage_manager,
+                 CatalogRelation *relation,
+                 const StorageBlockLayout *layout,
+                 const double fill_threshold,
+                 const bool rewrite_other_layouts);
+
+  /**
+   * @brief Destructor. Waits for a background compaction, if any, to finish.
+   * @note Retired blocks which have not been reclaimed are left in the
+   *       StorageManager.
+   **/
+  ~BlockCompactor();
+
+  /**
+   * @brief Find the under-filled blocks of the relation (and those with a
+   *        different layout, if rewriting them) and merge them, blocking until
+   *        the merged blocks have been swapped in.
+   * @note If another thread removes one of the blocks to be replaced from the
+   *       relation in the meantime, if some tuple does not fit in an empty
+   *       block with the merged blocks' layout, or if merging would not
+   *       reduce the number of blocks (and no block is being rewritten into a
+   *       different layout), the merged blocks are discarded and the relation
+   *       is left unchanged.
+   *
+   * @return The number of blocks which were replaced (and retired).
+   **/
+  std::size_t compact();
+
+  /**
+   * @brief Run compact() in a background thread.
+   * @warning Only one compaction may run at a time, so waitForCompaction()
+   *          must be called before starting another.
+   **/
+  void startCompaction();
+
+  /**
+   * @brief Block until a compaction started by startCompaction() has
+   *        finished.
+   *
+   * @return The number of blocks replaced by the compaction (0 if none was
+   *         running).
+   **/
+  std::size_t waitForCompaction();
+
+  /**
+   * @brief Get the number of blocks which have been replaced by merged
+   *        blocks but not yet freed.
+   *
+   * @return The number of retired blocks.
+   **/
+  std::size_t numRetiredBlocks() const {
+    MutexLock lock(retired_blocks_mutex_);
+    return retired_blocks_.size();
+  }
+
+  /**
+   * @brief Evict the retired blocks which no query can still be reading from
+   *        the StorageManager, freeing their slots for reuse. A block is kept
+   *        while any reader which registered with
+   *        CatalogRelation::beginBlocksRead() before it was retired has not
+   *        yet ended its read.
+   * @warning Queries which took an unregistered snapshot of the relation's
+   *          blocks (with CatalogRelation::getBlocksSnapshot()) are not
+   *          tracked, and must have finished before this is called.
+   *
+   * @return The number of blocks which were freed.
+   **/
+  std::size_t reclaimRetiredBlocks();
+
+ private:
+  // Copy every tuple in the blocks 'sources' into newly-created blocks (which
+  // are NOT added to the relation), appending their IDs to 'merged'. Returns
+  // false if rebuilding a merged block left an index inconsistent, or if a
+  // tuple is too large for an empty block with 'layout_'.
+  bool mergeBlocks(const std::vector<block_id> &sources,
+                   std::vector<block_id> *merged);
+
+  // Determine whether 'block' should be rewritten because it was created with
+  // a different layout.
+  bool hasOtherLayout(const block_id block) const;
+
+  // Evict blocks which were never added to the relation.
+  void discardBlocks(const std::vector<block_id> &blocks);
+
+  StorageManager *storage_manager_;
+  CatalogRelation *relation_;
+  const StorageBlockLayout *layout_;
+  const double fill_threshold_;
+  const bool rewrite_other_layouts_;
+
+  // The serialized description of 'layout_', for comparison with the layouts
+  // of existing blocks.
+  std::string layout_serialized_;
+
+  // The running (or finished but not yet joined) background compaction.
+  ScopedPtr<block_compactor_internal::CompactionThread> compaction_thread_;
+
+  // Retired blocks, each paired with the relation's blocks epoch as of when
+  // it was retired.
+  std::vector<std::pair<block_id, std::size_t> > retired_blocks_;
+  mutable Mutex retired_blocks_mutex_;
+
+  DISALLOW_COPY_AND_ASSIGN(BlockCompactor);
+};
+
+/** @} */
+
+}  // namespace quickstep
+
+#endif  // QUICKSTEP_STORAGE_BLOCK_COMPACTOR_HPP_
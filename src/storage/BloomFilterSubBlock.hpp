@@ -12,8 +12,10 @@
 #include "expressions/Predicate.hpp"
 #include "expressions/ComparisonPredicate.hpp"
 #include "storage/StorageBlockInfo.hpp"
+#include "storage/TupleBatch.hpp"
 #include "storage/TupleStorageSubBlock.hpp"
 #include "types/Tuple.hpp"
+#include "types/Type.hpp"
 #include "utility/Macros.hpp"
 #include "utility/BloomFilter.hpp"
 
@@ -85,6 +87,19 @@ class BloomFilterSubBlock {
    **/
   virtual bool addEntry(const Tuple &tuple) = 0;
 
+  /**
+   * @brief Add entries to this bloom filter for a run of tuples in a
+   *        TupleBatch, without building a Tuple for each of them.
+   *
+   * @param batch The TupleBatch which contains the tuples.
+   * @param first_tuple The position in batch of the first tuple to add.
+   * @param num_tuples The number of tuples to add.
+   * @return True if the entries were successfully added, false if not
+   **/
+  virtual bool addEntries(const TupleBatch &batch,
+                          const tuple_id first_tuple,
+                          const tuple_id num_tuples) = 0;
+
   /**
    * @brief Use this bloom filter to check (possibly a superset of) tuples matching a
    *        particular predicate.
@@ -206,6 +221,24 @@ class DefaultBloomFilterSubBlock : public BloomFilterSubBlock {
 	  return true;
   }
 
+  bool addEntries(const TupleBatch &batch, const tuple_id first_tuple, const tuple_id num_tuples) {
+	  // Values in a TupleBatch are fixed-length, so they are hashed in place
+	  // (getInstanceByteLength() is the type's maximumByteLength(), as in
+	  // addEntry()).
+	  CatalogRelation::const_iterator attr_it;
+	  int bloom_filter_id = 0;
+	  for (attr_it = relation_.begin(); attr_it != relation_.end(); ++attr_it, ++bloom_filter_id) {
+		  const std::size_t value_length = attr_it->getType().maximumByteLength();
+		  for (tuple_id tuple = first_tuple; tuple < first_tuple + num_tuples; ++tuple) {
+			  const void *value = batch.getValue(tuple, attr_it->getID());
+			  if (value != NULL) {
+				  bloom_filters_.get()[bloom_filter_id].insert(static_cast<const char*>(value), value_length);
+			  }
+		  }
+	  }
+	  return true;
+  }
+
   bool getMatchesForPredicate(const Predicate *predicate) const {
 	  if (predicate->getPredicateType() == predicate->kComparison) {
 
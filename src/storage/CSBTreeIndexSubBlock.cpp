@@ -38,8 +38,12 @@
 #include "storage/StorageErrors.hpp"
 #include "storage/TupleIdSequence.hpp"
 #include "storage/TupleStorageSubBlock.hpp"
+#include "threading/VersionedLatch.hpp"
 #include "types/Comparison.hpp"
 #include "types/CompressionDictionary.hpp"
+#include "types/IntType.hpp"
+#include "types/LongType.hpp"
+#include "types/Tuple.hpp"
 #include "types/Type.hpp"
 #include "types/TypeInstance.hpp"
 #include "utility/BitVector.hpp"
@@ -49,6 +53,8 @@
 #include "utility/ScopedBuffer.hpp"
 #include "utility/ScopedPtr.hpp"
 
+using std::find;
+using std::int64_t;
 using std::memcpy;
 using std::memmove;
 using std::pair;
@@ -212,6 +218,75 @@ class EntryReferenceComparator<CompressedEntryReference> {
   }
 };
 
+// Collects the tuple IDs of matching entries into a TupleIdSequence.
+class TupleIdMatchCollector {
+ public:
+  TupleIdMatchCollector(const std::size_t key_length_bytes, TupleIdSequence *matches)
+      : key_length_bytes_(key_length_bytes),
+        matches_(matches) {
+  }
+
+  inline void addEntry(const char *entry) {
+    matches_->append(*reinterpret_cast<const tuple_id*>(entry + key_length_bytes_));
+  }
+
+ private:
+  const std::size_t key_length_bytes_;
+  TupleIdSequence *matches_;
+};
+
+// Collects the values of some indexed attributes from matching entries, for
+// index-only scans which do not access the TupleStorageSubBlock.
+class KeyValueMatchCollector {
+ public:
+  KeyValueMatchCollector(const CSBTreeIndexSubBlock &owner,
+                         const std::vector<attribute_id> &attributes,
+                         PtrVector<Tuple> *matches)
+      : owner_(owner),
+        matches_(matches),
+        saw_invalid_key_(false) {
+    key_attribute_positions_.reserve(attributes.size());
+    for (vector<attribute_id>::const_iterator attr_it = attributes.begin();
+         attr_it != attributes.end();
+         ++attr_it) {
+      key_attribute_positions_.push_back(
+          find(owner_.indexed_attribute_ids_.begin(), owner_.indexed_attribute_ids_.end(), *attr_it)
+              - owner_.indexed_attribute_ids_.begin());
+    }
+  }
+
+  inline void addEntry(const char *entry) {
+    if (saw_invalid_key_) {
+      return;
+    }
+
+    Tuple *tuple = new Tuple();
+    matches_->push_back(tuple);
+    for (vector<size_t>::const_iterator position_it = key_attribute_positions_.begin();
+         position_it != key_attribute_positions_.end();
+         ++position_it) {
+      TypeInstance *value = owner_.makeKeyAttributeTypeInstance(entry, *position_it);
+      if (value == NULL) {
+        saw_invalid_key_ = true;
+        return;
+      }
+      tuple->append(value);
+    }
+  }
+
+  // Whether some key could not be decoded, which means the read was torn by
+  // a concurrent writer and the matches are incomplete.
+  bool sawInvalidKey() const {
+    return saw_invalid_key_;
+  }
+
+ private:
+  const CSBTreeIndexSubBlock &owner_;
+  std::vector<std::size_t> key_attribute_positions_;
+  PtrVector<Tuple> *matches_;
+  bool saw_invalid_key_;
+};
+
 }  // namespace csbtree_internal
 
 const int CSBTreeIndexSubBlock::kNodeGroupNone = -1;
@@ -233,6 +308,7 @@ CSBTreeIndexSubBlock::CSBTreeIndexSubBlock(const TupleStorageSubBlock &tuple_sto
       key_may_be_compressed_(false),
       key_is_compressed_(false),
       key_is_nullable_(false),
+      node_size_bytes_(GetNodeSizeBytes(description)),
       next_free_node_group_(kNodeGroupNone),
       num_free_node_groups_(0) {
   if (!DescriptionIsValid(relation_, description_)) {
@@ -259,7 +335,13 @@ CSBTreeIndexSubBlock::CSBTreeIndexSubBlock(const TupleStorageSubBlock &tuple_sto
     indexed_attribute_ids_.push_back(indexed_attribute_id);
 
     // TODO(chasseur): Support a composite key with compressed parts.
-    if ((!key_is_composite_) && tuple_store_.isCompressed()) {
+    //
+    // Tuples inserted ad-hoc go to the uncompressed delta region of a
+    // compressed block, and have no codes, so keys are only compressed if the
+    // tuple store doesn't accept ad-hoc inserts.
+    if ((!key_is_composite_)
+        && tuple_store_.isCompressed()
+        && !tuple_store_.supportsAdHocInsert()) {
       const CompressedTupleStorageSubBlock &compressed_tuple_store
           = static_cast<const CompressedTupleStorageSubBlock&>(tuple_store_);
       if (compressed_tuple_store.compressedBlockIsBuilt()) {
@@ -308,6 +390,18 @@ bool CSBTreeIndexSubBlock::DescriptionIsValid(const CatalogRelation &relation,
     return false;
   }
 
+  // Check that the node size, if specified, is a power of two in the allowed
+  // range.
+  if (description.HasExtension(CSBTreeIndexSubBlockDescription::node_size_bytes)) {
+    const size_t node_size_bytes
+        = description.GetExtension(CSBTreeIndexSubBlockDescription::node_size_bytes);
+    if ((node_size_bytes < kCSBTreeMinNodeSizeBytes)
+        || (node_size_bytes > kCSBTreeMaxNodeSizeBytes)
+        || (node_size_bytes & (node_size_bytes - 1))) {
+      return false;
+    }
+  }
+
   // Check that all key attributes exist and are fixed-length.
   for (int indexed_attribute_num = 0;
        indexed_attribute_num < description.ExtensionSize(CSBTreeIndexSubBlockDescription::indexed_attribute_id);
@@ -346,17 +440,19 @@ std::size_t CSBTreeIndexSubBlock::EstimateBytesPerTuple(
   return (5 * key_length) >> 1;
 }
 
+std::size_t CSBTreeIndexSubBlock::GetNodeSizeBytes(const IndexSubBlockDescription &description) {
+  if (description.HasExtension(CSBTreeIndexSubBlockDescription::node_size_bytes)) {
+    return description.GetExtension(CSBTreeIndexSubBlockDescription::node_size_bytes);
+  } else {
+    return kCSBTreeNodeSizeBytes;
+  }
+}
+
 bool CSBTreeIndexSubBlock::addEntry(const tuple_id tuple) {
   DEBUG_ASSERT(initialized_);
   DEBUG_ASSERT(tuple_store_.hasTupleWithID(tuple));
 
-  void *root_node = getRootNode();
-  NodeHeader super_root;
-  super_root.num_keys = 0;
-  super_root.is_leaf = false;
-  super_root.node_group_reference = getRootNodeGroupNumber();
-
-  InsertReturnValue retval;
+  VersionedLatchWriteLock lock(latch_);
 
   if (key_is_composite_) {
     ScopedBuffer composite_key_buffer(makeKeyCopy(tuple));
@@ -369,19 +465,7 @@ bool CSBTreeIndexSubBlock::addEntry(const tuple_id tuple) {
       DEBUG_ASSERT(!composite_key_buffer.empty());
     }
 
-    if (static_cast<NodeHeader*>(root_node)->is_leaf) {
-      retval = leafInsertHelper(0,
-                                tuple,
-                                composite_key_buffer.get(),
-                                &super_root,
-                                root_node);
-    } else {
-      retval = internalInsertHelper(0,
-                                    tuple,
-                                    composite_key_buffer.get(),
-                                    &super_root,
-                                    root_node);
-    }
+    return insertEntry(tuple, composite_key_buffer.get());
   } else if (key_is_compressed_) {
     // Don't insert a NULL key.
     if (key_is_nullable_) {
@@ -404,14 +488,11 @@ bool CSBTreeIndexSubBlock::addEntry(const tuple_id tuple) {
                                                              indexed_attribute_ids_.front());
     switch (compressed_tuple_store.compressedGetCompressedAttributeSize(indexed_attribute_ids_.front())) {
       case 1:
-        retval = compressedKeyAddEntryHelper<uint8_t>(tuple, code, super_root, root_node);
-        break;
+        return compressedKeyAddEntryHelper<uint8_t>(tuple, code);
       case 2:
-        retval = compressedKeyAddEntryHelper<uint16_t>(tuple, code, super_root, root_node);
-        break;
+        return compressedKeyAddEntryHelper<uint16_t>(tuple, code);
       case 4:
-        retval = compressedKeyAddEntryHelper<uint32_t>(tuple, code, super_root, root_node);
-        break;
+        return compressedKeyAddEntryHelper<uint32_t>(tuple, code);
       default:
         FATAL_ERROR("Unexpected compressed key byte-length (not 1, 2, or 4) encountered "
                     "in CSBTreeIndexSubBlock::addEntry()");
@@ -427,19 +508,7 @@ bool CSBTreeIndexSubBlock::addEntry(const tuple_id tuple) {
       DEBUG_ASSERT(key_ptr != NULL);
     }
 
-    if (static_cast<NodeHeader*>(root_node)->is_leaf) {
-      retval = leafInsertHelper(0,
-                                tuple,
-                                key_ptr,
-                                &super_root,
-                                root_node);
-    } else {
-      retval = internalInsertHelper(0,
-                                    tuple,
-                                    key_ptr,
-                                    &super_root,
-                                    root_node);
-    }
+    return insertEntry(tuple, key_ptr);
   } else {
     ScopedPtr<TypeInstance> typed_key(tuple_store_.getAttributeValueTyped(tuple, indexed_attribute_ids_.front()));
     if (key_is_nullable_) {
@@ -451,19 +520,106 @@ bool CSBTreeIndexSubBlock::addEntry(const tuple_id tuple) {
       DEBUG_ASSERT(!typed_key->isNull());
     }
 
-    if (static_cast<NodeHeader*>(root_node)->is_leaf) {
-      retval = leafInsertHelper(0,
-                                tuple,
-                                typed_key->getDataPtr(),
-                                &super_root,
-                                root_node);
-    } else {
-      retval = internalInsertHelper(0,
-                                    tuple,
-                                    typed_key->getDataPtr(),
-                                    &super_root,
-                                    root_node);
+    return insertEntry(tuple, typed_key->getDataPtr());
+  }
+}
+
+bool CSBTreeIndexSubBlock::bulkAddEntries(const TupleIdSequence &tuples) {
+  VersionedLatchWriteLock lock(latch_);
+
+  if (!initialized_) {
+    // The index can't be built incrementally until the tuple store has been
+    // built (see initialize()).
+    return rebuildTree();
+  }
+
+  if (tuples.empty()) {
+    return true;
+  }
+
+  if (static_cast<tuple_id>(tuples.size() << 1) >= tuple_store_.numTuples()) {
+    // The batch is at least as large as the existing contents of the index,
+    // so it's cheaper to just rebuild.
+    return rebuildTree();
+  }
+
+  if (key_is_compressed_) {
+    const CompressedTupleStorageSubBlock &compressed_tuple_store
+        = static_cast<const CompressedTupleStorageSubBlock&>(tuple_store_);
+
+    vector<csbtree_internal::CompressedEntryReference> entries;
+    entries.reserve(tuples.size());
+    for (TupleIdSequence::const_iterator tuple_it = tuples.begin();
+         tuple_it != tuples.end();
+         ++tuple_it) {
+      // Don't insert a NULL key.
+      if (key_is_nullable_
+          && compressed_tuple_store.compressedIsNull(*tuple_it, indexed_attribute_ids_.front())) {
+        continue;
+      }
+      entries.push_back(csbtree_internal::CompressedEntryReference(
+          compressed_tuple_store.compressedGetCode(*tuple_it, indexed_attribute_ids_.front()),
+          *tuple_it));
     }
+    return insertEntryReferences<csbtree_internal::CompressedEntryReference>(&entries);
+  } else {
+    vector<csbtree_internal::EntryReference> entries;
+    entries.reserve(tuples.size());
+    // These scoped containers automatically deallocate heap-allocated key copies
+    // when they go out of scope.
+    PtrVector<ScopedBuffer> composite_key_buffers;
+    PtrVector<TypeInstance> literal_typed_keys;
+
+    for (TupleIdSequence::const_iterator tuple_it = tuples.begin();
+         tuple_it != tuples.end();
+         ++tuple_it) {
+      DEBUG_ASSERT(tuple_store_.hasTupleWithID(*tuple_it));
+      // Don't insert a NULL key.
+      if (key_is_composite_) {
+        void *key_copy = makeKeyCopy(*tuple_it);
+        if (key_copy != NULL) {
+          composite_key_buffers.push_back(new ScopedBuffer(key_copy));
+          entries.push_back(csbtree_internal::EntryReference(composite_key_buffers.back().get(), *tuple_it));
+        }
+      } else if (tuple_store_supports_untyped_ptr_) {
+        const void *key_ptr = tuple_store_.getAttributeValue(*tuple_it, indexed_attribute_ids_.front());
+        if (key_ptr != NULL) {
+          entries.push_back(csbtree_internal::EntryReference(key_ptr, *tuple_it));
+        }
+      } else {
+        ScopedPtr<TypeInstance> literal_key(tuple_store_.getAttributeValueTyped(*tuple_it,
+                                                                                indexed_attribute_ids_.front()));
+        if (!literal_key->isNull()) {
+          literal_typed_keys.push_back(literal_key.release());
+          entries.push_back(csbtree_internal::EntryReference(literal_typed_keys.back().getDataPtr(), *tuple_it));
+        }
+      }
+    }
+
+    return insertEntryReferences<csbtree_internal::EntryReference>(&entries);
+  }
+}
+
+bool CSBTreeIndexSubBlock::insertEntry(const tuple_id tuple, const void *key) {
+  void *root_node = getRootNode();
+  NodeHeader super_root;
+  super_root.num_keys = 0;
+  super_root.is_leaf = false;
+  super_root.node_group_reference = getRootNodeGroupNumber();
+
+  InsertReturnValue retval;
+  if (static_cast<NodeHeader*>(root_node)->is_leaf) {
+    retval = leafInsertHelper(0,
+                              tuple,
+                              key,
+                              &super_root,
+                              root_node);
+  } else {
+    retval = internalInsertHelper(0,
+                                  tuple,
+                                  key,
+                                  &super_root,
+                                  root_node);
   }
 
   if (retval.new_node_group_id == kNodeGroupFull) {
@@ -498,6 +654,8 @@ bool CSBTreeIndexSubBlock::addEntry(const tuple_id tuple) {
 
 void CSBTreeIndexSubBlock::removeEntry(const tuple_id tuple) {
   DEBUG_ASSERT(initialized_);
+
+  VersionedLatchWriteLock lock(latch_);
   if (key_is_composite_) {
     ScopedBuffer composite_key_buffer(makeKeyCopy(tuple));
     if (key_is_nullable_) {
@@ -582,15 +740,102 @@ void CSBTreeIndexSubBlock::removeEntry(const tuple_id tuple) {
   }
 }
 
+bool CSBTreeIndexSubBlock::canEvaluatePredicate(const Predicate &predicate) const {
+  if (!initialized_ || key_is_composite_ || !predicate.isAttributeLiteralComparisonPredicate()) {
+    return false;
+  }
+
+  const ComparisonPredicate &comparison_predicate = static_cast<const ComparisonPredicate&>(predicate);
+  const Scalar &attribute_operand = comparison_predicate.getLeftOperand().hasStaticValue()
+                                    ? comparison_predicate.getRightOperand()
+                                    : comparison_predicate.getLeftOperand();
+  return static_cast<const ScalarAttribute&>(attribute_operand).getAttribute().getID()
+         == indexed_attribute_ids_.front();
+}
+
 IndexSearchResult CSBTreeIndexSubBlock::getMatchesForPredicate(const Predicate &predicate) const {
   DEBUG_ASSERT(initialized_);
+
+  IndexSearchResult result;
+  result.is_superset = false;
+
+  // Search optimistically, and start over if a writer modified the tree in
+  // the meantime.
+  for (;;) {
+    const size_t version = latch_.beginRead();
+    ScopedPtr<TupleIdSequence> matches(new TupleIdSequence());
+    csbtree_internal::TupleIdMatchCollector collector(key_length_bytes_, matches.get());
+    evaluatePredicate(predicate, &collector);
+    if (latch_.validateRead(version)) {
+      result.sequence = matches.release();
+      return result;
+    }
+  }
+}
+
+bool CSBTreeIndexSubBlock::dependsOnAttributes(const std::vector<attribute_id> &attributes) const {
+  for (vector<attribute_id>::const_iterator attr_it = attributes.begin();
+       attr_it != attributes.end();
+       ++attr_it) {
+    if (find(indexed_attribute_ids_.begin(), indexed_attribute_ids_.end(), *attr_it)
+        != indexed_attribute_ids_.end()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool CSBTreeIndexSubBlock::coversAttributes(const std::vector<attribute_id> &attributes) const {
+  // Predicates on composite keys can't be evaluated yet (see
+  // evaluatePredicate()), so composite keys cover nothing.
+  if (!initialized_ || key_is_composite_) {
+    return false;
+  }
+
+  for (vector<attribute_id>::const_iterator attr_it = attributes.begin();
+       attr_it != attributes.end();
+       ++attr_it) {
+    if (find(indexed_attribute_ids_.begin(), indexed_attribute_ids_.end(), *attr_it)
+        == indexed_attribute_ids_.end()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+PtrVector<Tuple, false>* CSBTreeIndexSubBlock::getMatchingValuesForPredicate(
+    const Predicate &predicate,
+    const std::vector<attribute_id> &attributes) const {
+  DEBUG_ASSERT(initialized_);
+  DEBUG_ASSERT(coversAttributes(attributes));
+
+  // Search optimistically, and start over if a writer modified the tree in
+  // the meantime.
+  for (;;) {
+    const size_t version = latch_.beginRead();
+    ScopedPtr<PtrVector<Tuple> > matches(new PtrVector<Tuple>());
+    csbtree_internal::KeyValueMatchCollector collector(*this, attributes, matches.get());
+    evaluatePredicate(predicate, &collector);
+    if (latch_.validateRead(version)) {
+      if (collector.sawInvalidKey()) {
+        FATAL_ERROR("Encountered an invalid compressed key in a CSBTreeIndexSubBlock "
+                    "which was not being modified.");
+      }
+      return matches.release();
+    }
+  }
+}
+
+template <class MatchCollectorT>
+void CSBTreeIndexSubBlock::evaluatePredicate(const Predicate &predicate,
+                                             MatchCollectorT *collector) const {
   if (key_is_composite_) {
     // TODO(chasseur): Evaluate predicates on composite keys.
-    FATAL_ERROR("CSBTreeIndexSubBlock::getMatchesForPredicate() is unimplemented for composite keys.");
+    FATAL_ERROR("CSBTreeIndexSubBlock::evaluatePredicate() is unimplemented for composite keys.");
   }
 
   if (!predicate.isAttributeLiteralComparisonPredicate()) {
-    FATAL_ERROR("CSBTreeIndexSubBlock::getMatchesForPredicate() can not "
+    FATAL_ERROR("CSBTreeIndexSubBlock::evaluatePredicate() can not "
                 "evaluate predicates other than simple comparisons.");
   }
 
@@ -611,7 +856,7 @@ IndexSearchResult CSBTreeIndexSubBlock::getMatchesForPredicate(const Predicate &
   }
 
   if (comparison_attribute->getID() != indexed_attribute_ids_.front()) {
-    FATAL_ERROR("CSBTreeIndexSubBlock::getMatchesForPredicate() can not "
+    FATAL_ERROR("CSBTreeIndexSubBlock::evaluatePredicate() can not "
                 "evaluate predicates on non-indexed attributes.");
   }
 
@@ -622,12 +867,8 @@ IndexSearchResult CSBTreeIndexSubBlock::getMatchesForPredicate(const Predicate &
     comparison_literal = &(comparison_predicate.getRightOperand().getStaticValue());
   }
 
-  IndexSearchResult result;
-  result.is_superset = false;
-
   if (comparison_literal->isNull()) {
-    result.sequence = new TupleIdSequence();
-    return result;
+    return;
   }
 
   // If the literal is on the left, flip the comparison around.
@@ -652,14 +893,18 @@ IndexSearchResult CSBTreeIndexSubBlock::getMatchesForPredicate(const Predicate &
   }
 
   if (key_is_compressed_) {
-    result.sequence = evaluateComparisonPredicateOnCompressedKey(comp, *comparison_literal);
+    evaluateComparisonPredicateOnCompressedKey(comp, *comparison_literal, collector);
   } else {
-    result.sequence = evaluateComparisonPredicateOnUncompressedKey(comp, *comparison_literal);
+    evaluateComparisonPredicateOnUncompressedKey(comp, *comparison_literal, collector);
   }
-  return result;
 }
 
 bool CSBTreeIndexSubBlock::rebuild() {
+  VersionedLatchWriteLock lock(latch_);
+  return rebuildTree();
+}
+
+bool CSBTreeIndexSubBlock::rebuildTree() {
   if (!initialized_) {
     if (!initialize(false)) {
       return false;
@@ -737,9 +982,9 @@ bool CSBTreeIndexSubBlock::initialize(const bool new_block) {
 
   // Compute the number of keys that can be stored in internal and leaf nodes.
   // Internal nodes are just a header and a list of keys.
-  max_keys_internal_ = (kCSBTreeNodeSizeBytes - sizeof(NodeHeader)) / key_length_bytes_;
+  max_keys_internal_ = (node_size_bytes_ - sizeof(NodeHeader)) / key_length_bytes_;
   // Leaf nodes are a header, plus a list of (key, tuple_id) pairs.
-  max_keys_leaf_ = (kCSBTreeNodeSizeBytes - sizeof(NodeHeader)) / key_tuple_id_pair_length_bytes_;
+  max_keys_leaf_ = (node_size_bytes_ - sizeof(NodeHeader)) / key_tuple_id_pair_length_bytes_;
   if ((max_keys_internal_ < 2) || (max_keys_leaf_ < 2)) {
     if (new_block) {
       throw CSBTreeKeyTooLarge();
@@ -779,7 +1024,7 @@ bool CSBTreeIndexSubBlock::initialize(const bool new_block) {
         .makeUncheckedComparatorForTypes(attr_type, attr_type));
   }
 
-  node_group_size_bytes_ = kCSBTreeNodeSizeBytes * (max_keys_internal_ + 1);
+  node_group_size_bytes_ = node_size_bytes_ * (max_keys_internal_ + 1);
 
   // Perform this computation on the order of bits.
   size_t num_node_groups = ((sub_block_memory_size_ - sizeof(int)) << 3)
@@ -791,14 +1036,14 @@ bool CSBTreeIndexSubBlock::initialize(const bool new_block) {
   size_t header_size_bytes = sizeof(int) + BitVector::BytesNeeded(num_node_groups);
 
   // Node groups start after the header, and should be aligned to
-  // kCSBTreeNodeSizeBytes (i.e. cache lines). In some circumstances, the
-  // alignment requirement forces us to use one less node group than would
-  // otherwise be possible.
+  // node_size_bytes_ (i.e. a whole number of cache lines). In some
+  // circumstances, the alignment requirement forces us to use one less node
+  // group than would otherwise be possible.
   node_groups_start_ = static_cast<char*>(sub_block_memory_) + header_size_bytes;
-  if (reinterpret_cast<size_t>(node_groups_start_) & (kCSBTreeNodeSizeBytes - 1)) {
+  if (reinterpret_cast<size_t>(node_groups_start_) & (node_size_bytes_ - 1)) {
     node_groups_start_ = static_cast<char*>(node_groups_start_)
-                         + kCSBTreeNodeSizeBytes
-                         - (reinterpret_cast<size_t>(node_groups_start_) & (kCSBTreeNodeSizeBytes - 1));
+                         + node_size_bytes_
+                         - (reinterpret_cast<size_t>(node_groups_start_) & (node_size_bytes_ - 1));
   }
 
   // Adjust num_node_groups as necessary for aligned nodes.
@@ -915,18 +1160,23 @@ void* CSBTreeIndexSubBlock::findLeafWithComparators(
     const void *literal,
     const UncheckedComparator &literal_less_key_comparator,
     const UncheckedComparator &key_less_literal_comparator) const {
+  if (node == NULL) {
+    return NULL;
+  }
   const NodeHeader *node_header = static_cast<const NodeHeader*>(node);
   if (node_header->is_leaf) {
     return const_cast<void*>(node);
   }
+  const uint16_t num_keys = (node_header->num_keys < max_keys_internal_) ? node_header->num_keys
+                                                                         : max_keys_internal_;
   for (uint16_t key_num = 0;
-       key_num < node_header->num_keys;
+       key_num < num_keys;
        ++key_num) {
     if (literal_less_key_comparator.compareDataPtrs(literal,
                                                     static_cast<const char*>(node)
                                                         + sizeof(NodeHeader)
                                                         + key_num * key_length_bytes_)) {
-      return findLeafWithComparators(getNode(node_header->node_group_reference, key_num),
+      return findLeafWithComparators(getNodeForRead(node_header->node_group_reference, key_num),
                                      literal,
                                      literal_less_key_comparator,
                                      key_less_literal_comparator);
@@ -939,46 +1189,53 @@ void* CSBTreeIndexSubBlock::findLeafWithComparators(
 
       // NOTE(chasseur): If duplicate keys are not allowed, this branch is
       // not necessary, and searches can be done slightly more efficiently.
-      return findLeafWithComparators(getNode(node_header->node_group_reference, key_num),
+      return findLeafWithComparators(getNodeForRead(node_header->node_group_reference, key_num),
                                      literal,
                                      literal_less_key_comparator,
                                      key_less_literal_comparator);
     }
   }
-  return findLeafWithComparators(getNode(node_header->node_group_reference, node_header->num_keys),
+  return findLeafWithComparators(getNodeForRead(node_header->node_group_reference, num_keys),
                                  literal,
                                  literal_less_key_comparator,
                                  key_less_literal_comparator);
 }
 
 void* CSBTreeIndexSubBlock::getLeftmostLeaf() const {
-  void* node = getRootNode();
-  while (!static_cast<const NodeHeader*>(node)->is_leaf) {
-    node = getNode(static_cast<const NodeHeader*>(node)->node_group_reference, 0);
+  void* node = getRootNodeForRead();
+  while ((node != NULL) && !static_cast<const NodeHeader*>(node)->is_leaf) {
+    node = getNodeForRead(static_cast<const NodeHeader*>(node)->node_group_reference, 0);
   }
   return node;
 }
 
 template <typename CodeType>
-CSBTreeIndexSubBlock::InsertReturnValue CSBTreeIndexSubBlock::compressedKeyAddEntryHelper(
-    const tuple_id tuple,
-    const std::uint32_t compressed_code,
-    const NodeHeader &super_root,
-    void *root_node) {
+bool CSBTreeIndexSubBlock::compressedKeyAddEntryHelper(const tuple_id tuple,
+                                                       const std::uint32_t compressed_code) {
   CodeType actual_code = compressed_code;
-  if (static_cast<NodeHeader*>(root_node)->is_leaf) {
-    return leafInsertHelper(0,
-                            tuple,
-                            &actual_code,
-                            &super_root,
-                            root_node);
-  } else {
-    return internalInsertHelper(0,
-                                tuple,
-                                &actual_code,
-                                &super_root,
-                                root_node);
+  return insertEntry(tuple, &actual_code);
+}
+
+template <class EntryReferenceT>
+bool CSBTreeIndexSubBlock::insertEntryReferences(std::vector<EntryReferenceT> *entry_references) {
+  // Sort the batch by key, so that consecutive insertions descend to the same
+  // or adjacent leaves.
+  sort(entry_references->begin(),
+       entry_references->end(),
+       csbtree_internal::EntryReferenceComparator<EntryReferenceT>(*key_comparator_));
+
+  for (typename vector<EntryReferenceT>::const_iterator entry_it = entry_references->begin();
+       entry_it != entry_references->end();
+       ++entry_it) {
+    // NOTE(chasseur): For compressed keys, getKeyPtr() points to a uint32_t
+    // code, of which only the first key_length_bytes_ are copied into the
+    // index (as in buildLeavesFromEntryReferences()).
+    if (!insertEntry(entry_it->getTupleID(), entry_it->getKeyPtr())) {
+      return false;
+    }
   }
+
+  return true;
 }
 
 CSBTreeIndexSubBlock::InsertReturnValue CSBTreeIndexSubBlock::internalInsertHelper(
@@ -1044,6 +1301,7 @@ CSBTreeIndexSubBlock::InsertReturnValue CSBTreeIndexSubBlock::internalInsertHelp
 
   InsertReturnValue retval;
   bool child_split_across_groups = !child_return_value.left_split_group_smaller
+                                   && (small_half_num_children_ != large_half_num_children_)
                                    && (key_num == small_half_num_children_);
   if (child_return_value.new_node_group_id != kNodeGroupNone) {
     // A new node group was allocated, and this node must be split.
@@ -1088,7 +1346,7 @@ CSBTreeIndexSubBlock::InsertReturnValue CSBTreeIndexSubBlock::internalInsertHelp
       if (group_end == NULL) {
         node = getNode(retval.new_node_group_id, 0);
       } else {
-        node = static_cast<char*>(node) + kCSBTreeNodeSizeBytes;
+        node = static_cast<char*>(node) + node_size_bytes_;
       }
     }
   }
@@ -1185,7 +1443,7 @@ CSBTreeIndexSubBlock::InsertReturnValue CSBTreeIndexSubBlock::leafInsertHelper(
         node = getNode(retval.new_node_group_id, 0);
       } else {
         retval.split_node_least_key = splitNodeInGroup(node, group_end, kNodeGroupNone, false, false);
-        node = static_cast<char*>(node) + kCSBTreeNodeSizeBytes;
+        node = static_cast<char*>(node) + node_size_bytes_;
       }
     }
   }
@@ -1206,19 +1464,17 @@ const void* CSBTreeIndexSubBlock::splitNodeGroupHelper(
     return getNode(parent_node_header->node_group_reference, small_half_num_children_);
   } else {
     caller_return_value->left_split_group_smaller = false;
-    if (*node == center_node) {
+    if ((*node == center_node) && (small_half_num_children_ != large_half_num_children_)) {
       caller_return_value->new_node_group_id = splitNodeGroup(parent_node_header, false, true);
       return NULL;
     } else {
       caller_return_value->new_node_group_id = splitNodeGroup(parent_node_header, false, false);
-      if (static_cast<const NodeHeader*>(*node)->node_group_reference >= 0) {
-        *node = static_cast<char*>(getNode(caller_return_value->new_node_group_id, 0))
-                + (static_cast<const char*>(*node) - static_cast<const char*>(center_node))
-                - kCSBTreeNodeSizeBytes;
-      } else {
-        *node = static_cast<char*>(getNode(caller_return_value->new_node_group_id, 0))
-                + (static_cast<const char*>(*node) - static_cast<const char*>(center_node));
-      }
+      // Nodes from large_half_num_children_ onwards were moved to the start of
+      // the new group.
+      *node = static_cast<char*>(getNode(caller_return_value->new_node_group_id, 0))
+              + (static_cast<const char*>(*node)
+                 - static_cast<const char*>(getNode(parent_node_header->node_group_reference,
+                                                    large_half_num_children_)));
       return getNode(caller_return_value->new_node_group_id, small_half_num_children_);
     }
   }
@@ -1249,14 +1505,14 @@ int CSBTreeIndexSubBlock::splitNodeGroup(const NodeHeader *parent_node_header,
   if (left_smaller) {
     memcpy(copy_destination,
            getNode(parent_node_header->node_group_reference, small_half_num_children_),
-           large_half_num_children_ * kCSBTreeNodeSizeBytes);
+           large_half_num_children_ * node_size_bytes_);
     rightmost_remaining_node_header
         = static_cast<NodeHeader*>(getNode(parent_node_header->node_group_reference,
                                            small_half_num_children_ - 1));
   } else {
     memcpy(copy_destination,
            getNode(parent_node_header->node_group_reference, large_half_num_children_),
-           small_half_num_children_ * kCSBTreeNodeSizeBytes);
+           small_half_num_children_ * node_size_bytes_);
     rightmost_remaining_node_header
         = static_cast<NodeHeader*>(getNode(parent_node_header->node_group_reference,
                                            large_half_num_children_ - 1));
@@ -1289,10 +1545,10 @@ const void* CSBTreeIndexSubBlock::splitNodeInGroup(void *node,
     DEBUG_ASSERT(node_header->num_keys == max_keys_internal_);
   }
 
-  void *next_node = static_cast<char*>(node) + kCSBTreeNodeSizeBytes;
+  void *next_node = static_cast<char*>(node) + node_size_bytes_;
   if (group_end != next_node) {
     // Shift subsequent nodes right.
-    memmove(static_cast<char*>(next_node) + kCSBTreeNodeSizeBytes,
+    memmove(static_cast<char*>(next_node) + node_size_bytes_,
             next_node,
             static_cast<const char*>(group_end) - static_cast<char*>(next_node));
   }
@@ -1549,9 +1805,11 @@ void CSBTreeIndexSubBlock::removeEntryFromLeaf(const tuple_id tuple, const void
   }
 }
 
-TupleIdSequence* CSBTreeIndexSubBlock::evaluateComparisonPredicateOnUncompressedKey(
+template <class MatchCollectorT>
+void CSBTreeIndexSubBlock::evaluateComparisonPredicateOnUncompressedKey(
     const Comparison::ComparisonID comp,
-    const TypeInstance &right_literal) const {
+    const TypeInstance &right_literal,
+    MatchCollectorT *collector) const {
   DEBUG_ASSERT(!key_is_compressed_);
   DEBUG_ASSERT(!key_is_composite_);
 
@@ -1581,38 +1839,52 @@ TupleIdSequence* CSBTreeIndexSubBlock::evaluateComparisonPredicateOnUncompressed
 
   switch (comp) {
     case Comparison::kEqual:
-      return evaluateEqualPredicate(right_literal.getDataPtr(),
-                                    *literal_less_key_comparator_ptr,
-                                    *key_less_literal_comparator_ptr);
+      evaluateEqualPredicate(right_literal.getDataPtr(),
+                             *literal_less_key_comparator_ptr,
+                             *key_less_literal_comparator_ptr,
+                             collector);
+      return;
     case Comparison::kNotEqual:
-      return evaluateNotEqualPredicate(right_literal.getDataPtr(),
-                                       *literal_less_key_comparator_ptr,
-                                       *key_less_literal_comparator_ptr);
+      evaluateNotEqualPredicate(right_literal.getDataPtr(),
+                                *literal_less_key_comparator_ptr,
+                                *key_less_literal_comparator_ptr,
+                                collector);
+      return;
     case Comparison::kLess:
-      return evaluateLessPredicate<false>(right_literal.getDataPtr(),
-                                          *literal_less_key_comparator_ptr,
-                                          *key_less_literal_comparator_ptr);
+      evaluateLessPredicate<false>(right_literal.getDataPtr(),
+                                   *literal_less_key_comparator_ptr,
+                                   *key_less_literal_comparator_ptr,
+                                   collector);
+      return;
     case Comparison::kLessOrEqual:
-      return evaluateLessPredicate<true>(right_literal.getDataPtr(),
-                                         *literal_less_key_comparator_ptr,
-                                         *key_less_literal_comparator_ptr);
+      evaluateLessPredicate<true>(right_literal.getDataPtr(),
+                                  *literal_less_key_comparator_ptr,
+                                  *key_less_literal_comparator_ptr,
+                                  collector);
+      return;
     case Comparison::kGreater:
-      return evaluateGreaterPredicate<false>(right_literal.getDataPtr(),
-                                             *literal_less_key_comparator_ptr,
-                                             *key_less_literal_comparator_ptr);
+      evaluateGreaterPredicate<false>(right_literal.getDataPtr(),
+                                      *literal_less_key_comparator_ptr,
+                                      *key_less_literal_comparator_ptr,
+                                      collector);
+      return;
     case Comparison::kGreaterOrEqual:
-      return evaluateGreaterPredicate<true>(right_literal.getDataPtr(),
-                                            *literal_less_key_comparator_ptr,
-                                            *key_less_literal_comparator_ptr);
+      evaluateGreaterPredicate<true>(right_literal.getDataPtr(),
+                                     *literal_less_key_comparator_ptr,
+                                     *key_less_literal_comparator_ptr,
+                                     collector);
+      return;
     default:
       FATAL_ERROR("Unknown Comparison in CSBTreeIndexSubBlock"
                   "::evaluateComparisonPredicateOnUncompressedKey()");
   }
 }
 
-TupleIdSequence* CSBTreeIndexSubBlock::evaluateComparisonPredicateOnCompressedKey(
+template <class MatchCollectorT>
+void CSBTreeIndexSubBlock::evaluateComparisonPredicateOnCompressedKey(
     Comparison::ComparisonID comp,
-    const TypeInstance &right_literal) const {
+    const TypeInstance &right_literal,
+    MatchCollectorT *collector) const {
   DEBUG_ASSERT(key_is_compressed_);
   DEBUG_ASSERT(!key_is_composite_);
 
@@ -1632,13 +1904,14 @@ TupleIdSequence* CSBTreeIndexSubBlock::evaluateComparisonPredicateOnCompressedKe
       case Comparison::kEqual:
         byte_code = short_code = word_code = dict.getCodeForTypedValue(right_literal);
         if (word_code == dict.numberOfCodes()) {
-          return new TupleIdSequence();
+          return;
         }
         break;
       case Comparison::kNotEqual:
         byte_code = short_code = word_code = dict.getCodeForTypedValue(right_literal);
         if (word_code == dict.numberOfCodes()) {
-          return tuple_store_.getMatchesForPredicate(NULL);
+          collectAllEntries(collector);
+          return;
         }
         break;
       default:
@@ -1646,7 +1919,8 @@ TupleIdSequence* CSBTreeIndexSubBlock::evaluateComparisonPredicateOnCompressedKe
           pair<uint32_t, uint32_t> limits = dict.getLimitCodesForComparisonTyped(comp, right_literal);
           if (limits.first == 0) {
             if (limits.second == dict.numberOfCodes()) {
-              return tuple_store_.getMatchesForPredicate(NULL);
+              collectAllEntries(collector);
+              return;
             } else {
               byte_code = short_code = word_code = limits.second;
               comp = Comparison::kLess;
@@ -1667,17 +1941,22 @@ TupleIdSequence* CSBTreeIndexSubBlock::evaluateComparisonPredicateOnCompressedKe
         comp,
         indexed_attribute_ids_.front(),
         right_literal)) {
-      return tuple_store_.getMatchesForPredicate(NULL);
+      collectAllEntries(collector);
+      return;
     } else if (compressed_tuple_store.compressedComparisonIsAlwaysFalseForTruncatedAttribute(
         comp,
         indexed_attribute_ids_.front(),
         right_literal)) {
-      return new TupleIdSequence();
+      return;
     } else {
       switch (comp) {
         case Comparison::kEqual:
         case Comparison::kNotEqual:
-          byte_code = short_code = word_code = right_literal.numericGetLongValue();
+          byte_code = short_code = word_code
+              = compressed_tuple_store.compressedGetEffectiveCodeForComparisonWithTruncatedAttribute(
+                  comp,
+                  indexed_attribute_ids_.front(),
+                  right_literal);
           break;
         // Adjustments for kLessOrEqual and kGreater make predicate evaluation
         // a bit more efficient (particularly in the presence of repeated
@@ -1691,21 +1970,24 @@ TupleIdSequence* CSBTreeIndexSubBlock::evaluateComparisonPredicateOnCompressedKe
         case Comparison::kLessOrEqual:
           comp = Comparison::kLess;
           byte_code = short_code = word_code
-              = 1 + CompressedTupleStorageSubBlock::GetEffectiveLiteralValueForComparisonWithTruncatedAttribute(
+              = 1 + compressed_tuple_store.compressedGetEffectiveCodeForComparisonWithTruncatedAttribute(
                   comp,
+                  indexed_attribute_ids_.front(),
                   right_literal);
           break;
         case Comparison::kGreater:
           comp = Comparison::kGreaterOrEqual;
           byte_code = short_code = word_code
-              = 1 + CompressedTupleStorageSubBlock::GetEffectiveLiteralValueForComparisonWithTruncatedAttribute(
+              = 1 + compressed_tuple_store.compressedGetEffectiveCodeForComparisonWithTruncatedAttribute(
                   comp,
+                  indexed_attribute_ids_.front(),
                   right_literal);
           break;
         default:
           byte_code = short_code = word_code
-              = CompressedTupleStorageSubBlock::GetEffectiveLiteralValueForComparisonWithTruncatedAttribute(
+              = compressed_tuple_store.compressedGetEffectiveCodeForComparisonWithTruncatedAttribute(
                   comp,
+                  indexed_attribute_ids_.front(),
                   right_literal);
           break;
       }
@@ -1729,21 +2011,29 @@ TupleIdSequence* CSBTreeIndexSubBlock::evaluateComparisonPredicateOnCompressedKe
 
   switch (comp) {
     case Comparison::kEqual:
-      return evaluateEqualPredicate(data_ptr,
-                                    *key_comparator_,
-                                    *key_comparator_);
+      evaluateEqualPredicate(data_ptr,
+                             *key_comparator_,
+                             *key_comparator_,
+                             collector);
+      return;
     case Comparison::kNotEqual:
-      return evaluateNotEqualPredicate(data_ptr,
-                                       *key_comparator_,
-                                       *key_comparator_);
+      evaluateNotEqualPredicate(data_ptr,
+                                *key_comparator_,
+                                *key_comparator_,
+                                collector);
+      return;
     case Comparison::kLess:
-      return evaluateLessPredicate<false>(data_ptr,
-                                          *key_comparator_,
-                                          *key_comparator_);
+      evaluateLessPredicate<false>(data_ptr,
+                                   *key_comparator_,
+                                   *key_comparator_,
+                                   collector);
+      return;
     case Comparison::kGreaterOrEqual:
-      return evaluateGreaterPredicate<true>(data_ptr,
-                                            *key_comparator_,
-                                            *key_comparator_);
+      evaluateGreaterPredicate<true>(data_ptr,
+                                     *key_comparator_,
+                                     *key_comparator_,
+                                     collector);
+      return;
     default:
       // Note: kLessOrEqual and kGreater will already be adjusted to kLess or
       // KGreaterOrEqual.
@@ -1752,20 +2042,19 @@ TupleIdSequence* CSBTreeIndexSubBlock::evaluateComparisonPredicateOnCompressedKe
   }
 }
 
-TupleIdSequence* CSBTreeIndexSubBlock::evaluateEqualPredicate(
+template <class MatchCollectorT>
+void CSBTreeIndexSubBlock::evaluateEqualPredicate(
     const void *literal,
     const UncheckedComparator &literal_less_key_comparator,
-    const UncheckedComparator &key_less_literal_comparator) const {
-  ScopedPtr<TupleIdSequence> matches(new TupleIdSequence());
-
+    const UncheckedComparator &key_less_literal_comparator,
+    MatchCollectorT *collector) const {
   bool match_found = false;
-  const void *search_node = findLeafWithComparators(getRootNode(),
+  const void *search_node = findLeafWithComparators(getRootNodeForRead(),
                                                     literal,
                                                     literal_less_key_comparator,
                                                     key_less_literal_comparator);
   while (search_node != NULL) {
-    DEBUG_ASSERT(static_cast<const NodeHeader*>(search_node)->is_leaf);
-    uint16_t num_keys = static_cast<const NodeHeader*>(search_node)->num_keys;
+    uint16_t num_keys = getNumKeysInLeafForRead(search_node);
     const char *key_ptr = static_cast<const char*>(search_node) + sizeof(NodeHeader);
     for (uint16_t entry_num = 0; entry_num < num_keys; ++entry_num) {
       if (!match_found) {
@@ -1777,57 +2066,50 @@ TupleIdSequence* CSBTreeIndexSubBlock::evaluateEqualPredicate(
       if (match_found) {
         if (literal_less_key_comparator.compareDataPtrs(literal, key_ptr)) {
           // End of matches.
-          return matches.release();
+          return;
         }
-        matches->append(*reinterpret_cast<const tuple_id*>(key_ptr + key_length_bytes_));
+        collector->addEntry(key_ptr);
       }
       key_ptr += key_tuple_id_pair_length_bytes_;
     }
-    search_node = getRightSiblingOfLeafNode(search_node);
+    search_node = getRightSiblingOfLeafNodeForRead(search_node);
   }
-
-  return matches.release();
 }
 
-TupleIdSequence* CSBTreeIndexSubBlock::evaluateNotEqualPredicate(
+template <class MatchCollectorT>
+void CSBTreeIndexSubBlock::evaluateNotEqualPredicate(
     const void *literal,
     const UncheckedComparator &literal_less_key_comparator,
-    const UncheckedComparator &key_less_literal_comparator) const {
-  ScopedPtr<TupleIdSequence> matches(new TupleIdSequence());
-
-  const void *boundary_node = findLeafWithComparators(getRootNode(),
+    const UncheckedComparator &key_less_literal_comparator,
+    MatchCollectorT *collector) const {
+  const void *boundary_node = findLeafWithComparators(getRootNodeForRead(),
                                                       literal,
                                                       literal_less_key_comparator,
                                                       key_less_literal_comparator);
   const void *search_node = getLeftmostLeaf();
 
   // Fill in all tuples from leaves definitively less than the key.
-  while (search_node != boundary_node) {
-    DEBUG_ASSERT(search_node != NULL);
-    DEBUG_ASSERT(static_cast<const NodeHeader*>(search_node)->is_leaf);
-    uint16_t num_keys = static_cast<const NodeHeader*>(search_node)->num_keys;
-    const char *tuple_id_ptr = static_cast<const char*>(search_node)
-                               + sizeof(NodeHeader)
-                               + key_length_bytes_;
+  while ((search_node != NULL) && (search_node != boundary_node)) {
+    uint16_t num_keys = getNumKeysInLeafForRead(search_node);
+    const char *entry_ptr = static_cast<const char*>(search_node) + sizeof(NodeHeader);
     for (uint16_t entry_num = 0; entry_num < num_keys; ++entry_num) {
-      matches->append(*reinterpret_cast<const tuple_id*>(tuple_id_ptr));
-      tuple_id_ptr += key_tuple_id_pair_length_bytes_;
+      collector->addEntry(entry_ptr);
+      entry_ptr += key_tuple_id_pair_length_bytes_;
     }
-    search_node = getRightSiblingOfLeafNode(search_node);
+    search_node = getRightSiblingOfLeafNodeForRead(search_node);
   }
 
   // Actually do comparisons in leaves that may contain the literal key.
   bool equal_found = false;
   bool past_equal = false;
   while (search_node != NULL) {
-    DEBUG_ASSERT(static_cast<const NodeHeader*>(search_node)->is_leaf);
-    uint16_t num_keys = static_cast<const NodeHeader*>(search_node)->num_keys;
+    uint16_t num_keys = getNumKeysInLeafForRead(search_node);
     const char *key_ptr = static_cast<const char*>(search_node) + sizeof(NodeHeader);
     for (uint16_t entry_num = 0; entry_num < num_keys; ++entry_num) {
       if (!equal_found) {
         if (key_less_literal_comparator.compareDataPtrs(key_ptr, literal)) {
           // key < literal
-          matches->append(*reinterpret_cast<const tuple_id*>(key_ptr + key_length_bytes_));
+          collector->addEntry(key_ptr);
         } else {
           equal_found = true;
         }
@@ -1840,7 +2122,7 @@ TupleIdSequence* CSBTreeIndexSubBlock::evaluateNotEqualPredicate(
           for (uint16_t subsequent_num = entry_num;
                subsequent_num < num_keys;
                ++subsequent_num) {
-            matches->append(*reinterpret_cast<const tuple_id*>(key_ptr + key_length_bytes_));
+            collector->addEntry(key_ptr);
             key_ptr += key_tuple_id_pair_length_bytes_;
           }
           past_equal = true;
@@ -1849,7 +2131,7 @@ TupleIdSequence* CSBTreeIndexSubBlock::evaluateNotEqualPredicate(
       }
       key_ptr += key_tuple_id_pair_length_bytes_;
     }
-    search_node = getRightSiblingOfLeafNode(search_node);
+    search_node = getRightSiblingOfLeafNodeForRead(search_node);
     if (past_equal) {
       break;
     }
@@ -1857,61 +2139,50 @@ TupleIdSequence* CSBTreeIndexSubBlock::evaluateNotEqualPredicate(
 
   // Fill in all tuples from leaves definitively greater than the key.
   while (search_node != NULL) {
-    DEBUG_ASSERT(static_cast<const NodeHeader*>(search_node)->is_leaf);
-    uint16_t num_keys = static_cast<const NodeHeader*>(search_node)->num_keys;
-    const char *tuple_id_ptr = static_cast<const char*>(search_node)
-                               + sizeof(NodeHeader)
-                               + key_length_bytes_;
+    uint16_t num_keys = getNumKeysInLeafForRead(search_node);
+    const char *entry_ptr = static_cast<const char*>(search_node) + sizeof(NodeHeader);
     for (uint16_t entry_num = 0; entry_num < num_keys; ++entry_num) {
-      matches->append(*reinterpret_cast<const tuple_id*>(tuple_id_ptr));
-      tuple_id_ptr += key_tuple_id_pair_length_bytes_;
+      collector->addEntry(entry_ptr);
+      entry_ptr += key_tuple_id_pair_length_bytes_;
     }
-    search_node = getRightSiblingOfLeafNode(search_node);
+    search_node = getRightSiblingOfLeafNodeForRead(search_node);
   }
-
-  return matches.release();
 }
 
-template <bool include_equal>
-TupleIdSequence* CSBTreeIndexSubBlock::evaluateLessPredicate(
+template <bool include_equal, class MatchCollectorT>
+void CSBTreeIndexSubBlock::evaluateLessPredicate(
     const void *literal,
     const UncheckedComparator &literal_less_key_comparator,
-    const UncheckedComparator &key_less_literal_comparator) const {
-  ScopedPtr<TupleIdSequence> matches(new TupleIdSequence());
-
-  const void *boundary_node = findLeafWithComparators(getRootNode(),
+    const UncheckedComparator &key_less_literal_comparator,
+    MatchCollectorT *collector) const {
+  const void *boundary_node = findLeafWithComparators(getRootNodeForRead(),
                                                       literal,
                                                       literal_less_key_comparator,
                                                       key_less_literal_comparator);
   const void *search_node = getLeftmostLeaf();
 
   // Fill in all tuples from leaves definitively less than the key.
-  while (search_node != boundary_node) {
-    DEBUG_ASSERT(search_node != NULL);
-    DEBUG_ASSERT(static_cast<const NodeHeader*>(search_node)->is_leaf);
-    uint16_t num_keys = static_cast<const NodeHeader*>(search_node)->num_keys;
-    const char *tuple_id_ptr = static_cast<const char*>(search_node)
-                               + sizeof(NodeHeader)
-                               + key_length_bytes_;
+  while ((search_node != NULL) && (search_node != boundary_node)) {
+    uint16_t num_keys = getNumKeysInLeafForRead(search_node);
+    const char *entry_ptr = static_cast<const char*>(search_node) + sizeof(NodeHeader);
     for (uint16_t entry_num = 0; entry_num < num_keys; ++entry_num) {
-      matches->append(*reinterpret_cast<const tuple_id*>(tuple_id_ptr));
-      tuple_id_ptr += key_tuple_id_pair_length_bytes_;
+      collector->addEntry(entry_ptr);
+      entry_ptr += key_tuple_id_pair_length_bytes_;
     }
-    search_node = getRightSiblingOfLeafNode(search_node);
+    search_node = getRightSiblingOfLeafNodeForRead(search_node);
   }
 
   // Actually do comparisons in leaves that may contain the literal key.
   if (include_equal) {
     bool equal_found = false;
     while (search_node != NULL) {
-      DEBUG_ASSERT(static_cast<const NodeHeader*>(search_node)->is_leaf);
-      uint16_t num_keys = static_cast<const NodeHeader*>(search_node)->num_keys;
+      uint16_t num_keys = getNumKeysInLeafForRead(search_node);
       const char *key_ptr = static_cast<const char*>(search_node) + sizeof(NodeHeader);
       for (uint16_t entry_num = 0; entry_num < num_keys; ++entry_num) {
         if (!equal_found) {
           if (key_less_literal_comparator.compareDataPtrs(key_ptr, literal)) {
             // key < literal
-            matches->append(*reinterpret_cast<const tuple_id*>(key_ptr + key_length_bytes_));
+            collector->addEntry(key_ptr);
           } else {
             equal_found = true;
           }
@@ -1920,45 +2191,41 @@ TupleIdSequence* CSBTreeIndexSubBlock::evaluateLessPredicate(
         if (equal_found) {
           if (literal_less_key_comparator.compareDataPtrs(literal, key_ptr)) {
             // literal < key
-            return matches.release();
+            return;
           } else {
-            matches->append(*reinterpret_cast<const tuple_id*>(key_ptr + key_length_bytes_));
+            collector->addEntry(key_ptr);
           }
         }
 
         key_ptr += key_tuple_id_pair_length_bytes_;
       }
-      search_node = getRightSiblingOfLeafNode(search_node);
+      search_node = getRightSiblingOfLeafNodeForRead(search_node);
     }
   } else {
     while (search_node != NULL) {
-      DEBUG_ASSERT(static_cast<const NodeHeader*>(search_node)->is_leaf);
-      uint16_t num_keys = static_cast<const NodeHeader*>(search_node)->num_keys;
+      uint16_t num_keys = getNumKeysInLeafForRead(search_node);
       const char *key_ptr = static_cast<const char*>(search_node) + sizeof(NodeHeader);
       for (uint16_t entry_num = 0; entry_num < num_keys; ++entry_num) {
         if (key_less_literal_comparator.compareDataPtrs(key_ptr, literal)) {
           // key < literal
-          matches->append(*reinterpret_cast<const tuple_id*>(key_ptr + key_length_bytes_));
+          collector->addEntry(key_ptr);
         } else {
-          return matches.release();
+          return;
         }
         key_ptr += key_tuple_id_pair_length_bytes_;
       }
-      search_node = getRightSiblingOfLeafNode(search_node);
+      search_node = getRightSiblingOfLeafNodeForRead(search_node);
     }
   }
-
-  return matches.release();
 }
 
-template <bool include_equal>
-TupleIdSequence* CSBTreeIndexSubBlock::evaluateGreaterPredicate(
+template <bool include_equal, class MatchCollectorT>
+void CSBTreeIndexSubBlock::evaluateGreaterPredicate(
     const void *literal,
     const UncheckedComparator &literal_less_key_comparator,
-    const UncheckedComparator &key_less_literal_comparator) const {
-  ScopedPtr<TupleIdSequence> matches(new TupleIdSequence());
-
-  const void *search_node = findLeafWithComparators(getRootNode(),
+    const UncheckedComparator &key_less_literal_comparator,
+    MatchCollectorT *collector) const {
+  const void *search_node = findLeafWithComparators(getRootNodeForRead(),
                                                     literal,
                                                     literal_less_key_comparator,
                                                     key_less_literal_comparator);
@@ -1966,8 +2233,7 @@ TupleIdSequence* CSBTreeIndexSubBlock::evaluateGreaterPredicate(
   // Do comparisons in leaves that may contain the literal key.
   bool match_found = false;
   while (search_node != NULL) {
-    DEBUG_ASSERT(static_cast<const NodeHeader*>(search_node)->is_leaf);
-    uint16_t num_keys = static_cast<const NodeHeader*>(search_node)->num_keys;
+    uint16_t num_keys = getNumKeysInLeafForRead(search_node);
     const char *key_ptr = static_cast<const char*>(search_node) + sizeof(NodeHeader);
     for (uint16_t entry_num = 0; entry_num < num_keys; ++entry_num) {
       if (include_equal) {
@@ -1983,7 +2249,7 @@ TupleIdSequence* CSBTreeIndexSubBlock::evaluateGreaterPredicate(
       if (match_found) {
         // Fill in the matching entries from this leaf.
         for (uint16_t match_num = entry_num; match_num < num_keys; ++match_num) {
-          matches->append(*reinterpret_cast<const tuple_id*>(key_ptr + key_length_bytes_));
+          collector->addEntry(key_ptr);
           key_ptr += key_tuple_id_pair_length_bytes_;
         }
         break;
@@ -1992,7 +2258,7 @@ TupleIdSequence* CSBTreeIndexSubBlock::evaluateGreaterPredicate(
       key_ptr += key_tuple_id_pair_length_bytes_;
     }
 
-    search_node = getRightSiblingOfLeafNode(search_node);
+    search_node = getRightSiblingOfLeafNodeForRead(search_node);
     if (match_found) {
       break;
     }
@@ -2000,19 +2266,82 @@ TupleIdSequence* CSBTreeIndexSubBlock::evaluateGreaterPredicate(
 
   // Fill in all tuples from leaves definitively greater than the key.
   while (search_node != NULL) {
-    DEBUG_ASSERT(static_cast<const NodeHeader*>(search_node)->is_leaf);
-    uint16_t num_keys = static_cast<const NodeHeader*>(search_node)->num_keys;
-    const char *tuple_id_ptr = static_cast<const char*>(search_node)
-                               + sizeof(NodeHeader)
-                               + key_length_bytes_;
+    uint16_t num_keys = getNumKeysInLeafForRead(search_node);
+    const char *entry_ptr = static_cast<const char*>(search_node) + sizeof(NodeHeader);
     for (uint16_t entry_num = 0; entry_num < num_keys; ++entry_num) {
-      matches->append(*reinterpret_cast<const tuple_id*>(tuple_id_ptr));
-      tuple_id_ptr += key_tuple_id_pair_length_bytes_;
+      collector->addEntry(entry_ptr);
+      entry_ptr += key_tuple_id_pair_length_bytes_;
     }
-    search_node = getRightSiblingOfLeafNode(search_node);
+    search_node = getRightSiblingOfLeafNodeForRead(search_node);
   }
+}
 
-  return matches.release();
+template <class MatchCollectorT>
+void CSBTreeIndexSubBlock::collectAllEntries(MatchCollectorT *collector) const {
+  const void *search_node = getLeftmostLeaf();
+  while (search_node != NULL) {
+    uint16_t num_keys = getNumKeysInLeafForRead(search_node);
+    const char *entry_ptr = static_cast<const char*>(search_node) + sizeof(NodeHeader);
+    for (uint16_t entry_num = 0; entry_num < num_keys; ++entry_num) {
+      collector->addEntry(entry_ptr);
+      entry_ptr += key_tuple_id_pair_length_bytes_;
+    }
+    search_node = getRightSiblingOfLeafNodeForRead(search_node);
+  }
+}
+
+TypeInstance* CSBTreeIndexSubBlock::makeKeyAttributeTypeInstance(
+    const void *key,
+    const std::size_t indexed_attribute_num) const {
+  const attribute_id attr_id = indexed_attribute_ids_[indexed_attribute_num];
+  const Type &attr_type = relation_.getAttributeById(attr_id).getType();
+  const char *attr_ptr = static_cast<const char*>(key) + indexed_attribute_offsets_[indexed_attribute_num];
+  if (!key_is_compressed_) {
+    // Copy the value, since a writer may change '*key' (e.g. by splitting
+    // its node) once the caller's read has been validated.
+    ScopedPtr<TypeInstance> value_reference(attr_type.makeReferenceTypeInstance(attr_ptr));
+    return value_reference->makeCopy();
+  }
+
+  DEBUG_ASSERT(!key_is_composite_);
+  uint32_t code;
+  switch (key_length_bytes_) {
+    case 1:
+      code = *reinterpret_cast<const uint8_t*>(attr_ptr);
+      break;
+    case 2:
+      code = *reinterpret_cast<const uint16_t*>(attr_ptr);
+      break;
+    case 4:
+      code = *reinterpret_cast<const uint32_t*>(attr_ptr);
+      break;
+    default:
+      FATAL_ERROR("Unexpected compressed key byte-length (not 1, 2, or 4) encountered "
+                  "in CSBTreeIndexSubBlock::makeKeyAttributeTypeInstance()");
+  }
+
+  const CompressedTupleStorageSubBlock &compressed_tuple_store
+      = static_cast<const CompressedTupleStorageSubBlock&>(tuple_store_);
+  if (compressed_tuple_store.compressedAttributeIsDictionaryCompressed(attr_id)) {
+    const CompressionDictionary &dictionary = compressed_tuple_store.compressedGetDictionary(attr_id);
+    if (code >= dictionary.numberOfCodes()) {
+      // '*key' was torn by a concurrent writer.
+      return NULL;
+    }
+    ScopedPtr<TypeInstance> value_reference(dictionary.getTypedValueForCode(code));
+    return value_reference->makeCopy();
+  } else {
+    // Truncated codes are the values of Int or Long attributes relative to
+    // the attribute's frame of reference.
+    DEBUG_ASSERT(compressed_tuple_store.compressedAttributeIsTruncationCompressed(attr_id));
+    const int64_t value = code + compressed_tuple_store.compressedGetFrameOfReference(attr_id);
+    if (attr_type.getTypeID() == Type::kInt) {
+      return static_cast<const IntType&>(attr_type).makeLiteralTypeInstance(static_cast<int>(value));
+    } else {
+      DEBUG_ASSERT(attr_type.getTypeID() == Type::kLong);
+      return static_cast<const LongType&>(attr_type).makeLiteralTypeInstance(value);
+    }
+  }
 }
 
 bool CSBTreeIndexSubBlock::rebuildSpaceCheck() const {
@@ -2116,7 +2445,7 @@ std::uint16_t CSBTreeIndexSubBlock::buildLeavesFromEntryReferences(
         // Use the next node in the current group.
         reinterpret_cast<NodeHeader*>(node_ptr)->node_group_reference = kNodeGroupNextLeaf;
         ++current_node_number;
-        node_ptr += kCSBTreeNodeSizeBytes;
+        node_ptr += node_size_bytes_;
       }
       // Set up new leaf node's header.
       // If this node is not totally full (i.e. it is the rightmost leaf),
@@ -2181,9 +2510,6 @@ void CSBTreeIndexSubBlock::generateEntryReferencesFromUntypedPtrs(
 void CSBTreeIndexSubBlock::generateEntryReferencesFromCompressedCodes(
     std::vector<csbtree_internal::CompressedEntryReference> *entry_references) const {
   DEBUG_ASSERT(key_is_compressed_);
-  // TODO(chasseur): Handle NULL in compressed blocks (currently unsupported,
-  // but may be in the future).
-  DEBUG_ASSERT(!key_is_nullable_);
   DEBUG_ASSERT(entry_references->empty());
 
   DEBUG_ASSERT(tuple_store_.isCompressed());
@@ -2193,15 +2519,14 @@ void CSBTreeIndexSubBlock::generateEntryReferencesFromCompressedCodes(
   DEBUG_ASSERT(compressed_tuple_store.compressedAttributeIsDictionaryCompressed(indexed_attribute_ids_.front())
                || compressed_tuple_store.compressedAttributeIsTruncationCompressed(indexed_attribute_ids_.front()));
 
-  if (tuple_store_.isPacked()) {
-    for (tuple_id tid = 0; tid <= tuple_store_.getMaxTupleID(); ++tid) {
-      entry_references->push_back(csbtree_internal::CompressedEntryReference(
-          compressed_tuple_store.compressedGetCode(tid, indexed_attribute_ids_.front()),
-          tid));
-    }
-  } else {
-    for (tuple_id tid = 0; tid <= tuple_store_.getMaxTupleID(); ++tid) {
-      if (tuple_store_.hasTupleWithID(tid)) {
+  tuple_id null_count = 0;
+  for (tuple_id tid = 0; tid <= tuple_store_.getMaxTupleID(); ++tid) {
+    if (tuple_store_.isPacked() || tuple_store_.hasTupleWithID(tid)) {
+      // Don't insert a NULL key.
+      if (key_is_nullable_
+          && compressed_tuple_store.compressedIsNull(tid, indexed_attribute_ids_.front())) {
+        ++null_count;
+      } else {
         entry_references->push_back(csbtree_internal::CompressedEntryReference(
             compressed_tuple_store.compressedGetCode(tid, indexed_attribute_ids_.front()),
             tid));
@@ -2210,7 +2535,7 @@ void CSBTreeIndexSubBlock::generateEntryReferencesFromCompressedCodes(
   }
 
   DEBUG_ASSERT(static_cast<vector<csbtree_internal::CompressedEntryReference>::size_type>(tuple_store_.numTuples())
-               == entry_references->size());
+               == entry_references->size() + null_count);
 }
 
 void CSBTreeIndexSubBlock::generateEntryReferencesFromTypeInstances(
@@ -2357,11 +2682,11 @@ uint16_t CSBTreeIndexSubBlock::rebalanceNodeGroups(const int full_node_group_num
   // Shift existing nodes in underfull node group right.
   memmove(getNode(underfull_node_group_number, shift_nodes),
           getNode(underfull_node_group_number, 0),
-          underfull_num_nodes * kCSBTreeNodeSizeBytes);
+          underfull_num_nodes * node_size_bytes_);
   // Copy nodes from full node group over.
   memcpy(getNode(underfull_node_group_number, 0),
          getNode(full_node_group_number, full_group_remaining_nodes),
-         shift_nodes * kCSBTreeNodeSizeBytes);
+         shift_nodes * node_size_bytes_);
 
   // If the rebalanced nodes are leaves, correct the sibling references.
   NodeHeader *full_group_last_header
@@ -27,6 +27,7 @@
 
 #include "storage/IndexSubBlock.hpp"
 #include "storage/StorageConstants.hpp"
+#include "threading/VersionedLatch.hpp"
 #include "types/Comparison.hpp"
 #include "utility/BitVector.hpp"
 #include "utility/CstdintCompat.hpp"
@@ -40,12 +41,15 @@ class CSBTreePrettyPrinter;
 class IndexSubBlockDescription;
 template <typename T, bool null_allowed> class PtrVector;
 class ScopedBuffer;
+class Tuple;
+class TupleIdSequence;
 class TypeInstance;
 
 namespace csbtree_internal {
 class CompositeKeyLessComparator;
 class EntryReference;
 class CompressedEntryReference;
+class KeyValueMatchCollector;
 }  // namespace csbtree_internal
 
 /** \addtogroup Storage
@@ -68,6 +72,11 @@ class CSBTreeKeyTooLarge : public std::exception {
 /**
  * @brief An IndexSubBlock which implements a full CSB+-tree with linear scan
  *        intra-node search.
+ * @note Searches (getMatchesForPredicate() and
+ *       getMatchingValuesForPredicate()) are latch-free, and may run
+ *       concurrently with a writer which is adding or removing entries.
+ *       Writers are serialized by a VersionedLatch. Searches traverse the
+ *       tree optimistically and are retried if a writer intervened.
  * @warning This IndexSubBlock only supports fixed-length attributes, and the
  *          total key length must be small enough to fit at least 2 keys in a
  *          node.
@@ -117,6 +126,17 @@ class CSBTreeIndexSubBlock : public IndexSubBlock {
   static std::size_t EstimateBytesPerTuple(const CatalogRelation &relation,
                                            const IndexSubBlockDescription &description);
 
+  /**
+   * @brief Get the size of each node, in bytes, for a CSBTreeIndexSubBlock
+   *        described by description.
+   *
+   * @param description A description of the parameters for this type of
+   *        IndexSubBlock.
+   * @return The node size specified by description, or kCSBTreeNodeSizeBytes
+   *         if description does not specify a node size.
+   **/
+  static std::size_t GetNodeSizeBytes(const IndexSubBlockDescription &description);
+
   IndexSubBlockType getIndexSubBlockType() const {
     return kCSBTree;
   }
@@ -131,14 +151,48 @@ class CSBTreeIndexSubBlock : public IndexSubBlock {
 
   bool addEntry(const tuple_id tuple);
 
+  /**
+   * @note Entries for 'tuples' are sorted by key and then inserted in key
+   *       order, so that each affected leaf is visited once, in sequence,
+   *       and node (group) splits proceed from left to right. The cost is
+   *       proportional to the size of the batch rather than the size of the
+   *       whole index. If the batch is at least as large as the existing
+   *       contents of the index, the index is simply rebuilt instead, since
+   *       this is cheaper and packs entries more tightly.
+   **/
+  bool bulkAddEntries(const TupleIdSequence &tuples);
+
   void removeEntry(const tuple_id tuple);
 
+  bool dependsOnAttributes(const std::vector<attribute_id> &attributes) const;
+
+  /**
+   * @note Currently this version only accepts simple comparisons of a literal
+   *       value with a non-composite key.
+   **/
+  bool canEvaluatePredicate(const Predicate &predicate) const;
+
   /**
    * @note Currently this version only supports simple comparisons of a literal
    *       value with a non-composite key.
    **/
   IndexSearchResult getMatchesForPredicate(const Predicate &predicate) const;
 
+  /**
+   * @note Currently only the attribute of a non-composite key is covered.
+   *       Compressed keys are decompressed as values are produced.
+   **/
+  bool coversAttributes(const std::vector<attribute_id> &attributes) const;
+
+  /**
+   * @note Currently this version only supports the same predicates as
+   *       getMatchesForPredicate(). Matches are produced in key order by a
+   *       sequential walk of the leaves.
+   **/
+  PtrVector<Tuple, false>* getMatchingValuesForPredicate(
+      const Predicate &predicate,
+      const std::vector<attribute_id> &attributes) const;
+
   bool rebuild();
 
  private:
@@ -178,6 +232,10 @@ class CSBTreeIndexSubBlock : public IndexSubBlock {
   // called by rebuild().
   bool initialize(const bool new_block);
 
+  // Does the actual work of rebuild(). The caller must hold 'latch_' for
+  // writing.
+  bool rebuildTree();
+
   // Get the number of the node group containing the root node for the tree.
   inline int getRootNodeGroupNumber() const {
     return *static_cast<const int*>(sub_block_memory_);
@@ -194,7 +252,7 @@ class CSBTreeIndexSubBlock : public IndexSubBlock {
     DEBUG_ASSERT(node_group_number >= 0);
     return static_cast<char*>(node_groups_start_)
            + node_group_number * node_group_size_bytes_
-           + node_number * kCSBTreeNodeSizeBytes;
+           + node_number * node_size_bytes_;
   }
 
   // Get the root node of the tree.
@@ -208,7 +266,7 @@ class CSBTreeIndexSubBlock : public IndexSubBlock {
     DEBUG_ASSERT(static_cast<const NodeHeader*>(node)->is_leaf);
     const int sibling_reference = static_cast<const NodeHeader*>(node)->node_group_reference;
     if (sibling_reference == kNodeGroupNextLeaf) {
-      return const_cast<char*>(static_cast<const char*>(node) + kCSBTreeNodeSizeBytes);
+      return const_cast<char*>(static_cast<const char*>(node) + node_size_bytes_);
     } else if (sibling_reference >= 0) {
       return getNode(sibling_reference, 0);
     } else {
@@ -217,6 +275,58 @@ class CSBTreeIndexSubBlock : public IndexSubBlock {
     }
   }
 
+  // The following methods are used by readers, which traverse the tree
+  // optimistically and may run concurrently with a writer (see 'latch_').
+  // Node references and key counts are checked before they are used, so that
+  // a reader never strays outside of this IndexSubBlock, and NULL is returned
+  // to cut a traversal short if a write is in progress (the read will then
+  // fail validation and be retried).
+
+  // Get the location of the node designated by 'node_number' in the group
+  // with 'node_group_number', or NULL if it doesn't exist.
+  inline void* getNodeForRead(const int node_group_number, const std::uint16_t node_number) const {
+    if ((node_group_number < 0)
+        || (static_cast<std::size_t>(node_group_number) >= node_group_used_bitmap_->size())
+        || (node_number > max_keys_internal_)
+        || latch_.writeInProgress()) {
+      return NULL;
+    }
+    return getNode(node_group_number, node_number);
+  }
+
+  // Get the root node of the tree, or NULL if the root reference is invalid.
+  inline void* getRootNodeForRead() const {
+    return getNodeForRead(getRootNodeGroupNumber(), 0);
+  }
+
+  // Get the number of entries in the leaf node '*node', or 0 if '*node' is
+  // not a leaf.
+  inline std::uint16_t getNumKeysInLeafForRead(const void *node) const {
+    const NodeHeader *node_header = static_cast<const NodeHeader*>(node);
+    if (!node_header->is_leaf) {
+      return 0;
+    }
+    return (node_header->num_keys < max_keys_leaf_) ? node_header->num_keys : max_keys_leaf_;
+  }
+
+  // Same as getRightSiblingOfLeafNode(), but also returns NULL if '*node' is
+  // not a leaf or its sibling reference is invalid.
+  inline void* getRightSiblingOfLeafNodeForRead(const void *node) const {
+    const NodeHeader *node_header = static_cast<const NodeHeader*>(node);
+    if (!node_header->is_leaf) {
+      return NULL;
+    }
+    const int sibling_reference = node_header->node_group_reference;
+    if (sibling_reference == kNodeGroupNextLeaf) {
+      const std::size_t node_offset = static_cast<const char*>(node)
+                                      - static_cast<const char*>(node_groups_start_);
+      return getNodeForRead(node_offset / node_group_size_bytes_,
+                            (node_offset % node_group_size_bytes_) / node_size_bytes_ + 1);
+    } else {
+      return getNodeForRead(sibling_reference, 0);
+    }
+  }
+
   // Remove all entries and reset this to an empty index.
   void clearIndex();
 
@@ -235,23 +345,37 @@ class CSBTreeIndexSubBlock : public IndexSubBlock {
   // Specialized version of findLeaf() which uses 'literal_less_key_comparator'
   // and 'key_less_literal_comparator' to compare '*literal' with keys in
   // '*node'. This is intended for searches where '*literal' is not the same
-  // exact type as the keys, but it comparable to them.
+  // exact type as the keys, but it comparable to them. This is used by
+  // readers, and returns NULL if the traversal is cut short (see
+  // getNodeForRead()).
   void* findLeafWithComparators(const void *node,
                                 const void *literal,
                                 const UncheckedComparator &literal_less_key_comparator,
                                 const UncheckedComparator &key_less_literal_comparator) const;
 
-  // Get the very first leaf node in the tree.
+  // Get the very first leaf node in the tree. This is used by readers, and
+  // returns NULL if the traversal is cut short (see getNodeForRead()).
   void* getLeftmostLeaf() const;
 
+  // Attempt to insert the entry (*key, tuple) in the index, allocating a new
+  // root if the old root is split. Returns false if there are not enough free
+  // node groups to insert the entry.
+  bool insertEntry(const tuple_id tuple, const void *key);
+
   // Attempt to insert the entry (compressed_code, tuple) in the index.
   // 'CodeType' is the compressed type of the code (either uint8_t, uint16_t,
   // or uint32_t).
   template <typename CodeType>
-  InsertReturnValue compressedKeyAddEntryHelper(const tuple_id tuple,
-                                                const std::uint32_t compressed_code,
-                                                const NodeHeader &super_root,
-                                                void *root_node);
+  bool compressedKeyAddEntryHelper(const tuple_id tuple,
+                                   const std::uint32_t compressed_code);
+
+  // Helper method for bulkAddEntries(). Sorts '*entry_references' by key, then
+  // inserts all of them with insertEntry(). Templated on 'EntryReferenceT' so
+  // that it may be used with both EntryReference and CompressedEntryReference.
+  // Returns false if the index ran out of space (in which case only some of
+  // the entries may have been inserted).
+  template <class EntryReferenceT>
+  bool insertEntryReferences(std::vector<EntryReferenceT> *entry_references);
 
   // Insert the entry (*key, tuple) into the appropriate leaf descendent of
   // '*node'. 'node_group_allocation_requirement' is the number of node group
@@ -410,61 +534,91 @@ class CSBTreeIndexSubBlock : public IndexSubBlock {
   // will be recursively called with the right-sibling of '*node'.
   void removeEntryFromLeaf(const tuple_id tuple, const void *key, void *node);
 
-  // Helper method for getMatchesForPredicate(). Generates a TupleIdSequence of
-  // all tuples which match a predicate of the form 'key comp right_literal'.
-  // This version is for uncompressed keys.
-  TupleIdSequence* evaluateComparisonPredicateOnUncompressedKey(
+  // Helper method for getMatchesForPredicate() and
+  // getMatchingValuesForPredicate(). Passes every entry which matches
+  // 'predicate' to 'collector->addEntry()'. 'MatchCollectorT' is one of the
+  // collector classes in csbtree_internal.
+  template <class MatchCollectorT>
+  void evaluatePredicate(const Predicate &predicate,
+                         MatchCollectorT *collector) const;
+
+  // Helper method for evaluatePredicate(). Collects all entries which match a
+  // predicate of the form 'key comp right_literal'. This version is for
+  // uncompressed keys.
+  template <class MatchCollectorT>
+  void evaluateComparisonPredicateOnUncompressedKey(
       const Comparison::ComparisonID comp,
-      const TypeInstance &right_literal) const;
-
-  // Helper method for getMatchesForPredicate(). Generates a TupleIdSequence of
-  // all tuples which match a predicate of the form 'key comp right_literal'.
-  // This version is for compressed keys.
-  TupleIdSequence* evaluateComparisonPredicateOnCompressedKey(
+      const TypeInstance &right_literal,
+      MatchCollectorT *collector) const;
+
+  // Helper method for evaluatePredicate(). Collects all entries which match a
+  // predicate of the form 'key comp right_literal'. This version is for
+  // compressed keys.
+  template <class MatchCollectorT>
+  void evaluateComparisonPredicateOnCompressedKey(
       Comparison::ComparisonID comp,
-      const TypeInstance &right_literal) const;
+      const TypeInstance &right_literal,
+      MatchCollectorT *collector) const;
 
   // Helper method for evaluateComparisonPredicateOnUncompressedKey() and
-  // evaluateComparisonPredicateOnCompressedKey(). Generates a TupleIdSequence
-  // of all tuples which have a key equal to '*literal' according to
+  // evaluateComparisonPredicateOnCompressedKey(). Collects all entries which
+  // have a key equal to '*literal' according to
   // 'literal_less_key_comparator' and 'key_less_literal_comparator'.
-  TupleIdSequence* evaluateEqualPredicate(
+  template <class MatchCollectorT>
+  void evaluateEqualPredicate(
       const void *literal,
       const UncheckedComparator &literal_less_key_comparator,
-      const UncheckedComparator &key_less_literal_comparator) const;
+      const UncheckedComparator &key_less_literal_comparator,
+      MatchCollectorT *collector) const;
 
   // Helper method for evaluateComparisonPredicateOnUncompressedKey() and
-  // evaluateComparisonPredicateOnCompressedKey(). Generates a TupleIdSequence
-  // of all tuples which have a key not equal to '*literal' according to
+  // evaluateComparisonPredicateOnCompressedKey(). Collects all entries which
+  // have a key not equal to '*literal' according to
   // 'literal_less_key_comparator' and 'key_less_literal_comparator'.
-  TupleIdSequence* evaluateNotEqualPredicate(
+  template <class MatchCollectorT>
+  void evaluateNotEqualPredicate(
       const void *literal,
       const UncheckedComparator &literal_less_key_comparator,
-      const UncheckedComparator &key_less_literal_comparator) const;
+      const UncheckedComparator &key_less_literal_comparator,
+      MatchCollectorT *collector) const;
 
   // Helper method for evaluateComparisonPredicateOnUncompressedKey() and
-  // evaluateComparisonPredicateOnCompressedKey(). Generates a TupleIdSequence
-  // of all tuples which have a key less than '*literal' according to
+  // evaluateComparisonPredicateOnCompressedKey(). Collects all entries which
+  // have a key less than '*literal' according to
   // 'literal_less_key_comparator' and 'key_less_literal_comparator'. If
-  // 'include_equal' is true, the sequence will also include tuples whose keys
-  // are equal to '*literal'.
-  template <bool include_equal>
-  TupleIdSequence* evaluateLessPredicate(
+  // 'include_equal' is true, entries whose keys are equal to '*literal' are
+  // also collected.
+  template <bool include_equal, class MatchCollectorT>
+  void evaluateLessPredicate(
       const void *literal,
       const UncheckedComparator &literal_less_key_comparator,
-      const UncheckedComparator &key_less_literal_comparator) const;
+      const UncheckedComparator &key_less_literal_comparator,
+      MatchCollectorT *collector) const;
 
   // Helper method for evaluateComparisonPredicateOnUncompressedKey() and
-  // evaluateComparisonPredicateOnCompressedKey(). Generates a TupleIdSequence
-  // of all tuples which have a key greater than '*literal' according to
+  // evaluateComparisonPredicateOnCompressedKey(). Collects all entries which
+  // have a key greater than '*literal' according to
   // 'literal_less_key_comparator' and 'key_less_literal_comparator'. If
-  // 'include_equal' is true, the sequence will also include tuples whose keys
-  // are equal to '*literal'.
-  template <bool include_equal>
-  TupleIdSequence* evaluateGreaterPredicate(
+  // 'include_equal' is true, entries whose keys are equal to '*literal' are
+  // also collected.
+  template <bool include_equal, class MatchCollectorT>
+  void evaluateGreaterPredicate(
       const void *literal,
       const UncheckedComparator &literal_less_key_comparator,
-      const UncheckedComparator &key_less_literal_comparator) const;
+      const UncheckedComparator &key_less_literal_comparator,
+      MatchCollectorT *collector) const;
+
+  // Pass every entry in the index to 'collector->addEntry()', in key order.
+  template <class MatchCollectorT>
+  void collectAllEntries(MatchCollectorT *collector) const;
+
+  // Make a copy of the value of the attribute at position
+  // 'indexed_attribute_num' in indexed_attribute_ids_ from '*key', which
+  // stays valid after the index is modified. If the key is compressed, the
+  // value is decompressed. Returns NULL if '*key' holds a code which is not
+  // in the dictionary (i.e. it was read while a writer modified it).
+  TypeInstance* makeKeyAttributeTypeInstance(const void *key,
+                                             const std::size_t indexed_attribute_num) const;
 
   // Check if there are enough node groups in this CSBTreeIndexSubBlock to
   // build a complete index of all tuple_store_'s tuples.
@@ -578,15 +732,21 @@ class CSBTreeIndexSubBlock : public IndexSubBlock {
   std::uint16_t small_half_num_keys_leaf_;
   std::uint16_t large_half_num_keys_leaf_;
 
+  const std::size_t node_size_bytes_;
   void *node_groups_start_;
   std::size_t node_group_size_bytes_;
   ScopedPtr<BitVector> node_group_used_bitmap_;
   int next_free_node_group_;
   int num_free_node_groups_;
 
+  // Held for writing by any method which modifies the tree. Searches read
+  // the tree optimistically, validating against this latch's version.
+  VersionedLatch latch_;
+
   friend class CSBTreeIndexSubBlockTest;
   friend class CSBTreePrettyPrinter;
   friend class csbtree_internal::CompositeKeyLessComparator;
+  friend class csbtree_internal::KeyValueMatchCollector;
 
   DISALLOW_COPY_AND_ASSIGN(CSBTreeIndexSubBlock);
 };
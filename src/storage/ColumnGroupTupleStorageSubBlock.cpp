@@ -0,0 +1,308 @@
+/*
+   This file copyright (c) 2011-2013, the Quickstep authors.
+   See file CREDITS.txt for details.
+  
+   This file is part of Quickstep.
+
+   Quickstep is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+  
+   Quickstep is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Quickstep.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "storage/ColumnGroupTupleStorageSubBlock.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "catalog/CatalogAttribute.hpp"
+#include "catalog/CatalogRelation.hpp"
+#include "expressions/ComparisonPredicate.hpp"
+#include "expressions/Predicate.hpp"
+#include "storage/StorageBlockInfo.hpp"
+#include "storage/StorageBlockLayout.pb.h"
+#include "storage/StorageErrors.hpp"
+#include "storage/TupleIdSequence.hpp"
+#include "types/Tuple.hpp"
+#include "types/Type.hpp"
+#include "types/TypeInstance.hpp"
+#include "utility/Macros.hpp"
+#include "utility/ScopedPtr.hpp"
+
+using std::memmove;
+using std::size_t;
+using std::vector;
+
+namespace quickstep {
+
+ColumnGroupTupleStorageSubBlock::ColumnGroupTupleStorageSubBlock(
+    const CatalogRelation &relation,
+    const TupleStorageSubBlockDescription &description,
+    const bool new_block,
+    void *sub_block_memory,
+    const std::size_t sub_block_memory_size)
+    : TupleStorageSubBlock(relation,
+                           description,
+                           new_block,
+                           sub_block_memory,
+                           sub_block_memory_size) {
+  if (!DescriptionIsValid(relation_, description_)) {
+    FATAL_ERROR("Attempted to construct a ColumnGroupTupleStorageSubBlock from an invalid description.");
+  }
+
+  if (sub_block_memory_size < sizeof(ColumnGroupHeader)) {
+    throw BlockMemoryTooSmall("ColumnGroupTupleStorageSubBlock", sub_block_memory_size);
+  }
+
+  // Every group's stripe has room for the same number of tuples.
+  max_tuples_ = (sub_block_memory_size_ - sizeof(ColumnGroupHeader)) / relation_.getFixedByteLength();
+  if (max_tuples_ == 0) {
+    throw BlockMemoryTooSmall("ColumnGroupTupleStorageSubBlock", sub_block_memory_size_);
+  }
+
+  // Collect the groups named in the description, followed by a
+  // single-attribute group for each attribute which was not named.
+  vector<vector<attribute_id> > groups;
+  vector<bool> attribute_in_group(relation_.getMaxAttributeId() + 1, false);
+  const int num_described_groups
+      = description_.ExtensionSize(ColumnGroupTupleStorageSubBlockDescription::column_group);
+  for (int group_num = 0; group_num < num_described_groups; ++group_num) {
+    const ColumnGroupTupleStorageSubBlockDescription::ColumnGroup &group_description
+        = description_.GetExtension(ColumnGroupTupleStorageSubBlockDescription::column_group, group_num);
+    groups.push_back(vector<attribute_id>());
+    for (int group_attr_num = 0; group_attr_num < group_description.attribute_id_size(); ++group_attr_num) {
+      groups.back().push_back(group_description.attribute_id(group_attr_num));
+      attribute_in_group[group_description.attribute_id(group_attr_num)] = true;
+    }
+  }
+  for (CatalogRelation::const_iterator attr_it = relation_.begin();
+       attr_it != relation_.end();
+       ++attr_it) {
+    if (!attribute_in_group[attr_it->getID()]) {
+      groups.push_back(vector<attribute_id>(1, attr_it->getID()));
+    }
+  }
+
+  // Lay out each group's attributes within a row of the group, and each
+  // group's stripe within the sub-block.
+  attribute_groups_.resize(relation_.getMaxAttributeId() + 1, 0);
+  attribute_offsets_in_group_.resize(relation_.getMaxAttributeId() + 1, 0);
+  char *stripe = static_cast<char*>(sub_block_memory_) + sizeof(ColumnGroupHeader);
+  for (size_t group_num = 0; group_num < groups.size(); ++group_num) {
+    size_t row_length = 0;
+    for (vector<attribute_id>::const_iterator attr_it = groups[group_num].begin();
+         attr_it != groups[group_num].end();
+         ++attr_it) {
+      attribute_groups_[*attr_it] = group_num;
+      attribute_offsets_in_group_[*attr_it] = row_length;
+      row_length += relation_.getAttributeById(*attr_it).getType().maximumByteLength();
+    }
+
+    group_stripes_.push_back(stripe);
+    group_row_lengths_.push_back(row_length);
+    stripe += max_tuples_ * row_length;
+  }
+
+  if (new_block) {
+    getHeaderPtr()->num_tuples = 0;
+  }
+}
+
+bool ColumnGroupTupleStorageSubBlock::DescriptionIsValid(
+    const CatalogRelation &relation,
+    const TupleStorageSubBlockDescription &description) {
+  // Make sure description is initialized and specifies ColumnGroupStore.
+  if (!description.IsInitialized()) {
+    return false;
+  }
+  if (description.sub_block_type() != TupleStorageSubBlockDescription::COLUMN_GROUP_STORE) {
+    return false;
+  }
+
+  // Make sure relation is not variable-length and contains no nullable attributes.
+  if (relation.isVariableLength()) {
+    return false;
+  }
+  if (relation.hasNullableAttributes()) {
+    return false;
+  }
+
+  // Make sure every group is nonempty, and that every attribute named in a
+  // group exists and belongs to no other group.
+  vector<bool> attribute_in_group(relation.getMaxAttributeId() + 1, false);
+  for (int group_num = 0;
+       group_num < description.ExtensionSize(ColumnGroupTupleStorageSubBlockDescription::column_group);
+       ++group_num) {
+    const ColumnGroupTupleStorageSubBlockDescription::ColumnGroup &group_description
+        = description.GetExtension(ColumnGroupTupleStorageSubBlockDescription::column_group, group_num);
+    if (group_description.attribute_id_size() == 0) {
+      return false;
+    }
+    for (int group_attr_num = 0; group_attr_num < group_description.attribute_id_size(); ++group_attr_num) {
+      const attribute_id group_attr = group_description.attribute_id(group_attr_num);
+      if (!relation.hasAttributeWithId(group_attr)) {
+        return false;
+      }
+      if (attribute_in_group[group_attr]) {
+        return false;
+      }
+      attribute_in_group[group_attr] = true;
+    }
+  }
+
+  return true;
+}
+
+std::size_t ColumnGroupTupleStorageSubBlock::EstimateBytesPerTuple(
+    const CatalogRelation &relation,
+    const TupleStorageSubBlockDescription &description) {
+  DEBUG_ASSERT(DescriptionIsValid(relation, description));
+
+  return relation.getFixedByteLength();
+}
+
+TupleStorageSubBlock::InsertResult ColumnGroupTupleStorageSubBlock::insertTuple(
+    const Tuple &tuple,
+    const AllowedTypeConversion atc) {
+#ifdef QUICKSTEP_DEBUG
+  paranoidInsertTypeCheck(tuple, atc);
+#endif
+  const tuple_id position = getHeaderPtr()->num_tuples;
+  if (position == max_tuples_) {
+    return InsertResult(-1, false);
+  }
+
+  Tuple::const_iterator value_it = tuple.begin();
+  CatalogRelation::const_iterator attr_it = relation_.begin();
+
+  switch (atc) {
+    case kNone:
+      while (value_it != tuple.end()) {
+        const size_t group = attribute_groups_[attr_it->getID()];
+        value_it->copyInto(group_stripes_[group]
+                           + position * group_row_lengths_[group]
+                           + attribute_offsets_in_group_[attr_it->getID()]);
+
+        ++value_it;
+        ++attr_it;
+      }
+      break;
+    case kSafe:
+    case kUnsafe:
+      while (value_it != tuple.end()) {
+        const size_t group = attribute_groups_[attr_it->getID()];
+        char *value_location = group_stripes_[group]
+                               + position * group_row_lengths_[group]
+                               + attribute_offsets_in_group_[attr_it->getID()];
+        if (value_it->getType().equals(attr_it->getType())) {
+          value_it->copyInto(value_location);
+        } else {
+          ScopedPtr<TypeInstance> converted_temp(value_it->makeCoercedCopy(attr_it->getType()));
+          converted_temp->copyInto(value_location);
+        }
+
+        ++value_it;
+        ++attr_it;
+      }
+      break;
+  }
+
+  ++(getHeaderPtr()->num_tuples);
+
+  return InsertResult(position, false);
+}
+
+const void* ColumnGroupTupleStorageSubBlock::getAttributeValue(const tuple_id tuple,
+                                                               const attribute_id attr) const {
+  DEBUG_ASSERT(hasTupleWithID(tuple));
+  DEBUG_ASSERT(relation_.hasAttributeWithId(attr));
+  const size_t group = attribute_groups_[attr];
+  return group_stripes_[group]                  // Start of the group's stripe.
+         + tuple * group_row_lengths_[group]    // Rows of prior tuples in the group.
+         + attribute_offsets_in_group_[attr];   // Prior attributes in this row.
+}
+
+TypeInstance* ColumnGroupTupleStorageSubBlock::getAttributeValueTyped(const tuple_id tuple,
+                                                                      const attribute_id attr) const {
+  return relation_.getAttributeById(attr).getType().makeReferenceTypeInstance(getAttributeValue(tuple, attr));
+}
+
+bool ColumnGroupTupleStorageSubBlock::canSetAttributeValuesInPlaceTyped(
+    const tuple_id tuple,
+    const PtrMap<attribute_id, LiteralTypeInstance> &new_values) const {
+  DEBUG_ASSERT(hasTupleWithID(tuple));
+  // All attributes are fixed-length and non-nullable.
+  for (PtrMap<attribute_id, LiteralTypeInstance>::const_iterator value_it = new_values.begin();
+       value_it != new_values.end();
+       ++value_it) {
+    if (value_it->second->isNull()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void ColumnGroupTupleStorageSubBlock::setAttributeValueInPlaceTyped(const tuple_id tuple,
+                                                                    const attribute_id attr,
+                                                                    const TypeInstance &value) {
+  DEBUG_ASSERT(hasTupleWithID(tuple));
+  DEBUG_ASSERT(relation_.hasAttributeWithId(attr));
+  DEBUG_ASSERT(!value.isNull());
+  const size_t group = attribute_groups_[attr];
+  value.copyInto(group_stripes_[group]
+                 + tuple * group_row_lengths_[group]
+                 + attribute_offsets_in_group_[attr]);
+}
+
+bool ColumnGroupTupleStorageSubBlock::deleteTuple(const tuple_id tuple) {
+  DEBUG_ASSERT(hasTupleWithID(tuple));
+
+  ColumnGroupHeader *header = getHeaderPtr();
+
+  if (tuple == header->num_tuples - 1) {
+    // If deleting the last tuple, simply truncate.
+    --(header->num_tuples);
+    return false;
+  }
+
+  // Shift subsequent rows of every group's stripe forward by one position.
+  for (size_t group = 0; group < group_stripes_.size(); ++group) {
+    const size_t row_length = group_row_lengths_[group];
+    memmove(group_stripes_[group] + tuple * row_length,
+            group_stripes_[group] + (tuple + 1) * row_length,
+            (header->num_tuples - tuple - 1) * row_length);
+  }
+
+  --(header->num_tuples);
+
+  return true;
+}
+
+TupleIdSequence* ColumnGroupTupleStorageSubBlock::getMatchesForPredicate(const Predicate *predicate) const {
+  if ((predicate == NULL) || !predicate->isAttributeLiteralComparisonPredicate()) {
+    return TupleStorageSubBlock::getMatchesForPredicate(predicate);
+  }
+
+  // Stride through the attribute's values in its group's stripe.
+  const ComparisonPredicate &comparison_predicate = *static_cast<const ComparisonPredicate*>(predicate);
+  const attribute_id comparison_attribute_id = GetComparisonAttributeID(comparison_predicate);
+  const size_t group = attribute_groups_[comparison_attribute_id];
+  return GetMatchesForComparisonOnStridedValues(
+      comparison_predicate,
+      group_stripes_[group] + attribute_offsets_in_group_[comparison_attribute_id],
+      group_row_lengths_[group],
+      getHeaderPtr()->num_tuples,
+      NULL,
+      NULL);
+}
+
+}  // namespace quickstep
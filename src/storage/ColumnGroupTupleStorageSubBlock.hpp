@@ -0,0 +1,219 @@
+/*
+   This file copyright (c) 2011-2013, the Quickstep authors.
+   See file CREDITS.txt for details.
+  
+   This file is part of Quickstep.
+
+   Quickstep is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+  
+   Quickstep is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Quickstep.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICKSTEP_STORAGE_COLUMN_GROUP_TUPLE_STORAGE_SUB_BLOCK_HPP_
+#define QUICKSTEP_STORAGE_COLUMN_GROUP_TUPLE_STORAGE_SUB_BLOCK_HPP_
+
+#include <cstddef>
+#include <vector>
+
+#include "catalog/CatalogTypedefs.hpp"
+#include "storage/TupleStorageSubBlock.hpp"
+#include "utility/Macros.hpp"
+#include "utility/PtrMap.hpp"
+
+namespace quickstep {
+
+class TupleStorageSubBlockDescription;
+
+/** \addtogroup Storage
+ *  @{
+ */
+
+/**
+ * @brief An implementation of TupleStorageSubBlock which vertically
+ *        partitions a relation into column groups. Each group of attributes
+ *        named in the description is stored row-wise in its own stripe, and
+ *        any attribute not named in a group is stored in a stripe by itself.
+ *        Tuples are stored in order of insertion, with no holes. A scan which
+ *        evaluates a predicate on one group and projects attributes from the
+ *        same group touches only that group's stripe.
+ * @warning This implementation does NOT support variable-length or nullable
+ *          attributes. It is an error to attempt to construct a
+ *          ColumnGroupTupleStorageSubBlock for a relation with any
+ *          variable-length or nullable attributes.
+ **/
+class ColumnGroupTupleStorageSubBlock : public TupleStorageSubBlock {
+ public:
+  ColumnGroupTupleStorageSubBlock(const CatalogRelation &relation,
+                                  const TupleStorageSubBlockDescription &description,
+                                  const bool new_block,
+                                  void *sub_block_memory,
+                                  const std::size_t sub_block_memory_size);
+
+  ~ColumnGroupTupleStorageSubBlock() {
+  }
+
+  /**
+   * @brief Determine whether a TupleStorageSubBlockDescription is valid for
+   *        this type of TupleStorageSubBlock.
+   *
+   * @param relation The relation a tuple store described by description would
+   *        belong to.
+   * @param description A description of the parameters for this type of
+   *        TupleStorageSubBlock, which will be checked for validity.
+   * @return Whether description is well-formed and valid for this type of
+   *         TupleStorageSubBlock belonging to relation (i.e. whether a
+   *         TupleStorageSubBlock of this type, belonging to relation, can be
+   *         constructed according to description).
+   **/
+  static bool DescriptionIsValid(const CatalogRelation &relation,
+                                 const TupleStorageSubBlockDescription &description);
+
+  /**
+   * @brief Estimate the average number of bytes (including any applicable
+   *        overhead) used to store a single tuple in this type of
+   *        TupleStorageSubBlock. Used by StorageBlockLayout::finalize() to
+   *        divide block memory amongst sub-blocks.
+   * @warning description must be valid. DescriptionIsValid() should be called
+   *          first if necessary.
+   *
+   * @param relation The relation tuples belong to.
+   * @param description A description of the parameters for this type of
+   *        TupleStorageSubBlock.
+   * @return The average/ammortized number of bytes used to store a single
+   *         tuple of relation in a TupleStorageSubBlock of this type described
+   *         by description.
+   **/
+  static std::size_t EstimateBytesPerTuple(const CatalogRelation &relation,
+                                           const TupleStorageSubBlockDescription &description);
+
+  bool supportsUntypedGetAttributeValue(const attribute_id attr) const {
+    return true;
+  }
+
+  bool supportsAdHocInsert() const {
+    return true;
+  }
+
+  bool adHocInsertIsEfficient() const {
+    return true;
+  }
+
+  TupleStorageSubBlockType getTupleStorageSubBlockType() const {
+    return kColumnGroupStore;
+  }
+
+  bool isEmpty() const {
+    return (getHeaderPtr()->num_tuples == 0);
+  }
+
+  bool isPacked() const {
+    return true;
+  }
+
+  tuple_id getMaxTupleID() const {
+    return getHeaderPtr()->num_tuples - 1;
+  }
+
+  bool hasTupleWithID(const tuple_id tuple) const {
+    return ((tuple >=0) && (tuple < getHeaderPtr()->num_tuples));
+  }
+
+  InsertResult insertTuple(const Tuple &tuple, const AllowedTypeConversion atc);
+
+  inline bool insertTupleInBatch(const Tuple &tuple, const AllowedTypeConversion atc) {
+    const InsertResult result = insertTuple(tuple, atc);
+    return (result.inserted_id >= 0);
+  }
+
+  bool batchInsertMutatesTupleIDs() const {
+    return false;
+  }
+
+  bool nextInsertAppends() const {
+    return true;
+  }
+
+  tuple_id estimateTupleCapacity() const {
+    return max_tuples_;
+  }
+
+  const void* getAttributeValue(const tuple_id tuple, const attribute_id attr) const;
+  TypeInstance* getAttributeValueTyped(const tuple_id tuple, const attribute_id attr) const;
+
+  bool canSetAttributeValuesInPlaceTyped(const tuple_id tuple,
+                                         const PtrMap<attribute_id, LiteralTypeInstance> &new_values) const;
+  void setAttributeValueInPlaceTyped(const tuple_id tuple, const attribute_id attr, const TypeInstance &value);
+
+  bool deleteTuple(const tuple_id tuple);
+
+  // This override evaluates comparisons between an attribute and a literal
+  // value by scanning only the stripe of the attribute's column group.
+  TupleIdSequence* getMatchesForPredicate(const Predicate *predicate) const;
+
+  void rebuild() {
+  }
+
+  /**
+   * @brief Get the number of column groups (including single-attribute groups
+   *        for attributes not named in the description) in this block.
+   *
+   * @return The number of column groups.
+   **/
+  std::size_t getNumColumnGroups() const {
+    return group_stripes_.size();
+  }
+
+  /**
+   * @brief Get the column group which an attribute is stored in.
+   *
+   * @param attr The ID of an attribute in this block's relation.
+   * @return The index of the column group which stores attr. Groups named in
+   *         the description are numbered first, in order, followed by the
+   *         single-attribute groups for all other attributes.
+   **/
+  std::size_t getColumnGroupForAttribute(const attribute_id attr) const {
+    return attribute_groups_[attr];
+  }
+
+ private:
+  struct ColumnGroupHeader {
+    tuple_id num_tuples;
+  };
+
+  ColumnGroupHeader* getHeaderPtr() {
+    return static_cast<ColumnGroupHeader*>(sub_block_memory_);
+  }
+
+  const ColumnGroupHeader* getHeaderPtr() const {
+    return static_cast<const ColumnGroupHeader*>(sub_block_memory_);
+  }
+
+  tuple_id max_tuples_;
+
+  // The start of each group's stripe and the length of one row of the group,
+  // indexed by group number.
+  std::vector<char*> group_stripes_;
+  std::vector<std::size_t> group_row_lengths_;
+
+  // The group each attribute is stored in, and the attribute's offset within
+  // a row of that group, indexed by attribute ID.
+  std::vector<std::size_t> attribute_groups_;
+  std::vector<std::size_t> attribute_offsets_in_group_;
+
+  DISALLOW_COPY_AND_ASSIGN(ColumnGroupTupleStorageSubBlock);
+};
+
+/** @} */
+
+}  // namespace quickstep
+
+#endif  // QUICKSTEP_STORAGE_COLUMN_GROUP_TUPLE_STORAGE_SUB_BLOCK_HPP_
@@ -21,6 +21,9 @@
 #include "storage/ColumnStoreUtil.hpp"
 
 #include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <utility>
 
 #include "catalog/CatalogAttribute.hpp"
 #include "catalog/CatalogRelation.hpp"
@@ -28,14 +31,25 @@
 #include "expressions/Predicate.hpp"
 #include "expressions/Scalar.hpp"
 #include "storage/StorageBlockInfo.hpp"
+#include "storage/StorageConfig.h"
 #include "storage/TupleIdSequence.hpp"
 #include "types/Comparison.hpp"
 #include "types/Type.hpp"
 #include "types/TypeInstance.hpp"
+#include "utility/BitManipulation.hpp"
+#include "utility/CstdintCompat.hpp"
 #include "utility/Macros.hpp"
 #include "utility/ScopedPtr.hpp"
 
+#ifdef QUICKSTEP_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
 using std::lower_bound;
+using std::pair;
+using std::size_t;
+using std::uint32_t;
+using std::uint64_t;
 using std::upper_bound;
 
 namespace quickstep {
@@ -196,5 +210,77 @@ TupleIdSequence* SortColumnPredicateEvaluator::EvaluatePredicateForUncompressedS
   }
 }
 
+tuple_id BitPackedCodeStripe::LowerBound(const void *stripe,
+                                         const unsigned int code_bits,
+                                         const tuple_id num_codes,
+                                         const uint32_t code) {
+  tuple_id lower = 0;
+  tuple_id count = num_codes;
+  while (count > 0) {
+    const tuple_id half = count >> 1;
+    if (GetCode(stripe, code_bits, lower + half) < code) {
+      lower += half + 1;
+      count -= half + 1;
+    } else {
+      count = half;
+    }
+  }
+  return lower;
+}
+
+void BitPackedCodeStripe::GetCodesInRange(const void *stripe,
+                                          const unsigned int code_bits,
+                                          const tuple_id num_codes,
+                                          const pair<uint32_t, uint32_t> range,
+                                          const bool complement,
+                                          TupleIdSequence *matches) {
+  DEBUG_ASSERT(range.first < range.second);
+  // A code is in range iff (code - range.first) < (range.second - range.first)
+  // when computed with unsigned wraparound, which needs only one comparison.
+  const uint32_t range_width = range.second - range.first;
+  const char *stripe_bytes = static_cast<const char*>(stripe);
+  const uint64_t code_mask = CodeMask(code_bits);
+
+  tuple_id position = 0;
+  size_t bit_offset = 0;
+#ifdef QUICKSTEP_HAVE_SSE2
+  // SSE2 only has signed 32-bit comparisons, so flip the sign bit of both
+  // sides to get an unsigned comparison.
+  const __m128i sign_flip = _mm_set1_epi32(static_cast<int>(0x80000000u));
+  const __m128i range_start = _mm_set1_epi32(static_cast<int>(range.first));
+  const __m128i flipped_width = _mm_set1_epi32(static_cast<int>(range_width ^ 0x80000000u));
+  const int complement_mask = complement ? 0xF : 0x0;
+  uint32_t codes[4];
+  for (; position + 4 <= num_codes; position += 4) {
+    // Unpack four codes, then compare all of them at once.
+    for (int lane = 0; lane < 4; ++lane) {
+      uint64_t word;
+      std::memcpy(&word, stripe_bytes + (bit_offset >> 3), sizeof(word));
+      codes[lane] = static_cast<uint32_t>((word >> (bit_offset & 0x7)) & code_mask);
+      bit_offset += code_bits;
+    }
+    const __m128i offsets = _mm_sub_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(codes)),
+                                          range_start);
+    const __m128i in_range = _mm_cmplt_epi32(_mm_xor_si128(offsets, sign_flip), flipped_width);
+    uint32_t lane_mask = _mm_movemask_ps(_mm_castsi128_ps(in_range)) ^ complement_mask;
+    while (lane_mask != 0) {
+      matches->append(position + trailing_zero_count_32(lane_mask));
+      lane_mask &= lane_mask - 1;
+    }
+  }
+#endif
+  // Scalar loop for the tail of the stripe (or the whole stripe if SSE2 is
+  // unavailable).
+  for (; position < num_codes; ++position) {
+    uint64_t word;
+    std::memcpy(&word, stripe_bytes + (bit_offset >> 3), sizeof(word));
+    const uint32_t code = static_cast<uint32_t>((word >> (bit_offset & 0x7)) & code_mask);
+    bit_offset += code_bits;
+    if (((code - range.first) < range_width) != complement) {
+      matches->append(position);
+    }
+  }
+}
+
 }  // namespace column_store_util
 }  // namespace quickstep
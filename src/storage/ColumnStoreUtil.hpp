@@ -22,10 +22,13 @@
 #define QUICKSTEP_STORAGE_COLUMN_STORE_UTIL_HPP_
 
 #include <cstddef>
+#include <cstring>
 #include <iterator>
+#include <utility>
 
 #include "catalog/CatalogTypedefs.hpp"
 #include "storage/StorageBlockInfo.hpp"
+#include "utility/CstdintCompat.hpp"
 #include "utility/Macros.hpp"
 
 namespace quickstep {
@@ -237,6 +240,122 @@ class SortColumnPredicateEvaluator {
   DISALLOW_COPY_AND_ASSIGN(SortColumnPredicateEvaluator);
 };
 
+/**
+ * @brief A class which contains static helper methods for reading, writing,
+ *        and scanning a column stripe of bit-packed codes, as used for
+ *        compressed attributes in a CompressedColumnStoreTupleStorageSubBlock.
+ * @note Codes are packed back-to-back in little-endian bit order with no
+ *       padding, so that a stripe of N codes of B bits each takes (N * B) / 8
+ *       bytes (rounded up) plus a few bytes of slack at the end which allow
+ *       any code to be read with a single unaligned 64-bit load. Codes may be
+ *       up to 32 bits long.
+ * @note This layout assumes a little-endian machine.
+ **/
+class BitPackedCodeStripe {
+ public:
+  /**
+   * @brief Get the number of bytes of memory needed for a stripe of
+   *        bit-packed codes, including slack at the end.
+   *
+   * @param num_codes The number of codes to be stored in the stripe.
+   * @param code_bits The length of each code in bits.
+   * @return The size of the stripe in bytes.
+   **/
+  static std::size_t SizeBytes(const std::size_t num_codes,
+                               const unsigned int code_bits) {
+    return ((num_codes * code_bits + 7) >> 3) + sizeof(std::uint64_t);
+  }
+
+  /**
+   * @brief Get the code at a particular position in a stripe.
+   *
+   * @param stripe The stripe of bit-packed codes.
+   * @param code_bits The length of each code in bits.
+   * @param position The position of the code to get.
+   * @return The code at position.
+   **/
+  static inline std::uint32_t GetCode(const void *stripe,
+                                      const unsigned int code_bits,
+                                      const std::size_t position) {
+    DEBUG_ASSERT((code_bits > 0) && (code_bits <= 32));
+    const std::size_t bit_offset = position * code_bits;
+    std::uint64_t word;
+    std::memcpy(&word, static_cast<const char*>(stripe) + (bit_offset >> 3), sizeof(word));
+    return static_cast<std::uint32_t>((word >> (bit_offset & 0x7)) & CodeMask(code_bits));
+  }
+
+  /**
+   * @brief Overwrite the code at a particular position in a stripe.
+   *
+   * @param stripe The stripe of bit-packed codes.
+   * @param code_bits The length of each code in bits.
+   * @param position The position of the code to set.
+   * @param code The new code, which must fit in code_bits.
+   **/
+  static inline void SetCode(void *stripe,
+                             const unsigned int code_bits,
+                             const std::size_t position,
+                             const std::uint32_t code) {
+    DEBUG_ASSERT((code_bits > 0) && (code_bits <= 32));
+    DEBUG_ASSERT((code & ~CodeMask(code_bits)) == 0);
+    const std::size_t bit_offset = position * code_bits;
+    char *word_location = static_cast<char*>(stripe) + (bit_offset >> 3);
+    std::uint64_t word;
+    std::memcpy(&word, word_location, sizeof(word));
+    word &= ~(CodeMask(code_bits) << (bit_offset & 0x7));
+    word |= static_cast<std::uint64_t>(code) << (bit_offset & 0x7);
+    std::memcpy(word_location, &word, sizeof(word));
+  }
+
+  /**
+   * @brief Find the position of the first code in a sorted stripe which is
+   *        not less than a given code.
+   *
+   * @param stripe A stripe of bit-packed codes sorted in ascending order.
+   * @param code_bits The length of each code in bits.
+   * @param num_codes The number of codes in stripe.
+   * @param code The code to search for.
+   * @return The position of the first code in stripe which is not less than
+   *         code, or num_codes if there is no such code.
+   **/
+  static tuple_id LowerBound(const void *stripe,
+                             const unsigned int code_bits,
+                             const tuple_id num_codes,
+                             const std::uint32_t code);
+
+  /**
+   * @brief Scan a stripe for codes in a range, decoding and comparing several
+   *        codes at once with SIMD instructions where available.
+   *
+   * @param stripe The stripe of bit-packed codes.
+   * @param code_bits The length of each code in bits.
+   * @param num_codes The number of codes in stripe.
+   * @param range The range of codes to match. The first element is the
+   *        inclusive lower bound, and the second is the exclusive upper
+   *        bound, which must be greater than the lower bound.
+   * @param complement If true, match codes which are NOT in range instead.
+   * @param matches A sequence which the positions of matching codes are
+   *        appended to, in ascending order.
+   **/
+  static void GetCodesInRange(const void *stripe,
+                              const unsigned int code_bits,
+                              const tuple_id num_codes,
+                              const std::pair<std::uint32_t, std::uint32_t> range,
+                              const bool complement,
+                              TupleIdSequence *matches);
+
+ private:
+  // Undefined default constructor - class is all static and should not be
+  // instantiated.
+  BitPackedCodeStripe();
+
+  static inline std::uint64_t CodeMask(const unsigned int code_bits) {
+    return (static_cast<std::uint64_t>(1) << code_bits) - 1;
+  }
+
+  DISALLOW_COPY_AND_ASSIGN(BitPackedCodeStripe);
+};
+
 /** @} */
 
 }  // namespace column_store_util
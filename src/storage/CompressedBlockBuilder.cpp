@@ -21,6 +21,7 @@
 
 #include <algorithm>
 #include <cstddef>
+#include <cstring>
 #include <limits>
 #include <utility>
 #include <vector>
@@ -28,6 +29,10 @@
 #include "catalog/CatalogAttribute.hpp"
 #include "catalog/CatalogRelation.hpp"
 #include "catalog/CatalogTypedefs.hpp"
+#include "catalog/SharedCompressionDictionary.hpp"
+#include "storage/ColumnStoreUtil.hpp"
+#include "storage/CompressedColumnStoreTupleStorageSubBlock.hpp"
+#include "storage/NullBitmaps.hpp"
 #include "storage/StorageBlockInfo.hpp"
 #include "storage/StorageBlockLayout.pb.h"
 #include "types/Comparison.hpp"
@@ -40,10 +45,16 @@
 #include "utility/ContainerCompat.hpp"
 #include "utility/CstdintCompat.hpp"
 #include "utility/Macros.hpp"
+#include "utility/PtrVector.hpp"
+#include "utility/ScopedBuffer.hpp"
 #include "utility/ScopedPtr.hpp"
 
+using std::int64_t;
+using std::memcpy;
+using std::memset;
 using std::numeric_limits;
 using std::pair;
+using std::size_t;
 using std::sort;
 using std::uint8_t;
 using std::uint16_t;
@@ -51,29 +62,52 @@ using std::uint32_t;
 using std::uint64_t;
 using std::vector;
 
+using quickstep::column_store_util::BitPackedCodeStripe;
+
 namespace quickstep {
 
 namespace {
 
-class TupleComparator {
+// The size of each chunk of memory used to hold the values of a column.
+const size_t kColumnBufferChunkSizeBytes = 64 * 1024;
+
+}  // anonymous namespace
+
+class CompressedBlockBuilder::PositionComparator {
  public:
-  TupleComparator(const attribute_id sort_attribute_id,
-                  const UncheckedComparator &comparator)
-      : sort_attribute_id_(sort_attribute_id),
+  PositionComparator(const ColumnBuffer &column,
+                     const UncheckedComparator &comparator)
+      : column_(column),
         internal_comparator_(comparator) {
   }
 
-  inline bool operator() (const Tuple *left, const Tuple *right) const {
-    return internal_comparator_.compareTypeInstances(left->getAttributeValue(sort_attribute_id_),
-                                                     right->getAttributeValue(sort_attribute_id_));
+  inline bool operator() (const size_t left, const size_t right) const {
+    return internal_comparator_.compareDataPtrs(column_.getValue(left),
+                                                column_.getValue(right));
   }
 
  private:
-  const attribute_id sort_attribute_id_;
+  const ColumnBuffer &column_;
   const UncheckedComparator &internal_comparator_;
 };
 
-}  // anonymous namespace
+const void* CompressedBlockBuilder::ColumnBuffer::appendValue(const TypeInstance &value) {
+  DEBUG_ASSERT(!value.isNull());
+  const size_t value_length = value.getInstanceByteLength();
+  if (chunks_.empty() || (chunk_bytes_used_ + value_length > kColumnBufferChunkSizeBytes)) {
+    // Start a new chunk, which is made bigger than usual for an extremely long
+    // value.
+    chunks_.push_back(new ScopedBuffer(value_length > kColumnBufferChunkSizeBytes ? value_length
+                                                                                  : kColumnBufferChunkSizeBytes));
+    chunk_bytes_used_ = 0;
+  }
+
+  char *value_location = static_cast<char*>(chunks_.back().get()) + chunk_bytes_used_;
+  value.copyInto(value_location);
+  chunk_bytes_used_ += value_length;
+  values_.push_back(value_location);
+  return value_location;
+}
 
 CompressedBlockBuilder::CompressedBlockBuilder(
     const CatalogRelation &relation,
@@ -81,7 +115,19 @@ CompressedBlockBuilder::CompressedBlockBuilder(
     const std::size_t block_size)
     : relation_(relation),
       block_size_(block_size),
-      sort_attribute_id_(0) {
+      sort_attribute_id_(0),
+      bit_pack_codes_(false),
+      num_tuples_(0),
+      num_non_null_values_(relation.getMaxAttributeId() + 1, 0),
+      num_merged_tuples_(0),
+      guaranteed_num_tuples_(0),
+      unmerged_value_bytes_(relation.getMaxAttributeId() + 1, 0),
+      integer_range_tracked_(relation.getMaxAttributeId() + 1, false),
+      maximum_integers_(relation.getMaxAttributeId() + 1, 0),
+      minimum_integers_(relation.getMaxAttributeId() + 1, 0),
+      shared_dictionaries_(relation.getMaxAttributeId() + 1, NULL),
+      shared_dictionary_base_versions_(relation.getMaxAttributeId() + 1, 0),
+      shared_dictionary_base_num_codes_(relation.getMaxAttributeId() + 1, 0) {
   CompatUnorderedSet<attribute_id>::unordered_set compressed_attribute_ids;
 
   if (description.sub_block_type() == TupleStorageSubBlockDescription::COMPRESSED_PACKED_ROW_STORE) {
@@ -102,6 +148,7 @@ CompressedBlockBuilder::CompressedBlockBuilder(
     }
     sort_attribute_id_ = description.GetExtension(
         CompressedColumnStoreTupleStorageSubBlockDescription::sort_attribute_id);
+    bit_pack_codes_ = true;
 
     for (int compressed_attr_num = 0;
          compressed_attr_num < description.ExtensionSize(
@@ -120,157 +167,314 @@ CompressedBlockBuilder::CompressedBlockBuilder(
   for (attribute_id attr_num = 0;
        attr_num <= relation.getMaxAttributeId();
        ++attr_num) {
+    if (relation_.hasAttributeWithId(attr_num)) {
+      column_buffers_.push_back(new ColumnBuffer());
+    } else {
+      column_buffers_.push_back(NULL);
+    }
+
     compression_info_.add_attribute_size(0);
     compression_info_.add_dictionary_size(0);
+    if (bit_pack_codes_) {
+      compression_info_.add_attribute_bits(0);
+    }
+    compression_info_.add_frame_of_reference(0);
+    if (bit_pack_codes_) {
+      compression_info_.add_num_runs(0);
+    }
+    compression_info_.add_shared_dictionary_version(0);
 
     if (relation_.hasAttributeWithId(attr_num)
         && (compressed_attribute_ids.find(attr_num) != compressed_attribute_ids.end())) {
       const Type &attr_type = relation_.getAttributeById(attr_num).getType();
+      const bool build_lookup_tables = CompressionDictionaryBuilder::LookupTablesRecommendedForType(attr_type);
       if (attr_type.isVariableLength()) {
         dictionary_builders_.insert(attr_num,
-                                    new VariableLengthTypeCompressionDictionaryBuilder(attr_type));
+                                    new VariableLengthTypeCompressionDictionaryBuilder(attr_type,
+                                                                                       build_lookup_tables));
       } else {
         dictionary_builders_.insert(attr_num,
-                                    new FixedLengthTypeCompressionDictionaryBuilder(attr_type));
+                                    new FixedLengthTypeCompressionDictionaryBuilder(attr_type,
+                                                                                    build_lookup_tables));
       }
-      if ((attr_type.getTypeID() == Type::kInt)
-          || (attr_type.getTypeID() == Type::kLong)) {
-        // Some older versions of GCC will raise an error here if we don't
-        // manually cast NULL to the appropriate type.
-        maximum_integers_.insert(pair<attribute_id, const TypeInstance*>(attr_num,
-                                                                         static_cast<const TypeInstance*>(NULL)));
+      if (relation_.hasSharedCompressionDictionary(attr_num)) {
+        // Attributes with a shared dictionary are never truncated, so their
+        // ranges need not be tracked.
+        SharedCompressionDictionary *shared_dictionary = relation_.getSharedCompressionDictionary(attr_num);
+        shared_dictionaries_[attr_num] = shared_dictionary;
+        shared_dictionary_base_versions_[attr_num] = shared_dictionary->getLatestVersion();
+        if (shared_dictionary_base_versions_[attr_num] > 0) {
+          shared_dictionary_base_num_codes_[attr_num]
+              = shared_dictionary->getVersion(shared_dictionary_base_versions_[attr_num]).numberOfCodes();
+        }
+      } else if ((attr_type.getTypeID() == Type::kInt)
+                 || (attr_type.getTypeID() == Type::kLong)) {
+        integer_range_tracked_[attr_num] = true;
       }
     }
   }
+
+  // Reserve space in the header for the length of the NULL bitmaps, which is
+  // filled in when the block is built.
+  if (relation_.hasNullableAttributes()) {
+    compression_info_.set_null_bitmap_num_bits(0);
+  }
+}
+
+inline std::uint32_t CompressedBlockBuilder::computeTruncatedCode(const attribute_id attr_id,
+                                                                 const void *value) const {
+  return static_cast<uint32_t>(getIntegerValue(relation_.getAttributeById(attr_id).getType(), value)
+                               - compression_info_.frame_of_reference(attr_id));
+}
+
+inline std::uint32_t CompressedBlockBuilder::getDictionaryCodeForTuple(
+    const attribute_id attr_id,
+    const CompressionDictionary &dictionary,
+    const std::size_t tuple_num) const {
+  const void *value = getValueForTuple(attr_id, tuple_num);
+  return (value == NULL) ? 0 : dictionary.getCodeForUntypedValue(value);
+}
+
+inline std::uint32_t CompressedBlockBuilder::getTruncatedCodeForTuple(const attribute_id attr_id,
+                                                                     const std::size_t tuple_num) const {
+  const void *value = getValueForTuple(attr_id, tuple_num);
+  return (value == NULL) ? 0 : computeTruncatedCode(attr_id, value);
+}
+
+bool CompressedBlockBuilder::attributeIsAllNull(const attribute_id attr_id) const {
+  return (num_non_null_values_[attr_id] == 0)
+         && relation_.getAttributeById(attr_id).getType().isNullable();
 }
 
 bool CompressedBlockBuilder::addTuple(const Tuple &tuple,
                                       const bool coerce_types) {
-  ScopedPtr<Tuple> candidate_tuple;
-  if (coerce_types) {
-    candidate_tuple.reset(tuple.cloneAsInstanceOfRelation(relation_));
-  } else {
-    candidate_tuple.reset(tuple.clone());
-  }
+  DEBUG_ASSERT(tuple.size() == relation_.size());
 
-  DEBUG_ASSERT(candidate_tuple->size() == relation_.size());
-
-  // Modify dictionaries and maximum integers to reflect the new tuple's
-  // values. Keep track of what has changed in case a rollback is needed.
-  vector<CompressionDictionaryBuilder*> modified_dictionaries;
-  CompatUnorderedMap<attribute_id, const TypeInstance*>::unordered_map previous_maximum_integers;
+  // Append the tuple's values to the column buffers, and update minimum and
+  // maximum integers. Keep track of what has changed in case a rollback is
+  // needed.
+  vector<pair<attribute_id, int64_t> > previous_maximum_integers;
+  vector<pair<attribute_id, int64_t> > previous_minimum_integers;
 
   CatalogRelation::const_iterator attr_it = relation_.begin();
-  Tuple::const_iterator value_it = candidate_tuple->begin();
+  Tuple::const_iterator value_it = tuple.begin();
   while (attr_it != relation_.end()) {
-    attribute_id attr_id = attr_it->getID();
+    const attribute_id attr_id = attr_it->getID();
+
+    if (value_it->isNull()) {
+      // NULLs take no part in dictionaries or integer ranges.
+      column_buffers_[attr_id].appendNull();
+      ++attr_it;
+      ++value_it;
+      continue;
+    }
+
+    const void *value;
+    if (coerce_types && !value_it->getType().equals(attr_it->getType())) {
+      ScopedPtr<TypeInstance> coerced_value(value_it->makeCoercedCopy(attr_it->getType()));
+      value = column_buffers_[attr_id].appendValue(*coerced_value);
+    } else {
+      value = column_buffers_[attr_id].appendValue(*value_it);
+    }
+
+    if (attr_it->getType().isVariableLength()) {
+      unmerged_value_bytes_[attr_id] += attr_it->getType().determineByteLength(value);
+    }
+
+    if (integer_range_tracked_[attr_id]) {
+      // Both Int and Long values can be read as longs.
+      const int64_t int_value = getIntegerValue(attr_it->getType(), value);
+      if (num_non_null_values_[attr_id] == 0) {
+        // This is the first value, which automatically becomes both the
+        // minimum and the maximum.
+        maximum_integers_[attr_id] = int_value;
+        minimum_integers_[attr_id] = int_value;
+      } else if (maximum_integers_[attr_id] < int_value) {
+        previous_maximum_integers.push_back(pair<attribute_id, int64_t>(attr_id, maximum_integers_[attr_id]));
+        maximum_integers_[attr_id] = int_value;
+      } else if (int_value < minimum_integers_[attr_id]) {
+        previous_minimum_integers.push_back(pair<attribute_id, int64_t>(attr_id, minimum_integers_[attr_id]));
+        minimum_integers_[attr_id] = int_value;
+      }
+    }
+    ++num_non_null_values_[attr_id];
+
+    ++attr_it;
+    ++value_it;
+  }
+  ++num_tuples_;
 
-    PtrMap<attribute_id, CompressionDictionaryBuilder>::iterator
-        dictionary_it = dictionary_builders_.find(attr_id);
-    if (dictionary_it != dictionary_builders_.end()) {
-      if (dictionary_it->second->insertEntryByReference(*value_it)) {
+  // The required storage only needs to be recomputed when the new tuple is
+  // beyond the number which are known to fit, or when the range of some
+  // integer attribute (and therefore its truncated length) has changed.
+  if ((num_tuples_ > guaranteed_num_tuples_)
+      || !previous_maximum_integers.empty()
+      || !previous_minimum_integers.empty()) {
+    if (!updateGuaranteedNumTuples()) {
+      removeLastTuple(previous_maximum_integers, previous_minimum_integers);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool CompressedBlockBuilder::updateGuaranteedNumTuples() {
+  if (computeRequiredStorage(0) > block_size_) {
+    // The (conservative) estimate is too big, so merge the values of all but
+    // the newest tuple into the dictionaries to get an exact size, then check
+    // whether the newest tuple's values are new dictionary entries.
+    mergeValuesIntoDictionaries(num_tuples_ - 1);
+
+    vector<CompressionDictionaryBuilder*> modified_dictionaries;
+    for (PtrMap<attribute_id, CompressionDictionaryBuilder>::iterator dictionary_it = dictionary_builders_.begin();
+         dictionary_it != dictionary_builders_.end();
+         ++dictionary_it) {
+      const void *value = column_buffers_[dictionary_it->first].getValue(num_tuples_ - 1);
+      if ((value != NULL) && dictionary_it->second->insertEntryByReference(value)) {
         modified_dictionaries.push_back(dictionary_it->second);
       }
     }
+    num_merged_tuples_ = num_tuples_;
+    recomputeUnmergedValueBytes();
+
+    if (computeRequiredStorage(0) > block_size_) {
+      // Leave the newest tuple's values unmerged so that it can be removed.
+      for (vector<CompressionDictionaryBuilder*>::iterator dictionary_it = modified_dictionaries.begin();
+           dictionary_it != modified_dictionaries.end();
+           ++dictionary_it) {
+        (*dictionary_it)->undoLastInsert();
+      }
+      num_merged_tuples_ = num_tuples_ - 1;
+      recomputeUnmergedValueBytes();
+      return false;
+    }
+  }
 
-    CompatUnorderedMap<attribute_id, const TypeInstance*>::unordered_map::iterator
-        max_int_it = maximum_integers_.find(attr_id);
-    if (max_int_it != maximum_integers_.end()) {
-      // If the new value less than zero, we can't truncate it.
-      bool value_is_negative;
-      switch (attr_it->getType().getTypeID()) {
-        case Type::kInt:
-          value_is_negative = value_it->numericGetIntValue() < 0;
-          break;
-        case Type::kLong:
-          value_is_negative = value_it->numericGetLongValue() < 0;
-          break;
-        default:
-          FATAL_ERROR("Non-integer type encountered in the maximum_integers_ map "
-                      "of a CompressedBlockBuilder.");
+  // Find (conservatively) how many more tuples are sure to fit, by doubling
+  // the number of additional tuples and then doing a binary search.
+  size_t fits = 0;
+  size_t does_not_fit = 1;
+  while (computeRequiredStorage(does_not_fit) <= block_size_) {
+    fits = does_not_fit;
+    does_not_fit <<= 1;
+  }
+  while (does_not_fit - fits > 1) {
+    const size_t middle = fits + ((does_not_fit - fits) >> 1);
+    if (computeRequiredStorage(middle) <= block_size_) {
+      fits = middle;
+    } else {
+      does_not_fit = middle;
+    }
+  }
+  guaranteed_num_tuples_ = num_tuples_ + fits;
+  return true;
+}
+
+void CompressedBlockBuilder::mergeValuesIntoDictionaries(const std::size_t num_tuples) {
+  DEBUG_ASSERT(num_tuples <= num_tuples_);
+  if (num_tuples <= num_merged_tuples_) {
+    return;
+  }
+
+  vector<const void*> new_values;
+  new_values.reserve(num_tuples - num_merged_tuples_);
+  for (PtrMap<attribute_id, CompressionDictionaryBuilder>::iterator dictionary_it = dictionary_builders_.begin();
+       dictionary_it != dictionary_builders_.end();
+       ++dictionary_it) {
+    const ColumnBuffer &column = column_buffers_[dictionary_it->first];
+    new_values.clear();
+    for (size_t position = num_merged_tuples_; position < num_tuples; ++position) {
+      if (column.getValue(position) != NULL) {
+        new_values.push_back(column.getValue(position));
       }
+    }
+    dictionary_it->second->insertEntriesByReference(&new_values);
+  }
+  num_merged_tuples_ = num_tuples;
+  recomputeUnmergedValueBytes();
+}
 
-      if (value_is_negative) {
-        previous_maximum_integers.insert(pair<attribute_id, const TypeInstance*>(attr_id, max_int_it->second));
-        // Stop counting maximum, since we can no longer compress by truncating.
-        maximum_integers_.erase(max_int_it);
-      } else if (max_int_it->second == NULL) {
-        // If there was no maximum before, then this is the first value and
-        // automatically becomes the maximum.
-        //
-        // Some older versions of GCC will raise an error here if we don't
-        // manually cast NULL to the appropriate type.
-        previous_maximum_integers.insert(pair<attribute_id, const TypeInstance*>(
-            attr_id,
-            static_cast<const TypeInstance*>(NULL)));
-        max_int_it->second = &(*value_it);
-      } else {
-        // Compare with the previous maximum and update as necessary.
-        bool new_maximum;
-        switch (attr_it->getType().getTypeID()) {
-          case Type::kInt:
-            new_maximum = max_int_it->second->numericGetIntValue() < value_it->numericGetIntValue();
-            break;
-          case Type::kLong:
-            new_maximum = max_int_it->second->numericGetLongValue() < value_it->numericGetLongValue();
-            break;
-          default:
-            FATAL_ERROR("Non-integer type encountered in the maximum_integers_ map "
-                        "of a CompressedBlockBuilder.");
+void CompressedBlockBuilder::recomputeUnmergedValueBytes() {
+  for (CatalogRelation::const_iterator attr_it = relation_.begin();
+       attr_it != relation_.end();
+       ++attr_it) {
+    if (attr_it->getType().isVariableLength()) {
+      size_t unmerged_bytes = 0;
+      const ColumnBuffer &column = column_buffers_[attr_it->getID()];
+      for (size_t position = num_merged_tuples_; position < num_tuples_; ++position) {
+        if (column.getValue(position) != NULL) {
+          unmerged_bytes += attr_it->getType().determineByteLength(column.getValue(position));
         }
+      }
+      unmerged_value_bytes_[attr_it->getID()] = unmerged_bytes;
+    }
+  }
+}
 
-        if (new_maximum) {
-          previous_maximum_integers.insert(pair<attribute_id, const TypeInstance*>(attr_id, max_int_it->second));
-          max_int_it->second = &(*value_it);
-        }
+void CompressedBlockBuilder::removeLastTuple(
+    const std::vector<std::pair<attribute_id, std::int64_t> > &previous_maximum_integers,
+    const std::vector<std::pair<attribute_id, std::int64_t> > &previous_minimum_integers) {
+  DEBUG_ASSERT(num_tuples_ > num_merged_tuples_);
+  --num_tuples_;
+  for (CatalogRelation::const_iterator attr_it = relation_.begin();
+       attr_it != relation_.end();
+       ++attr_it) {
+    const void *value = column_buffers_[attr_it->getID()].getValue(num_tuples_);
+    if (value != NULL) {
+      if (attr_it->getType().isVariableLength()) {
+        unmerged_value_bytes_[attr_it->getID()] -= attr_it->getType().determineByteLength(value);
       }
+      --num_non_null_values_[attr_it->getID()];
     }
+    column_buffers_[attr_it->getID()].removeLastValue();
+  }
 
-    ++attr_it;
-    ++value_it;
+  for (vector<pair<attribute_id, int64_t> >::const_iterator previous_max_it = previous_maximum_integers.begin();
+       previous_max_it != previous_maximum_integers.end();
+       ++previous_max_it) {
+    maximum_integers_[previous_max_it->first] = previous_max_it->second;
   }
 
-  if (computeRequiredStorage(tuples_.size() + 1) > block_size_) {
-    rollbackLastInsert(modified_dictionaries, previous_maximum_integers);
-    return false;
-  } else {
-    tuples_.push_back(candidate_tuple.release());
-    return true;
+  for (vector<pair<attribute_id, int64_t> >::const_iterator previous_min_it = previous_minimum_integers.begin();
+       previous_min_it != previous_minimum_integers.end();
+       ++previous_min_it) {
+    minimum_integers_[previous_min_it->first] = previous_min_it->second;
   }
 }
 
 void CompressedBlockBuilder::buildCompressedPackedRowStoreTupleStorageSubBlock(void *sub_block_memory) {
-  DEBUG_ASSERT(computeRequiredStorage(tuples_.size()) <= block_size_);
+  // Finish building the dictionaries.
+  mergeValuesIntoDictionaries(num_tuples_);
+  DEBUG_ASSERT(computeRequiredStorage(0) <= block_size_);
 
   char *data_ptr = static_cast<char*>(sub_block_memory)
                    + buildTupleStorageSubBlockHeader(sub_block_memory);
 
-  PtrMap<attribute_id, CompressionDictionary> dictionaries;
-  buildDictionaryMap(sub_block_memory, &dictionaries);
+  PtrVector<CompressionDictionary> block_dictionaries;
+  vector<const CompressionDictionary*> dictionaries;
+  buildDictionaryMap(sub_block_memory, &block_dictionaries, &dictionaries);
 
-  for (PtrVector<Tuple>::const_iterator tuple_it = tuples_.begin();
-       tuple_it != tuples_.end();
-       ++tuple_it) {
+  for (size_t tuple_num = 0;
+       tuple_num < num_tuples_;
+       ++tuple_num) {
     for (CatalogRelation::const_iterator attr_it = relation_.begin();
          attr_it != relation_.end();
          ++attr_it) {
-      if (compression_info_.dictionary_size(attr_it->getID()) > 0) {
+      if (dictionaries[attr_it->getID()] != NULL) {
         // Attribute is dictionary-compressed.
-        PtrMap<attribute_id, CompressionDictionary>::const_iterator
-            dictionary_it = dictionaries.find(attr_it->getID());
-        DEBUG_ASSERT(dictionary_it != dictionaries.end());
+        const CompressionDictionary &dictionary = *dictionaries[attr_it->getID()];
         switch (compression_info_.attribute_size(attr_it->getID())) {
           case 1:
             *reinterpret_cast<uint8_t*>(data_ptr)
-                = dictionary_it->second->getCodeForTypedValue(tuple_it->getAttributeValue(attr_it->getID()));
+                = getDictionaryCodeForTuple(attr_it->getID(), dictionary, tuple_num);
             break;
           case 2:
             *reinterpret_cast<uint16_t*>(data_ptr)
-                = dictionary_it->second->getCodeForTypedValue(tuple_it->getAttributeValue(attr_it->getID()));
+                = getDictionaryCodeForTuple(attr_it->getID(), dictionary, tuple_num);
             break;
           case 4:
             *reinterpret_cast<uint32_t*>(data_ptr)
-                = dictionary_it->second->getCodeForTypedValue(tuple_it->getAttributeValue(attr_it->getID()));
+                = getDictionaryCodeForTuple(attr_it->getID(), dictionary, tuple_num);
             break;
           default:
             FATAL_ERROR("Dictionary-compressed type had non power-of-two length in "
@@ -281,16 +485,13 @@ void CompressedBlockBuilder::buildCompressedPackedRowStoreTupleStorageSubBlock(v
         // Attribute is compressed by truncation.
         switch (compression_info_.attribute_size(attr_it->getID())) {
           case 1:
-            *reinterpret_cast<uint8_t*>(data_ptr)
-                = tuple_it->getAttributeValue(attr_it->getID()).numericGetIntValue();
+            *reinterpret_cast<uint8_t*>(data_ptr) = getTruncatedCodeForTuple(attr_it->getID(), tuple_num);
             break;
           case 2:
-            *reinterpret_cast<uint16_t*>(data_ptr)
-                = tuple_it->getAttributeValue(attr_it->getID()).numericGetIntValue();
+            *reinterpret_cast<uint16_t*>(data_ptr) = getTruncatedCodeForTuple(attr_it->getID(), tuple_num);
             break;
           case 4:
-            *reinterpret_cast<uint32_t*>(data_ptr)
-                = tuple_it->getAttributeValue(attr_it->getID()).numericGetLongValue();
+            *reinterpret_cast<uint32_t*>(data_ptr) = getTruncatedCodeForTuple(attr_it->getID(), tuple_num);
             break;
           default:
             FATAL_ERROR("Truncation-compressed type had non power-of-two length in "
@@ -298,7 +499,12 @@ void CompressedBlockBuilder::buildCompressedPackedRowStoreTupleStorageSubBlock(v
         }
       } else {
         // Attribute is uncompressed.
-        tuple_it->getAttributeValue(attr_it->getID()).copyInto(data_ptr);
+        const void *value = getValueForTuple(attr_it->getID(), tuple_num);
+        if (value == NULL) {
+          memset(data_ptr, 0, compression_info_.attribute_size(attr_it->getID()));
+        } else {
+          memcpy(data_ptr, value, compression_info_.attribute_size(attr_it->getID()));
+        }
       }
       data_ptr += compression_info_.attribute_size(attr_it->getID());
     }
@@ -306,49 +512,53 @@ void CompressedBlockBuilder::buildCompressedPackedRowStoreTupleStorageSubBlock(v
 }
 
 void CompressedBlockBuilder::buildCompressedColumnStoreTupleStorageSubBlock(void *sub_block_memory) {
-  DEBUG_ASSERT(computeRequiredStorage(tuples_.size()) <= block_size_);
+  // Finish building the dictionaries.
+  mergeValuesIntoDictionaries(num_tuples_);
+  DEBUG_ASSERT(computeRequiredStorage(0) <= block_size_);
 
-  // Sort tuples according to values of the sort attribute.
+  // Sort tuples according to values of the sort attribute. Rather than moving
+  // values around, this sorts the tuples' positions in the column buffers.
   const Type &sort_attribute_type = relation_.getAttributeById(sort_attribute_id_).getType();
   ScopedPtr<UncheckedComparator> sort_attribute_comp(
       Comparison::GetComparison(Comparison::kLess).makeUncheckedComparatorForTypes(sort_attribute_type,
                                                                                    sort_attribute_type));
-  sort(tuples_.getInternalVectorMutable()->begin(),
-       tuples_.getInternalVectorMutable()->end(),
-       TupleComparator(sort_attribute_id_, *sort_attribute_comp));
+  sorted_positions_.resize(num_tuples_);
+  for (size_t position = 0; position < num_tuples_; ++position) {
+    sorted_positions_[position] = position;
+  }
+  sort(sorted_positions_.begin(),
+       sorted_positions_.end(),
+       PositionComparator(column_buffers_[sort_attribute_id_], *sort_attribute_comp));
 
-  char *current_stripe = static_cast<char*>(sub_block_memory)
-                         + buildTupleStorageSubBlockHeader(sub_block_memory);
+  const size_t header_size = buildTupleStorageSubBlockHeader(sub_block_memory);
+  char *current_stripe = static_cast<char*>(sub_block_memory) + header_size;
 
-  PtrMap<attribute_id, CompressionDictionary> dictionaries;
-  buildDictionaryMap(sub_block_memory, &dictionaries);
+  PtrVector<CompressionDictionary> block_dictionaries;
+  vector<const CompressionDictionary*> dictionaries;
+  buildDictionaryMap(sub_block_memory, &block_dictionaries, &dictionaries);
 
-  size_t tuple_size = 0;
-  size_t total_dictionary_size = 0;
-  for (CatalogRelation::const_iterator attr_it = relation_.begin();
-       attr_it != relation_.end();
-       ++attr_it) {
-    tuple_size += compression_info_.attribute_size(attr_it->getID());
-    total_dictionary_size += compression_info_.dictionary_size(attr_it->getID());
-  }
-  DEBUG_ASSERT(tuple_size > 0);
-  size_t max_tuples = (block_size_
-                      - (sizeof(tuple_id) + sizeof(int) + compression_info_.ByteSize() + total_dictionary_size))
-                      / tuple_size;
+  const size_t max_tuples = CompressedColumnStoreTupleStorageSubBlock::ComputeMaxNumTuples(
+      relation_,
+      compression_info_,
+      block_size_ - header_size);
+  DEBUG_ASSERT(max_tuples >= num_tuples_);
 
   for (CatalogRelation::const_iterator attr_it = relation_.begin();
        attr_it != relation_.end();
        ++attr_it) {
-    if (compression_info_.dictionary_size(attr_it->getID()) > 0) {
+    if (compression_info_.num_runs(attr_it->getID()) > 0) {
+      // Attribute is run-length encoded (only possible for the sort column).
+      buildRunLengthEncodedColumnStripe(attr_it->getID(),
+                                        dictionaries,
+                                        current_stripe);
+    } else if (dictionaries[attr_it->getID()] != NULL) {
       // Attribute is dictionary-compressed.
-      PtrMap<attribute_id, CompressionDictionary>::const_iterator
-          dictionary_it = dictionaries.find(attr_it->getID());
-      DEBUG_ASSERT(dictionary_it != dictionaries.end());
       buildDictionaryCompressedColumnStripe(attr_it->getID(),
-                                            *(dictionary_it->second),
+                                            *dictionaries[attr_it->getID()],
                                             current_stripe);
-    } else if (compression_info_.attribute_size(attr_it->getID())
-               != attr_it->getType().maximumByteLength()) {
+    } else if ((compression_info_.attribute_size(attr_it->getID())
+                    != attr_it->getType().maximumByteLength())
+               || (compression_info_.attribute_bits(attr_it->getID()) > 0)) {
       // Attribute is truncation-compressed.
       buildTruncationCompressedColumnStripe(attr_it->getID(),
                                             current_stripe);
@@ -358,13 +568,21 @@ void CompressedBlockBuilder::buildCompressedColumnStoreTupleStorageSubBlock(void
                                     current_stripe);
     }
 
-    current_stripe += max_tuples * compression_info_.attribute_size(attr_it->getID());
+    current_stripe += CompressedColumnStoreTupleStorageSubBlock::ComputeStripeSizeBytes(compression_info_,
+                                                                                        attr_it->getID(),
+                                                                                        max_tuples);
   }
 }
 
-std::size_t CompressedBlockBuilder::computeRequiredStorage(const std::size_t num_tuples) const {
-  // Start with the size of the header.
-  size_t required_storage = compression_info_.ByteSize() + sizeof(int) + sizeof(tuple_id);
+std::size_t CompressedBlockBuilder::computeRequiredStorage(const std::size_t num_additional_tuples) const {
+  const size_t num_tuples = num_tuples_ + num_additional_tuples;
+  // Values which have not been merged into dictionaries yet (including those
+  // of the additional tuples) might all be new dictionary entries.
+  const size_t num_unmerged_tuples = num_tuples - num_merged_tuples_;
+
+  // Start with the size of the header and the NULL bitmaps.
+  size_t required_storage = compression_info_.ByteSize() + sizeof(int) + sizeof(tuple_id)
+                            + NullBitmaps::BytesNeeded(relation_, num_tuples);
 
   // Add required storage attribute-by-attribute.
   for (CatalogRelation::const_iterator attr_it = relation_.begin();
@@ -372,22 +590,53 @@ std::size_t CompressedBlockBuilder::computeRequiredStorage(const std::size_t num
        ++attr_it) {
     PtrMap<attribute_id, CompressionDictionaryBuilder>::const_iterator
         dictionary_it = dictionary_builders_.find(attr_it->getID());
-    if (dictionary_it == dictionary_builders_.end()) {
-      // This attribute is not compressed.
+    if ((dictionary_it == dictionary_builders_.end()) || attributeIsAllNull(attr_it->getID())) {
+      // This attribute is not compressed. An attribute which only has NULLs
+      // so far might remain all NULL, and this is an upper bound otherwise.
       required_storage += num_tuples * attr_it->getType().maximumByteLength();
-    } else if (attr_it->getType().isVariableLength()) {
+      continue;
+    }
+
+    // Calculate the total number of bytes (including storage for the
+    // dictionary itself) needed to store all values with dictionary
+    // compression.
+    const size_t max_num_entries = dictionary_it->second->numberOfEntries() + num_unmerged_tuples;
+    const size_t max_total_value_size
+        = dictionary_it->second->totalValueSizeBytes()
+          + unmerged_value_bytes_[attr_it->getID()]
+          + num_additional_tuples * attr_it->getType().maximumByteLength();
+    if (shared_dictionaries_[attr_it->getID()] != NULL) {
+      // No dictionary is stored in the block, and codes come from a version
+      // of the shared dictionary with at most 'max_num_entries' more codes
+      // than the base version.
+      required_storage += computeCodeStorageWithRunLengthEncoding(
+          attr_it->getID(),
+          max_num_entries,
+          computeDictionaryCodeStorage(
+              CompressionDictionaryBuilder::CodeLengthBitsForEntries(
+                  shared_dictionary_base_num_codes_[attr_it->getID()] + max_num_entries),
+              num_tuples));
+      continue;
+    }
+    size_t dictionary_bytes
+        = dictionary_it->second->dictionarySizeBytesFor(max_num_entries, max_total_value_size)
+          + computeCodeStorageWithRunLengthEncoding(
+              attr_it->getID(),
+              max_num_entries,
+              computeDictionaryCodeStorage(CompressionDictionaryBuilder::CodeLengthBitsForEntries(max_num_entries),
+                                           num_tuples));
+    if (attr_it->getType().isVariableLength()) {
       // Variable-length types MUST use dictionary compression.
-      required_storage += dictionary_it->second->dictionarySizeBytes()
-                          + num_tuples * dictionary_it->second->codeLengthPaddedBytes();
+      required_storage += dictionary_bytes;
     } else {
       // Calculate the number of bytes needed to store all values when
       // truncating (if possible) or just storing values uncompressed.
-      size_t truncated_bytes = num_tuples * computeTruncatedByteLengthForAttribute(attr_it->getID());
-      // Calculate the total number of bytes (including storage for the
-      // dictionary itself) needed to store all values with dictionary
-      // compression.
-      size_t dictionary_bytes = dictionary_it->second->dictionarySizeBytes()
-                                + num_tuples * dictionary_it->second->codeLengthPaddedBytes();
+      size_t truncated_bytes = computeTruncatedStorageForAttribute(attr_it->getID(), num_tuples);
+      if (truncationIsPossible(attr_it->getID())) {
+        truncated_bytes = computeCodeStorageWithRunLengthEncoding(attr_it->getID(),
+                                                                  max_num_entries,
+                                                                  truncated_bytes);
+      }
       // Choose the method that uses space most efficiently.
       if (truncated_bytes < dictionary_bytes) {
         required_storage += truncated_bytes;
@@ -405,66 +654,112 @@ std::size_t CompressedBlockBuilder::computeTruncatedByteLengthForAttribute(
   DEBUG_ASSERT(relation_.hasAttributeWithId(attr_id));
 
   size_t truncated_bytes = relation_.getAttributeById(attr_id).getType().maximumByteLength();
-  CompatUnorderedMap<attribute_id, const TypeInstance*>::unordered_map::const_iterator
-      max_int_it = maximum_integers_.find(attr_id);
-  if ((max_int_it != maximum_integers_.end() && (max_int_it->second != NULL))) {
-    unsigned int leading_zero_bits;
-    switch (max_int_it->second->getType().getTypeID()) {
-      case Type::kInt:
-        DEBUG_ASSERT(max_int_it->second->numericGetIntValue() >= 0);
-        if (max_int_it->second->numericGetIntValue()) {
-          leading_zero_bits = leading_zero_count_32(
-              static_cast<uint32_t>(max_int_it->second->numericGetIntValue()));
-        } else {
-          leading_zero_bits = 32;
-        }
-        break;
-      case Type::kLong:
-        DEBUG_ASSERT(max_int_it->second->numericGetLongValue() >= 0);
-        if (max_int_it->second->numericGetLongValue()) {
-          // Due to a quirk in predicate evaluation on truncated values,
-          // we shouldn't store UINT32_MAX truncated.
-          if (max_int_it->second->numericGetLongValue() == numeric_limits<uint32_t>::max()) {
-            return truncated_bytes;
-          }
-          leading_zero_bits = leading_zero_count_64(
-              static_cast<uint64_t>(max_int_it->second->numericGetLongValue()));
-        } else {
-          leading_zero_bits = 64;
-        }
-        break;
-      default:
-        FATAL_ERROR("Non-integer type encountered in the maximum_integers_ map "
-                    "of a CompressedBlockBuilder.");
-    }
-
-    unsigned int needed_bits = (truncated_bytes << 3) - leading_zero_bits;
-    if (needed_bits < 9) {
-      truncated_bytes = 1;
-    } else if (needed_bits < 17) {
-      truncated_bytes = 2;
-    } else if (needed_bits < 33) {
-      truncated_bytes = 4;
-    }
+  unsigned int needed_bits = computeTruncatedBitLengthForAttribute(attr_id);
+  if (needed_bits == 0) {
+    return truncated_bytes;
+  } else if (needed_bits < 9) {
+    truncated_bytes = 1;
+  } else if (needed_bits < 17) {
+    truncated_bytes = 2;
+  } else {
+    truncated_bytes = 4;
   }
 
   return truncated_bytes;
 }
 
-void CompressedBlockBuilder::rollbackLastInsert(
-    const std::vector<CompressionDictionaryBuilder*> &modified_dictionaries,
-    const CompatUnorderedMap<attribute_id, const TypeInstance*>::unordered_map &previous_maximum_integers) {
-  for (vector<CompressionDictionaryBuilder*>::const_iterator dictionary_it = modified_dictionaries.begin();
-       dictionary_it != modified_dictionaries.end();
-       ++dictionary_it) {
-    (*dictionary_it)->undoLastInsert();
+unsigned int CompressedBlockBuilder::computeTruncatedBitLengthForAttribute(
+    const attribute_id attr_id) const {
+  DEBUG_ASSERT(relation_.hasAttributeWithId(attr_id));
+
+  if (!integer_range_tracked_[attr_id] || (num_tuples_ == 0)) {
+    return 0;
   }
 
-  for (CompatUnorderedMap<attribute_id, const TypeInstance*>::unordered_map::const_iterator
-           previous_max_it = previous_maximum_integers.begin();
-       previous_max_it != previous_maximum_integers.end();
-       ++previous_max_it) {
-    maximum_integers_[previous_max_it->first] = previous_max_it->second;
+  // Values are stored as offsets from the minimum value (the frame of
+  // reference), so the number of bits needed depends only on the range of
+  // values. Unsigned arithmetic avoids overflow for very wide Long ranges.
+  const uint64_t value_range = static_cast<uint64_t>(maximum_integers_[attr_id])
+                               - static_cast<uint64_t>(minimum_integers_[attr_id]);
+  // Due to a quirk in predicate evaluation on truncated values, we shouldn't
+  // store a range of UINT32_MAX (or more) truncated.
+  if (value_range >= numeric_limits<uint32_t>::max()) {
+    return 0;
+  }
+
+  // Even if all values are the same, codes still take up at least one bit.
+  if (value_range == 0) {
+    return 1;
+  } else {
+    return 64 - leading_zero_count_64(value_range);
+  }
+}
+
+std::size_t CompressedBlockBuilder::computeTruncatedStorageForAttribute(
+    const attribute_id attr_id,
+    const std::size_t num_tuples) const {
+  if (bitPackedTruncationIsPossible(attr_id)) {
+    return BitPackedCodeStripe::SizeBytes(num_tuples, computeTruncatedBitLengthForAttribute(attr_id));
+  } else {
+    return num_tuples * computeTruncatedByteLengthForAttribute(attr_id);
+  }
+}
+
+bool CompressedBlockBuilder::bitPackedTruncationIsPossible(const attribute_id attr_id) const {
+  if (!bit_pack_codes_) {
+    return false;
+  }
+  const unsigned int truncated_bits = computeTruncatedBitLengthForAttribute(attr_id);
+  return (truncated_bits > 0)
+         && (truncated_bits < (relation_.getAttributeById(attr_id).getType().maximumByteLength() << 3));
+}
+
+std::size_t CompressedBlockBuilder::computeDictionaryCodeStorage(
+    const std::uint8_t code_length_bits,
+    const std::size_t num_tuples) const {
+  if (bit_pack_codes_) {
+    return BitPackedCodeStripe::SizeBytes(num_tuples, code_length_bits);
+  } else {
+    return num_tuples * CompressionDictionaryBuilder::CodeLengthPaddedBytes(code_length_bits);
+  }
+}
+
+bool CompressedBlockBuilder::truncationIsPossible(const attribute_id attr_id) const {
+  return (computeTruncatedByteLengthForAttribute(attr_id)
+              != relation_.getAttributeById(attr_id).getType().maximumByteLength())
+         || bitPackedTruncationIsPossible(attr_id);
+}
+
+bool CompressedBlockBuilder::runLengthEncodingIsSmaller(const attribute_id attr_id,
+                                                        const std::size_t num_runs,
+                                                        const std::size_t code_storage_bytes) const {
+  if (!bit_pack_codes_ || (attr_id != sort_attribute_id_)) {
+    return false;
+  }
+  return CompressedColumnStoreTupleStorageSubBlock::ComputeRunLengthStripeSizeBytes(num_runs)
+         < code_storage_bytes;
+}
+
+std::size_t CompressedBlockBuilder::computeCodeStorageWithRunLengthEncoding(
+    const attribute_id attr_id,
+    const std::size_t num_runs,
+    const std::size_t code_storage_bytes) const {
+  if (runLengthEncodingIsSmaller(attr_id, num_runs, code_storage_bytes)) {
+    return CompressedColumnStoreTupleStorageSubBlock::ComputeRunLengthStripeSizeBytes(num_runs);
+  } else {
+    return code_storage_bytes;
+  }
+}
+
+void CompressedBlockBuilder::setRunLengthEncodingIfSmaller(const attribute_id attr_id,
+                                                           const std::size_t code_storage_bytes) {
+  // Tuples are sorted on the sort attribute, so there is exactly one run for
+  // each distinct value.
+  const size_t num_runs = dictionary_builders_.find(attr_id)->second->numberOfEntries();
+  if (runLengthEncodingIsSmaller(attr_id, num_runs, code_storage_bytes)) {
+    compression_info_.set_num_runs(attr_id, num_runs);
+  } else if (bit_pack_codes_) {
+    compression_info_.set_num_runs(attr_id, 0);
   }
 }
 
@@ -475,42 +770,102 @@ std::size_t CompressedBlockBuilder::buildTupleStorageSubBlockHeader(void *sub_bl
        ++attr_it) {
     PtrMap<attribute_id, CompressionDictionaryBuilder>::const_iterator
         dictionary_it = dictionary_builders_.find(attr_it->getID());
-    if (dictionary_it == dictionary_builders_.end()) {
+    if ((dictionary_it == dictionary_builders_.end()) || attributeIsAllNull(attr_it->getID())) {
       // This attribute is not compressed.
       compression_info_.set_attribute_size(attr_it->getID(),
                                            attr_it->getType().maximumByteLength());
       compression_info_.set_dictionary_size(attr_it->getID(), 0);
+    } else if (shared_dictionaries_[attr_it->getID()] != NULL) {
+      // Find (or create) a version of the shared dictionary with all of this
+      // block's values, whose codes are no longer than estimated.
+      const uint32_t version = shared_dictionaries_[attr_it->getID()]->getVersionContainingValues(
+          dictionary_it->second->getEntriesByReference(),
+          shared_dictionary_base_versions_[attr_it->getID()],
+          CompressionDictionaryBuilder::CodeLengthBitsForEntries(
+              shared_dictionary_base_num_codes_[attr_it->getID()]
+                  + dictionary_it->second->numberOfEntries()));
+      const uint8_t code_length_bits = CompressionDictionaryBuilder::CodeLengthBitsForEntries(
+          shared_dictionaries_[attr_it->getID()]->getVersion(version).numberOfCodes());
+      compression_info_.set_shared_dictionary_version(attr_it->getID(), version);
+      compression_info_.set_attribute_size(attr_it->getID(),
+                                           CompressionDictionaryBuilder::CodeLengthPaddedBytes(code_length_bits));
+      compression_info_.set_dictionary_size(attr_it->getID(), 0);
+      if (bit_pack_codes_) {
+        compression_info_.set_attribute_bits(attr_it->getID(), code_length_bits);
+        setRunLengthEncodingIfSmaller(attr_it->getID(),
+                                      computeDictionaryCodeStorage(code_length_bits, num_tuples_));
+      }
     } else if (attr_it->getType().isVariableLength()) {
       // Variable-length types MUST use dictionary compression.
       compression_info_.set_attribute_size(attr_it->getID(),
                                            dictionary_it->second->codeLengthPaddedBytes());
       compression_info_.set_dictionary_size(attr_it->getID(),
                                             dictionary_it->second->dictionarySizeBytes());
+      if (bit_pack_codes_) {
+        compression_info_.set_attribute_bits(attr_it->getID(),
+                                             dictionary_it->second->codeLengthBits());
+        setRunLengthEncodingIfSmaller(
+            attr_it->getID(),
+            computeDictionaryCodeStorage(dictionary_it->second->codeLengthBits(), num_tuples_));
+      }
     } else {
       // Calculate the number of bytes needed to store all values when
       // truncating (if possible) or just storing values uncompressed.
-      size_t truncated_bytes = tuples_.size() * computeTruncatedByteLengthForAttribute(attr_it->getID());
+      size_t truncated_bytes = computeTruncatedStorageForAttribute(attr_it->getID(), num_tuples_);
+      const size_t truncated_code_bytes = truncated_bytes;
+      if (truncationIsPossible(attr_it->getID())) {
+        truncated_bytes = computeCodeStorageWithRunLengthEncoding(attr_it->getID(),
+                                                                  dictionary_it->second->numberOfEntries(),
+                                                                  truncated_bytes);
+      }
       // Calculate the total number of bytes (including storage for the
       // dictionary itself) needed to store all values with dictionary
       // compression.
+      const size_t dictionary_code_bytes = computeDictionaryCodeStorage(dictionary_it->second->codeLengthBits(),
+                                                                        num_tuples_);
       size_t dictionary_bytes = dictionary_it->second->dictionarySizeBytes()
-                                + tuples_.size() * dictionary_it->second->codeLengthPaddedBytes();
+                                + computeCodeStorageWithRunLengthEncoding(attr_it->getID(),
+                                                                          dictionary_it->second->numberOfEntries(),
+                                                                          dictionary_code_bytes);
       // Choose the method that uses space most efficiently.
       if (truncated_bytes < dictionary_bytes) {
-        compression_info_.set_attribute_size(attr_it->getID(),
-                                             computeTruncatedByteLengthForAttribute(attr_it->getID()));
+        size_t truncated_length = computeTruncatedByteLengthForAttribute(attr_it->getID());
+        compression_info_.set_attribute_size(attr_it->getID(), truncated_length);
         compression_info_.set_dictionary_size(attr_it->getID(), 0);
+        bool is_truncated = (truncated_length != attr_it->getType().maximumByteLength());
+        if (bitPackedTruncationIsPossible(attr_it->getID())) {
+          // NOTE(chasseur): When codes are bit-packed, an attribute can be
+          // truncated even if its padded code length is the same as the
+          // length of the type (e.g. an Int with a 20-bit range of values).
+          compression_info_.set_attribute_bits(attr_it->getID(),
+                                               computeTruncatedBitLengthForAttribute(attr_it->getID()));
+          is_truncated = true;
+        }
+        if (is_truncated) {
+          compression_info_.set_frame_of_reference(
+              attr_it->getID(),
+              minimum_integers_[attr_it->getID()]);
+          setRunLengthEncodingIfSmaller(attr_it->getID(), truncated_code_bytes);
+        }
       } else {
         compression_info_.set_attribute_size(attr_it->getID(),
                                              dictionary_it->second->codeLengthPaddedBytes());
         compression_info_.set_dictionary_size(attr_it->getID(),
                                               dictionary_it->second->dictionarySizeBytes());
+        if (bit_pack_codes_) {
+          compression_info_.set_attribute_bits(attr_it->getID(),
+                                               dictionary_it->second->codeLengthBits());
+          setRunLengthEncodingIfSmaller(attr_it->getID(), dictionary_code_bytes);
+        }
       }
     }
   }
 
   // Record the number of tuples.
-  *static_cast<tuple_id*>(sub_block_memory) = tuples_.size();
+  *static_cast<tuple_id*>(sub_block_memory) = num_tuples_;
+  if (relation_.hasNullableAttributes()) {
+    compression_info_.set_null_bitmap_num_bits(num_tuples_);
+  }
 
   // Serialize the compression info.
   *reinterpret_cast<int*>(static_cast<char*>(sub_block_memory) + sizeof(tuple_id))
@@ -521,8 +876,29 @@ std::size_t CompressedBlockBuilder::buildTupleStorageSubBlockHeader(void *sub_bl
                 "CompressedBlockBuilder::buildTupleStorageSubBlockHeader");
   }
 
-  // Build the physical dictionaries.
   size_t memory_offset = sizeof(tuple_id) + sizeof(int) + compression_info_.ByteSize();
+
+  // Build the NULL bitmaps.
+  if (relation_.hasNullableAttributes()) {
+    NullBitmaps null_bitmaps(relation_,
+                             static_cast<char*>(sub_block_memory) + memory_offset,
+                             num_tuples_,
+                             true);
+    for (CatalogRelation::const_iterator attr_it = relation_.begin();
+         attr_it != relation_.end();
+         ++attr_it) {
+      if (null_bitmaps.hasNullBitmap(attr_it->getID())) {
+        for (size_t tuple_num = 0; tuple_num < num_tuples_; ++tuple_num) {
+          if (getValueForTuple(attr_it->getID(), tuple_num) == NULL) {
+            null_bitmaps.setNull(tuple_num, attr_it->getID(), true);
+          }
+        }
+      }
+    }
+    memory_offset += NullBitmaps::BytesNeeded(relation_, num_tuples_);
+  }
+
+  // Build the physical dictionaries.
   for (attribute_id attr_id = 0;
        attr_id <= relation_.getMaxAttributeId();
        ++attr_id) {
@@ -538,26 +914,31 @@ std::size_t CompressedBlockBuilder::buildTupleStorageSubBlockHeader(void *sub_bl
 
 void CompressedBlockBuilder::buildDictionaryMap(
     const void *sub_block_memory,
-    PtrMap<attribute_id, CompressionDictionary> *dictionary_map) const {
+    PtrVector<CompressionDictionary> *block_dictionaries,
+    std::vector<const CompressionDictionary*> *dictionary_map) const {
+  dictionary_map->assign(relation_.getMaxAttributeId() + 1, NULL);
   const char *dictionary_memory = static_cast<const char*>(sub_block_memory)
-                                  + sizeof(int) + sizeof(tuple_id) + compression_info_.ByteSize();
+                                  + sizeof(int) + sizeof(tuple_id) + compression_info_.ByteSize()
+                                  + NullBitmaps::BytesNeeded(relation_, num_tuples_);
   for (CatalogRelation::const_iterator attr_it = relation_.begin();
        attr_it != relation_.end();
        ++attr_it) {
-    if (compression_info_.dictionary_size(attr_it->getID()) > 0) {
+    if (compression_info_.shared_dictionary_version(attr_it->getID()) > 0) {
+      (*dictionary_map)[attr_it->getID()] = &(shared_dictionaries_[attr_it->getID()]->getVersion(
+          compression_info_.shared_dictionary_version(attr_it->getID())));
+    } else if (compression_info_.dictionary_size(attr_it->getID()) > 0) {
       if (attr_it->getType().isVariableLength()) {
-        dictionary_map->insert(
-            attr_it->getID(),
+        block_dictionaries->push_back(
             new VariableLengthTypeCompressionDictionary(attr_it->getType(),
                                                         dictionary_memory,
                                                         compression_info_.dictionary_size(attr_it->getID())));
       } else {
-        dictionary_map->insert(
-            attr_it->getID(),
+        block_dictionaries->push_back(
             new FixedLengthTypeCompressionDictionary(attr_it->getType(),
                                                      dictionary_memory,
                                                      compression_info_.dictionary_size(attr_it->getID())));
       }
+      (*dictionary_map)[attr_it->getID()] = &(block_dictionaries->back());
 
       dictionary_memory += compression_info_.dictionary_size(attr_it->getID());
     }
@@ -568,29 +949,42 @@ void CompressedBlockBuilder::buildDictionaryCompressedColumnStripe(
     const attribute_id attr_id,
     const CompressionDictionary &dictionary,
     void *stripe_location) const {
+  if (bit_pack_codes_) {
+    const unsigned int code_bits = compression_info_.attribute_bits(attr_id);
+    for (size_t tuple_num = 0;
+         tuple_num < num_tuples_;
+         ++tuple_num) {
+      BitPackedCodeStripe::SetCode(stripe_location,
+                                   code_bits,
+                                   tuple_num,
+                                   getDictionaryCodeForTuple(attr_id, dictionary, tuple_num));
+    }
+    return;
+  }
+
   switch (compression_info_.attribute_size(attr_id)) {
     case 1:
       for (size_t tuple_num = 0;
-           tuple_num < tuples_.size();
+           tuple_num < num_tuples_;
            ++tuple_num) {
         reinterpret_cast<uint8_t*>(stripe_location)[tuple_num]
-            = dictionary.getCodeForTypedValue(tuples_[tuple_num].getAttributeValue(attr_id));
+            = getDictionaryCodeForTuple(attr_id, dictionary, tuple_num);
       }
       break;
     case 2:
       for (size_t tuple_num = 0;
-           tuple_num < tuples_.size();
+           tuple_num < num_tuples_;
            ++tuple_num) {
         reinterpret_cast<uint16_t*>(stripe_location)[tuple_num]
-            = dictionary.getCodeForTypedValue(tuples_[tuple_num].getAttributeValue(attr_id));
+            = getDictionaryCodeForTuple(attr_id, dictionary, tuple_num);
       }
       break;
     case 4:
       for (size_t tuple_num = 0;
-           tuple_num < tuples_.size();
+           tuple_num < num_tuples_;
            ++tuple_num) {
         reinterpret_cast<uint32_t*>(stripe_location)[tuple_num]
-            = dictionary.getCodeForTypedValue(tuples_[tuple_num].getAttributeValue(attr_id));
+            = getDictionaryCodeForTuple(attr_id, dictionary, tuple_num);
       }
       break;
     default:
@@ -602,29 +996,42 @@ void CompressedBlockBuilder::buildDictionaryCompressedColumnStripe(
 void CompressedBlockBuilder::buildTruncationCompressedColumnStripe(
     const attribute_id attr_id,
     void *stripe_location) const {
+  if (bit_pack_codes_) {
+    const unsigned int code_bits = compression_info_.attribute_bits(attr_id);
+    for (size_t tuple_num = 0;
+         tuple_num < num_tuples_;
+         ++tuple_num) {
+      BitPackedCodeStripe::SetCode(stripe_location,
+                                   code_bits,
+                                   tuple_num,
+                                   getTruncatedCodeForTuple(attr_id, tuple_num));
+    }
+    return;
+  }
+
   switch (compression_info_.attribute_size(attr_id)) {
     case 1:
       for (size_t tuple_num = 0;
-           tuple_num < tuples_.size();
+           tuple_num < num_tuples_;
            ++tuple_num) {
         reinterpret_cast<uint8_t*>(stripe_location)[tuple_num]
-            = tuples_[tuple_num].getAttributeValue(attr_id).numericGetIntValue();
+            = getTruncatedCodeForTuple(attr_id, tuple_num);
       }
       break;
     case 2:
       for (size_t tuple_num = 0;
-           tuple_num < tuples_.size();
+           tuple_num < num_tuples_;
            ++tuple_num) {
         reinterpret_cast<uint16_t*>(stripe_location)[tuple_num]
-            = tuples_[tuple_num].getAttributeValue(attr_id).numericGetIntValue();
+            = getTruncatedCodeForTuple(attr_id, tuple_num);
       }
       break;
     case 4:
       for (size_t tuple_num = 0;
-           tuple_num < tuples_.size();
+           tuple_num < num_tuples_;
            ++tuple_num) {
         reinterpret_cast<uint32_t*>(stripe_location)[tuple_num]
-            = tuples_[tuple_num].getAttributeValue(attr_id).numericGetLongValue();
+            = getTruncatedCodeForTuple(attr_id, tuple_num);
       }
       break;
     default:
@@ -633,15 +1040,48 @@ void CompressedBlockBuilder::buildTruncationCompressedColumnStripe(
   }
 }
 
+void CompressedBlockBuilder::buildRunLengthEncodedColumnStripe(
+    const attribute_id attr_id,
+    const std::vector<const CompressionDictionary*> &dictionaries,
+    void *stripe_location) const {
+  const size_t max_runs = compression_info_.num_runs(attr_id);
+  tuple_id *num_runs = static_cast<tuple_id*>(stripe_location);
+  uint32_t *run_codes = reinterpret_cast<uint32_t*>(static_cast<char*>(stripe_location) + sizeof(tuple_id));
+  tuple_id *run_ends = reinterpret_cast<tuple_id*>(run_codes + max_runs);
+
+  const CompressionDictionary *dictionary = dictionaries[attr_id];
+  *num_runs = 0;
+  for (size_t tuple_num = 0;
+       tuple_num < num_tuples_;
+       ++tuple_num) {
+    const void *value = getValueForTuple(attr_id, tuple_num);
+    const uint32_t code = (dictionary == NULL)
+                          ? computeTruncatedCode(attr_id, value)
+                          : dictionary->getCodeForUntypedValue(value);
+    if ((*num_runs == 0) || (run_codes[*num_runs - 1] != code)) {
+      // Start a new run.
+      DEBUG_ASSERT(static_cast<size_t>(*num_runs) < max_runs);
+      run_codes[*num_runs] = code;
+      ++(*num_runs);
+    }
+    run_ends[*num_runs - 1] = tuple_num + 1;
+  }
+}
+
 void CompressedBlockBuilder::buildUncompressedColumnStripe(
     const attribute_id attr_id,
     void *stripe_location) const {
   char *value_location = static_cast<char*>(stripe_location);
   size_t value_length = compression_info_.attribute_size(attr_id);
-  for (PtrVector<Tuple>::const_iterator tuple_it = tuples_.begin();
-       tuple_it != tuples_.end();
-       ++tuple_it) {
-    tuple_it->getAttributeValue(attr_id).copyInto(value_location);
+  for (size_t tuple_num = 0;
+       tuple_num < num_tuples_;
+       ++tuple_num) {
+    const void *value = getValueForTuple(attr_id, tuple_num);
+    if (value == NULL) {
+      memset(value_location, 0, value_length);
+    } else {
+      memcpy(value_location, value, value_length);
+    }
     value_location += value_length;
   }
 }
@@ -22,6 +22,7 @@
 #define QUICKSTEP_STORAGE_COMPRESSED_BLOCK_BUILDER_HPP_
 
 #include <cstddef>
+#include <utility>
 #include <vector>
 
 #include "catalog/CatalogTypedefs.hpp"
@@ -29,16 +30,19 @@
 #include "storage/StorageBlockLayout.pb.h"
 #include "types/CompressionDictionaryBuilder.hpp"
 #include "types/Tuple.hpp"
+#include "types/Type.hpp"
 #include "types/TypeInstance.hpp"
-#include "utility/ContainerCompat.hpp"
+#include "utility/CstdintCompat.hpp"
 #include "utility/Macros.hpp"
 #include "utility/PtrMap.hpp"
 #include "utility/PtrVector.hpp"
+#include "utility/ScopedBuffer.hpp"
 
 namespace quickstep {
 
 class CatalogRelation;
 class CompressionDictionary;
+class SharedCompressionDictionary;
 
 /** \addtogroup Storage
  *  @{
@@ -50,7 +54,20 @@ class CompressionDictionary;
  *        CompressedPackedRowStoreTupleStorageSubBlock or a
  *        CompressedColumnStoreTupleStorageSubBlock, automatically selecting
  *        most efficient coding for each compressed column (dictionary coding,
- *        truncation, or none).
+ *        truncation relative to the column's minimum value, or none).
+ *        Compressed codes in a column store are bit-packed, while those in a
+ *        row store are padded to whole bytes.
+ * @note Tuples are not stored as Tuple objects. Instead, the raw value of each
+ *       attribute is copied into a per-column buffer, and the size of the
+ *       block is estimated incrementally (conservatively assuming that values
+ *       not yet merged into the dictionaries are all distinct). Values are
+ *       merged into the dictionaries in batches by sorting and deduplicating
+ *       them, which only happens when the estimate grows too big for the
+ *       block, and once more when the block is finally built.
+ * @note Compressed attributes which have a relation-wide
+ *       SharedCompressionDictionary are always dictionary-coded with a
+ *       version of the shared dictionary (extending it if necessary), and no
+ *       dictionary for them is stored in the block.
  **/
 class CompressedBlockBuilder {
  public:
@@ -95,7 +112,7 @@ class CompressedBlockBuilder {
   /**
    * @brief Add a Tuple to the block being built.
    *
-   * @param tuple The Tuple to add. It will be copied.
+   * @param tuple The Tuple to add. Its values will be copied.
    * @param coerce_types True if some of the types of the values in tuple may
    *        need to be coerced to match the types of attributes in the
    *        relation. False if the caller can guarantee that all value types
@@ -118,7 +135,7 @@ class CompressedBlockBuilder {
    * @return The number of tuples in this CompressedBlockBuilder.
    **/
   inline std::size_t numTuples() const {
-    return tuples_.size();
+    return num_tuples_;
   }
 
   /**
@@ -156,34 +173,198 @@ class CompressedBlockBuilder {
   void buildCompressedColumnStoreTupleStorageSubBlock(void *sub_block_memory);
 
  private:
-  std::size_t computeRequiredStorage(const std::size_t num_tuples) const;
+  // Holds the raw values of one attribute for every tuple in chunks of
+  // memory, so that values never move once they have been added (they are
+  // referenced by the CompressionDictionaryBuilders).
+  class ColumnBuffer {
+   public:
+    ColumnBuffer()
+        : chunk_bytes_used_(0) {
+    }
+
+    // Copy 'value' into this buffer, returning a pointer to the copy.
+    const void* appendValue(const TypeInstance &value);
+
+    // Append a NULL value, which is represented by a NULL pointer.
+    inline void appendNull() {
+      values_.push_back(NULL);
+    }
+
+    // Remove the last value appended (its memory is not reused).
+    inline void removeLastValue() {
+      values_.pop_back();
+    }
+
+    inline const void* getValue(const std::size_t position) const {
+      return values_[position];
+    }
+
+   private:
+    std::vector<const void*> values_;
+    PtrVector<ScopedBuffer> chunks_;
+    std::size_t chunk_bytes_used_;
+
+    DISALLOW_COPY_AND_ASSIGN(ColumnBuffer);
+  };
+
+  // Compares tuples' positions by the values of one attribute.
+  class PositionComparator;
+
+  // Compute the number of bytes needed to store the block if
+  // 'num_additional_tuples' more tuples (with unknown values) were added.
+  // This is an upper bound unless all values have been merged into the
+  // dictionaries and 'num_additional_tuples' is zero, in which case it is
+  // exact.
+  std::size_t computeRequiredStorage(const std::size_t num_additional_tuples) const;
+  // Check whether the tuples added so far fit in the block (merging values
+  // into the dictionaries if necessary) and, if so, update
+  // 'guaranteed_num_tuples_'. Returns false if the last tuple doesn't fit.
+  bool updateGuaranteedNumTuples();
+  // Merge the values of the first 'num_tuples' tuples into the dictionaries.
+  void mergeValuesIntoDictionaries(const std::size_t num_tuples);
+  // Recompute 'unmerged_value_bytes_' after 'num_merged_tuples_' changes.
+  void recomputeUnmergedValueBytes();
+  // Determine whether an attribute is nullable and every value added so far
+  // is NULL. Such an attribute has nothing to compress, so it is stored
+  // uncompressed.
+  bool attributeIsAllNull(const attribute_id attr_id) const;
+
+  // Remove the last tuple added (whose values must not have been merged into
+  // the dictionaries), restoring the previous integer ranges.
+  void removeLastTuple(
+      const std::vector<std::pair<attribute_id, std::int64_t> > &previous_maximum_integers,
+      const std::vector<std::pair<attribute_id, std::int64_t> > &previous_minimum_integers);
+
   std::size_t computeTruncatedByteLengthForAttribute(const attribute_id attr_id) const;
+  // Returns 0 if the attribute can not be truncated.
+  unsigned int computeTruncatedBitLengthForAttribute(const attribute_id attr_id) const;
+
+  // Determine whether bit-packing is enabled and values of an attribute can be
+  // truncated to fewer bits than the attribute's type.
+  bool bitPackedTruncationIsPossible(const attribute_id attr_id) const;
+  // Compute the number of bytes needed to store 'num_tuples' values of an
+  // attribute truncated with computeTruncatedByteLengthForAttribute(),
+  // accounting for bit-packing if it is enabled.
+  std::size_t computeTruncatedStorageForAttribute(const attribute_id attr_id,
+                                                  const std::size_t num_tuples) const;
+  // Compute the number of bytes needed to store 'num_tuples' dictionary codes
+  // of 'code_length_bits' (not including the dictionary itself), accounting
+  // for bit-packing if it is enabled.
+  std::size_t computeDictionaryCodeStorage(const std::uint8_t code_length_bits,
+                                           const std::size_t num_tuples) const;
+
+  // Determine whether values of an attribute can be truncated, either to a
+  // shorter byte length or (with bit-packing) to fewer bits.
+  bool truncationIsPossible(const attribute_id attr_id) const;
+
+  // Determine whether an attribute's codes may be run-length encoded (i.e. it
+  // is the sort attribute of a CompressedColumnStore) and whether doing so
+  // with 'num_runs' runs would take fewer bytes than 'code_storage_bytes'.
+  bool runLengthEncodingIsSmaller(const attribute_id attr_id,
+                                  const std::size_t num_runs,
+                                  const std::size_t code_storage_bytes) const;
+  // Returns the smaller of 'code_storage_bytes' and the storage needed to
+  // run-length encode an attribute's codes with 'num_runs' runs (if
+  // possible).
+  std::size_t computeCodeStorageWithRunLengthEncoding(const attribute_id attr_id,
+                                                      const std::size_t num_runs,
+                                                      const std::size_t code_storage_bytes) const;
+  // Set the number of runs for an attribute in compression_info_ if
+  // run-length encoding it is smaller than 'code_storage_bytes'.
+  void setRunLengthEncodingIfSmaller(const attribute_id attr_id,
+                                     const std::size_t code_storage_bytes);
+
+  // Get the value of an attribute for the 'tuple_num'th tuple in the block
+  // being built (after sorting, for a CompressedColumnStore).
+  inline const void* getValueForTuple(const attribute_id attr_id,
+                                      const std::size_t tuple_num) const {
+    return column_buffers_[attr_id].getValue(sorted_positions_.empty() ? tuple_num
+                                                                       : sorted_positions_[tuple_num]);
+  }
+
+  // Read a raw Int or Long value as a 64-bit integer.
+  static inline std::int64_t getIntegerValue(const Type &type, const void *value) {
+    if (type.getTypeID() == Type::kLong) {
+      return *static_cast<const std::int64_t*>(value);
+    } else {
+      return *static_cast<const int*>(value);
+    }
+  }
+
+  // Compute the code for a value of a truncated attribute, relative to the
+  // attribute's frame of reference.
+  inline std::uint32_t computeTruncatedCode(const attribute_id attr_id,
+                                            const void *value) const;
 
-  void rollbackLastInsert(
-      const std::vector<CompressionDictionaryBuilder*> &modified_dictionaries,
-      const CompatUnorderedMap<attribute_id, const TypeInstance*>::unordered_map &previous_maximum_integers);
+  // Get the code for the 'tuple_num'th tuple's value of a dictionary-coded or
+  // truncated attribute. NULL values (which are marked in the NULL bitmaps)
+  // are stored with a code of zero.
+  inline std::uint32_t getDictionaryCodeForTuple(const attribute_id attr_id,
+                                                 const CompressionDictionary &dictionary,
+                                                 const std::size_t tuple_num) const;
+  inline std::uint32_t getTruncatedCodeForTuple(const attribute_id attr_id,
+                                                const std::size_t tuple_num) const;
 
   std::size_t buildTupleStorageSubBlockHeader(void *sub_block_memory);
+  // Fill in 'dictionary_map' (indexed by attribute ID) with the dictionary
+  // for each dictionary-coded attribute. Dictionaries stored in the block are
+  // created in 'block_dictionaries'.
   void buildDictionaryMap(const void *sub_block_memory,
-                          PtrMap<attribute_id, CompressionDictionary> *dictionary_map) const;
+                          PtrVector<CompressionDictionary> *block_dictionaries,
+                          std::vector<const CompressionDictionary*> *dictionary_map) const;
 
   void buildDictionaryCompressedColumnStripe(const attribute_id attr_id,
                                              const CompressionDictionary &dictionary,
                                              void *stripe_location) const;
   void buildTruncationCompressedColumnStripe(const attribute_id attr_id,
                                              void *stripe_location) const;
+  void buildRunLengthEncodedColumnStripe(const attribute_id attr_id,
+                                         const std::vector<const CompressionDictionary*> &dictionaries,
+                                         void *stripe_location) const;
   void buildUncompressedColumnStripe(const attribute_id attr_id,
                                      void *stripe_location) const;
 
   const CatalogRelation &relation_;
   const std::size_t block_size_;
   attribute_id sort_attribute_id_;  // Only used for CompressedColumnStore.
+  // If true, compressed codes are bit-packed instead of being padded to 1, 2,
+  // or 4 bytes. Only used for CompressedColumnStore.
+  bool bit_pack_codes_;
 
-  PtrVector<Tuple> tuples_;
+  // The values of each attribute, indexed by attribute ID (NULL for IDs
+  // which are not in the relation).
+  PtrVector<ColumnBuffer, true> column_buffers_;
+  std::size_t num_tuples_;
+  // The number of values of each attribute which are not NULL.
+  std::vector<std::size_t> num_non_null_values_;
+  // The values of the first 'num_merged_tuples_' tuples have been merged into
+  // the dictionaries.
+  std::size_t num_merged_tuples_;
+  // The number of tuples which are known to fit in the block, as long as the
+  // range of integer attributes does not change.
+  std::size_t guaranteed_num_tuples_;
+  // The total length of values of each variable-length attribute which have
+  // not been merged into its dictionary.
+  std::vector<std::size_t> unmerged_value_bytes_;
+  // If not empty, the order in which tuples' positions in 'column_buffers_'
+  // appear in the block being built.
+  std::vector<std::size_t> sorted_positions_;
 
   CompressedBlockInfo compression_info_;
   PtrMap<attribute_id, CompressionDictionaryBuilder> dictionary_builders_;
-  CompatUnorderedMap<attribute_id, const TypeInstance*>::unordered_map maximum_integers_;
+  // The minimum and maximum values of each Int or Long attribute which may be
+  // truncated (those with 'integer_range_tracked_' set). Truncated values are
+  // stored relative to the minimum.
+  std::vector<bool> integer_range_tracked_;
+  std::vector<std::int64_t> maximum_integers_;
+  std::vector<std::int64_t> minimum_integers_;
+  // The relation's SharedCompressionDictionary for each compressed attribute
+  // which has one (NULL otherwise), along with the latest version of it (and
+  // that version's number of codes) when this builder was created. Code
+  // lengths are estimated relative to that version.
+  std::vector<SharedCompressionDictionary*> shared_dictionaries_;
+  std::vector<std::uint32_t> shared_dictionary_base_versions_;
+  std::vector<std::uint32_t> shared_dictionary_base_num_codes_;
 
   DISALLOW_COPY_AND_ASSIGN(CompressedBlockBuilder);
 };
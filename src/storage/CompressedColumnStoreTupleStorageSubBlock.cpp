@@ -33,17 +33,21 @@
 #include "storage/ColumnStoreUtil.hpp"
 #include "storage/StorageBlockInfo.hpp"
 #include "storage/StorageBlockLayout.pb.h"
+#include "storage/StorageErrors.hpp"
 #include "storage/TupleIdSequence.hpp"
 #include "types/Comparison.hpp"
+#include "types/Tuple.hpp"
 #include "types/Type.hpp"
 #include "utility/ContainerCompat.hpp"
 #include "utility/CstdintCompat.hpp"
 #include "utility/Macros.hpp"
+#include "utility/PtrVector.hpp"
 
 using std::equal_to;
 using std::greater;
 using std::less_equal;
 using std::lower_bound;
+using std::upper_bound;
 using std::memmove;
 using std::not_equal_to;
 using std::numeric_limits;
@@ -52,7 +56,9 @@ using std::size_t;
 using std::uint8_t;
 using std::uint16_t;
 using std::uint32_t;
+using std::uint64_t;
 
+using quickstep::column_store_util::BitPackedCodeStripe;
 using quickstep::column_store_util::SortColumnPredicateEvaluator;
 
 namespace quickstep {
@@ -67,7 +73,10 @@ CompressedColumnStoreTupleStorageSubBlock::CompressedColumnStoreTupleStorageSubB
                                      description,
                                      new_block,
                                      sub_block_memory,
-                                     sub_block_memory_size) {
+                                     sub_block_memory_size),
+      max_num_tuples_(0),
+      sort_column_run_codes_(NULL),
+      sort_column_run_ends_(NULL) {
   if (!DescriptionIsValid(relation_, description_)) {
     FATAL_ERROR("Attempted to construct a CompressedColumnStoreTupleStorageSubBlock "
                 "from an invalid description.");
@@ -92,9 +101,17 @@ bool CompressedColumnStoreTupleStorageSubBlock::DescriptionIsValid(
     return false;
   }
 
-  // Make sure relation does not have nullable attributes.
+  // Make sure relation does not have nullable variable-length attributes. An
+  // attribute whose values are all NULL is stored uncompressed, which is not
+  // possible for a variable-length attribute.
   if (relation.hasNullableAttributes()) {
-    return false;
+    for (CatalogRelation::const_iterator attr_it = relation.begin();
+         attr_it != relation.end();
+         ++attr_it) {
+      if (attr_it->getType().isNullable() && attr_it->getType().isVariableLength()) {
+        return false;
+      }
+    }
   }
 
   const Comparison &less_comparison = Comparison::GetComparison(Comparison::kLess);
@@ -110,7 +127,7 @@ bool CompressedColumnStoreTupleStorageSubBlock::DescriptionIsValid(
     return false;
   }
   const Type &sort_attr_type = relation.getAttributeById(sort_attribute_id).getType();
-  if (!less_comparison.canCompareTypes(sort_attr_type, sort_attr_type)) {
+  if (sort_attr_type.isNullable() || !less_comparison.canCompareTypes(sort_attr_type, sort_attr_type)) {
     return false;
   }
 
@@ -149,11 +166,81 @@ bool CompressedColumnStoreTupleStorageSubBlock::DescriptionIsValid(
         }
       }
     }
+
+    // The delta region is a PackedRowStore, which can't hold variable-length
+    // values.
+    if (GetDeltaRegionBytes(description) > 0) {
+      return false;
+    }
   }
 
   return true;
 }
 
+std::size_t CompressedColumnStoreTupleStorageSubBlock::ComputeStripeSizeBytes(
+    const CompressedBlockInfo &compression_info,
+    const attribute_id attr_id,
+    const std::size_t max_num_tuples) {
+  if ((attr_id < compression_info.num_runs_size())
+      && (compression_info.num_runs(attr_id) > 0)) {
+    return ComputeRunLengthStripeSizeBytes(compression_info.num_runs(attr_id));
+  } else if ((attr_id < compression_info.attribute_bits_size())
+      && (compression_info.attribute_bits(attr_id) > 0)) {
+    return BitPackedCodeStripe::SizeBytes(max_num_tuples, compression_info.attribute_bits(attr_id));
+  } else {
+    return max_num_tuples * compression_info.attribute_size(attr_id);
+  }
+}
+
+std::size_t CompressedColumnStoreTupleStorageSubBlock::ComputeMaxNumTuples(
+    const CatalogRelation &relation,
+    const CompressedBlockInfo &compression_info,
+    const std::size_t stripe_memory_size) {
+  // Add up the bits used by each tuple, and the fixed slack at the end of
+  // each bit-packed stripe. Run-length encoded stripes have a fixed size.
+  size_t tuple_bits = 0;
+  size_t stripe_overhead = 0;
+  for (CatalogRelation::const_iterator attr_it = relation.begin();
+       attr_it != relation.end();
+       ++attr_it) {
+    if ((attr_it->getID() < compression_info.num_runs_size())
+        && (compression_info.num_runs(attr_it->getID()) > 0)) {
+      stripe_overhead += ComputeRunLengthStripeSizeBytes(compression_info.num_runs(attr_it->getID()));
+    } else if ((attr_it->getID() < compression_info.attribute_bits_size())
+        && (compression_info.attribute_bits(attr_it->getID()) > 0)) {
+      tuple_bits += compression_info.attribute_bits(attr_it->getID());
+      stripe_overhead += BitPackedCodeStripe::SizeBytes(0, compression_info.attribute_bits(attr_it->getID()));
+    } else {
+      tuple_bits += compression_info.attribute_size(attr_it->getID()) << 3;
+    }
+  }
+  if (stripe_memory_size < stripe_overhead) {
+    return 0;
+  }
+  if (tuple_bits == 0) {
+    // Every column is run-length encoded, so there is no limit other than
+    // the range of tuple_id.
+    return numeric_limits<tuple_id>::max();
+  }
+
+  // The estimate may be slightly too high, because each bit-packed stripe is
+  // rounded up to a whole number of bytes, so back off until all the stripes
+  // fit.
+  size_t max_num_tuples = ((stripe_memory_size - stripe_overhead) << 3) / tuple_bits;
+  for (;;) {
+    size_t total_size = 0;
+    for (CatalogRelation::const_iterator attr_it = relation.begin();
+         attr_it != relation.end();
+         ++attr_it) {
+      total_size += ComputeStripeSizeBytes(compression_info, attr_it->getID(), max_num_tuples);
+    }
+    if ((total_size <= stripe_memory_size) || (max_num_tuples == 0)) {
+      return max_num_tuples;
+    }
+    --max_num_tuples;
+  }
+}
+
 // TODO(chasseur): Make this heuristic better.
 std::size_t CompressedColumnStoreTupleStorageSubBlock::EstimateBytesPerTuple(
     const CatalogRelation &relation,
@@ -188,9 +275,21 @@ std::size_t CompressedColumnStoreTupleStorageSubBlock::EstimateBytesPerTuple(
 bool CompressedColumnStoreTupleStorageSubBlock::deleteTuple(const tuple_id tuple) {
   DEBUG_ASSERT(hasTupleWithID(tuple));
 
+  if (tuple >= *static_cast<const tuple_id*>(sub_block_memory_)) {
+    return deleteDeltaTuple(tuple);
+  }
+
+  if (sort_column_run_codes_ != NULL) {
+    removeFromSortColumnRuns(tuple);
+  }
+  if (!null_bitmaps_.empty()) {
+    null_bitmaps_->removeTuple(tuple);
+  }
+
   if (tuple == *static_cast<const tuple_id*>(sub_block_memory_) - 1) {
     --(*static_cast<tuple_id*>(sub_block_memory_));
-    return false;
+    // Any tuples in the delta region are renumbered.
+    return deltaHasTuples();
   } else {
     // Shift subsequent tuples forward.
     shiftTuples(tuple, tuple + 1, *static_cast<const tuple_id*>(sub_block_memory_) - tuple - 1);
@@ -205,6 +304,10 @@ TupleIdSequence* CompressedColumnStoreTupleStorageSubBlock::getMatchesForPredica
     // Pass through all the way to the base version to get all tuples.
     return TupleStorageSubBlock::getMatchesForPredicate(predicate);
   }
+  if (!builder_.empty()) {
+    // Only the delta region of an unbuilt block can be scanned.
+    return CompressedTupleStorageSubBlock::getMatchesForPredicate(predicate);
+  }
 
   if (dictionary_coded_attributes_[sort_column_id_] || truncated_attributes_[sort_column_id_]) {
     // NOTE(chasseur): The version from CompressedTupleStorageSubBlock will in
@@ -222,16 +325,18 @@ TupleIdSequence* CompressedColumnStoreTupleStorageSubBlock::getMatchesForPredica
     if (matches == NULL) {
       return CompressedTupleStorageSubBlock::getMatchesForPredicate(predicate);
     } else {
-      return matches;
+      return appendDeltaMatches(predicate, matches);
     }
   }
 }
 
 void CompressedColumnStoreTupleStorageSubBlock::rebuild() {
-  if (!builder_.empty()) {
+  PtrVector<Tuple> unmerged_delta_tuples;
+  if (prepareBuilderForRebuild(&unmerged_delta_tuples)) {
     builder_->buildCompressedColumnStoreTupleStorageSubBlock(sub_block_memory_);
     builder_.reset();
     initialize();
+    resetDelta(unmerged_delta_tuples);
   }
 }
 
@@ -240,6 +345,17 @@ std::uint32_t CompressedColumnStoreTupleStorageSubBlock::compressedGetCode(
     const attribute_id attr_id) const {
   DEBUG_ASSERT(hasTupleWithID(tid));
   DEBUG_ASSERT((dictionary_coded_attributes_[attr_id]) || (truncated_attributes_[attr_id]));
+  if ((attr_id == sort_column_id_) && (sort_column_run_codes_ != NULL)) {
+    // Find the run containing 'tid'.
+    const tuple_id num_runs = *static_cast<const tuple_id*>(column_stripes_[sort_column_id_]);
+    return sort_column_run_codes_[upper_bound(sort_column_run_ends_,
+                                              sort_column_run_ends_ + num_runs,
+                                              tid)
+                                  - sort_column_run_ends_];
+  } else if (code_bits_[attr_id] > 0) {
+    return BitPackedCodeStripe::GetCode(column_stripes_[attr_id], code_bits_[attr_id], tid);
+  }
+
   const void *code_location = static_cast<const char*>(column_stripes_[attr_id])
                               + tid * compression_info_.attribute_size(attr_id);
   switch (compression_info_.attribute_size(attr_id)) {
@@ -280,6 +396,8 @@ TupleIdSequence* CompressedColumnStoreTupleStorageSubBlock::getEqualCodes(
       matches->append(tid);
     }
     return matches;
+  } else if (code_bits_[attr_id] > 0) {
+    return getBitPackedCodesInRange(attr_id, pair<uint32_t, uint32_t>(code, code + 1), false);
   } else {
     return getCodesSatisfyingComparison<equal_to>(attr_id, code);
   }
@@ -316,6 +434,8 @@ TupleIdSequence* CompressedColumnStoreTupleStorageSubBlock::getNotEqualCodes(
       matches->append(tid);
     }
     return matches;
+  } else if (code_bits_[attr_id] > 0) {
+    return getBitPackedCodesInRange(attr_id, pair<uint32_t, uint32_t>(code, code + 1), true);
   } else {
     return getCodesSatisfyingComparison<not_equal_to>(attr_id, code);
   }
@@ -335,6 +455,8 @@ TupleIdSequence* CompressedColumnStoreTupleStorageSubBlock::getLessCodes(
       matches->append(tid);
     }
     return matches;
+  } else if (code_bits_[attr_id] > 0) {
+    return getBitPackedCodesInRange(attr_id, pair<uint32_t, uint32_t>(0, code), false);
   } else {
     return getCodesSatisfyingComparison<greater>(attr_id, code);
   }
@@ -354,6 +476,10 @@ TupleIdSequence* CompressedColumnStoreTupleStorageSubBlock::getGreaterOrEqualCod
       matches->append(tid);
     }
     return matches;
+  } else if (code_bits_[attr_id] > 0) {
+    return getBitPackedCodesInRange(attr_id,
+                                    pair<uint32_t, uint32_t>(code, numeric_limits<uint32_t>::max()),
+                                    false);
   } else {
     return getCodesSatisfyingComparison<less_equal>(attr_id, code);
   }
@@ -362,6 +488,10 @@ TupleIdSequence* CompressedColumnStoreTupleStorageSubBlock::getGreaterOrEqualCod
 TupleIdSequence* CompressedColumnStoreTupleStorageSubBlock::getCodesInRange(
     const attribute_id attr_id,
     const std::pair<std::uint32_t, std::uint32_t> range) const {
+  if ((attr_id != sort_column_id_) && (code_bits_[attr_id] > 0)) {
+    return getBitPackedCodesInRange(attr_id, range, false);
+  }
+
   TupleIdSequence *matches = new TupleIdSequence();
   if (attr_id == sort_column_id_) {
     // Special (fast) case: do a binary search of the sort column.
@@ -417,25 +547,111 @@ TupleIdSequence* CompressedColumnStoreTupleStorageSubBlock::getCodesInRange(
 void CompressedColumnStoreTupleStorageSubBlock::initialize() {
   void *stripe_location = initializeCommon();
 
-  size_t tuple_length = 0;
-  for (CatalogRelation::const_iterator attr_it = relation_.begin();
-       attr_it != relation_.end();
-       ++attr_it) {
-    tuple_length += compression_info_.attribute_size(attr_it->getID());
+  // Blocks built before bit-packing was introduced have no attribute_bits.
+  code_bits_.assign(relation_.getMaxAttributeId() + 1, 0);
+  if (compression_info_.attribute_bits_size() > 0) {
+    if (compression_info_.attribute_bits_size() != relation_.getMaxAttributeId() + 1) {
+      throw MalformedBlock();
+    }
+    for (CatalogRelation::const_iterator attr_it = relation_.begin();
+         attr_it != relation_.end();
+         ++attr_it) {
+      const unsigned int code_bits = compression_info_.attribute_bits(attr_it->getID());
+      if (code_bits > 0) {
+        if ((code_bits > 32)
+            || !(dictionary_coded_attributes_[attr_it->getID()] || truncated_attributes_[attr_it->getID()])) {
+          throw MalformedBlock();
+        }
+        code_bits_[attr_it->getID()] = code_bits;
+      }
+    }
+  }
+
+  // Only the compressed sort column may be run-length encoded.
+  bool sort_column_run_length_encoded = false;
+  if (compression_info_.num_runs_size() > 0) {
+    if (compression_info_.num_runs_size() != relation_.getMaxAttributeId() + 1) {
+      throw MalformedBlock();
+    }
+    for (CatalogRelation::const_iterator attr_it = relation_.begin();
+         attr_it != relation_.end();
+         ++attr_it) {
+      if (compression_info_.num_runs(attr_it->getID()) > 0) {
+        if ((attr_it->getID() != sort_column_id_)
+            || !(dictionary_coded_attributes_[attr_it->getID()] || truncated_attributes_[attr_it->getID()])) {
+          throw MalformedBlock();
+        }
+        sort_column_run_length_encoded = true;
+        code_bits_[attr_it->getID()] = 0;
+      }
+    }
   }
 
-  size_t max_num_tuples = (static_cast<const char*>(sub_block_memory_)
-                          + sub_block_memory_size_ - static_cast<const char*>(stripe_location))
-                          / tuple_length;
+  max_num_tuples_ = ComputeMaxNumTuples(
+      relation_,
+      compression_info_,
+      static_cast<const char*>(sub_block_memory_) + compressed_region_size_
+          - static_cast<const char*>(stripe_location));
 
-  column_stripes_.resize(relation_.getMaxAttributeId() + 1, NULL);
+  column_stripes_.assign(relation_.getMaxAttributeId() + 1, NULL);
 
   for (CatalogRelation::const_iterator attr_it = relation_.begin();
        attr_it != relation_.end();
        ++attr_it) {
     column_stripes_[attr_it->getID()] = stripe_location;
     stripe_location = static_cast<char*>(stripe_location)
-                      + max_num_tuples * compression_info_.attribute_size(attr_it->getID());
+                      + ComputeStripeSizeBytes(compression_info_, attr_it->getID(), max_num_tuples_);
+  }
+
+  if (sort_column_run_length_encoded) {
+    sort_column_run_codes_ = reinterpret_cast<uint32_t*>(
+        static_cast<char*>(column_stripes_[sort_column_id_]) + sizeof(tuple_id));
+    sort_column_run_ends_ = reinterpret_cast<tuple_id*>(
+        sort_column_run_codes_ + compression_info_.num_runs(sort_column_id_));
+  } else {
+    sort_column_run_codes_ = NULL;
+    sort_column_run_ends_ = NULL;
+  }
+}
+
+std::size_t CompressedColumnStoreTupleStorageSubBlock::getSortColumnRunLengthSavingsBytes() const {
+  if (sort_column_run_codes_ == NULL) {
+    return 0;
+  }
+
+  // Compare with the stripe that would otherwise have been used.
+  size_t unencoded_size;
+  if (compression_info_.attribute_bits(sort_column_id_) > 0) {
+    unencoded_size = BitPackedCodeStripe::SizeBytes(max_num_tuples_,
+                                                    compression_info_.attribute_bits(sort_column_id_));
+  } else {
+    unencoded_size = max_num_tuples_ * compression_info_.attribute_size(sort_column_id_);
+  }
+  const size_t encoded_size = ComputeRunLengthStripeSizeBytes(compression_info_.num_runs(sort_column_id_));
+  return (unencoded_size > encoded_size) ? (unencoded_size - encoded_size) : 0;
+}
+
+void CompressedColumnStoreTupleStorageSubBlock::removeFromSortColumnRuns(const tuple_id tuple) {
+  DEBUG_ASSERT(sort_column_run_codes_ != NULL);
+  tuple_id *num_runs = static_cast<tuple_id*>(column_stripes_[sort_column_id_]);
+
+  // Find the run containing 'tuple' and shorten it.
+  const tuple_id run = upper_bound(sort_column_run_ends_, sort_column_run_ends_ + *num_runs, tuple)
+                       - sort_column_run_ends_;
+  DEBUG_ASSERT(run < *num_runs);
+  for (tuple_id later_run = run; later_run < *num_runs; ++later_run) {
+    --sort_column_run_ends_[later_run];
+  }
+
+  // If the run is now empty, remove it.
+  if (sort_column_run_ends_[run] == ((run == 0) ? 0 : sort_column_run_ends_[run - 1])) {
+    memmove(sort_column_run_codes_ + run,
+            sort_column_run_codes_ + run + 1,
+            (*num_runs - run - 1) * sizeof(uint32_t));
+    memmove(sort_column_run_ends_ + run,
+            sort_column_run_ends_ + run + 1,
+            (*num_runs - run - 1) * sizeof(tuple_id));
+    --(*num_runs);
   }
 }
 
@@ -446,6 +662,25 @@ void CompressedColumnStoreTupleStorageSubBlock::shiftTuples(
   for (attribute_id attr_id = 0;
        attr_id < compression_info_.attribute_size_size();
        ++attr_id) {
+    if ((attr_id == sort_column_id_) && (sort_column_run_codes_ != NULL)) {
+      // Runs are adjusted separately by removeFromSortColumnRuns().
+      continue;
+    } else if (code_bits_[attr_id] > 0) {
+      // Bit-packed codes are moved one at a time. Tuples are only ever
+      // shifted towards the front of the block, so this is safe when the
+      // source and destination overlap.
+      DEBUG_ASSERT(dest_position <= src_tuple);
+      for (tuple_id offset = 0; offset < num_tuples; ++offset) {
+        BitPackedCodeStripe::SetCode(column_stripes_[attr_id],
+                                     code_bits_[attr_id],
+                                     dest_position + offset,
+                                     BitPackedCodeStripe::GetCode(column_stripes_[attr_id],
+                                                                  code_bits_[attr_id],
+                                                                  src_tuple + offset));
+      }
+      continue;
+    }
+
     size_t attr_length = compression_info_.attribute_size(attr_id);
     if (attr_length > 0) {
       memmove(static_cast<char*>(column_stripes_[attr_id]) + dest_position * attr_length,
@@ -459,75 +694,109 @@ std::pair<tuple_id, tuple_id> CompressedColumnStoreTupleStorageSubBlock::getComp
     const std::pair<std::uint32_t, std::uint32_t> code_range) const {
   DEBUG_ASSERT(dictionary_coded_attributes_[sort_column_id_] || truncated_attributes_[sort_column_id_]);
 
-  const void *attr_stripe = column_stripes_[sort_column_id_];
   pair<tuple_id, tuple_id> tuple_range;
   if (code_range.first == 0) {
     tuple_range.first = 0;
   } else {
-    switch (compression_info_.attribute_size(sort_column_id_)) {
-      case 1:
-        tuple_range.first = lower_bound(static_cast<const uint8_t*>(attr_stripe),
-                                        static_cast<const uint8_t*>(attr_stripe)
-                                            + *static_cast<const tuple_id*>(sub_block_memory_),
-                                        code_range.first)
-                            - static_cast<const uint8_t*>(attr_stripe);
-        break;
-      case 2:
-        tuple_range.first = lower_bound(static_cast<const uint16_t*>(attr_stripe),
-                                        static_cast<const uint16_t*>(attr_stripe)
-                                            + *static_cast<const tuple_id*>(sub_block_memory_),
-                                        code_range.first)
-                            - static_cast<const uint16_t*>(attr_stripe);
-        break;
-      case 4:
-        tuple_range.first = lower_bound(static_cast<const uint32_t*>(attr_stripe),
-                                        static_cast<const uint32_t*>(attr_stripe)
-                                            + *static_cast<const tuple_id*>(sub_block_memory_),
-                                        code_range.first)
-                            - static_cast<const uint32_t*>(attr_stripe);
-        break;
-      default:
-        FATAL_ERROR("Unexpected byte-length (not 1, 2, or 4) for compressed "
-                    "attribute ID " << sort_column_id_
-                    << " in CompressedColumnStoreTupleStorageSubBlock::getCompressedSortColumnRange()");
-    }
+    tuple_range.first = getSortColumnLowerBound(code_range.first);
   }
 
   if (code_range.second == numeric_limits<uint32_t>::max()) {
     tuple_range.second = *static_cast<const tuple_id*>(sub_block_memory_);
   } else {
-    switch (compression_info_.attribute_size(sort_column_id_)) {
-      case 1:
-        tuple_range.second = lower_bound(static_cast<const uint8_t*>(attr_stripe),
-                                         static_cast<const uint8_t*>(attr_stripe)
-                                             + *static_cast<const tuple_id*>(sub_block_memory_),
-                                         code_range.second)
-                             - static_cast<const uint8_t*>(attr_stripe);
-        break;
-      case 2:
-        tuple_range.second = lower_bound(static_cast<const uint16_t*>(attr_stripe),
-                                         static_cast<const uint16_t*>(attr_stripe)
-                                             + *static_cast<const tuple_id*>(sub_block_memory_),
-                                         code_range.second)
-                             - static_cast<const uint16_t*>(attr_stripe);
-        break;
-      case 4:
-        tuple_range.second = lower_bound(static_cast<const uint32_t*>(attr_stripe),
-                                         static_cast<const uint32_t*>(attr_stripe)
-                                             + *static_cast<const tuple_id*>(sub_block_memory_),
-                                         code_range.second)
-                             - static_cast<const uint32_t*>(attr_stripe);
-        break;
-      default:
-        FATAL_ERROR("Unexpected byte-length (not 1, 2, or 4) for compressed "
-                    "attribute ID " << sort_column_id_
-                    << " in CompressedColumnStoreTupleStorageSubBlock::getCompressedSortColumnRange()");
-    }
+    tuple_range.second = getSortColumnLowerBound(code_range.second);
   }
 
   return tuple_range;
 }
 
+tuple_id CompressedColumnStoreTupleStorageSubBlock::getSortColumnLowerBound(const std::uint32_t code) const {
+  const void *attr_stripe = column_stripes_[sort_column_id_];
+  const tuple_id num_tuples = *static_cast<const tuple_id*>(sub_block_memory_);
+  if (sort_column_run_codes_ != NULL) {
+    // Search run codes, and return the starting position of the first run
+    // whose code is not less than 'code'.
+    const tuple_id num_runs = *static_cast<const tuple_id*>(attr_stripe);
+    const tuple_id run = lower_bound(sort_column_run_codes_, sort_column_run_codes_ + num_runs, code)
+                         - sort_column_run_codes_;
+    return (run == 0) ? 0 : sort_column_run_ends_[run - 1];
+  } else if (code_bits_[sort_column_id_] > 0) {
+    return BitPackedCodeStripe::LowerBound(attr_stripe, code_bits_[sort_column_id_], num_tuples, code);
+  }
+
+  switch (compression_info_.attribute_size(sort_column_id_)) {
+    case 1:
+      return lower_bound(static_cast<const uint8_t*>(attr_stripe),
+                         static_cast<const uint8_t*>(attr_stripe) + num_tuples,
+                         code)
+             - static_cast<const uint8_t*>(attr_stripe);
+    case 2:
+      return lower_bound(static_cast<const uint16_t*>(attr_stripe),
+                         static_cast<const uint16_t*>(attr_stripe) + num_tuples,
+                         code)
+             - static_cast<const uint16_t*>(attr_stripe);
+    case 4:
+      return lower_bound(static_cast<const uint32_t*>(attr_stripe),
+                         static_cast<const uint32_t*>(attr_stripe) + num_tuples,
+                         code)
+             - static_cast<const uint32_t*>(attr_stripe);
+    default:
+      FATAL_ERROR("Unexpected byte-length (not 1, 2, or 4) for compressed "
+                  "attribute ID " << sort_column_id_
+                  << " in CompressedColumnStoreTupleStorageSubBlock::getSortColumnLowerBound()");
+  }
+}
+
+TupleIdSequence* CompressedColumnStoreTupleStorageSubBlock::getBitPackedCodesInRange(
+    const attribute_id attr_id,
+    const std::pair<std::uint32_t, std::uint32_t> range,
+    const bool complement) const {
+  DEBUG_ASSERT(code_bits_[attr_id] > 0);
+  const tuple_id num_tuples = *static_cast<const tuple_id*>(sub_block_memory_);
+  const uint32_t max_code = static_cast<uint32_t>((static_cast<uint64_t>(1) << code_bits_[attr_id]) - 1);
+
+  // Clip the range to the codes which can actually be stored in the stripe.
+  pair<uint32_t, uint32_t> clipped_range(range);
+  bool unbounded = (range.second == numeric_limits<uint32_t>::max()) || (range.second > max_code);
+  if ((range.first > max_code) || (!unbounded && (range.first >= range.second))) {
+    // No codes are in the range.
+    TupleIdSequence *matches = new TupleIdSequence();
+    if (complement) {
+      for (tuple_id tid = 0; tid < num_tuples; ++tid) {
+        matches->append(tid);
+      }
+    }
+    return matches;
+  }
+
+  bool scan_complement = complement;
+  if (unbounded) {
+    if (range.first == 0) {
+      // All codes are in the range.
+      TupleIdSequence *matches = new TupleIdSequence();
+      if (!complement) {
+        for (tuple_id tid = 0; tid < num_tuples; ++tid) {
+          matches->append(tid);
+        }
+      }
+      return matches;
+    }
+    // Codes >= range.first are the complement of codes < range.first.
+    clipped_range.first = 0;
+    clipped_range.second = range.first;
+    scan_complement = !complement;
+  }
+
+  TupleIdSequence *matches = new TupleIdSequence();
+  BitPackedCodeStripe::GetCodesInRange(column_stripes_[attr_id],
+                                       code_bits_[attr_id],
+                                       num_tuples,
+                                       clipped_range,
+                                       scan_complement,
+                                       matches);
+  return matches;
+}
+
 template <template <typename T> class comparison_functor>
 TupleIdSequence* CompressedColumnStoreTupleStorageSubBlock::getCodesSatisfyingComparison(
     const attribute_id attr_id,
@@ -556,7 +825,7 @@ TupleIdSequence* CompressedColumnStoreTupleStorageSubBlock::getCodesSatisfyingCo
       break;
     case 4:
       for (tuple_id tid = 0;
-           tid <= *static_cast<const tuple_id*>(sub_block_memory_);
+           tid < *static_cast<const tuple_id*>(sub_block_memory_);
            ++tid) {
         if (comp(code, static_cast<const uint32_t*>(attr_stripe)[tid])) {
           matches->append(tid);
@@ -33,6 +33,8 @@
 
 namespace quickstep {
 
+class CompressedBlockInfo;
+
 /** \addtogroup Storage
  *  @{
  */
@@ -40,14 +42,16 @@ namespace quickstep {
 /**
  * @brief An implementation of TupleStorageSubBlock as a column store with a
  *        single sort column, optional column compression (dictionary or
- *        truncation), and no holes.
- * @warning This implementation does NOT support nullable attributes. It is an
- *          error to attempt to construct a
- *          CompressedColumnStoreTupleStorageSubBlock for a relation with any
- *          nullable attributes.
+ *        truncation), and no holes. Compressed codes are bit-packed in their
+ *        column stripes, and the sort column may be run-length encoded if it
+ *        is compressed and doing so saves space.
+ * @note Nullable attributes other than the sort column are supported with a
+ *       NULL bitmap for each nullable attribute. NULL values of compressed
+ *       attributes are stored as code 0, and an attribute whose values are
+ *       all NULL is left uncompressed.
  * @warning This implementation does support variable-length attributes, but
  *          they must all be compressed (specified with compressed_attribute_id
- *          in the TupleStorageSubBlockDescription).
+ *          in the TupleStorageSubBlockDescription) and must not be nullable.
  **/
 class CompressedColumnStoreTupleStorageSubBlock : public CompressedTupleStorageSubBlock {
  public:
@@ -95,6 +99,47 @@ class CompressedColumnStoreTupleStorageSubBlock : public CompressedTupleStorageS
   static std::size_t EstimateBytesPerTuple(const CatalogRelation &relation,
                                            const TupleStorageSubBlockDescription &description);
 
+  /**
+   * @brief Compute the number of bytes used by the column stripe for a
+   *        particular attribute.
+   * @note This is used both when building a block (by CompressedBlockBuilder)
+   *       and when loading one, so that the layout of stripes is the same.
+   *
+   * @param compression_info The CompressedBlockInfo for the block.
+   * @param attr_id The ID of the attribute whose stripe size to compute.
+   * @param max_num_tuples The maximum number of tuples in the block.
+   * @return The size, in bytes, of the column stripe for attr_id.
+   **/
+  static std::size_t ComputeStripeSizeBytes(const CompressedBlockInfo &compression_info,
+                                            const attribute_id attr_id,
+                                            const std::size_t max_num_tuples);
+
+  /**
+   * @brief Compute the number of bytes used by a run-length encoded column
+   *        stripe.
+   *
+   * @param num_runs The maximum number of runs in the stripe.
+   * @return The size, in bytes, of a run-length encoded stripe which can hold
+   *         num_runs runs.
+   **/
+  static std::size_t ComputeRunLengthStripeSizeBytes(const std::size_t num_runs) {
+    return sizeof(tuple_id) + num_runs * (sizeof(std::uint32_t) + sizeof(tuple_id));
+  }
+
+  /**
+   * @brief Compute the maximum number of tuples whose column stripes can fit
+   *        into a given amount of memory.
+   *
+   * @param relation The relation tuples belong to.
+   * @param compression_info The CompressedBlockInfo for the block.
+   * @param stripe_memory_size The amount of memory, in bytes, available for
+   *        column stripes (i.e. after the header and dictionaries).
+   * @return The maximum number of tuples the block can hold.
+   **/
+  static std::size_t ComputeMaxNumTuples(const CatalogRelation &relation,
+                                         const CompressedBlockInfo &compression_info,
+                                         const std::size_t stripe_memory_size);
+
   TupleStorageSubBlockType getTupleStorageSubBlockType() const {
     return kCompressedColumnStore;
   }
@@ -110,9 +155,29 @@ class CompressedColumnStoreTupleStorageSubBlock : public CompressedTupleStorageS
   std::uint32_t compressedGetCode(const tuple_id tid,
                                   const attribute_id attr_id) const;
 
+  /**
+   * @brief Determine whether the sort column is run-length encoded.
+   *
+   * @return Whether the sort column of this block is run-length encoded.
+   **/
+  bool sortColumnIsRunLengthEncoded() const {
+    return sort_column_run_codes_ != NULL;
+  }
+
+  /**
+   * @brief Get the number of bytes of block memory saved by run-length
+   *        encoding the sort column, compared with storing its codes for
+   *        every tuple.
+   *
+   * @return The number of bytes saved (zero if the sort column is not
+   *         run-length encoded).
+   **/
+  std::size_t getSortColumnRunLengthSavingsBytes() const;
+
  protected:
   const void* getAttributePtr(const tuple_id tid,
                               const attribute_id attr_id) const {
+    DEBUG_ASSERT(code_bits_[attr_id] == 0);
     return static_cast<const char*>(column_stripes_[attr_id])
            + tid * compression_info_.attribute_size(attr_id);
   }
@@ -137,8 +202,11 @@ class CompressedColumnStoreTupleStorageSubBlock : public CompressedTupleStorageS
   // block has been built.
   void initialize();
 
+  // Remove 'tuple' from the runs of a run-length encoded sort column.
+  void removeFromSortColumnRuns(const tuple_id tuple);
+
   // Move 'num_tuples' values in each column from 'src_tuple' to
-  // 'dest_position'.
+  // 'dest_position'. The sort column is skipped if it is run-length encoded.
   void shiftTuples(const tuple_id dest_position,
                    const tuple_id src_tuple,
                    const tuple_id num_tuples);
@@ -146,6 +214,18 @@ class CompressedColumnStoreTupleStorageSubBlock : public CompressedTupleStorageS
   std::pair<tuple_id, tuple_id> getCompressedSortColumnRange(
       const std::pair<std::uint32_t, std::uint32_t> code_range) const;
 
+  // Find the position of the first code in the (compressed) sort column which
+  // is not less than 'code'.
+  tuple_id getSortColumnLowerBound(const std::uint32_t code) const;
+
+  // Scan the bit-packed stripe for 'attr_id' for codes in 'range' (or not in
+  // 'range' if 'complement' is true). As in getCompressedSortColumnRange(), an
+  // upper bound of numeric_limits<uint32_t>::max() means that the range is
+  // unbounded.
+  TupleIdSequence* getBitPackedCodesInRange(const attribute_id attr_id,
+                                            const std::pair<std::uint32_t, std::uint32_t> range,
+                                            const bool complement) const;
+
   // Note: order of application is
   // comparison_functor(literal_code, attribute_code).
   template <template <typename T> class comparison_functor>
@@ -155,6 +235,16 @@ class CompressedColumnStoreTupleStorageSubBlock : public CompressedTupleStorageS
   attribute_id sort_column_id_;
 
   std::vector<void*> column_stripes_;
+  // The bit-length of codes for bit-packed attributes, or 0 if an attribute's
+  // values are stored as whole bytes (or run-length encoded).
+  std::vector<unsigned int> code_bits_;
+  std::size_t max_num_tuples_;
+
+  // If the sort column is run-length encoded, its stripe holds the number of
+  // runs, followed by the code for each run in ascending order, followed by
+  // the (exclusive) ending position of each run. These are NULL otherwise.
+  std::uint32_t *sort_column_run_codes_;
+  tuple_id *sort_column_run_ends_;
 
   DISALLOW_COPY_AND_ASSIGN(CompressedColumnStoreTupleStorageSubBlock);
 };
@@ -32,10 +32,12 @@
 #include "storage/StorageBlockLayout.pb.h"
 #include "storage/TupleIdSequence.hpp"
 #include "types/Comparison.hpp"
+#include "types/Tuple.hpp"
 #include "types/Type.hpp"
 #include "utility/ContainerCompat.hpp"
 #include "utility/CstdintCompat.hpp"
 #include "utility/Macros.hpp"
+#include "utility/PtrVector.hpp"
 
 using std::equal_to;
 using std::greater;
@@ -83,9 +85,17 @@ bool CompressedPackedRowStoreTupleStorageSubBlock::DescriptionIsValid(
     return false;
   }
 
-  // Make sure relation does not have nullable attributes.
+  // Make sure relation does not have nullable variable-length attributes. An
+  // attribute whose values are all NULL is stored uncompressed, which is not
+  // possible for a variable-length attribute.
   if (relation.hasNullableAttributes()) {
-    return false;
+    for (CatalogRelation::const_iterator attr_it = relation.begin();
+         attr_it != relation.end();
+         ++attr_it) {
+      if (attr_it->getType().isNullable() && attr_it->getType().isVariableLength()) {
+        return false;
+      }
+    }
   }
 
   // Make sure all the specified compressed attributes exist and can be ordered
@@ -124,6 +134,12 @@ bool CompressedPackedRowStoreTupleStorageSubBlock::DescriptionIsValid(
         }
       }
     }
+
+    // The delta region is a PackedRowStore, which can't hold variable-length
+    // values.
+    if (GetDeltaRegionBytes(description) > 0) {
+      return false;
+    }
   }
 
   return true;
@@ -163,9 +179,18 @@ std::size_t CompressedPackedRowStoreTupleStorageSubBlock::EstimateBytesPerTuple(
 bool CompressedPackedRowStoreTupleStorageSubBlock::deleteTuple(const tuple_id tuple) {
   DEBUG_ASSERT(hasTupleWithID(tuple));
 
+  if (tuple >= *static_cast<const tuple_id*>(sub_block_memory_)) {
+    return deleteDeltaTuple(tuple);
+  }
+
+  if (!null_bitmaps_.empty()) {
+    null_bitmaps_->removeTuple(tuple);
+  }
+
   if (tuple == *static_cast<const tuple_id*>(sub_block_memory_) - 1) {
     --(*static_cast<tuple_id*>(sub_block_memory_));
-    return false;
+    // Any tuples in the delta region are renumbered.
+    return deltaHasTuples();
   } else {
     // Shift subsequent tuples forward.
     memmove(static_cast<char*>(tuple_storage_) + tuple * tuple_length_bytes_,
@@ -177,10 +202,12 @@ bool CompressedPackedRowStoreTupleStorageSubBlock::deleteTuple(const tuple_id tu
 }
 
 void CompressedPackedRowStoreTupleStorageSubBlock::rebuild() {
-  if (!builder_.empty()) {
+  PtrVector<Tuple> unmerged_delta_tuples;
+  if (prepareBuilderForRebuild(&unmerged_delta_tuples)) {
     builder_->buildCompressedPackedRowStoreTupleStorageSubBlock(sub_block_memory_);
     builder_.reset();
     initialize();
+    resetDelta(unmerged_delta_tuples);
   }
 }
 
@@ -279,7 +306,7 @@ void CompressedPackedRowStoreTupleStorageSubBlock::initialize() {
   tuple_storage_ = initializeCommon();
 
   tuple_length_bytes_ = 0;
-  attribute_offsets_.resize(relation_.getMaxAttributeId() + 1, 0);
+  attribute_offsets_.assign(relation_.getMaxAttributeId() + 1, 0);
 
   for (CatalogRelation::const_iterator attr_it = relation_.begin();
        attr_it != relation_.end();
@@ -43,13 +43,13 @@ class TupleStorageSubBlockDescription;
 /**
  * @brief An implementation of TupleStorageSubBlock as a packed row store with
  *        optional column compression (dictionary or truncation) and no holes.
- * @warning This implementation does NOT support nullable attributes. It is an
- *          error to attempt to construct a
- *          CompressedPackedRowStoreTupleStorageSubBlock for a relation with
- *          any nullable attributes.
+ * @note Nullable attributes are supported with a NULL bitmap for each
+ *       nullable attribute. NULL values of compressed attributes are stored
+ *       as code 0, and an attribute whose values are all NULL is left
+ *       uncompressed.
  * @warning This implementation does support variable-length attributes, but
  *          they must all be compressed (specified with compressed_attribute_id
- *          in the TupleStorageSubBlockDescription).
+ *          in the TupleStorageSubBlockDescription) and must not be nullable.
  **/
 class CompressedPackedRowStoreTupleStorageSubBlock : public CompressedTupleStorageSubBlock {
  public:
@@ -30,14 +30,20 @@
 #include "expressions/ComparisonPredicate.hpp"
 #include "expressions/Predicate.hpp"
 #include "expressions/Scalar.hpp"
+#include "storage/PackedRowStoreTupleStorageSubBlock.hpp"
+#include "storage/StorageBlockLayout.pb.h"
 #include "storage/TupleIdSequence.hpp"
 #include "types/CompressionDictionary.hpp"
 #include "types/IntType.hpp"
 #include "types/LongType.hpp"
 #include "types/Type.hpp"
+#include "types/Tuple.hpp"
 #include "types/TypeInstance.hpp"
+#include "utility/ContainerCompat.hpp"
 #include "utility/CstdintCompat.hpp"
 #include "utility/Macros.hpp"
+#include "utility/PtrVector.hpp"
+#include "utility/ScopedPtr.hpp"
 
 using std::ceil;
 using std::floor;
@@ -49,6 +55,25 @@ using std::uint32_t;
 
 namespace quickstep {
 
+namespace {
+
+// Subtract a frame of reference from a literal value, saturating instead of
+// overflowing. Saturated results are still far outside the range of
+// truncated codes, so comparisons with codes are unaffected.
+inline int64_t RebaseLiteral(const int64_t literal, const int64_t frame_of_reference) {
+  if ((frame_of_reference < 0)
+      && (literal > numeric_limits<int64_t>::max() + frame_of_reference)) {
+    return numeric_limits<int64_t>::max();
+  } else if ((frame_of_reference > 0)
+             && (literal < numeric_limits<int64_t>::min() + frame_of_reference)) {
+    return numeric_limits<int64_t>::min();
+  } else {
+    return literal - frame_of_reference;
+  }
+}
+
+}  // anonymous namespace
+
 CompressedTupleStorageSubBlock::CompressedTupleStorageSubBlock(
     const CatalogRelation &relation,
     const TupleStorageSubBlockDescription &description,
@@ -59,21 +84,44 @@ CompressedTupleStorageSubBlock::CompressedTupleStorageSubBlock(
                            description,
                            new_block,
                            sub_block_memory,
-                           sub_block_memory_size) {
+                           sub_block_memory_size),
+      compressed_region_size_(sub_block_memory_size),
+      delta_memory_(NULL) {
+  // The delta region, if any, is carved off the end of the sub-block.
+  const size_t delta_region_bytes = GetDeltaRegionBytes(description_);
+  if (delta_region_bytes > 0) {
+    if (delta_region_bytes >= sub_block_memory_size_) {
+      if (new_block) {
+        throw BlockMemoryTooSmall("CompressedTupleStorageSubBlock",
+                                  sub_block_memory_size_);
+      } else {
+        throw MalformedBlock();
+      }
+    }
+    compressed_region_size_ = sub_block_memory_size_ - delta_region_bytes;
+    delta_memory_ = static_cast<char*>(sub_block_memory_) + compressed_region_size_;
+    delta_description_.set_sub_block_type(TupleStorageSubBlockDescription::PACKED_ROW_STORE);
+    delta_.reset(new PackedRowStoreTupleStorageSubBlock(relation_,
+                                                        delta_description_,
+                                                        new_block,
+                                                        delta_memory_,
+                                                        delta_region_bytes));
+  }
+
   if (new_block) {
-    if (sub_block_memory_size_ < sizeof(tuple_id) + sizeof(int)) {
+    if (compressed_region_size_ < sizeof(tuple_id) + sizeof(int)) {
       throw BlockMemoryTooSmall("CompressedTupleStorageSubBlock",
                                 sub_block_memory_size_);
     }
 
     *static_cast<tuple_id*>(sub_block_memory_) = 0;
-    builder_.reset(new CompressedBlockBuilder(relation_, description_, sub_block_memory_size_));
-    if (builder_->getMinimumRequiredBlockSize() > sub_block_memory_size_) {
+    builder_.reset(new CompressedBlockBuilder(relation_, description_, compressed_region_size_));
+    if (builder_->getMinimumRequiredBlockSize() > compressed_region_size_) {
       throw BlockMemoryTooSmall("CompressedTupleStorageSubBlock",
                                 sub_block_memory_size_);
     }
   } else {
-    if (sub_block_memory_size_ < sizeof(tuple_id) + sizeof(int)) {
+    if (compressed_region_size_ < sizeof(tuple_id) + sizeof(int)) {
       throw MalformedBlock();
     }
     if (*reinterpret_cast<const int*>(static_cast<const char*>(sub_block_memory_) + sizeof(tuple_id)) <= 0) {
@@ -81,13 +129,13 @@ CompressedTupleStorageSubBlock::CompressedTupleStorageSubBlock(
     }
     if (*reinterpret_cast<const int*>(static_cast<const char*>(sub_block_memory_) + sizeof(tuple_id))
         + sizeof(int) + sizeof(tuple_id)
-        > sub_block_memory_size_) {
+        > compressed_region_size_) {
       throw MalformedBlock();
     }
 
     if (*static_cast<tuple_id*>(sub_block_memory_) == 0) {
-      builder_.reset(new CompressedBlockBuilder(relation_, description_, sub_block_memory_size_));
-      if (builder_->getMinimumRequiredBlockSize() > sub_block_memory_size_) {
+      builder_.reset(new CompressedBlockBuilder(relation_, description_, compressed_region_size_));
+      if (builder_->getMinimumRequiredBlockSize() > compressed_region_size_) {
         throw MalformedBlock();
       }
     }
@@ -118,6 +166,45 @@ std::int64_t CompressedTupleStorageSubBlock::GetEffectiveLiteralValueForComparis
   }
 }
 
+std::size_t CompressedTupleStorageSubBlock::GetDeltaRegionBytes(
+    const TupleStorageSubBlockDescription &description) {
+  switch (description.sub_block_type()) {
+    case TupleStorageSubBlockDescription::COMPRESSED_PACKED_ROW_STORE:
+      return description.GetExtension(
+          CompressedPackedRowStoreTupleStorageSubBlockDescription::delta_region_bytes);
+    case TupleStorageSubBlockDescription::COMPRESSED_COLUMN_STORE:
+      return description.GetExtension(
+          CompressedColumnStoreTupleStorageSubBlockDescription::delta_region_bytes);
+    default:
+      FATAL_ERROR("Unexpected TupleStorageSubBlockType in "
+                  "CompressedTupleStorageSubBlock::GetDeltaRegionBytes()");
+  }
+}
+
+bool CompressedTupleStorageSubBlock::compressedDeltaNeedsMerge() const {
+  if (!deltaHasTuples()) {
+    return false;
+  }
+  // Deleted tuples still take up space until the delta is merged, so count
+  // every tuple ID in use.
+  return ((delta_->getMaxTupleID() + 1) * relation_.getFixedByteLength()) << 1
+         >= sub_block_memory_size_ - compressed_region_size_;
+}
+
+TupleStorageSubBlock::InsertResult CompressedTupleStorageSubBlock::insertTuple(
+    const Tuple &tuple,
+    const AllowedTypeConversion atc) {
+  if (delta_.empty()) {
+    return InsertResult(-1, false);
+  }
+
+  InsertResult result = delta_->insertTuple(tuple, atc);
+  if (result.inserted_id >= 0) {
+    result.inserted_id += *static_cast<const tuple_id*>(sub_block_memory_);
+  }
+  return result;
+}
+
 bool CompressedTupleStorageSubBlock::insertTupleInBatch(
     const Tuple &tuple,
     const AllowedTypeConversion atc) {
@@ -126,7 +213,9 @@ bool CompressedTupleStorageSubBlock::insertTupleInBatch(
 #endif
 
   if (builder_.empty()) {
-    return false;
+    // Once the block is built, batches go to the delta region (if any) and
+    // are merged by the next rebuild().
+    return !delta_.empty() && delta_->insertTupleInBatch(tuple, atc);
   }
 
   if (atc == kNone) {
@@ -142,8 +231,12 @@ const void* CompressedTupleStorageSubBlock::getAttributeValue(
   DEBUG_ASSERT(hasTupleWithID(tuple));
   DEBUG_ASSERT(supportsUntypedGetAttributeValue(attr));
 
-  if (dictionary_coded_attributes_[attr]) {
-    return dictionaries_.at(attr).getUntypedValueForCode(compressedGetCode(tuple, attr));
+  if (tuple >= *static_cast<const tuple_id*>(sub_block_memory_)) {
+    return delta_->getAttributeValue(tuple - *static_cast<const tuple_id*>(sub_block_memory_), attr);
+  } else if (compressedIsNull(tuple, attr)) {
+    return NULL;
+  } else if (dictionary_coded_attributes_[attr]) {
+    return dictionaries_[attr]->getUntypedValueForCode(compressedGetCode(tuple, attr));
   } else {
     return getAttributePtr(tuple, attr);
   }
@@ -154,24 +247,35 @@ TypeInstance* CompressedTupleStorageSubBlock::getAttributeValueTyped(
     const attribute_id attr) const {
   DEBUG_ASSERT(hasTupleWithID(tuple));
 
+  if (tuple >= *static_cast<const tuple_id*>(sub_block_memory_)) {
+    return delta_->getAttributeValueTyped(tuple - *static_cast<const tuple_id*>(sub_block_memory_), attr);
+  }
+
   const Type &attr_type = relation_.getAttributeById(attr).getType();
-  if (supportsUntypedGetAttributeValue(attr)) {
+  if (compressedIsNull(tuple, attr)) {
+    return attr_type.makeReferenceTypeInstance(NULL);
+  } else if (supportsUntypedGetAttributeValue(attr)) {
     return attr_type.makeReferenceTypeInstance(getAttributeValue(tuple, attr));
   } else {
     DEBUG_ASSERT(truncated_attributes_[attr]);
     DEBUG_ASSERT((attr_type.getTypeID() == Type::kInt) || (attr_type.getTypeID() == Type::kLong));
 
+    const int64_t value = compressedGetCode(tuple, attr) + compressedGetFrameOfReference(attr);
     if (attr_type.getTypeID() == Type::kInt) {
-      return static_cast<const IntType&>(attr_type).makeLiteralTypeInstance(compressedGetCode(tuple, attr));
+      return static_cast<const IntType&>(attr_type).makeLiteralTypeInstance(static_cast<int>(value));
     } else {
-      return static_cast<const LongType&>(attr_type).makeLiteralTypeInstance(compressedGetCode(tuple, attr));
+      return static_cast<const LongType&>(attr_type).makeLiteralTypeInstance(value);
     }
   }
 }
 
 TupleIdSequence* CompressedTupleStorageSubBlock::getMatchesForPredicate(
     const Predicate *predicate) const {
-  DEBUG_ASSERT(builder_.empty());
+  if (!builder_.empty()) {
+    // Only the delta region of an unbuilt block can be scanned.
+    DEBUG_ASSERT(builder_->numTuples() == 0);
+    return TupleStorageSubBlock::getMatchesForPredicate(predicate);
+  }
   if (predicate == NULL) {
     // No predicate, so pass through to base version to get all tuples.
     return TupleStorageSubBlock::getMatchesForPredicate(predicate);
@@ -200,49 +304,15 @@ TupleIdSequence* CompressedTupleStorageSubBlock::getMatchesForPredicate(
     DEBUG_ASSERT(comparison_attribute->getParent().getID() == relation_.getID());
     if (dictionary_coded_attributes_[comparison_attribute_id]
         || truncated_attributes_[comparison_attribute_id]) {
-      const LiteralTypeInstance* comparison_literal;
-      if (left_literal) {
-        comparison_literal = &(comparison_predicate.getLeftOperand().getStaticValue());
-      } else {
-        comparison_literal = &(comparison_predicate.getRightOperand().getStaticValue());
-      }
-
-      if (comparison_predicate.getComparison().getComparisonID() == Comparison::kEqual) {
-        return evaluateEqualPredicateOnCompressedAttribute(comparison_attribute_id,
-                                                           *comparison_literal);
-      } else if (comparison_predicate.getComparison().getComparisonID() == Comparison::kNotEqual) {
-        return evaluateNotEqualPredicateOnCompressedAttribute(comparison_attribute_id,
-                                                              *comparison_literal);
-      } else {
-        if (left_literal) {
-          switch (comparison_predicate.getComparison().getComparisonID()) {
-            case Comparison::kLess:
-              return evaluateOtherComparisonPredicateOnCompressedAttribute(Comparison::kGreater,
-                                                                           comparison_attribute_id,
-                                                                           *comparison_literal);
-            case Comparison::kLessOrEqual:
-              return evaluateOtherComparisonPredicateOnCompressedAttribute(Comparison::kGreaterOrEqual,
-                                                                           comparison_attribute_id,
-                                                                           *comparison_literal);
-            case Comparison::kGreater:
-              return evaluateOtherComparisonPredicateOnCompressedAttribute(Comparison::kLess,
-                                                                           comparison_attribute_id,
-                                                                           *comparison_literal);
-            case Comparison::kGreaterOrEqual:
-              return evaluateOtherComparisonPredicateOnCompressedAttribute(Comparison::kLessOrEqual,
-                                                                           comparison_attribute_id,
-                                                                           *comparison_literal);
-            default:
-              FATAL_ERROR("Unexpected ComparisonID in "
-                          "CompressedTupleStorageSubBlock::getMatchesForPredicate()");
-          }
-        } else {
-          return evaluateOtherComparisonPredicateOnCompressedAttribute(
-              comparison_predicate.getComparison().getComparisonID(),
-              comparison_attribute_id,
-              *comparison_literal);
-        }
+      TupleIdSequence *matches = evaluatePredicateOnCompressedAttribute(comparison_predicate,
+                                                                        comparison_attribute_id,
+                                                                        left_literal);
+      if (!null_bitmaps_.empty() && null_bitmaps_->hasNullBitmap(comparison_attribute_id)) {
+        // NULLs are stored as code 0, which the code comparisons above do
+        // not distinguish from a real value.
+        matches = excludeNullValues(comparison_attribute_id, matches);
       }
+      return appendDeltaMatches(predicate, matches);
     } else {
       // Attribute is uncompressed, so pass through.
       return TupleStorageSubBlock::getMatchesForPredicate(predicate);
@@ -253,12 +323,31 @@ TupleIdSequence* CompressedTupleStorageSubBlock::getMatchesForPredicate(
   }
 }
 
+std::int64_t CompressedTupleStorageSubBlock::compressedGetEffectiveCodeForComparisonWithTruncatedAttribute(
+    const Comparison::ComparisonID comp,
+    const attribute_id left_attr_id,
+    const TypeInstance &right_literal) const {
+  DEBUG_ASSERT(truncated_attributes_[left_attr_id]);
+  switch (comp) {
+    case Comparison::kEqual:
+    case Comparison::kNotEqual:
+      return RebaseLiteral(right_literal.numericGetLongValue(),
+                           compressedGetFrameOfReference(left_attr_id));
+    default:
+      return RebaseLiteral(GetEffectiveLiteralValueForComparisonWithTruncatedAttribute(comp, right_literal),
+                           compressedGetFrameOfReference(left_attr_id));
+  }
+}
+
 bool CompressedTupleStorageSubBlock::compressedComparisonIsAlwaysTrueForTruncatedAttribute(
     const Comparison::ComparisonID comp,
     const attribute_id left_attr_id,
     const TypeInstance &right_literal) const {
   DEBUG_ASSERT(truncated_attributes_[left_attr_id]);
-  int64_t effective_literal = right_literal.numericGetLongValue();
+  int64_t effective_literal = compressedGetEffectiveCodeForComparisonWithTruncatedAttribute(
+      Comparison::kEqual,
+      left_attr_id,
+      right_literal);
 
   // First, check equality and inequality.
   switch (comp) {
@@ -268,7 +357,7 @@ bool CompressedTupleStorageSubBlock::compressedComparisonIsAlwaysTrueForTruncate
       switch (right_literal.getType().getTypeID()) {
         case Type::kFloat:
         case Type::kDouble:
-          if (right_literal.numericGetDoubleValue() != effective_literal) {
+          if (right_literal.numericGetDoubleValue() != right_literal.numericGetLongValue()) {
             // Literal is a float or double with a fractional part.
             return true;
           }
@@ -282,8 +371,9 @@ bool CompressedTupleStorageSubBlock::compressedComparisonIsAlwaysTrueForTruncate
       return false;
     default:
       effective_literal
-          = GetEffectiveLiteralValueForComparisonWithTruncatedAttribute(comp,
-                                                                        right_literal);
+          = compressedGetEffectiveCodeForComparisonWithTruncatedAttribute(comp,
+                                                                          left_attr_id,
+                                                                          right_literal);
       break;
   }
 
@@ -323,7 +413,10 @@ bool CompressedTupleStorageSubBlock::compressedComparisonIsAlwaysFalseForTruncat
     const attribute_id left_attr_id,
     const TypeInstance &right_literal) const {
   DEBUG_ASSERT(truncated_attributes_[left_attr_id]);
-  int64_t effective_literal = right_literal.numericGetLongValue();
+  int64_t effective_literal = compressedGetEffectiveCodeForComparisonWithTruncatedAttribute(
+      Comparison::kEqual,
+      left_attr_id,
+      right_literal);
 
   // First, check equality and inequality.
   switch (comp) {
@@ -331,7 +424,7 @@ bool CompressedTupleStorageSubBlock::compressedComparisonIsAlwaysFalseForTruncat
       switch (right_literal.getType().getTypeID()) {
         case Type::kFloat:
         case Type::kDouble:
-          if (right_literal.numericGetDoubleValue() != effective_literal) {
+          if (right_literal.numericGetDoubleValue() != right_literal.numericGetLongValue()) {
             // Literal is a float or double with a fractional part.
             return true;
           } else if ((effective_literal < 0)
@@ -351,8 +444,9 @@ bool CompressedTupleStorageSubBlock::compressedComparisonIsAlwaysFalseForTruncat
       return false;
     default:
       effective_literal
-          = GetEffectiveLiteralValueForComparisonWithTruncatedAttribute(comp,
-                                                                        right_literal);
+          = compressedGetEffectiveCodeForComparisonWithTruncatedAttribute(comp,
+                                                                          left_attr_id,
+                                                                          right_literal);
       break;
   }
 
@@ -398,43 +492,89 @@ void* CompressedTupleStorageSubBlock::initializeCommon() {
       || (relation_.getMaxAttributeId() + 1 != compression_info_.dictionary_size_size())) {
     throw MalformedBlock();
   }
+  // Older blocks (and blocks which do not bit-pack codes) may omit
+  // attribute_bits and frame_of_reference. Blocks which predate shared
+  // dictionaries omit shared_dictionary_version.
+  if (((compression_info_.attribute_bits_size() != 0)
+          && (relation_.getMaxAttributeId() + 1 != compression_info_.attribute_bits_size()))
+      || ((compression_info_.frame_of_reference_size() != 0)
+          && (relation_.getMaxAttributeId() + 1 != compression_info_.frame_of_reference_size()))
+      || ((compression_info_.shared_dictionary_version_size() != 0)
+          && (relation_.getMaxAttributeId() + 1 != compression_info_.shared_dictionary_version_size()))) {
+    throw MalformedBlock();
+  }
 
-  dictionary_coded_attributes_.resize(relation_.getMaxAttributeId() + 1, false);
-  truncated_attributes_.resize(relation_.getMaxAttributeId() + 1, false);
+  // This may be called again after the block is rebuilt in place (e.g. when
+  // the delta region is merged), so reset any state from a previous build.
+  dictionary_coded_attributes_.assign(relation_.getMaxAttributeId() + 1, false);
+  truncated_attributes_.assign(relation_.getMaxAttributeId() + 1, false);
+  dictionaries_.assign(relation_.getMaxAttributeId() + 1, NULL);
+  while (!block_dictionaries_.empty()) {
+    block_dictionaries_.removeBack();
+  }
   size_t dictionary_offset =
       sizeof(tuple_id) + sizeof(int)
       + *reinterpret_cast<const int*>(static_cast<const char*>(sub_block_memory_) + sizeof(tuple_id));
+
+  // The NULL bitmaps, if any, come between the header and the dictionaries.
+  if (relation_.hasNullableAttributes()) {
+    if (!compression_info_.has_null_bitmap_num_bits()) {
+      throw MalformedBlock();
+    }
+    null_bitmaps_.reset(new NullBitmaps(relation_,
+                                        static_cast<char*>(sub_block_memory_) + dictionary_offset,
+                                        compression_info_.null_bitmap_num_bits(),
+                                        false));
+    dictionary_offset += NullBitmaps::BytesNeeded(relation_, compression_info_.null_bitmap_num_bits());
+  } else {
+    null_bitmaps_.reset();
+  }
+
   for (CatalogRelation::const_iterator attr_it = relation_.begin();
        attr_it != relation_.end();
        ++attr_it) {
     const Type &attr_type = attr_it->getType();
+    const uint32_t shared_dictionary_version = compressedGetSharedDictionaryVersion(attr_it->getID());
     if (attr_type.isVariableLength()) {
-      if (compression_info_.dictionary_size(attr_it->getID()) == 0) {
+      if ((compression_info_.dictionary_size(attr_it->getID()) == 0)
+          && (shared_dictionary_version == 0)) {
         throw MalformedBlock();
       }
     }
 
-    if (compression_info_.dictionary_size(attr_it->getID()) > 0) {
+    if (shared_dictionary_version > 0) {
+      if (!relation_.hasSharedCompressionDictionary(attr_it->getID())
+          || (shared_dictionary_version
+              > relation_.getSharedCompressionDictionary(attr_it->getID())->getLatestVersion())) {
+        throw MalformedBlock();
+      }
+      dictionaries_[attr_it->getID()]
+          = &(relation_.getSharedCompressionDictionary(attr_it->getID())->getVersion(shared_dictionary_version));
+      dictionary_coded_attributes_[attr_it->getID()] = true;
+    } else if (compression_info_.dictionary_size(attr_it->getID()) > 0) {
       if (attr_type.isVariableLength()) {
-        dictionaries_.insert(
-            attr_it->getID(),
+        block_dictionaries_.push_back(
             new VariableLengthTypeCompressionDictionary(
                 attr_type,
                 static_cast<const char*>(sub_block_memory_) + dictionary_offset,
                 compression_info_.dictionary_size(attr_it->getID())));
       } else {
-        dictionaries_.insert(
-            attr_it->getID(),
+        block_dictionaries_.push_back(
             new FixedLengthTypeCompressionDictionary(
                 attr_type,
                 static_cast<const char*>(sub_block_memory_) + dictionary_offset,
                 compression_info_.dictionary_size(attr_it->getID())));
       }
 
+      dictionaries_[attr_it->getID()] = &(block_dictionaries_.back());
       dictionary_coded_attributes_[attr_it->getID()] = true;
       dictionary_offset += compression_info_.dictionary_size(attr_it->getID());
-    } else if (compression_info_.attribute_size(attr_it->getID())
-               != attr_type.maximumByteLength()) {
+    } else if ((compression_info_.attribute_size(attr_it->getID())
+                    != attr_type.maximumByteLength())
+               || ((compression_info_.attribute_bits_size() != 0)
+                   && (compression_info_.attribute_bits(attr_it->getID()) > 0))) {
+      // Note that bit-packed attributes may be truncated to fewer bits than
+      // their type even if attribute_size is the same as the type's length.
       switch (attr_type.getTypeID()) {
         case Type::kInt:
         case Type::kLong:
@@ -457,12 +597,175 @@ void* CompressedTupleStorageSubBlock::initializeCommon() {
   return static_cast<char*>(sub_block_memory_) + dictionary_offset;
 }
 
+bool CompressedTupleStorageSubBlock::prepareBuilderForRebuild(
+    PtrVector<Tuple> *unmerged_delta_tuples) {
+  DEBUG_ASSERT(unmerged_delta_tuples->empty());
+  const CompatUnorderedMap<attribute_id, LiteralTypeInstance*>::unordered_map no_updated_values;
+
+  if (builder_.empty()) {
+    if (!deltaHasTuples()) {
+      return false;
+    }
+
+    // Load the existing compressed tuples into a new builder. The values are
+    // copied, so they can safely be overwritten when the block is rebuilt.
+    ScopedPtr<CompressedBlockBuilder> new_builder(
+        new CompressedBlockBuilder(relation_, description_, compressed_region_size_));
+    for (tuple_id tid = 0; tid < *static_cast<const tuple_id*>(sub_block_memory_); ++tid) {
+      Tuple tuple(*this, tid, no_updated_values);
+      if (!new_builder->addTuple(tuple, false)) {
+        // This should not happen, since the tuples already fit once, but if it
+        // does the existing block is left as it is.
+        return false;
+      }
+    }
+    builder_.reset(new_builder.release());
+  } else if (!deltaHasTuples()) {
+    return true;
+  }
+
+  for (tuple_id delta_tid = 0; delta_tid <= delta_->getMaxTupleID(); ++delta_tid) {
+    if (delta_->hasTupleWithID(delta_tid)) {
+      ScopedPtr<Tuple> tuple(new Tuple(*delta_, delta_tid, no_updated_values));
+      if (!builder_->addTuple(*tuple, false)) {
+        unmerged_delta_tuples->push_back(tuple.release());
+      }
+    }
+  }
+  return true;
+}
+
+void CompressedTupleStorageSubBlock::resetDelta(const PtrVector<Tuple> &unmerged_delta_tuples) {
+  if (delta_.empty()) {
+    DEBUG_ASSERT(unmerged_delta_tuples.empty());
+    return;
+  }
+
+  delta_.reset(new PackedRowStoreTupleStorageSubBlock(relation_,
+                                                      delta_description_,
+                                                      true,
+                                                      delta_memory_,
+                                                      sub_block_memory_size_ - compressed_region_size_));
+  for (PtrVector<Tuple>::const_iterator it = unmerged_delta_tuples.begin();
+       it != unmerged_delta_tuples.end();
+       ++it) {
+    // These tuples all fit in the delta region before it was cleared.
+    if (delta_->insertTuple(*it, kNone).inserted_id < 0) {
+      FATAL_ERROR("Failed to re-insert an unmerged tuple into the delta region in "
+                  "CompressedTupleStorageSubBlock::resetDelta()");
+    }
+  }
+}
+
+TupleIdSequence* CompressedTupleStorageSubBlock::appendDeltaMatches(
+    const Predicate *predicate,
+    TupleIdSequence *compressed_matches) const {
+  if (!deltaHasTuples()) {
+    return compressed_matches;
+  }
+
+  ScopedPtr<TupleIdSequence> matches(compressed_matches);
+  ScopedPtr<TupleIdSequence> delta_matches(delta_->getMatchesForPredicate(predicate));
+  const tuple_id delta_base = *static_cast<const tuple_id*>(sub_block_memory_);
+  for (TupleIdSequence::const_iterator it = delta_matches->begin();
+       it != delta_matches->end();
+       ++it) {
+    matches->append(delta_base + *it);
+  }
+  return matches.release();
+}
+
+TupleIdSequence* CompressedTupleStorageSubBlock::getAllCompressedTuples() const {
+  TupleIdSequence *matches = new TupleIdSequence();
+  for (tuple_id tid = 0; tid < *static_cast<const tuple_id*>(sub_block_memory_); ++tid) {
+    matches->append(tid);
+  }
+  return matches;
+}
+
+TupleIdSequence* CompressedTupleStorageSubBlock::evaluatePredicateOnCompressedAttribute(
+    const ComparisonPredicate &predicate,
+    const attribute_id comparison_attribute_id,
+    const bool left_literal) const {
+  const LiteralTypeInstance* comparison_literal;
+  if (left_literal) {
+    comparison_literal = &(predicate.getLeftOperand().getStaticValue());
+  } else {
+    comparison_literal = &(predicate.getRightOperand().getStaticValue());
+  }
+  if (comparison_literal->isNull()) {
+    // A comparison with NULL is never true.
+    return new TupleIdSequence();
+  }
+
+  if (predicate.getComparison().getComparisonID() == Comparison::kEqual) {
+    return evaluateEqualPredicateOnCompressedAttribute(comparison_attribute_id,
+                                                       *comparison_literal);
+  } else if (predicate.getComparison().getComparisonID() == Comparison::kNotEqual) {
+    return evaluateNotEqualPredicateOnCompressedAttribute(comparison_attribute_id,
+                                                          *comparison_literal);
+  } else {
+    if (left_literal) {
+      switch (predicate.getComparison().getComparisonID()) {
+        case Comparison::kLess:
+          return evaluateOtherComparisonPredicateOnCompressedAttribute(Comparison::kGreater,
+                                                                       comparison_attribute_id,
+                                                                       *comparison_literal);
+        case Comparison::kLessOrEqual:
+          return evaluateOtherComparisonPredicateOnCompressedAttribute(Comparison::kGreaterOrEqual,
+                                                                       comparison_attribute_id,
+                                                                       *comparison_literal);
+        case Comparison::kGreater:
+          return evaluateOtherComparisonPredicateOnCompressedAttribute(Comparison::kLess,
+                                                                       comparison_attribute_id,
+                                                                       *comparison_literal);
+        case Comparison::kGreaterOrEqual:
+          return evaluateOtherComparisonPredicateOnCompressedAttribute(Comparison::kLessOrEqual,
+                                                                       comparison_attribute_id,
+                                                                       *comparison_literal);
+        default:
+          FATAL_ERROR("Unexpected ComparisonID in "
+                      "CompressedTupleStorageSubBlock::evaluatePredicateOnCompressedAttribute()");
+      }
+    } else {
+      return evaluateOtherComparisonPredicateOnCompressedAttribute(
+          predicate.getComparison().getComparisonID(),
+          comparison_attribute_id,
+          *comparison_literal);
+    }
+  }
+}
+
+TupleIdSequence* CompressedTupleStorageSubBlock::excludeNullValues(
+    const attribute_id attr_id,
+    TupleIdSequence *matches) const {
+  ScopedPtr<TupleIdSequence> all_matches(matches);
+  if (all_matches->empty()) {
+    return all_matches.release();
+  }
+
+  // Check the NULL bitmap a word at a time, so that runs of tuples with no
+  // NULLs are passed through without testing individual bits.
+  const size_t kWordBits = sizeof(size_t) << 3;
+  const size_t *null_words = null_bitmaps_->getNullWords(attr_id);
+  TupleIdSequence *non_null_matches = new TupleIdSequence();
+  for (TupleIdSequence::const_iterator it = all_matches->begin();
+       it != all_matches->end();
+       ++it) {
+    const size_t null_word = null_words[*it / kWordBits];
+    if ((null_word == 0) || !((null_word >> (*it % kWordBits)) & 0x1)) {
+      non_null_matches->append(*it);
+    }
+  }
+  return non_null_matches;
+}
+
 TupleIdSequence* CompressedTupleStorageSubBlock::evaluateEqualPredicateOnCompressedAttribute(
     const attribute_id left_attr_id,
     const TypeInstance &right_literal) const {
   uint32_t match_code;
   if (dictionary_coded_attributes_[left_attr_id]) {
-    const CompressionDictionary &dictionary = *(dictionaries_.find(left_attr_id)->second);
+    const CompressionDictionary &dictionary = *(dictionaries_[left_attr_id]);
     match_code = dictionary.getCodeForTypedValue(right_literal);
     if (match_code == dictionary.numberOfCodes()) {
       return new TupleIdSequence();
@@ -473,7 +776,9 @@ TupleIdSequence* CompressedTupleStorageSubBlock::evaluateEqualPredicateOnCompres
                                                                right_literal)) {
       return new TupleIdSequence();
     }
-    match_code = right_literal.numericGetLongValue();
+    match_code = compressedGetEffectiveCodeForComparisonWithTruncatedAttribute(Comparison::kEqual,
+                                                                                left_attr_id,
+                                                                                right_literal);
   }
 
   return getEqualCodes(left_attr_id, match_code);
@@ -484,18 +789,20 @@ TupleIdSequence* CompressedTupleStorageSubBlock::evaluateNotEqualPredicateOnComp
     const TypeInstance &right_literal) const {
   uint32_t match_code;
   if (dictionary_coded_attributes_[left_attr_id]) {
-    const CompressionDictionary &dictionary = *(dictionaries_.find(left_attr_id)->second);
+    const CompressionDictionary &dictionary = *(dictionaries_[left_attr_id]);
     match_code = dictionary.getCodeForTypedValue(right_literal);
     if (match_code == dictionary.numberOfCodes()) {
-      return TupleStorageSubBlock::getMatchesForPredicate(NULL);
+      return getAllCompressedTuples();
     }
   } else {
     if (compressedComparisonIsAlwaysTrueForTruncatedAttribute(Comparison::kNotEqual,
                                                               left_attr_id,
                                                               right_literal)) {
-      return TupleStorageSubBlock::getMatchesForPredicate(NULL);
+      return getAllCompressedTuples();
     }
-    match_code = right_literal.numericGetLongValue();
+    match_code = compressedGetEffectiveCodeForComparisonWithTruncatedAttribute(Comparison::kNotEqual,
+                                                                                left_attr_id,
+                                                                                right_literal);
   }
 
   return getNotEqualCodes(left_attr_id, match_code);
@@ -507,7 +814,7 @@ TupleIdSequence* CompressedTupleStorageSubBlock::evaluateOtherComparisonPredicat
     const TypeInstance &right_literal) const {
   pair<uint32_t, uint32_t> match_range;
   if (dictionary_coded_attributes_[left_attr_id]) {
-    const CompressionDictionary &dictionary = *(dictionaries_.find(left_attr_id)->second);
+    const CompressionDictionary &dictionary = *(dictionaries_[left_attr_id]);
     match_range = dictionary.getLimitCodesForComparisonTyped(comp,
                                                              right_literal);
     if (match_range.first == match_range.second) {
@@ -520,15 +827,16 @@ TupleIdSequence* CompressedTupleStorageSubBlock::evaluateOtherComparisonPredicat
     }
   } else {
     if (compressedComparisonIsAlwaysTrueForTruncatedAttribute(comp, left_attr_id, right_literal)) {
-      return TupleStorageSubBlock::getMatchesForPredicate(NULL);
+      return getAllCompressedTuples();
     }
     if (compressedComparisonIsAlwaysFalseForTruncatedAttribute(comp, left_attr_id, right_literal)) {
       return new TupleIdSequence();
     }
 
     int64_t effective_literal
-        = GetEffectiveLiteralValueForComparisonWithTruncatedAttribute(comp,
-                                                                      right_literal);
+        = compressedGetEffectiveCodeForComparisonWithTruncatedAttribute(comp,
+                                                                        left_attr_id,
+                                                                        right_literal);
     switch (comp) {
       case Comparison::kLess:
         match_range.first = 0;
@@ -554,7 +862,7 @@ TupleIdSequence* CompressedTupleStorageSubBlock::evaluateOtherComparisonPredicat
 
   if (match_range.first == 0) {
     if (match_range.second == numeric_limits<uint32_t>::max()) {
-      return TupleStorageSubBlock::getMatchesForPredicate(NULL);
+      return getAllCompressedTuples();
     } else {
       return getLessCodes(left_attr_id, match_range.second);
     }
@@ -28,6 +28,8 @@
 
 #include "catalog/CatalogTypedefs.hpp"
 #include "storage/CompressedBlockBuilder.hpp"
+#include "storage/NullBitmaps.hpp"
+#include "storage/PackedRowStoreTupleStorageSubBlock.hpp"
 #include "storage/StorageBlockLayout.pb.h"
 #include "storage/StorageErrors.hpp"
 #include "storage/TupleIdSequence.hpp"
@@ -36,12 +38,13 @@
 #include "types/CompressionDictionary.hpp"
 #include "utility/CstdintCompat.hpp"
 #include "utility/Macros.hpp"
-#include "utility/PtrMap.hpp"
+#include "utility/PtrVector.hpp"
 #include "utility/ScopedPtr.hpp"
 
 namespace quickstep {
 
 class CatalogRelation;
+class ComparisonPredicate;
 class TupleStorageSubBlockDescription;
 
 /** \addtogroup Storage
@@ -52,6 +55,13 @@ class TupleStorageSubBlockDescription;
  * @brief Abstract base class which implements common functionality for
  *        CompressedPackedRowStoreTupleStorageSubBlock and
  *        CompressedColumnStoreTupleStorageSubBlock.
+ * @note If the description specifies a nonzero delta_region_bytes, the end of
+ *       the sub-block is set aside as an uncompressed delta region (an
+ *       embedded PackedRowStoreTupleStorageSubBlock). Ad-hoc inserts are
+ *       appended to the delta, and tuples in the delta have IDs following
+ *       those of the compressed tuples. rebuild() folds the delta into the
+ *       compressed tuples, so trickle inserts don't have to re-compress the
+ *       whole block every time.
  **/
 class CompressedTupleStorageSubBlock : public TupleStorageSubBlock {
  public:
@@ -83,19 +93,38 @@ class CompressedTupleStorageSubBlock : public TupleStorageSubBlock {
       const Comparison::ComparisonID comp,
       const TypeInstance &right_literal);
 
+  /**
+   * @brief Get the number of bytes at the end of a sub-block which a
+   *        description reserves for an uncompressed delta region.
+   *
+   * @param description A description of a CompressedPackedRowStore or
+   *        CompressedColumnStore.
+   * @return The size of the delta region in bytes, or 0 if there is none.
+   **/
+  static std::size_t GetDeltaRegionBytes(const TupleStorageSubBlockDescription &description);
+
   bool supportsUntypedGetAttributeValue(const attribute_id attr) const {
-    return !truncated_attributes_[attr];
+    if (builder_.empty()) {
+      return !truncated_attributes_[attr];
+    } else {
+      // Tuples in the delta region of an unbuilt block are readable, so
+      // answer conservatively for any attribute which may be truncated.
+      return !builder_->attributeMayBeCompressed(attr);
+    }
   }
 
   bool supportsAdHocInsert() const {
-    return false;
+    return !delta_.empty();
   }
 
   bool adHocInsertIsEfficient() const {
-    return false;
+    return !delta_.empty();
   }
 
   bool isEmpty() const {
+    if (!delta_.empty() && !delta_->isEmpty()) {
+      return false;
+    }
     if (builder_.empty()) {
       return *static_cast<const tuple_id*>(sub_block_memory_) == 0;
     } else {
@@ -104,26 +133,61 @@ class CompressedTupleStorageSubBlock : public TupleStorageSubBlock {
   }
 
   bool isPacked() const {
-    return true;
+    return delta_.empty() || delta_->isPacked();
   }
 
   tuple_id getMaxTupleID() const {
-    return *static_cast<const tuple_id*>(sub_block_memory_) - 1;
+    if (delta_.empty()) {
+      return *static_cast<const tuple_id*>(sub_block_memory_) - 1;
+    } else {
+      return *static_cast<const tuple_id*>(sub_block_memory_) + delta_->getMaxTupleID();
+    }
   }
 
-  bool hasTupleWithID(const tuple_id tuple) const {
-    return tuple < *static_cast<const tuple_id*>(sub_block_memory_);
+  tuple_id numTuples() const {
+    if (delta_.empty()) {
+      return *static_cast<const tuple_id*>(sub_block_memory_);
+    } else {
+      return *static_cast<const tuple_id*>(sub_block_memory_) + delta_->numTuples();
+    }
   }
 
-  InsertResult insertTuple(const Tuple &tuple, const AllowedTypeConversion atc) {
-    return InsertResult(-1, false);
+  bool hasTupleWithID(const tuple_id tuple) const {
+    if (tuple < *static_cast<const tuple_id*>(sub_block_memory_)) {
+      return true;
+    } else {
+      return !delta_.empty()
+             && delta_->hasTupleWithID(tuple - *static_cast<const tuple_id*>(sub_block_memory_));
+    }
   }
 
+  InsertResult insertTuple(const Tuple &tuple, const AllowedTypeConversion atc);
+
   bool insertTupleInBatch(const Tuple &tuple, const AllowedTypeConversion atc);
 
+  // Tuples are only ever appended to the delta region (or buffered out of
+  // band until the block is built).
+  bool nextInsertAppends() const {
+    return delta_.empty() || delta_->nextInsertAppends();
+  }
+
   const void* getAttributeValue(const tuple_id tuple, const attribute_id attr) const;
   TypeInstance* getAttributeValueTyped(const tuple_id tuple, const attribute_id attr) const;
 
+  // Compressed tuples can not be updated in place, but tuples in the delta
+  // region can.
+  bool canSetAttributeValuesInPlaceTyped(const tuple_id tuple,
+                                         const PtrMap<attribute_id, LiteralTypeInstance> &new_values) const {
+    return (tuple >= *static_cast<const tuple_id*>(sub_block_memory_))
+           && delta_->canSetAttributeValuesInPlaceTyped(tuple - *static_cast<const tuple_id*>(sub_block_memory_),
+                                                        new_values);
+  }
+
+  void setAttributeValueInPlaceTyped(const tuple_id tuple, const attribute_id attr, const TypeInstance &value) {
+    DEBUG_ASSERT(tuple >= *static_cast<const tuple_id*>(sub_block_memory_));
+    delta_->setAttributeValueInPlaceTyped(tuple - *static_cast<const tuple_id*>(sub_block_memory_), attr, value);
+  }
+
   // This override can more efficiently evaluate comparisons between a
   // compressed attribute and a literal value.
   virtual TupleIdSequence* getMatchesForPredicate(const Predicate *predicate) const;
@@ -148,6 +212,15 @@ class CompressedTupleStorageSubBlock : public TupleStorageSubBlock {
     return builder_.empty();
   }
 
+  /**
+   * @brief Check whether the delta region has filled up enough that it should
+   *        be folded into the compressed tuples by calling rebuild().
+   *
+   * @return true if this block has a delta region which is at least half
+   *         full.
+   **/
+  bool compressedDeltaNeedsMerge() const;
+
   /**
    * @brief Check if an attribute may be compressed in a block which is not yet
    *        built.
@@ -222,15 +295,81 @@ class CompressedTupleStorageSubBlock : public TupleStorageSubBlock {
    **/
   const CompressionDictionary& compressedGetDictionary(const attribute_id attr_id) const {
     DEBUG_ASSERT(builder_.empty());
-    PtrMap<attribute_id, CompressionDictionary>::const_iterator dict_it = dictionaries_.find(attr_id);
-    if (dict_it == dictionaries_.end()) {
+    if (!dictionary_coded_attributes_[attr_id]) {
       FATAL_ERROR("Called CompressedTupleStorageSubBlock::getCompressionDictionary() "
                   "for an attribute which is not dictionary-compressed.");
     } else {
-      return *(dict_it->second);
+      return *(dictionaries_[attr_id]);
     }
   }
 
+  /**
+   * @brief Get the version of the relation's SharedCompressionDictionary
+   *        which an attribute is coded with. Codes of attributes coded with
+   *        the same version of a shared dictionary can be compared across
+   *        blocks.
+   * @warning This method can only be called if compressedBlockIsBuilt()
+   *          returns true.
+   *
+   * @param attr_id The ID of the attribute to check.
+   * @return The version of the shared dictionary used for the attribute
+   *         specified by attr_id, or 0 if it is not coded with a shared
+   *         dictionary.
+   **/
+  std::uint32_t compressedGetSharedDictionaryVersion(const attribute_id attr_id) const {
+    DEBUG_ASSERT(builder_.empty());
+    if (compression_info_.shared_dictionary_version_size() == 0) {
+      return 0;
+    } else {
+      return compression_info_.shared_dictionary_version(attr_id);
+    }
+  }
+
+  /**
+   * @brief Get the frame of reference for a truncated attribute, i.e. the
+   *        value which is subtracted from each of the attribute's values to
+   *        get its truncated codes.
+   * @warning This method can only be called if compressedBlockIsBuilt()
+   *          returns true.
+   *
+   * @param attr_id The ID of the attribute to get the frame of reference for.
+   * @return The frame of reference for the attribute specified by attr_id
+   *         (zero if the attribute is not truncated).
+   **/
+  inline std::int64_t compressedGetFrameOfReference(const attribute_id attr_id) const {
+    DEBUG_ASSERT(builder_.empty());
+    if (compression_info_.frame_of_reference_size() == 0) {
+      return 0;
+    } else {
+      return compression_info_.frame_of_reference(attr_id);
+    }
+  }
+
+  /**
+   * @brief Get the effective code to use for a comparison of a truncated
+   *        attribute with a literal. This is
+   *        GetEffectiveLiteralValueForComparisonWithTruncatedAttribute()
+   *        (or the literal's long value for kEqual and kNotEqual) rebased
+   *        relative to the attribute's frame of reference.
+   * @warning compressedAttributeIsTruncationCompressed() must return true for
+   *          the specified attribute.
+   * @note The result may be negative or greater than the maximum truncated
+   *       code, so compressedComparisonIsAlwaysTrueForTruncatedAttribute() and
+   *       compressedComparisonIsAlwaysFalseForTruncatedAttribute() should be
+   *       checked first.
+   *
+   * @param comp The comparison to evaluate.
+   * @param left_attr_id The ID of the truncated attribute on the left side
+   *        of the comparison.
+   * @param right_literal The literal value on the right side of the
+   *        comparison.
+   * @return The rebased literal, which can be compared directly with codes.
+   **/
+  std::int64_t compressedGetEffectiveCodeForComparisonWithTruncatedAttribute(
+      const Comparison::ComparisonID comp,
+      const attribute_id left_attr_id,
+      const TypeInstance &right_literal) const;
+
   /**
    * @brief Determine if a comparison must always be true for any possible
    *        value of a truncated attribute.
@@ -275,6 +414,8 @@ class CompressedTupleStorageSubBlock : public TupleStorageSubBlock {
    * @warning The specified attribute must be compressed, i.e. either
    *          compressedAttributeIsDictionaryCompressed() or
    *          compressedAttributeIsTruncationCompressed() must be true for it.
+   * @warning Tuples in the delta region have no compressed codes, so this
+   *          method should only be used if supportsAdHocInsert() is false.
    *
    * @param tid The ID of the desired tuple.
    * @param attr_id The ID of the compressed attribute to get the code for.
@@ -282,6 +423,23 @@ class CompressedTupleStorageSubBlock : public TupleStorageSubBlock {
   virtual std::uint32_t compressedGetCode(const tuple_id tid,
                                           const attribute_id attr_id) const = 0;
 
+  /**
+   * @brief Check whether an attribute's value in a tuple is NULL. NULL values
+   *        of a compressed attribute are stored as code 0, so this should be
+   *        checked before interpreting the result of compressedGetCode() for
+   *        a nullable attribute.
+   * @warning This method can only be called if compressedBlockIsBuilt()
+   *          returns true.
+   *
+   * @param tid The ID of the desired tuple.
+   * @param attr_id The ID of the attribute to check.
+   * @return Whether the value of attr_id in tid is NULL.
+   **/
+  inline bool compressedIsNull(const tuple_id tid, const attribute_id attr_id) const {
+    DEBUG_ASSERT(builder_.empty());
+    return !null_bitmaps_.empty() && null_bitmaps_->isNull(tid, attr_id);
+  }
+
  protected:
   inline static std::int64_t GetMaxTruncatedValue(const std::size_t byte_length) {
     switch (byte_length) {
@@ -299,6 +457,37 @@ class CompressedTupleStorageSubBlock : public TupleStorageSubBlock {
 
   void* initializeCommon();
 
+  // Delete a tuple from the delta region. Returns true if IDs of other tuples
+  // were mutated.
+  bool deleteDeltaTuple(const tuple_id tuple) {
+    DEBUG_ASSERT(!delta_.empty());
+    return delta_->deleteTuple(tuple - *static_cast<const tuple_id*>(sub_block_memory_));
+  }
+
+  // Check if there are any tuple IDs in use in the delta region (which are
+  // renumbered when a compressed tuple is deleted).
+  bool deltaHasTuples() const {
+    return !delta_.empty() && (delta_->getMaxTupleID() >= 0);
+  }
+
+  // Prepare 'builder_' to rebuild this block with the contents of the delta
+  // region. If the block is already built, a new builder is first loaded with
+  // the existing compressed tuples. Delta tuples which don't fit are copied to
+  // 'unmerged_delta_tuples'. Returns false if there is nothing to rebuild.
+  bool prepareBuilderForRebuild(PtrVector<Tuple> *unmerged_delta_tuples);
+
+  // Clear the delta region after the block has been rebuilt, then re-insert
+  // any delta tuples which could not be merged.
+  void resetDelta(const PtrVector<Tuple> &unmerged_delta_tuples);
+
+  // Append the matches for 'predicate' in the delta region (if any) to
+  // 'compressed_matches', which covers only the compressed tuples.
+  TupleIdSequence* appendDeltaMatches(const Predicate *predicate,
+                                      TupleIdSequence *compressed_matches) const;
+
+  // Get the IDs of all the compressed tuples (but not those in the delta).
+  TupleIdSequence* getAllCompressedTuples() const;
+
   virtual const void* getAttributePtr(const tuple_id tid,
                                       const attribute_id attr_id) const = 0;
 
@@ -324,7 +513,24 @@ class CompressedTupleStorageSubBlock : public TupleStorageSubBlock {
   std::vector<bool> dictionary_coded_attributes_;
   std::vector<bool> truncated_attributes_;
 
+  // Empty if the relation has no nullable attributes.
+  ScopedPtr<NullBitmaps> null_bitmaps_;
+
+  // The size of the memory which holds the compressed tuples, i.e. everything
+  // before the delta region.
+  std::size_t compressed_region_size_;
+
  private:
+  TupleIdSequence* evaluatePredicateOnCompressedAttribute(
+      const ComparisonPredicate &predicate,
+      const attribute_id comparison_attribute_id,
+      const bool left_literal) const;
+
+  // Remove the tuples whose value of the nullable attribute attr_id is NULL
+  // from matches, which is deleted and replaced by the returned sequence.
+  TupleIdSequence* excludeNullValues(const attribute_id attr_id,
+                                     TupleIdSequence *matches) const;
+
   TupleIdSequence* evaluateEqualPredicateOnCompressedAttribute(
       const attribute_id left_attr_id,
       const TypeInstance &right_literal) const;
@@ -338,7 +544,19 @@ class CompressedTupleStorageSubBlock : public TupleStorageSubBlock {
       const attribute_id left_attr_id,
       const TypeInstance &right_literal) const;
 
-  PtrMap<attribute_id, CompressionDictionary> dictionaries_;
+  // Describes the PackedRowStore used for the delta region. This must outlive
+  // 'delta_', which holds a reference to it.
+  TupleStorageSubBlockDescription delta_description_;
+  // Empty if the description does not reserve a delta region.
+  ScopedPtr<PackedRowStoreTupleStorageSubBlock> delta_;
+  void *delta_memory_;
+
+  // Dictionaries stored in this block. Attributes coded with a shared
+  // dictionary instead use a version owned by the relation.
+  PtrVector<CompressionDictionary> block_dictionaries_;
+  // The dictionary for each attribute, indexed by attribute ID (NULL if the
+  // attribute is not dictionary-coded).
+  std::vector<const CompressionDictionary*> dictionaries_;
 
   DISALLOW_COPY_AND_ASSIGN(CompressedTupleStorageSubBlock);
 };
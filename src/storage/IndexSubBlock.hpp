@@ -22,6 +22,7 @@
 #define QUICKSTEP_STORAGE_INDEX_SUB_BLOCK_HPP_
 
 #include <cstddef>
+#include <vector>
 
 #include "catalog/CatalogTypedefs.hpp"
 #include "storage/StorageBlockInfo.hpp"
@@ -34,6 +35,8 @@ class CatalogRelation;
 struct IndexSearchResult;
 class IndexSubBlockDescription;
 class Predicate;
+template <typename T, bool null_allowed> class PtrVector;
+class Tuple;
 class TupleIdSequence;
 
 /** \addtogroup Storage
@@ -125,6 +128,24 @@ class IndexSubBlock {
    **/
   virtual bool addEntry(const tuple_id tuple) = 0;
 
+  /**
+   * @brief Add entries for a batch of tuples to this index.
+   * @note Implementations should access the necessary attribute values via
+   *       parent_'s TupleStorageSubBlock.
+   * @note This is used by StorageBlock to bring an index up to date after a
+   *       batch of tuples is inserted with insertTupleInBatch(), when the
+   *       TupleStorageSubBlock's rebuild() does not disturb the IDs of
+   *       existing tuples. Implementations should avoid rebuilding the whole
+   *       index where possible.
+   *
+   * @param tuples The IDs of the tuples to index.
+   * @return True if entries were successfully added, false otherwise (e.g.
+   *         because there was no space, or ad-hoc adds are not supported). If
+   *         false is returned, this index may have been left partially
+   *         updated, and rebuild() must be called to make it consistent.
+   **/
+  virtual bool bulkAddEntries(const TupleIdSequence &tuples) = 0;
+
   /**
    * @brief Remove an entry from this index.
    * @note Tuples are removed from indexes BEFORE the TupleStorageSubBlock, so
@@ -136,6 +157,31 @@ class IndexSubBlock {
    **/
   virtual void removeEntry(const tuple_id tuple) = 0;
 
+  /**
+   * @brief Determine whether the entries in this index depend on the value of
+   *        any of the specified attributes, i.e. whether an entry must be
+   *        removed and re-added when those attributes of a tuple are updated.
+   * @note The default implementation conservatively returns true.
+   *
+   * @param attributes The IDs of the attributes to check.
+   * @return Whether this index's entries depend on any of attributes.
+   **/
+  virtual bool dependsOnAttributes(const std::vector<attribute_id> &attributes) const {
+    return true;
+  }
+
+  /**
+   * @brief Determine whether this index is able to evaluate a particular
+   *        predicate with getMatchesForPredicate().
+   * @note This is used to decide which parts of a complex predicate (e.g.
+   *       which conjuncts of a ConjunctionPredicate) can be handed off to
+   *       which indexes.
+   *
+   * @param predicate The predicate to check.
+   * @return Whether getMatchesForPredicate() can be called for predicate.
+   **/
+  virtual bool canEvaluatePredicate(const Predicate &predicate) const = 0;
+
   /**
    * @brief Use this index to find (possibly a superset of) tuples matching a
    *        particular predicate.
@@ -146,6 +192,41 @@ class IndexSubBlock {
    **/
   virtual IndexSearchResult getMatchesForPredicate(const Predicate &predicate) const = 0;
 
+  /**
+   * @brief Determine whether this IndexSubBlock stores the values of all the
+   *        specified attributes in its entries, so that they can be projected
+   *        by getMatchingValuesForPredicate() without accessing the
+   *        TupleStorageSubBlock (i.e. whether the index is covering).
+   *
+   * @param attributes The IDs of the attributes to check.
+   * @return Whether getMatchingValuesForPredicate() can be used to get values
+   *         of all of attributes.
+   **/
+  virtual bool coversAttributes(const std::vector<attribute_id> &attributes) const {
+    return false;
+  }
+
+  /**
+   * @brief Use this index to find tuples matching a particular predicate, and
+   *        get the values of some attributes of the matching tuples directly
+   *        from index entries.
+   * @warning coversAttributes() must return true for attributes.
+   * @warning Values in the returned Tuples may refer to memory inside this
+   *          IndexSubBlock, and are only valid until it is modified.
+   *
+   * @param predicate The predicate to match.
+   * @param attributes The IDs of the attributes to get values for.
+   * @return A vector with one Tuple for each tuple matching predicate, whose
+   *         values are those of attributes (in the same order). Caller takes
+   *         ownership.
+   **/
+  virtual PtrVector<Tuple, false>* getMatchingValuesForPredicate(
+      const Predicate &predicate,
+      const std::vector<attribute_id> &attributes) const {
+    FATAL_ERROR("Called IndexSubBlock::getMatchingValuesForPredicate() on an "
+                "IndexSubBlock which does not cover any attributes.");
+  }
+
   /**
    * @brief Rebuild this index from scratch.
    *
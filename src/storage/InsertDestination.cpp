@@ -20,14 +20,76 @@
 
 #include "storage/InsertDestination.hpp"
 
+#include <cstddef>
+#include <deque>
+#include <utility>
 #include <vector>
 
+#include "catalog/CatalogAttribute.hpp"
 #include "catalog/CatalogRelation.hpp"
 #include "storage/StorageBlock.hpp"
+#include "storage/StorageConstants.hpp"
+#include "storage/StorageErrors.hpp"
 #include "storage/StorageManager.hpp"
+#include "storage/TupleStorageSubBlock.hpp"
+#include "threading/Thread.hpp"
+#include "threading/VersionedLatch.hpp"
+#include "types/AllowedTypeConversion.hpp"
+#include "types/Tuple.hpp"
+#include "utility/Macros.hpp"
+
+using std::pair;
+using std::vector;
 
 namespace quickstep {
 
+namespace insert_destination_internal {
+
+class BlockRebuildThread : public Thread {
+ public:
+  BlockRebuildThread(ParallelRebuildInsertDestination *parent_destination,
+                     StorageBlock *block)
+      : parent_destination_(parent_destination),
+        block_(block) {
+  }
+
+ protected:
+  void run() {
+    if (!block_->rebuild()) {
+      FATAL_ERROR("ParallelRebuildInsertDestination failed to rebuild a StorageBlock.");
+    }
+    parent_destination_->publishRebuiltBlock(block_);
+  }
+
+ private:
+  ParallelRebuildInsertDestination *parent_destination_;
+  StorageBlock *block_;
+
+  DISALLOW_COPY_AND_ASSIGN(BlockRebuildThread);
+};
+
+class DeltaMergeThread : public Thread {
+ public:
+  DeltaMergeThread(BlockPoolInsertDestination *parent_destination,
+                   StorageBlock *block)
+      : parent_destination_(parent_destination),
+        block_(block) {
+  }
+
+ protected:
+  void run() {
+    parent_destination_->mergeDelta(block_);
+  }
+
+ private:
+  BlockPoolInsertDestination *parent_destination_;
+  StorageBlock *block_;
+
+  DISALLOW_COPY_AND_ASSIGN(DeltaMergeThread);
+};
+
+}  // namespace insert_destination_internal
+
 InsertDestination::InsertDestination(StorageManager *storage_manager,
                                      CatalogRelation *relation,
                                      const StorageBlockLayout *layout)
@@ -53,25 +115,51 @@ void AlwaysCreateBlockInsertDestination::returnBlock(StorageBlock *block, const
 void BlockPoolInsertDestination::addAllBlocksFromRelation() {
   MutexLock lock(mutex_);
   DEBUG_ASSERT(available_block_ids_.empty());
-  for (CatalogRelation::const_iterator_blocks it = relation_->begin_blocks();
-       it != relation_->end_blocks();
-       it++) {
-    available_block_ids_.push_back(*it);
-  }
+  relation_->getBlocksSnapshot(&available_block_ids_);
 }
 
 StorageBlock* BlockPoolInsertDestination::getBlockForInsertion() {
   MutexLock lock(mutex_);
-  if (available_block_ids_.empty()) {
-    return createNewBlock();
-  } else {
+  while (!available_block_ids_.empty()) {
     StorageBlock *retval = storage_manager_->getBlockMutable(available_block_ids_.back());
     available_block_ids_.pop_back();
-    return retval;
+    // Skip blocks which have been swapped out of the relation (e.g. by a
+    // BlockCompactor) since they were added to the pool.
+    if (!retval->isRetired()) {
+      return retval;
+    }
   }
+  return createNewBlock();
+}
+
+BlockPoolInsertDestination::~BlockPoolInsertDestination() {
+  waitForDeltaMerges();
 }
 
 void BlockPoolInsertDestination::returnBlock(StorageBlock *block, const bool full) {
+  if (block->isRetired()) {
+    // The block was swapped out of the relation while it was checked out, so
+    // it belongs to whoever retired it now.
+    return;
+  }
+
+  if (block->tupleStoreNeedsMerge()) {
+    // Merge in the background, even if the block is full, since merging frees
+    // up space in the delta region. The block is kept out of the pool until
+    // the merge is done.
+    MutexLock lock(merge_threads_mutex_);
+    if (merge_threads_.size() == kMaxConcurrentDeltaMerges) {
+      insert_destination_internal::DeltaMergeThread *oldest_thread = merge_threads_.front();
+      merge_threads_.pop_front();
+      oldest_thread->join();
+      delete oldest_thread;
+    }
+
+    merge_threads_.push_back(new insert_destination_internal::DeltaMergeThread(this, block));
+    merge_threads_.back()->start();
+    return;
+  }
+
   MutexLock lock(mutex_);
   if (full) {
     done_block_ids_.push_back(block->getID());
@@ -80,6 +168,120 @@ void BlockPoolInsertDestination::returnBlock(StorageBlock *block, const bool ful
   }
 }
 
+void BlockPoolInsertDestination::waitForDeltaMerges() {
+  MutexLock lock(merge_threads_mutex_);
+  while (!merge_threads_.empty()) {
+    merge_threads_.front()->join();
+    delete merge_threads_.front();
+    merge_threads_.pop_front();
+  }
+}
+
+std::size_t BlockPoolInsertDestination::reclaimRetiredBlocks() {
+  const std::size_t oldest_reader_epoch = relation_->getOldestBlocksReaderEpoch();
+
+  MutexLock lock(mutex_);
+  std::size_t num_reclaimed_blocks = 0;
+  vector<pair<block_id, std::size_t> >::iterator kept_it = retired_blocks_.begin();
+  for (vector<pair<block_id, std::size_t> >::const_iterator it = retired_blocks_.begin();
+       it != retired_blocks_.end();
+       ++it) {
+    if (it->second <= oldest_reader_epoch) {
+      storage_manager_->evictBlock(it->first);
+      ++num_reclaimed_blocks;
+    } else {
+      *kept_it = *it;
+      ++kept_it;
+    }
+  }
+  retired_blocks_.erase(kept_it, retired_blocks_.end());
+  return num_reclaimed_blocks;
+}
+
+void BlockPoolInsertDestination::mergeDelta(StorageBlock *block) {
+  vector<block_id> merged_block_ids;
+  bool merged = false;
+  {
+    // Keep writers out of 'block' until it has been swapped out of the
+    // relation. Scans may keep reading it throughout (and afterwards, if they
+    // took a snapshot of the relation's blocks beforehand), which is why it
+    // is not simply rebuilt in place.
+    VersionedLatchAppendLock lock(*block->getLatchMutable());
+    try {
+      copyToNewBlocks(block->getTupleStorageSubBlock(), &merged_block_ids);
+      merged = relation_->replaceBlocks(vector<block_id>(1, block->getID()), merged_block_ids);
+      if (merged) {
+        // Refuse any write which is waiting for the latch, since it would be
+        // lost.
+        block->markRetired();
+      }
+    } catch (const TupleTooLargeForBlock &e) {
+      merged = false;
+    }
+  }
+
+  if (!merged) {
+    // Either 'block' doesn't belong to the relation (so it can't be swapped
+    // out), or its tuples didn't fit in blocks with 'layout_'. Leave it
+    // unmerged, and treat it as full (unless another thread has retired it
+    // in the meantime).
+    for (vector<block_id>::const_iterator it = merged_block_ids.begin();
+         it != merged_block_ids.end();
+         ++it) {
+      storage_manager_->evictBlock(*it);
+    }
+    if (!block->isRetired()) {
+      MutexLock lock(mutex_);
+      done_block_ids_.push_back(block->getID());
+    }
+    return;
+  }
+
+  // Readers which register after the swap can't see 'block', so the current
+  // epoch is a safe (if conservative) time of retirement.
+  const std::size_t retired_epoch = relation_->getBlocksEpoch();
+  MutexLock lock(mutex_);
+  retired_blocks_.push_back(pair<block_id, std::size_t>(block->getID(), retired_epoch));
+  if (!merged_block_ids.empty()) {
+    // Every merged block but the last one is full.
+    done_block_ids_.insert(done_block_ids_.end(), merged_block_ids.begin(), merged_block_ids.end() - 1);
+    available_block_ids_.push_back(merged_block_ids.back());
+  }
+}
+
+void BlockPoolInsertDestination::copyToNewBlocks(const TupleStorageSubBlock &source_store,
+                                                 std::vector<block_id> *merged_block_ids) {
+  if (source_store.isEmpty()) {
+    return;
+  }
+
+  vector<attribute_id> all_attributes;
+  for (CatalogRelation::const_iterator attr_it = relation_->begin();
+       attr_it != relation_->end();
+       ++attr_it) {
+    all_attributes.push_back(attr_it->getID());
+  }
+
+  // If an index runs out of space, a merged block is still usable (the index
+  // is just left inconsistent), so the results of rebuild() are not checked.
+  merged_block_ids->push_back(storage_manager_->createBlock(*relation_, layout_));
+  StorageBlock *merged_block = storage_manager_->getBlockMutable(merged_block_ids->back());
+  const tuple_id max_tid = source_store.getMaxTupleID();
+  for (tuple_id tid = 0; tid <= max_tid; ++tid) {
+    if (!source_store.hasTupleWithID(tid)) {
+      continue;
+    }
+
+    Tuple tuple(source_store, tid, all_attributes);
+    while (!merged_block->insertTupleInBatch(tuple, kNone)) {
+      merged_block->rebuild();
+      merged_block_ids->push_back(storage_manager_->createBlock(*relation_, layout_));
+      merged_block = storage_manager_->getBlockMutable(merged_block_ids->back());
+    }
+  }
+  merged_block->rebuild();
+}
+
 const std::vector<block_id>& BlockPoolInsertDestination::getTouchedBlocksInternal() {
   done_block_ids_.insert(done_block_ids_.end(),
                          available_block_ids_.begin(),
@@ -89,4 +291,53 @@ const std::vector<block_id>& BlockPoolInsertDestination::getTouchedBlocksInterna
   return done_block_ids_;
 }
 
+ParallelRebuildInsertDestination::ParallelRebuildInsertDestination(
+    StorageManager *storage_manager,
+    CatalogRelation *relation,
+    const StorageBlockLayout *layout,
+    const std::size_t max_rebuild_threads)
+    : InsertDestination(storage_manager, relation, layout),
+      max_rebuild_threads_(max_rebuild_threads) {
+  DEBUG_ASSERT(max_rebuild_threads_ > 0);
+}
+
+ParallelRebuildInsertDestination::~ParallelRebuildInsertDestination() {
+  waitForRebuilds();
+}
+
+StorageBlock* ParallelRebuildInsertDestination::getBlockForInsertion() {
+  // The new block is not added to the relation until it has been rebuilt.
+  MutexLock lock(mutex_);
+  block_id new_id = storage_manager_->createBlock(*relation_, layout_);
+  return storage_manager_->getBlockMutable(new_id);
+}
+
+void ParallelRebuildInsertDestination::returnBlock(StorageBlock *block, const bool full) {
+  MutexLock lock(rebuild_threads_mutex_);
+  if (rebuild_threads_.size() == max_rebuild_threads_) {
+    insert_destination_internal::BlockRebuildThread *oldest_thread = rebuild_threads_.front();
+    rebuild_threads_.pop_front();
+    oldest_thread->join();
+    delete oldest_thread;
+  }
+
+  rebuild_threads_.push_back(new insert_destination_internal::BlockRebuildThread(this, block));
+  rebuild_threads_.back()->start();
+}
+
+void ParallelRebuildInsertDestination::waitForRebuilds() {
+  MutexLock lock(rebuild_threads_mutex_);
+  while (!rebuild_threads_.empty()) {
+    rebuild_threads_.front()->join();
+    delete rebuild_threads_.front();
+    rebuild_threads_.pop_front();
+  }
+}
+
+void ParallelRebuildInsertDestination::publishRebuiltBlock(StorageBlock *block) {
+  MutexLock lock(mutex_);
+  relation_->addBlock(block->getID());
+  rebuilt_block_ids_.push_back(block->getID());
+}
+
 }  // namespace quickstep
@@ -21,6 +21,9 @@
 #ifndef QUICKSTEP_STORAGE_INSERT_DESTINATION_HPP_
 #define QUICKSTEP_STORAGE_INSERT_DESTINATION_HPP_
 
+#include <cstddef>
+#include <deque>
+#include <utility>
 #include <vector>
 
 #include "storage/StorageBlockInfo.hpp"
@@ -34,6 +37,12 @@ class CatalogRelation;
 class StorageBlock;
 class StorageBlockLayout;
 class StorageManager;
+class TupleStorageSubBlock;
+
+namespace insert_destination_internal {
+class BlockRebuildThread;
+class DeltaMergeThread;
+}  // namespace insert_destination_internal
 
 /** \addtogroup Storage
  *  @{
@@ -160,6 +169,22 @@ class AlwaysCreateBlockInsertDestination : public InsertDestination {
  *        partially-full blocks. Creates new blocks as necessary when
  *        getBlockForInsertion() is called and there are no partially-full
  *        blocks from the pool which are not "checked out" by workers.
+ * @note If a returned block's compressed delta region has filled past its
+ *       merge threshold (see StorageBlock::tupleStoreNeedsMerge()), its
+ *       tuples are copied into new blocks in a background thread, which are
+ *       swapped into the relation in its place with
+ *       CatalogRelation::replaceBlocks() and go into the pool instead. The
+ *       original block is only retired, not freed, since scans may still be
+ *       reading it. reclaimRetiredBlocks() frees those which no such scan
+ *       (registered with CatalogRelation::beginBlocksRead()) can still be
+ *       reading.
+ * @note A block which doesn't belong to the relation (see addBlockToPool())
+ *       can't be swapped out, so it is treated as full instead of being
+ *       merged.
+ * @note Blocks which have been retired (see StorageBlock::markRetired()),
+ *       e.g. by a BlockCompactor, are dropped from the pool rather than
+ *       handed out or treated as full.
+ * @warning Call waitForDeltaMerges() before getTouchedBlocks().
  **/
 class BlockPoolInsertDestination : public InsertDestination {
  public:
@@ -169,8 +194,12 @@ class BlockPoolInsertDestination : public InsertDestination {
       : InsertDestination(storage_manager, relation, layout) {
   }
 
-  ~BlockPoolInsertDestination() {
-  }
+  /**
+   * @brief Destructor. Waits for any outstanding delta merges to finish.
+   * @note Retired blocks which have not been reclaimed are left in the
+   *       StorageManager.
+   **/
+  ~BlockPoolInsertDestination();
 
   /**
    * @brief Manually add a block to the pool.
@@ -197,16 +226,134 @@ class BlockPoolInsertDestination : public InsertDestination {
 
   void returnBlock(StorageBlock *block, const bool full);
 
+  /**
+   * @brief Block until every background delta merge started so far has
+   *        finished and its block has been returned to the pool.
+   **/
+  void waitForDeltaMerges();
+
+  /**
+   * @brief Evict the blocks which have been replaced by delta merges, and
+   *        which no query can still be reading, from the StorageManager,
+   *        freeing their slots for reuse. A block is kept while any reader
+   *        which registered with CatalogRelation::beginBlocksRead() before it
+   *        was replaced has not yet ended its read.
+   * @warning Call waitForDeltaMerges() first. Queries which took an
+   *          unregistered snapshot of the relation's blocks (with
+   *          CatalogRelation::getBlocksSnapshot()) are not tracked, and must
+   *          have finished before this is called.
+   *
+   * @return The number of blocks which were freed.
+   **/
+  std::size_t reclaimRetiredBlocks();
+
  protected:
   const std::vector<block_id>& getTouchedBlocksInternal();
 
  private:
+  // Called by a DeltaMergeThread to copy the tuples of 'block' into new
+  // blocks, swap them into the relation in its place, and return them to the
+  // pool.
+  void mergeDelta(StorageBlock *block);
+
+  // Copy every tuple in 'source_store' into newly-created (and rebuilt)
+  // blocks, which are NOT added to the relation, appending their IDs to
+  // 'merged_block_ids'.
+  void copyToNewBlocks(const TupleStorageSubBlock &source_store,
+                       std::vector<block_id> *merged_block_ids);
+
   std::vector<block_id> available_block_ids_;
   std::vector<block_id> done_block_ids_;
 
+  // Blocks which have been replaced by delta merges, but may still be read by
+  // scans, each paired with the relation's blocks epoch as of when it was
+  // replaced.
+  std::vector<std::pair<block_id, std::size_t> > retired_blocks_;
+
+  // Running (or finished but not yet joined) delta merge threads, oldest
+  // first. As with ParallelRebuildInsertDestination, these are protected by
+  // their own mutex, since merge threads take 'mutex_' to return blocks.
+  std::deque<insert_destination_internal::DeltaMergeThread*> merge_threads_;
+  Mutex merge_threads_mutex_;
+
+  friend class insert_destination_internal::DeltaMergeThread;
+
   DISALLOW_COPY_AND_ASSIGN(BlockPoolInsertDestination);
 };
 
+/**
+ * @brief Implementation of InsertDestination that always creates new blocks,
+ *        and which rebuilds each block returned to it in a separate worker
+ *        thread. This allows the expensive part of building a block (e.g.
+ *        compressing, sorting, and building indices for a compressed block,
+ *        all of which happen in StorageBlock::rebuild()) to proceed for
+ *        several blocks at once, in parallel with further insertion.
+ * @note Clients should insert into blocks with
+ *       StorageBlock::insertTupleInBatch() and should NOT call rebuild()
+ *       themselves. Every returned block is rebuilt, whether or not it is
+ *       full.
+ * @note A block is only added to the relation once it has been rebuilt.
+ * @warning Call waitForRebuilds() before getTouchedBlocks(), or before
+ *          otherwise accessing the relation's blocks.
+ **/
+class ParallelRebuildInsertDestination : public InsertDestination {
+ public:
+  /**
+   * @brief Constructor.
+   *
+   * @param storage_manager The StorageManager to use.
+   * @param relation The relation to insert tuples into.
+   * @param layout The layout to use for any newly-created blocks. If NULL,
+   *        defaults to relation's default layout.
+   * @param max_rebuild_threads The maximum number of blocks which may be
+   *        rebuilt concurrently. If this many rebuilds are already running,
+   *        returnBlock() waits for the oldest one to finish.
+   **/
+  ParallelRebuildInsertDestination(StorageManager *storage_manager,
+                                   CatalogRelation *relation,
+                                   const StorageBlockLayout *layout,
+                                   const std::size_t max_rebuild_threads);
+
+  /**
+   * @brief Destructor. Waits for any outstanding rebuilds to finish.
+   **/
+  ~ParallelRebuildInsertDestination();
+
+  StorageBlock* getBlockForInsertion();
+
+  void returnBlock(StorageBlock *block, const bool full);
+
+  /**
+   * @brief Block until every block returned so far has been rebuilt and
+   *        added to the relation.
+   **/
+  void waitForRebuilds();
+
+ protected:
+  const std::vector<block_id>& getTouchedBlocksInternal() {
+    return rebuilt_block_ids_;
+  }
+
+ private:
+  // Called by a BlockRebuildThread once it has rebuilt 'block'.
+  void publishRebuiltBlock(StorageBlock *block);
+
+  const std::size_t max_rebuild_threads_;
+
+  // Running (or finished but not yet joined) rebuild threads, oldest first.
+  // Protected by 'rebuild_threads_mutex_' rather than 'mutex_', since rebuild
+  // threads take 'mutex_' to publish their blocks while they are being
+  // joined.
+  std::deque<insert_destination_internal::BlockRebuildThread*> rebuild_threads_;
+  Mutex rebuild_threads_mutex_;
+
+  std::vector<block_id> rebuilt_block_ids_;
+
+  friend class insert_destination_internal::BlockRebuildThread;
+
+  DISALLOW_COPY_AND_ASSIGN(ParallelRebuildInsertDestination);
+};
+
 /** @} */
 
 }  // namespace quickstep
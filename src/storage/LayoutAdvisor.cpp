@@ -0,0 +1,208 @@
+/*
+   This file copyright (c) 2011-2013, the Quickstep authors.
+   See file CREDITS.txt for details.
+
+   This file is part of Quickstep.
+
+   Quickstep is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Quickstep is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Quickstep.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "storage/LayoutAdvisor.hpp"
+
+#include <cstddef>
+#include <vector>
+
+#include "catalog/CatalogAttribute.hpp"
+#include "catalog/CatalogRelation.hpp"
+#include "storage/StorageBlockLayout.hpp"
+#include "storage/StorageBlockLayout.pb.h"
+#include "storage/StorageConstants.hpp"
+#include "utility/Macros.hpp"
+
+using std::size_t;
+using std::vector;
+
+namespace quickstep {
+
+namespace {
+
+TupleStorageSubBlockDescription MakeCompressedDescription(
+    const CatalogRelation &relation,
+    const bool columnar,
+    const attribute_id sort_attribute,
+    const size_t delta_region_bytes) {
+  TupleStorageSubBlockDescription description;
+  if (columnar) {
+    description.set_sub_block_type(TupleStorageSubBlockDescription::COMPRESSED_COLUMN_STORE);
+    description.SetExtension(CompressedColumnStoreTupleStorageSubBlockDescription::sort_attribute_id,
+                             sort_attribute);
+  } else {
+    description.set_sub_block_type(TupleStorageSubBlockDescription::COMPRESSED_PACKED_ROW_STORE);
+  }
+
+  for (CatalogRelation::const_iterator attr_it = relation.begin();
+       attr_it != relation.end();
+       ++attr_it) {
+    if (columnar) {
+      description.AddExtension(CompressedColumnStoreTupleStorageSubBlockDescription::compressed_attribute_id,
+                               attr_it->getID());
+    } else {
+      description.AddExtension(CompressedPackedRowStoreTupleStorageSubBlockDescription::compressed_attribute_id,
+                               attr_it->getID());
+    }
+  }
+
+  if (delta_region_bytes > 0) {
+    if (columnar) {
+      description.SetExtension(CompressedColumnStoreTupleStorageSubBlockDescription::delta_region_bytes,
+                               delta_region_bytes);
+    } else {
+      description.SetExtension(CompressedPackedRowStoreTupleStorageSubBlockDescription::delta_region_bytes,
+                               delta_region_bytes);
+    }
+  }
+
+  return description;
+}
+
+// Determine whether a TupleStorageSubBlock described by 'description' keeps
+// its tuples sorted on 'attr' (so that predicates on it are evaluated by
+// binary search rather than a scan).
+bool TupleStoreIsSortedOn(const TupleStorageSubBlockDescription &description,
+                          const attribute_id attr) {
+  switch (description.sub_block_type()) {
+    case TupleStorageSubBlockDescription::BASIC_COLUMN_STORE:
+      return description.GetExtension(BasicColumnStoreTupleStorageSubBlockDescription::sort_attribute_id) == attr;
+    case TupleStorageSubBlockDescription::COMPRESSED_COLUMN_STORE:
+      return description.GetExtension(CompressedColumnStoreTupleStorageSubBlockDescription::sort_attribute_id)
+             == attr;
+    default:
+      return false;
+  }
+}
+
+}  // anonymous namespace
+
+LayoutAdvisor::LayoutAdvisor(const CatalogRelation &relation)
+    : relation_(relation),
+      num_selections_(0),
+      num_projected_attributes_(0),
+      num_inserted_tuples_(0),
+      predicate_counts_(relation.getMaxAttributeId() + 1, 0),
+      predicate_selectivity_sums_(relation.getMaxAttributeId() + 1, 0.0) {
+}
+
+void LayoutAdvisor::recordSelection(const vector<attribute_id> &predicate_attributes,
+                                    const double selectivity,
+                                    const size_t num_projected_attributes) {
+  MutexLock lock(mutex_);
+  ++num_selections_;
+  num_projected_attributes_ += num_projected_attributes;
+  for (vector<attribute_id>::const_iterator it = predicate_attributes.begin();
+       it != predicate_attributes.end();
+       ++it) {
+    DEBUG_ASSERT(relation_.hasAttributeWithId(*it));
+    ++predicate_counts_[*it];
+    predicate_selectivity_sums_[*it] += selectivity;
+  }
+}
+
+void LayoutAdvisor::clear() {
+  MutexLock lock(mutex_);
+  num_selections_ = 0;
+  num_projected_attributes_ = 0;
+  num_inserted_tuples_ = 0;
+  predicate_counts_.assign(predicate_counts_.size(), 0);
+  predicate_selectivity_sums_.assign(predicate_selectivity_sums_.size(), 0.0);
+}
+
+StorageBlockLayout* LayoutAdvisor::recommendLayout() const {
+  MutexLock lock(mutex_);
+  if (num_selections_ == 0) {
+    return StorageBlockLayout::GenerateDefaultLayout(relation_);
+  }
+
+  // Find the most frequently filtered attribute.
+  attribute_id hot_attribute = -1;
+  for (attribute_id attr = 0; attr < static_cast<attribute_id>(predicate_counts_.size()); ++attr) {
+    if ((predicate_counts_[attr] > 0)
+        && ((hot_attribute == -1) || (predicate_counts_[attr] > predicate_counts_[hot_attribute]))) {
+      hot_attribute = attr;
+    }
+  }
+  const attribute_id sort_attribute = (hot_attribute == -1) ? relation_.begin()->getID() : hot_attribute;
+
+  const bool columnar = num_projected_attributes_
+                        <= kLayoutAdvisorColumnarProjectionFraction * num_selections_ * relation_.size();
+  const bool compress = num_inserted_tuples_
+                        <= kLayoutAdvisorMaxInsertsPerQueryForCompression * num_selections_;
+  const size_t num_slots = relation_.getDefaultStorageBlockLayout().getDescription().num_slots();
+
+  // Candidate TupleStorageSubBlocks, most preferred first. Later candidates
+  // are used if earlier ones are not valid for the relation.
+  vector<TupleStorageSubBlockDescription> tuple_store_candidates;
+  if (compress) {
+    if (num_inserted_tuples_ > 0) {
+      tuple_store_candidates.push_back(MakeCompressedDescription(
+          relation_,
+          columnar,
+          sort_attribute,
+          static_cast<size_t>(kLayoutAdvisorDeltaRegionFraction * num_slots * kSlotSizeBytes)));
+    }
+    tuple_store_candidates.push_back(MakeCompressedDescription(relation_, columnar, sort_attribute, 0));
+  }
+  if (columnar) {
+    tuple_store_candidates.push_back(TupleStorageSubBlockDescription());
+    tuple_store_candidates.back().set_sub_block_type(TupleStorageSubBlockDescription::BASIC_COLUMN_STORE);
+    tuple_store_candidates.back().SetExtension(BasicColumnStoreTupleStorageSubBlockDescription::sort_attribute_id,
+                                               sort_attribute);
+  }
+  tuple_store_candidates.push_back(TupleStorageSubBlockDescription());
+  tuple_store_candidates.back().set_sub_block_type(TupleStorageSubBlockDescription::PACKED_ROW_STORE);
+  tuple_store_candidates.push_back(TupleStorageSubBlockDescription());
+  tuple_store_candidates.back().set_sub_block_type(TupleStorageSubBlockDescription::SLOTTED_PAGE_STORE);
+
+  const bool want_index = (hot_attribute != -1)
+                          && (predicate_selectivity_sums_[hot_attribute]
+                              <= kLayoutAdvisorIndexMaxSelectivity * predicate_counts_[hot_attribute]);
+
+  for (vector<TupleStorageSubBlockDescription>::const_iterator it = tuple_store_candidates.begin();
+       it != tuple_store_candidates.end();
+       ++it) {
+    StorageBlockLayoutDescription description;
+    description.set_num_slots(num_slots);
+    description.mutable_tuple_store_description()->CopyFrom(*it);
+    if (want_index && !TupleStoreIsSortedOn(*it, hot_attribute)) {
+      IndexSubBlockDescription *index_description = description.add_index_description();
+      index_description->set_sub_block_type(IndexSubBlockDescription::CSB_TREE);
+      index_description->AddExtension(CSBTreeIndexSubBlockDescription::indexed_attribute_id, hot_attribute);
+      if (!StorageBlockLayout::DescriptionIsValid(relation_, description)) {
+        // The attribute can't be indexed, but the TupleStorageSubBlock may
+        // still be usable without the index.
+        description.clear_index_description();
+      }
+    }
+
+    if (StorageBlockLayout::DescriptionIsValid(relation_, description)) {
+      StorageBlockLayout *layout = new StorageBlockLayout(relation_);
+      layout->getDescriptionMutable()->CopyFrom(description);
+      layout->finalize();
+      return layout;
+    }
+  }
+
+  return StorageBlockLayout::GenerateDefaultLayout(relation_);
+}
+
+}  // namespace quickstep
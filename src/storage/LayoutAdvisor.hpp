@@ -0,0 +1,159 @@
+/*
+   This file copyright (c) 2011-2013, the Quickstep authors.
+   See file CREDITS.txt for details.
+
+   This file is part of Quickstep.
+
+   Quickstep is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Quickstep is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Quickstep.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICKSTEP_STORAGE_LAYOUT_ADVISOR_HPP_
+#define QUICKSTEP_STORAGE_LAYOUT_ADVISOR_HPP_
+
+#include <cstddef>
+#include <vector>
+
+#include "catalog/CatalogTypedefs.hpp"
+#include "threading/Mutex.hpp"
+#include "utility/Macros.hpp"
+
+namespace quickstep {
+
+class CatalogRelation;
+class StorageBlockLayout;
+
+/** \addtogroup Storage
+ *  @{
+ */
+
+/**
+ * @brief Records the workload on a relation (which attributes queries filter
+ *        on and how selectively, how many attributes they project, and how
+ *        many tuples are inserted) and recommends a StorageBlockLayout which
+ *        suits it.
+ * @note The recommendation is a column store if queries project few of the
+ *       relation's attributes and a row store otherwise, sorted on the most
+ *       frequently filtered attribute where the store supports sorting. It
+ *       is compressed unless inserts are frequent (with a delta region if
+ *       there are any inserts at all), and has a CSBTreeIndexSubBlock on the
+ *       most frequently filtered attribute if predicates on it are highly
+ *       selective and the store is not already sorted on it. The thresholds
+ *       are in StorageConstants.hpp. If a choice is not valid for the
+ *       relation (e.g. a BasicColumnStore for a variable-length relation),
+ *       the next best valid one is used instead.
+ * @note To move a relation to the recommended layout, make it the relation's
+ *       default layout (so that new blocks use it), and rewrite existing
+ *       blocks which are no longer being modified in the background with a
+ *       BlockCompactor which rewrites blocks with other layouts.
+ * @note Queries may record their statistics concurrently from multiple
+ *       threads.
+ **/
+class LayoutAdvisor {
+ public:
+  /**
+   * @brief Constructor.
+   *
+   * @param relation The relation to record the workload on.
+   **/
+  explicit LayoutAdvisor(const CatalogRelation &relation);
+
+  /**
+   * @brief Destructor.
+   **/
+  ~LayoutAdvisor() {
+  }
+
+  /**
+   * @brief Get the relation this LayoutAdvisor records the workload on.
+   *
+   * @return The relation this LayoutAdvisor records the workload on.
+   **/
+  const CatalogRelation& getRelation() const {
+    return relation_;
+  }
+
+  /**
+   * @brief Record a selection query on the relation.
+   *
+   * @param predicate_attributes The IDs of the attributes the query's
+   *        predicate filters on (empty if it has no predicate).
+   * @param selectivity The fraction of tuples which matched the predicate.
+   * @param num_projected_attributes The number of attributes the query
+   *        projected (0 if it only evaluated the predicate).
+   **/
+  void recordSelection(const std::vector<attribute_id> &predicate_attributes,
+                       const double selectivity,
+                       const std::size_t num_projected_attributes);
+
+  /**
+   * @brief Record tuples inserted into the relation.
+   *
+   * @param num_tuples The number of tuples inserted.
+   **/
+  void recordInsertion(const std::size_t num_tuples) {
+    MutexLock lock(mutex_);
+    num_inserted_tuples_ += num_tuples;
+  }
+
+  /**
+   * @brief Get the number of selection queries recorded so far.
+   *
+   * @return The number of calls to recordSelection() since this
+   *         LayoutAdvisor was created or last cleared.
+   **/
+  std::size_t numRecordedSelections() const {
+    MutexLock lock(mutex_);
+    return num_selections_;
+  }
+
+  /**
+   * @brief Forget everything recorded so far (e.g. when the workload is known
+   *        to have changed).
+   **/
+  void clear();
+
+  /**
+   * @brief Recommend a layout for the relation based on the workload
+   *        recorded so far.
+   * @note If no selections have been recorded, the relation's default layout
+   *       policy is used (see StorageBlockLayout::GenerateDefaultLayout()).
+   *
+   * @return A new, finalized StorageBlockLayout for the relation, which the
+   *         caller takes ownership of.
+   **/
+  StorageBlockLayout* recommendLayout() const;
+
+ private:
+  const CatalogRelation &relation_;
+
+  // Protects all of the members below.
+  mutable Mutex mutex_;
+
+  std::size_t num_selections_;
+  std::size_t num_projected_attributes_;
+  std::size_t num_inserted_tuples_;
+
+  // Indexed by attribute ID: the number of recorded selections filtering on
+  // each attribute, and the sum of their selectivities.
+  std::vector<std::size_t> predicate_counts_;
+  std::vector<double> predicate_selectivity_sums_;
+
+  DISALLOW_COPY_AND_ASSIGN(LayoutAdvisor);
+};
+
+/** @} */
+
+}  // namespace quickstep
+
+#endif  // QUICKSTEP_STORAGE_LAYOUT_ADVISOR_HPP_
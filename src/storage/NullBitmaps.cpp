@@ -0,0 +1,155 @@
+/*
+   This file copyright (c) 2011-2013, the Quickstep authors.
+   See file CREDITS.txt for details.
+  
+   This file is part of Quickstep.
+
+   Quickstep is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+  
+   Quickstep is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Quickstep.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "storage/NullBitmaps.hpp"
+
+#include <cstddef>
+
+#include "catalog/CatalogAttribute.hpp"
+#include "catalog/CatalogRelation.hpp"
+#include "storage/StorageBlockInfo.hpp"
+#include "types/Type.hpp"
+#include "utility/BitVector.hpp"
+#include "utility/Macros.hpp"
+
+using std::size_t;
+
+namespace quickstep {
+
+NullBitmaps::NullBitmaps(const CatalogRelation &relation,
+                         void *bitmap_memory,
+                         const tuple_id max_tuples,
+                         const bool new_bitmaps)
+    : attribute_nullable_(relation.getMaxAttributeId() + 1, false) {
+  const size_t bitmap_bytes = BitVector::BytesNeeded(max_tuples);
+  char *bitmap_location = static_cast<char*>(bitmap_memory);
+  for (attribute_id attr = 0; attr <= relation.getMaxAttributeId(); ++attr) {
+    if (relation.hasAttributeWithId(attr)
+        && relation.getAttributeById(attr).getType().isNullable()) {
+      attribute_nullable_[attr] = true;
+      // A BitVector must have at least one bit, so a store with no room for
+      // any tuples has no bitmaps (and no bits which could be accessed).
+      if (max_tuples > 0) {
+        bitmaps_.push_back(new BitVector(bitmap_location, max_tuples));
+        if (new_bitmaps) {
+          bitmaps_.back().clear();
+        }
+        bitmap_location += bitmap_bytes;
+        continue;
+      }
+    }
+    bitmaps_.push_back(NULL);
+  }
+}
+
+size_t NullBitmaps::BytesNeeded(const CatalogRelation &relation,
+                                const tuple_id max_tuples) {
+  if (!relation.hasNullableAttributes() || (max_tuples <= 0)) {
+    return 0;
+  }
+
+  size_t num_nullable_attributes = 0;
+  for (CatalogRelation::const_iterator attr_it = relation.begin();
+       attr_it != relation.end();
+       ++attr_it) {
+    if (attr_it->getType().isNullable()) {
+      ++num_nullable_attributes;
+    }
+  }
+
+  return num_nullable_attributes * BitVector::BytesNeeded(max_tuples);
+}
+
+tuple_id NullBitmaps::MaxTuplesThatFit(const CatalogRelation &relation,
+                                       const std::size_t memory_size,
+                                       const std::size_t bytes_per_tuple,
+                                       const std::size_t num_extra_bitmaps) {
+  DEBUG_ASSERT(bytes_per_tuple > 0);
+  const size_t num_bitmaps = BytesNeeded(relation, 1) / sizeof(size_t) + num_extra_bitmaps;
+  if (num_bitmaps == 0) {
+    return memory_size / bytes_per_tuple;
+  }
+
+  // Each tuple takes bytes_per_tuple plus one bit in each bitmap, and each
+  // bitmap is rounded up to at most one extra word. This gives a lower bound,
+  // which is then increased to the exact answer.
+  const size_t rounding_bytes = num_bitmaps * sizeof(size_t);
+  tuple_id max_tuples = 0;
+  if (memory_size > rounding_bytes) {
+    max_tuples = ((memory_size - rounding_bytes) << 3)
+                 / ((bytes_per_tuple << 3) + num_bitmaps);
+  }
+  while (BytesNeeded(relation, max_tuples + 1)
+             + num_extra_bitmaps * BitVector::BytesNeeded(max_tuples + 1)
+             + (max_tuples + 1) * bytes_per_tuple
+         <= memory_size) {
+    ++max_tuples;
+  }
+
+  return max_tuples;
+}
+
+void NullBitmaps::removeTuple(const tuple_id tuple) {
+  for (PtrVector<BitVector, true>::iterator bitmap_it = bitmaps_.begin();
+       bitmap_it != bitmaps_.end();
+       ++bitmap_it) {
+    if (!bitmap_it.isNull()) {
+      bitmap_it->shiftTailForward(tuple);
+    }
+  }
+}
+
+void NullBitmaps::insertTuple(const tuple_id tuple) {
+  for (PtrVector<BitVector, true>::iterator bitmap_it = bitmaps_.begin();
+       bitmap_it != bitmaps_.end();
+       ++bitmap_it) {
+    if (!bitmap_it.isNull()) {
+      bitmap_it->shiftTailBackward(tuple);
+    }
+  }
+}
+
+void NullBitmaps::moveTuples(const tuple_id dest_position,
+                             const tuple_id src_position,
+                             const tuple_id num_tuples) {
+  if (dest_position == src_position) {
+    return;
+  }
+
+  for (PtrVector<BitVector, true>::iterator bitmap_it = bitmaps_.begin();
+       bitmap_it != bitmaps_.end();
+       ++bitmap_it) {
+    if (bitmap_it.isNull()) {
+      continue;
+    }
+    // Copy in the direction which never overwrites a bit before reading it.
+    if (dest_position < src_position) {
+      for (tuple_id offset = 0; offset < num_tuples; ++offset) {
+        bitmap_it->setBit(dest_position + offset, bitmap_it->getBit(src_position + offset));
+      }
+    } else {
+      for (tuple_id offset = num_tuples - 1; offset >= 0; --offset) {
+        bitmap_it->setBit(dest_position + offset, bitmap_it->getBit(src_position + offset));
+      }
+    }
+  }
+}
+
+}  // namespace quickstep
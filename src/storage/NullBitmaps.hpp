@@ -0,0 +1,191 @@
+/*
+   This file copyright (c) 2011-2013, the Quickstep authors.
+   See file CREDITS.txt for details.
+  
+   This file is part of Quickstep.
+
+   Quickstep is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+  
+   Quickstep is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Quickstep.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICKSTEP_STORAGE_NULL_BITMAPS_HPP_
+#define QUICKSTEP_STORAGE_NULL_BITMAPS_HPP_
+
+#include <cstddef>
+#include <vector>
+
+#include "catalog/CatalogTypedefs.hpp"
+#include "storage/StorageBlockInfo.hpp"
+#include "utility/BitVector.hpp"
+#include "utility/Macros.hpp"
+#include "utility/PtrVector.hpp"
+
+namespace quickstep {
+
+class CatalogRelation;
+
+/** \addtogroup Storage
+ *  @{
+ */
+
+/**
+ * @brief A set of per-attribute NULL bitmaps, one for each nullable attribute
+ *        of a relation, stored contiguously in a TupleStorageSubBlock's
+ *        memory. Bit N of an attribute's bitmap is set if the attribute's
+ *        value in the tuple at position N is NULL.
+ * @note Each bitmap occupies a whole number of size_t words, so that scans
+ *       can combine a word of NULL bits with the results of comparing the
+ *       corresponding values (see
+ *       TupleStorageSubBlock::GetMatchesForComparisonOnStridedValues()).
+ **/
+class NullBitmaps {
+ public:
+  /**
+   * @brief Constructor.
+   *
+   * @param relation The relation whose nullable attributes have bitmaps.
+   * @param bitmap_memory The memory to store the bitmaps in, which must be at
+   *        least BytesNeeded(relation, max_tuples) bytes.
+   * @param max_tuples The number of tuples each bitmap has bits for.
+   * @param new_bitmaps If true, all bitmaps are cleared. If false, existing
+   *        bitmaps are reconstituted from bitmap_memory.
+   **/
+  NullBitmaps(const CatalogRelation &relation,
+              void *bitmap_memory,
+              const tuple_id max_tuples,
+              const bool new_bitmaps);
+
+  /**
+   * @brief Determine the number of bytes needed to store NULL bitmaps for
+   *        all of a relation's nullable attributes.
+   *
+   * @param relation The relation whose nullable attributes have bitmaps.
+   * @param max_tuples The number of tuples each bitmap has bits for.
+   * @return The total size of the bitmaps in bytes (zero if relation has no
+   *         nullable attributes).
+   **/
+  static std::size_t BytesNeeded(const CatalogRelation &relation,
+                                 const tuple_id max_tuples);
+
+  /**
+   * @brief Determine the maximum number of tuples which fit in a region of
+   *        memory along with their NULL bitmaps.
+   *
+   * @param relation The relation whose nullable attributes have bitmaps.
+   * @param memory_size The size of the memory in bytes.
+   * @param bytes_per_tuple The number of bytes used to store each tuple,
+   *        excluding its NULL bits.
+   * @param num_extra_bitmaps The number of additional one-bit-per-tuple
+   *        BitVectors (e.g. a delete bitmap) which must also fit in
+   *        memory_size.
+   * @return The largest number of tuples, N, such that BytesNeeded(relation,
+   *         N) + N * bytes_per_tuple (plus num_extra_bitmaps BitVectors of N
+   *         bits) is no more than memory_size.
+   **/
+  static tuple_id MaxTuplesThatFit(const CatalogRelation &relation,
+                                   const std::size_t memory_size,
+                                   const std::size_t bytes_per_tuple,
+                                   const std::size_t num_extra_bitmaps = 0);
+
+  /**
+   * @brief Check whether an attribute has a NULL bitmap (i.e. whether it is
+   *        nullable).
+   *
+   * @param attr The ID of an attribute.
+   * @return Whether attr is nullable.
+   **/
+  inline bool hasNullBitmap(const attribute_id attr) const {
+    DEBUG_ASSERT(static_cast<std::size_t>(attr) < attribute_nullable_.size());
+    return attribute_nullable_[attr];
+  }
+
+  /**
+   * @brief Check whether an attribute's value in a tuple is NULL.
+   *
+   * @param tuple The position of a tuple.
+   * @param attr The ID of an attribute.
+   * @return Whether the value of attr in tuple is NULL (always false for
+   *         non-nullable attributes).
+   **/
+  inline bool isNull(const tuple_id tuple, const attribute_id attr) const {
+    DEBUG_ASSERT(static_cast<std::size_t>(attr) < attribute_nullable_.size());
+    return attribute_nullable_[attr] && bitmaps_[attr].getBit(tuple);
+  }
+
+  /**
+   * @brief Set whether a nullable attribute's value in a tuple is NULL.
+   *
+   * @param tuple The position of a tuple.
+   * @param attr The ID of a nullable attribute.
+   * @param is_null Whether the value of attr in tuple is NULL.
+   **/
+  inline void setNull(const tuple_id tuple, const attribute_id attr, const bool is_null) {
+    DEBUG_ASSERT(hasNullBitmap(attr));
+    bitmaps_[attr].setBit(tuple, is_null);
+  }
+
+  /**
+   * @brief Get the words of a nullable attribute's bitmap.
+   *
+   * @param attr The ID of a nullable attribute.
+   * @return The words of attr's NULL bitmap.
+   **/
+  inline const std::size_t* getNullWords(const attribute_id attr) const {
+    DEBUG_ASSERT(hasNullBitmap(attr));
+    return bitmaps_[attr].getWords();
+  }
+
+  /**
+   * @brief Remove the bits for a tuple from every bitmap, moving the bits for
+   *        all subsequent tuples forward by one position.
+   *
+   * @param tuple The position of the tuple to remove.
+   **/
+  void removeTuple(const tuple_id tuple);
+
+  /**
+   * @brief Make room for a new tuple in every bitmap, moving the bits for the
+   *        tuple at the specified position and all subsequent tuples back by
+   *        one position. The new tuple is marked as not NULL.
+   *
+   * @param tuple The position of the new tuple.
+   **/
+  void insertTuple(const tuple_id tuple);
+
+  /**
+   * @brief Copy the NULL bits of a range of tuples to another position, as
+   *        when a TupleStorageSubBlock moves tuples around. The source and
+   *        destination ranges may overlap.
+   *
+   * @param dest_position The new position of the first tuple in the range.
+   * @param src_position The current position of the first tuple in the
+   *        range.
+   * @param num_tuples The number of tuples in the range.
+   **/
+  void moveTuples(const tuple_id dest_position,
+                  const tuple_id src_position,
+                  const tuple_id num_tuples);
+
+ private:
+  std::vector<bool> attribute_nullable_;
+  // Indexed by attribute ID. NULL for attributes which are not nullable.
+  PtrVector<BitVector, true> bitmaps_;
+
+  DISALLOW_COPY_AND_ASSIGN(NullBitmaps);
+};
+
+/** @} */
+
+}  // namespace quickstep
+
+#endif  // QUICKSTEP_STORAGE_NULL_BITMAPS_HPP_
@@ -20,25 +20,33 @@
 
 #include "storage/PackedRowStoreTupleStorageSubBlock.hpp"
 
+#include <algorithm>
 #include <cstddef>
 #include <cstring>
 #include <vector>
 
 #include "catalog/CatalogAttribute.hpp"
 #include "catalog/CatalogRelation.hpp"
+#include "expressions/ComparisonPredicate.hpp"
+#include "expressions/Predicate.hpp"
+#include "storage/NullBitmaps.hpp"
 #include "storage/StorageBlock.hpp"
 #include "storage/StorageBlockInfo.hpp"
 #include "storage/StorageBlockLayout.pb.h"
 #include "storage/StorageErrors.hpp"
+#include "storage/TupleBatch.hpp"
 #include "storage/TupleIdSequence.hpp"
 #include "types/Tuple.hpp"
 #include "types/Type.hpp"
 #include "types/TypeInstance.hpp"
+#include "utility/BitVector.hpp"
 #include "utility/Macros.hpp"
 #include "utility/ScopedPtr.hpp"
 
 using std::vector;
 using std::memcpy;
+using std::memmove;
+using std::min;
 using std::size_t;
 
 namespace quickstep {
@@ -62,8 +70,28 @@ PackedRowStoreTupleStorageSubBlock::PackedRowStoreTupleStorageSubBlock(
     throw BlockMemoryTooSmall("PackedRowStoreTupleStorageSubBlock", sub_block_memory_size);
   }
 
+  // The delete bitmap and NULL bitmaps (if any) are stored between the header
+  // and the tuples.
+  max_tuples_ = NullBitmaps::MaxTuplesThatFit(relation_,
+                                              sub_block_memory_size_ - sizeof(PackedRowStoreHeader),
+                                              relation_.getFixedByteLength(),
+                                              1);
+  tuple_storage_ = static_cast<char*>(sub_block_memory_) + sizeof(PackedRowStoreHeader);
+  if (max_tuples_ > 0) {
+    deleted_tuples_.reset(new BitVector(tuple_storage_, max_tuples_));
+    if (new_block) {
+      deleted_tuples_->clear();
+    }
+    tuple_storage_ += BitVector::BytesNeeded(max_tuples_);
+  }
+  if (relation_.hasNullableAttributes()) {
+    null_bitmaps_.reset(new NullBitmaps(relation_, tuple_storage_, max_tuples_, new_block));
+    tuple_storage_ += NullBitmaps::BytesNeeded(relation_, max_tuples_);
+  }
+
   if (new_block) {
     getHeaderPtr()->num_tuples = 0;
+    getHeaderPtr()->num_deleted_tuples = 0;
   }
 }
 
@@ -78,13 +106,10 @@ bool PackedRowStoreTupleStorageSubBlock::DescriptionIsValid(
     return false;
   }
 
-  // Make sure relation is not variable-length and contains no nullable attributes.
+  // Make sure relation is not variable-length.
   if (relation.isVariableLength()) {
     return false;
   }
-  if (relation.hasNullableAttributes()) {
-    return false;
-  }
 
   return true;
 }
@@ -103,13 +128,19 @@ TupleStorageSubBlock::InsertResult PackedRowStoreTupleStorageSubBlock::insertTup
 #ifdef QUICKSTEP_DEBUG
   paranoidInsertTypeCheck(tuple, atc);
 #endif
+  bool ids_mutated = false;
   if (!hasSpaceToInsert(1)) {
-    return InsertResult(-1, false);
+    if (isPacked()) {
+      return InsertResult(-1, false);
+    }
+    // Reclaim the space used by deleted tuples.
+    compact();
+    ids_mutated = true;
   }
 
-  char *base_addr = static_cast<char*>(sub_block_memory_)                           // Start of the SubBlock.
-                    + sizeof(PackedRowStoreHeader)                                  // Space taken by the header.
-                    + getHeaderPtr()->num_tuples * relation_.getFixedByteLength();  // Existing tuples.
+  const tuple_id new_tuple = getHeaderPtr()->num_tuples;
+  char *base_addr = tuple_storage_                                   // Start of tuple storage.
+                    + new_tuple * relation_.getFixedByteLength();  // Existing tuples.
 
   Tuple::const_iterator value_it = tuple.begin();
   CatalogRelation::const_iterator attr_it = relation_.begin();
@@ -117,7 +148,9 @@ TupleStorageSubBlock::InsertResult PackedRowStoreTupleStorageSubBlock::insertTup
   switch (atc) {
     case kNone:
       while (value_it != tuple.end()) {
-        value_it->copyInto(base_addr);
+        if (!value_it->isNull()) {
+          value_it->copyInto(base_addr);
+        }
         base_addr += attr_it->getType().maximumByteLength();
 
         ++value_it;
@@ -127,7 +160,9 @@ TupleStorageSubBlock::InsertResult PackedRowStoreTupleStorageSubBlock::insertTup
     case kSafe:
     case kUnsafe:
       while (value_it != tuple.end()) {
-        if (value_it->getType().equals(attr_it->getType())) {
+        if (value_it->isNull()) {
+          // Nothing to copy, the NULL bitmap is set below.
+        } else if (value_it->getType().equals(attr_it->getType())) {
           value_it->copyInto(base_addr);
         } else {
           ScopedPtr<TypeInstance> converted_temp(value_it->makeCoercedCopy(attr_it->getType()));
@@ -142,17 +177,85 @@ TupleStorageSubBlock::InsertResult PackedRowStoreTupleStorageSubBlock::insertTup
       break;
   }
 
+  if (null_bitmaps_.get() != NULL) {
+    value_it = tuple.begin();
+    for (attr_it = relation_.begin(); attr_it != relation_.end(); ++attr_it, ++value_it) {
+      if (null_bitmaps_->hasNullBitmap(attr_it->getID())) {
+        null_bitmaps_->setNull(new_tuple, attr_it->getID(), value_it->isNull());
+      }
+    }
+  }
+
   ++(getHeaderPtr()->num_tuples);
 
-  return InsertResult(getHeaderPtr()->num_tuples - 1, false);
+  return InsertResult(getHeaderPtr()->num_tuples - 1, ids_mutated);
+}
+
+tuple_id PackedRowStoreTupleStorageSubBlock::bulkInsertTuples(const TupleBatch &batch,
+                                                              const tuple_id first_tuple) {
+  DEBUG_ASSERT(&batch.getRelation() == &relation_);
+  if (!isPacked() && !hasSpaceToInsert(batch.size() - first_tuple)) {
+    // Reclaim the space used by deleted tuples, so that as much of the batch
+    // as possible fits.
+    compact();
+  }
+
+  const tuple_id num_tuples = min(batch.size() - first_tuple,
+                                  max_tuples_ - getHeaderPtr()->num_tuples);
+  if (num_tuples <= 0) {
+    return 0;
+  }
+
+  const tuple_id first_new_tuple = getHeaderPtr()->num_tuples;
+  const size_t tuple_length = relation_.getFixedByteLength();
+  char *base_addr = tuple_storage_                      // Start of tuple storage.
+                    + first_new_tuple * tuple_length;  // Existing tuples.
+
+  if (batch.isColumnMajor()) {
+    for (CatalogRelation::const_iterator attr_it = relation_.begin();
+         attr_it != relation_.end();
+         ++attr_it) {
+      const size_t attr_length = attr_it->getType().maximumByteLength();
+      const char *value_ptr = batch.getColumnValues(attr_it->getID()) + first_tuple * attr_length;
+      char *dest_ptr = base_addr + relation_.getFixedLengthAttributeOffset(attr_it->getID());
+      for (tuple_id tuple_num = 0; tuple_num < num_tuples; ++tuple_num) {
+        memcpy(dest_ptr, value_ptr, attr_length);
+        value_ptr += attr_length;
+        dest_ptr += tuple_length;
+      }
+    }
+  } else {
+    // The batch's rows are already in the same format as this block's.
+    memcpy(base_addr, batch.getRows() + first_tuple * tuple_length, num_tuples * tuple_length);
+  }
+
+  if (null_bitmaps_.get() != NULL) {
+    for (CatalogRelation::const_iterator attr_it = relation_.begin();
+         attr_it != relation_.end();
+         ++attr_it) {
+      if (!null_bitmaps_->hasNullBitmap(attr_it->getID())) {
+        continue;
+      }
+      for (tuple_id tuple_num = 0; tuple_num < num_tuples; ++tuple_num) {
+        null_bitmaps_->setNull(first_new_tuple + tuple_num,
+                               attr_it->getID(),
+                               batch.isNull(first_tuple + tuple_num, attr_it->getID()));
+      }
+    }
+  }
+
+  getHeaderPtr()->num_tuples += num_tuples;
+  return num_tuples;
 }
 
 const void* PackedRowStoreTupleStorageSubBlock::getAttributeValue(const tuple_id tuple,
                                                                   const attribute_id attr) const {
   DEBUG_ASSERT(hasTupleWithID(tuple));
   DEBUG_ASSERT(relation_.hasAttributeWithId(attr));
-  return static_cast<char*>(sub_block_memory_)             // SubBlock start.
-         + sizeof(PackedRowStoreHeader)                    // Space taken by header.
+  if ((null_bitmaps_.get() != NULL) && null_bitmaps_->isNull(tuple, attr)) {
+    return NULL;
+  }
+  return tuple_storage_                                    // Start of tuple storage.
          + (tuple * relation_.getFixedByteLength())        // Tuples prior to 'tuple'.
          + relation_.getFixedLengthAttributeOffset(attr);  // Attribute offset within tuple.
 }
@@ -162,29 +265,78 @@ TypeInstance* PackedRowStoreTupleStorageSubBlock::getAttributeValueTyped(const t
   return relation_.getAttributeById(attr).getType().makeReferenceTypeInstance(getAttributeValue(tuple, attr));
 }
 
+bool PackedRowStoreTupleStorageSubBlock::canSetAttributeValuesInPlaceTyped(
+    const tuple_id tuple,
+    const PtrMap<attribute_id, LiteralTypeInstance> &new_values) const {
+  DEBUG_ASSERT(hasTupleWithID(tuple));
+  // Every attribute has a fixed length, so any value fits in place, provided
+  // that a NULL value has a NULL bitmap to be recorded in.
+  for (PtrMap<attribute_id, LiteralTypeInstance>::const_iterator value_it = new_values.begin();
+       value_it != new_values.end();
+       ++value_it) {
+    if (value_it->second->isNull()
+        && ((null_bitmaps_.get() == NULL) || !null_bitmaps_->hasNullBitmap(value_it->first))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void PackedRowStoreTupleStorageSubBlock::setAttributeValueInPlaceTyped(const tuple_id tuple,
+                                                                       const attribute_id attr,
+                                                                       const TypeInstance &value) {
+  DEBUG_ASSERT(hasTupleWithID(tuple));
+  DEBUG_ASSERT(relation_.hasAttributeWithId(attr));
+  if (!value.isNull()) {
+    value.copyInto(tuple_storage_                                     // Start of tuple storage.
+                   + (tuple * relation_.getFixedByteLength())         // Tuples prior to 'tuple'.
+                   + relation_.getFixedLengthAttributeOffset(attr));  // Attribute offset within tuple.
+  }
+  if ((null_bitmaps_.get() != NULL) && null_bitmaps_->hasNullBitmap(attr)) {
+    null_bitmaps_->setNull(tuple, attr, value.isNull());
+  }
+}
+
 bool PackedRowStoreTupleStorageSubBlock::deleteTuple(const tuple_id tuple) {
   DEBUG_ASSERT(hasTupleWithID(tuple));
 
   PackedRowStoreHeader *header = getHeaderPtr();
 
   if (tuple == header->num_tuples - 1) {
-    // If deleting the last tuple, simply truncate.
+    // If deleting the last tuple, simply truncate, along with any deleted
+    // tuples which would otherwise be left at the end.
     --(header->num_tuples);
-    return false;
+    while ((header->num_tuples > 0) && deleted_tuples_->getBit(header->num_tuples - 1)) {
+      deleted_tuples_->setBit(header->num_tuples - 1, false);
+      --(header->num_tuples);
+      --(header->num_deleted_tuples);
+    }
   } else {
-    const size_t tuple_length = relation_.getFixedByteLength();
-
-    char *dest_addr = static_cast<char*>(sub_block_memory_)  // SubBlock start.
-                      + sizeof(PackedRowStoreHeader)         // Space taken by header.
-                      + (tuple * tuple_length);              // Prior tuples.
-    char *src_addr = dest_addr + tuple_length;  // Start of subsequent tuples.
-    const size_t copy_bytes = (header->num_tuples - tuple - 1) * tuple_length;  // Bytes in subsequent tuples.
-    memmove(dest_addr, src_addr, copy_bytes);
+    // Leave a tombstone in place. The tuple's space is reclaimed by compact().
+    deleted_tuples_->setBit(tuple, true);
+    ++(header->num_deleted_tuples);
+  }
 
-    --(header->num_tuples);
+  return false;
+}
 
-    return true;
+TupleIdSequence* PackedRowStoreTupleStorageSubBlock::getMatchesForPredicate(const Predicate *predicate) const {
+  if ((predicate == NULL) || !predicate->isAttributeLiteralComparisonPredicate()) {
+    return TupleStorageSubBlock::getMatchesForPredicate(predicate);
   }
+
+  // Stride through the attribute's values in every tuple.
+  const ComparisonPredicate &comparison_predicate = *static_cast<const ComparisonPredicate*>(predicate);
+  const attribute_id comparison_attribute_id = GetComparisonAttributeID(comparison_predicate);
+  return GetMatchesForComparisonOnStridedValues(
+      comparison_predicate,
+      tuple_storage_ + relation_.getFixedLengthAttributeOffset(comparison_attribute_id),
+      relation_.getFixedByteLength(),
+      getHeaderPtr()->num_tuples,
+      ((null_bitmaps_.get() != NULL) && null_bitmaps_->hasNullBitmap(comparison_attribute_id))
+          ? null_bitmaps_->getNullWords(comparison_attribute_id)
+          : NULL,
+      isPacked() ? NULL : deleted_tuples_->getWords());
 }
 
 PackedRowStoreTupleStorageSubBlock::PackedRowStoreHeader* PackedRowStoreTupleStorageSubBlock::getHeaderPtr() {
@@ -197,12 +349,45 @@ const PackedRowStoreTupleStorageSubBlock::PackedRowStoreHeader*
 }
 
 bool PackedRowStoreTupleStorageSubBlock::hasSpaceToInsert(const tuple_id num_tuples) const {
-  if (sizeof(PackedRowStoreHeader) + (getHeaderPtr()->num_tuples + num_tuples) * relation_.getFixedByteLength()
-      <= sub_block_memory_size_) {
-    return true;
-  } else {
-    return false;
+  return (getHeaderPtr()->num_tuples + num_tuples <= max_tuples_);
+}
+
+void PackedRowStoreTupleStorageSubBlock::compact() {
+  PackedRowStoreHeader *header = getHeaderPtr();
+  if (header->num_deleted_tuples == 0) {
+    return;
   }
+
+  // Tuples before the first deleted one stay where they are. After that,
+  // each run of remaining tuples is moved forward with a single memmove.
+  const size_t tuple_length = relation_.getFixedByteLength();
+  tuple_id dest_position = deleted_tuples_->firstOne();
+  tuple_id run_start = dest_position;
+  while (run_start < header->num_tuples) {
+    // The last tuple is never deleted, so every run of deleted tuples is
+    // followed by at least one remaining tuple.
+    run_start = deleted_tuples_->firstZero(run_start);
+    DEBUG_ASSERT(run_start < header->num_tuples);
+    tuple_id run_end = deleted_tuples_->firstOne(run_start);
+    if (run_end > header->num_tuples) {
+      run_end = header->num_tuples;
+    }
+
+    memmove(tuple_storage_ + dest_position * tuple_length,
+            tuple_storage_ + run_start * tuple_length,
+            (run_end - run_start) * tuple_length);
+    if (null_bitmaps_.get() != NULL) {
+      null_bitmaps_->moveTuples(dest_position, run_start, run_end - run_start);
+    }
+
+    dest_position += run_end - run_start;
+    run_start = run_end;
+  }
+
+  DEBUG_ASSERT(dest_position == header->num_tuples - header->num_deleted_tuples);
+  header->num_tuples = dest_position;
+  header->num_deleted_tuples = 0;
+  deleted_tuples_->clear();
 }
 
 }  // namespace quickstep
@@ -21,13 +21,19 @@
 #ifndef QUICKSTEP_STORAGE_PACKED_ROW_STORE_TUPLE_STORAGE_SUB_BLOCK_HPP_
 #define QUICKSTEP_STORAGE_PACKED_ROW_STORE_TUPLE_STORAGE_SUB_BLOCK_HPP_
 
+#include <cstddef>
 #include <vector>
 
+#include "storage/NullBitmaps.hpp"
 #include "storage/TupleStorageSubBlock.hpp"
+#include "utility/BitVector.hpp"
 #include "utility/Macros.hpp"
+#include "utility/PtrMap.hpp"
+#include "utility/ScopedPtr.hpp"
 
 namespace quickstep {
 
+class Predicate;
 class TupleStorageSubBlockDescription;
 
 /** \addtogroup Storage
@@ -37,10 +43,17 @@ class TupleStorageSubBlockDescription;
 /**
  * @brief An implementation of TupleStorageSubBlock as a packed row-store (i.e.
  *        an array of fixed-length values with no holes).
- * @warning This implementation does NOT support variable-length or nullable
- *          attributes. It is an error to attempt to construct a
+ * @note Nullable attributes are supported with a NULL bitmap for each
+ *       nullable attribute, stored between the header and the tuples.
+ * @note Deleting a tuple other than the last one only sets its bit in a
+ *       delete bitmap, so that deletion is O(1) and does not mutate tuple
+ *       IDs. The block is not packed while any deleted tuples remain, and
+ *       their space is reclaimed by compacting the remaining tuples in
+ *       rebuild() (or when an insert would not otherwise fit).
+ * @warning This implementation does NOT support variable-length attributes.
+ *          It is an error to attempt to construct a
  *          PackedRowStoreTupleStorageSubBlock for a relation with any
- *          variable-length or nullable attributes.
+ *          variable-length attributes.
  **/
 class PackedRowStoreTupleStorageSubBlock: public TupleStorageSubBlock {
  public:
@@ -108,15 +121,21 @@ class PackedRowStoreTupleStorageSubBlock: public TupleStorageSubBlock {
   }
 
   bool isPacked() const {
-    return true;
+    return (getHeaderPtr()->num_deleted_tuples == 0);
   }
 
   tuple_id getMaxTupleID() const {
     return getHeaderPtr()->num_tuples - 1;
   }
 
+  tuple_id numTuples() const {
+    return getHeaderPtr()->num_tuples - getHeaderPtr()->num_deleted_tuples;
+  }
+
   bool hasTupleWithID(const tuple_id tuple) const {
-    return ((tuple >=0) && (tuple < getHeaderPtr()->num_tuples));
+    return ((tuple >=0)
+            && (tuple < getHeaderPtr()->num_tuples)
+            && !deleted_tuples_->getBit(tuple));
   }
 
   InsertResult insertTuple(const Tuple &tuple, const AllowedTypeConversion atc);
@@ -126,17 +145,44 @@ class PackedRowStoreTupleStorageSubBlock: public TupleStorageSubBlock {
     return (result.inserted_id >= 0);
   }
 
+  // Copies rows from a row-major batch with a single memcpy().
+  tuple_id bulkInsertTuples(const TupleBatch &batch, const tuple_id first_tuple);
+
+  bool batchInsertMutatesTupleIDs() const {
+    // Inserting may compact away deleted tuples to make room.
+    return !isPacked();
+  }
+
+  bool nextInsertAppends() const {
+    return hasSpaceToInsert(1) || isPacked();
+  }
+
+  tuple_id estimateTupleCapacity() const {
+    return max_tuples_;
+  }
+
   const void* getAttributeValue(const tuple_id tuple, const attribute_id attr) const;
   TypeInstance* getAttributeValueTyped(const tuple_id tuple, const attribute_id attr) const;
 
+  bool canSetAttributeValuesInPlaceTyped(const tuple_id tuple,
+                                         const PtrMap<attribute_id, LiteralTypeInstance> &new_values) const;
+  void setAttributeValueInPlaceTyped(const tuple_id tuple, const attribute_id attr, const TypeInstance &value);
+
   bool deleteTuple(const tuple_id tuple);
 
+  TupleIdSequence* getMatchesForPredicate(const Predicate *predicate) const;
+
   void rebuild() {
+    if (!isPacked()) {
+      compact();
+    }
   }
 
  private:
   struct PackedRowStoreHeader {
+    // Includes deleted tuples which have not yet been compacted away.
     tuple_id num_tuples;
+    tuple_id num_deleted_tuples;
   };
 
   PackedRowStoreHeader* getHeaderPtr();
@@ -144,6 +190,17 @@ class PackedRowStoreTupleStorageSubBlock: public TupleStorageSubBlock {
 
   bool hasSpaceToInsert(const tuple_id num_tuples) const;
 
+  // Move all tuples which have not been deleted forward to fill the space
+  // left by deleted tuples, and clear the delete bitmap.
+  void compact();
+
+  tuple_id max_tuples_;
+  // Bit N is set if the tuple at position N has been deleted.
+  ScopedPtr<BitVector> deleted_tuples_;
+  // NULL if the relation has no nullable attributes.
+  ScopedPtr<NullBitmaps> null_bitmaps_;
+  char *tuple_storage_;
+
   DISALLOW_COPY_AND_ASSIGN(PackedRowStoreTupleStorageSubBlock);
 };
 
@@ -0,0 +1,311 @@
+/*
+   This file copyright (c) 2011-2013, the Quickstep authors.
+   See file CREDITS.txt for details.
+  
+   This file is part of Quickstep.
+
+   Quickstep is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+  
+   Quickstep is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Quickstep.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "storage/PaxTupleStorageSubBlock.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "catalog/CatalogAttribute.hpp"
+#include "catalog/CatalogRelation.hpp"
+#include "expressions/ComparisonPredicate.hpp"
+#include "expressions/Predicate.hpp"
+#include "storage/StorageBlockInfo.hpp"
+#include "storage/StorageBlockLayout.pb.h"
+#include "storage/StorageConstants.hpp"
+#include "storage/StorageErrors.hpp"
+#include "storage/TupleIdSequence.hpp"
+#include "types/Tuple.hpp"
+#include "types/Type.hpp"
+#include "types/TypeInstance.hpp"
+#include "utility/Macros.hpp"
+#include "utility/ScopedPtr.hpp"
+
+using std::memcpy;
+using std::memmove;
+using std::size_t;
+using std::vector;
+
+namespace quickstep {
+
+PaxTupleStorageSubBlock::PaxTupleStorageSubBlock(
+    const CatalogRelation &relation,
+    const TupleStorageSubBlockDescription &description,
+    const bool new_block,
+    void *sub_block_memory,
+    const std::size_t sub_block_memory_size)
+    : TupleStorageSubBlock(relation,
+                           description,
+                           new_block,
+                           sub_block_memory,
+                           sub_block_memory_size) {
+  if (!DescriptionIsValid(relation_, description_)) {
+    FATAL_ERROR("Attempted to construct a PaxTupleStorageSubBlock from an invalid description.");
+  }
+
+  if (sub_block_memory_size < sizeof(PaxHeader)) {
+    throw BlockMemoryTooSmall("PaxTupleStorageSubBlock", sub_block_memory_size);
+  }
+
+  // Determine how many tuples fit in each mini-page. A mini-page always holds
+  // at least one tuple, and is shrunk if the whole sub-block is smaller than a
+  // single mini-page.
+  const size_t tuple_length = relation_.getFixedByteLength();
+  const size_t minipage_size = description_.HasExtension(PaxTupleStorageSubBlockDescription::minipage_size_bytes)
+                               ? description_.GetExtension(PaxTupleStorageSubBlockDescription::minipage_size_bytes)
+                               : kPaxMinipageSizeBytes;
+  tuples_per_minipage_ = minipage_size / tuple_length;
+  if (tuples_per_minipage_ == 0) {
+    tuples_per_minipage_ = 1;
+  }
+  const size_t available_tuple_slots = (sub_block_memory_size_ - sizeof(PaxHeader)) / tuple_length;
+  if (available_tuple_slots == 0) {
+    throw BlockMemoryTooSmall("PaxTupleStorageSubBlock", sub_block_memory_size_);
+  }
+  if (available_tuple_slots < static_cast<size_t>(tuples_per_minipage_)) {
+    tuples_per_minipage_ = available_tuple_slots;
+  }
+  minipage_stride_ = tuples_per_minipage_ * tuple_length;
+  max_tuples_ = ((sub_block_memory_size_ - sizeof(PaxHeader)) / minipage_stride_) * tuples_per_minipage_;
+
+  // Determine minipartition locations within a mini-page.
+  minipartition_offsets_.resize(relation_.getMaxAttributeId() + 1, 0);
+  attribute_lengths_.resize(relation_.getMaxAttributeId() + 1, 0);
+  for (CatalogRelation::const_iterator attr_it = relation_.begin();
+       attr_it != relation_.end();
+       ++attr_it) {
+    minipartition_offsets_[attr_it->getID()]
+        = tuples_per_minipage_ * relation_.getFixedLengthAttributeOffset(attr_it->getID());
+    attribute_lengths_[attr_it->getID()] = attr_it->getType().maximumByteLength();
+  }
+
+  if (new_block) {
+    getHeaderPtr()->num_tuples = 0;
+  }
+}
+
+bool PaxTupleStorageSubBlock::DescriptionIsValid(
+    const CatalogRelation &relation,
+    const TupleStorageSubBlockDescription &description) {
+  // Make sure description is initialized and specifies PaxStore.
+  if (!description.IsInitialized()) {
+    return false;
+  }
+  if (description.sub_block_type() != TupleStorageSubBlockDescription::PAX_STORE) {
+    return false;
+  }
+
+  // Make sure the mini-page size, if specified, is nonzero.
+  if (description.HasExtension(PaxTupleStorageSubBlockDescription::minipage_size_bytes)
+      && (description.GetExtension(PaxTupleStorageSubBlockDescription::minipage_size_bytes) == 0)) {
+    return false;
+  }
+
+  // Make sure relation is not variable-length and contains no nullable attributes.
+  if (relation.isVariableLength()) {
+    return false;
+  }
+  if (relation.hasNullableAttributes()) {
+    return false;
+  }
+
+  return true;
+}
+
+std::size_t PaxTupleStorageSubBlock::EstimateBytesPerTuple(
+    const CatalogRelation &relation,
+    const TupleStorageSubBlockDescription &description) {
+  DEBUG_ASSERT(DescriptionIsValid(relation, description));
+
+  return relation.getFixedByteLength();
+}
+
+TupleStorageSubBlock::InsertResult PaxTupleStorageSubBlock::insertTuple(
+    const Tuple &tuple,
+    const AllowedTypeConversion atc) {
+#ifdef QUICKSTEP_DEBUG
+  paranoidInsertTypeCheck(tuple, atc);
+#endif
+  const tuple_id position = getHeaderPtr()->num_tuples;
+  if (position == max_tuples_) {
+    return InsertResult(-1, false);
+  }
+
+  const tuple_id minipage_first_tuple = position - position % tuples_per_minipage_;
+  const tuple_id minipage_slot = position - minipage_first_tuple;
+
+  Tuple::const_iterator value_it = tuple.begin();
+  CatalogRelation::const_iterator attr_it = relation_.begin();
+
+  switch (atc) {
+    case kNone:
+      while (value_it != tuple.end()) {
+        value_it->copyInto(getMinipartition(minipage_first_tuple, attr_it->getID())
+                           + minipage_slot * attribute_lengths_[attr_it->getID()]);
+
+        ++value_it;
+        ++attr_it;
+      }
+      break;
+    case kSafe:
+    case kUnsafe:
+      while (value_it != tuple.end()) {
+        char *value_location = getMinipartition(minipage_first_tuple, attr_it->getID())
+                               + minipage_slot * attribute_lengths_[attr_it->getID()];
+        if (value_it->getType().equals(attr_it->getType())) {
+          value_it->copyInto(value_location);
+        } else {
+          ScopedPtr<TypeInstance> converted_temp(value_it->makeCoercedCopy(attr_it->getType()));
+          converted_temp->copyInto(value_location);
+        }
+
+        ++value_it;
+        ++attr_it;
+      }
+      break;
+  }
+
+  ++(getHeaderPtr()->num_tuples);
+
+  return InsertResult(position, false);
+}
+
+const void* PaxTupleStorageSubBlock::getAttributeValue(const tuple_id tuple,
+                                                       const attribute_id attr) const {
+  DEBUG_ASSERT(hasTupleWithID(tuple));
+  DEBUG_ASSERT(relation_.hasAttributeWithId(attr));
+  const tuple_id minipage_slot = tuple % tuples_per_minipage_;
+  return getMinipartition(tuple - minipage_slot, attr)  // Minipartition for 'attr' in the tuple's mini-page.
+         + minipage_slot * attribute_lengths_[attr];    // Values of prior tuples in the mini-page.
+}
+
+TypeInstance* PaxTupleStorageSubBlock::getAttributeValueTyped(const tuple_id tuple,
+                                                              const attribute_id attr) const {
+  return relation_.getAttributeById(attr).getType().makeReferenceTypeInstance(getAttributeValue(tuple, attr));
+}
+
+bool PaxTupleStorageSubBlock::canSetAttributeValuesInPlaceTyped(
+    const tuple_id tuple,
+    const PtrMap<attribute_id, LiteralTypeInstance> &new_values) const {
+  DEBUG_ASSERT(hasTupleWithID(tuple));
+  // All attributes are fixed-length and non-nullable.
+  for (PtrMap<attribute_id, LiteralTypeInstance>::const_iterator value_it = new_values.begin();
+       value_it != new_values.end();
+       ++value_it) {
+    if (value_it->second->isNull()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void PaxTupleStorageSubBlock::setAttributeValueInPlaceTyped(const tuple_id tuple,
+                                                            const attribute_id attr,
+                                                            const TypeInstance &value) {
+  DEBUG_ASSERT(hasTupleWithID(tuple));
+  DEBUG_ASSERT(relation_.hasAttributeWithId(attr));
+  DEBUG_ASSERT(!value.isNull());
+  const tuple_id minipage_slot = tuple % tuples_per_minipage_;
+  value.copyInto(getMinipartition(tuple - minipage_slot, attr)
+                 + minipage_slot * attribute_lengths_[attr]);
+}
+
+bool PaxTupleStorageSubBlock::deleteTuple(const tuple_id tuple) {
+  DEBUG_ASSERT(hasTupleWithID(tuple));
+
+  PaxHeader *header = getHeaderPtr();
+
+  if (tuple == header->num_tuples - 1) {
+    // If deleting the last tuple, simply truncate.
+    --(header->num_tuples);
+    return false;
+  }
+
+  // Shift subsequent tuples forward by one position. Within each mini-page,
+  // the values in each minipartition are moved down one slot, and the first
+  // value from the same minipartition in the next mini-page (if any) fills
+  // the last slot.
+  const tuple_id num_tuples = header->num_tuples;
+  for (CatalogRelation::const_iterator attr_it = relation_.begin();
+       attr_it != relation_.end();
+       ++attr_it) {
+    const size_t attr_length = attribute_lengths_[attr_it->getID()];
+    tuple_id hole = tuple;
+    while (hole < num_tuples - 1) {
+      const tuple_id minipage_first_tuple = hole - hole % tuples_per_minipage_;
+      const tuple_id minipage_end = (num_tuples < minipage_first_tuple + tuples_per_minipage_)
+                                    ? num_tuples
+                                    : minipage_first_tuple + tuples_per_minipage_;
+      char *minipartition = getMinipartition(minipage_first_tuple, attr_it->getID());
+      memmove(minipartition + (hole - minipage_first_tuple) * attr_length,
+              minipartition + (hole - minipage_first_tuple + 1) * attr_length,
+              (minipage_end - hole - 1) * attr_length);
+      if (minipage_end < num_tuples) {
+        memcpy(minipartition + (minipage_end - minipage_first_tuple - 1) * attr_length,
+               getMinipartition(minipage_end, attr_it->getID()),
+               attr_length);
+      }
+      hole = minipage_end;
+    }
+  }
+
+  --(header->num_tuples);
+
+  return true;
+}
+
+TupleIdSequence* PaxTupleStorageSubBlock::getMatchesForPredicate(const Predicate *predicate) const {
+  if ((predicate == NULL) || !predicate->isAttributeLiteralComparisonPredicate()) {
+    return TupleStorageSubBlock::getMatchesForPredicate(predicate);
+  }
+
+  // Stride through the attribute's minipartition in each mini-page in turn.
+  // The tuple IDs in each mini-page's matches are relative to the first tuple
+  // in the mini-page.
+  const ComparisonPredicate &comparison_predicate = *static_cast<const ComparisonPredicate*>(predicate);
+  const attribute_id comparison_attribute_id = GetComparisonAttributeID(comparison_predicate);
+  const size_t attr_length = attribute_lengths_[comparison_attribute_id];
+  const tuple_id num_tuples = getHeaderPtr()->num_tuples;
+  TupleIdSequence *matches = new TupleIdSequence();
+  for (tuple_id minipage_first_tuple = 0;
+       minipage_first_tuple < num_tuples;
+       minipage_first_tuple += tuples_per_minipage_) {
+    const tuple_id minipage_end = (num_tuples < minipage_first_tuple + tuples_per_minipage_)
+                                  ? num_tuples
+                                  : minipage_first_tuple + tuples_per_minipage_;
+    ScopedPtr<TupleIdSequence> minipage_matches(GetMatchesForComparisonOnStridedValues(
+        comparison_predicate,
+        getMinipartition(minipage_first_tuple, comparison_attribute_id),
+        attr_length,
+        minipage_end - minipage_first_tuple,
+        NULL,
+        NULL));
+    for (TupleIdSequence::const_iterator match_it = minipage_matches->begin();
+         match_it != minipage_matches->end();
+         ++match_it) {
+      matches->append(minipage_first_tuple + *match_it);
+    }
+  }
+
+  return matches;
+}
+
+}  // namespace quickstep
@@ -0,0 +1,218 @@
+/*
+   This file copyright (c) 2011-2013, the Quickstep authors.
+   See file CREDITS.txt for details.
+  
+   This file is part of Quickstep.
+
+   Quickstep is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+  
+   Quickstep is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Quickstep.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICKSTEP_STORAGE_PAX_TUPLE_STORAGE_SUB_BLOCK_HPP_
+#define QUICKSTEP_STORAGE_PAX_TUPLE_STORAGE_SUB_BLOCK_HPP_
+
+#include <cstddef>
+#include <vector>
+
+#include "catalog/CatalogTypedefs.hpp"
+#include "storage/TupleStorageSubBlock.hpp"
+#include "utility/Macros.hpp"
+#include "utility/PtrMap.hpp"
+
+namespace quickstep {
+
+class TupleStorageSubBlockDescription;
+
+/** \addtogroup Storage
+ *  @{
+ */
+
+/**
+ * @brief An implementation of TupleStorageSubBlock using the PAX
+ *        (Partition Attributes Across) layout. Tuples are stored in order of
+ *        insertion, with no holes, in a sequence of fixed-size mini-pages.
+ *        Each mini-page holds a contiguous range of tuples, and stores the
+ *        values of each attribute for those tuples together in a
+ *        minipartition (i.e. a short column stripe). Predicates are evaluated
+ *        by scanning minipartitions like a column store, while all of a
+ *        tuple's values are within a single mini-page.
+ * @warning This implementation does NOT support variable-length or nullable
+ *          attributes. It is an error to attempt to construct a
+ *          PaxTupleStorageSubBlock for a relation with any variable-length or
+ *          nullable attributes.
+ **/
+class PaxTupleStorageSubBlock : public TupleStorageSubBlock {
+ public:
+  PaxTupleStorageSubBlock(const CatalogRelation &relation,
+                          const TupleStorageSubBlockDescription &description,
+                          const bool new_block,
+                          void *sub_block_memory,
+                          const std::size_t sub_block_memory_size);
+
+  ~PaxTupleStorageSubBlock() {
+  }
+
+  /**
+   * @brief Determine whether a TupleStorageSubBlockDescription is valid for
+   *        this type of TupleStorageSubBlock.
+   *
+   * @param relation The relation a tuple store described by description would
+   *        belong to.
+   * @param description A description of the parameters for this type of
+   *        TupleStorageSubBlock, which will be checked for validity.
+   * @return Whether description is well-formed and valid for this type of
+   *         TupleStorageSubBlock belonging to relation (i.e. whether a
+   *         TupleStorageSubBlock of this type, belonging to relation, can be
+   *         constructed according to description).
+   **/
+  static bool DescriptionIsValid(const CatalogRelation &relation,
+                                 const TupleStorageSubBlockDescription &description);
+
+  /**
+   * @brief Estimate the average number of bytes (including any applicable
+   *        overhead) used to store a single tuple in this type of
+   *        TupleStorageSubBlock. Used by StorageBlockLayout::finalize() to
+   *        divide block memory amongst sub-blocks.
+   * @warning description must be valid. DescriptionIsValid() should be called
+   *          first if necessary.
+   *
+   * @param relation The relation tuples belong to.
+   * @param description A description of the parameters for this type of
+   *        TupleStorageSubBlock.
+   * @return The average/ammortized number of bytes used to store a single
+   *         tuple of relation in a TupleStorageSubBlock of this type described
+   *         by description.
+   **/
+  static std::size_t EstimateBytesPerTuple(const CatalogRelation &relation,
+                                           const TupleStorageSubBlockDescription &description);
+
+  bool supportsUntypedGetAttributeValue(const attribute_id attr) const {
+    return true;
+  }
+
+  bool supportsAdHocInsert() const {
+    return true;
+  }
+
+  bool adHocInsertIsEfficient() const {
+    return true;
+  }
+
+  TupleStorageSubBlockType getTupleStorageSubBlockType() const {
+    return kPaxStore;
+  }
+
+  bool isEmpty() const {
+    return (getHeaderPtr()->num_tuples == 0);
+  }
+
+  bool isPacked() const {
+    return true;
+  }
+
+  tuple_id getMaxTupleID() const {
+    return getHeaderPtr()->num_tuples - 1;
+  }
+
+  bool hasTupleWithID(const tuple_id tuple) const {
+    return ((tuple >=0) && (tuple < getHeaderPtr()->num_tuples));
+  }
+
+  InsertResult insertTuple(const Tuple &tuple, const AllowedTypeConversion atc);
+
+  inline bool insertTupleInBatch(const Tuple &tuple, const AllowedTypeConversion atc) {
+    const InsertResult result = insertTuple(tuple, atc);
+    return (result.inserted_id >= 0);
+  }
+
+  bool batchInsertMutatesTupleIDs() const {
+    return false;
+  }
+
+  bool nextInsertAppends() const {
+    return true;
+  }
+
+  tuple_id estimateTupleCapacity() const {
+    return max_tuples_;
+  }
+
+  const void* getAttributeValue(const tuple_id tuple, const attribute_id attr) const;
+  TypeInstance* getAttributeValueTyped(const tuple_id tuple, const attribute_id attr) const;
+
+  bool canSetAttributeValuesInPlaceTyped(const tuple_id tuple,
+                                         const PtrMap<attribute_id, LiteralTypeInstance> &new_values) const;
+  void setAttributeValueInPlaceTyped(const tuple_id tuple, const attribute_id attr, const TypeInstance &value);
+
+  bool deleteTuple(const tuple_id tuple);
+
+  // This override evaluates comparisons between an attribute and a literal
+  // value by scanning the attribute's minipartition in each mini-page.
+  TupleIdSequence* getMatchesForPredicate(const Predicate *predicate) const;
+
+  void rebuild() {
+  }
+
+  /**
+   * @brief Get the number of tuples stored in each mini-page.
+   *
+   * @return The number of tuples in a full mini-page.
+   **/
+  tuple_id getTuplesPerMinipage() const {
+    return tuples_per_minipage_;
+  }
+
+ private:
+  struct PaxHeader {
+    tuple_id num_tuples;
+  };
+
+  PaxHeader* getHeaderPtr() {
+    return static_cast<PaxHeader*>(sub_block_memory_);
+  }
+
+  const PaxHeader* getHeaderPtr() const {
+    return static_cast<const PaxHeader*>(sub_block_memory_);
+  }
+
+  // Get the start of the minipartition for 'attr' in the mini-page holding
+  // tuples starting from 'first_tuple', which must be a multiple of
+  // 'tuples_per_minipage_'.
+  inline char* getMinipartition(const tuple_id first_tuple, const attribute_id attr) const {
+    return static_cast<char*>(sub_block_memory_)
+           + sizeof(PaxHeader)
+           + (first_tuple / tuples_per_minipage_) * minipage_stride_
+           + minipartition_offsets_[attr];
+  }
+
+  tuple_id tuples_per_minipage_;
+  // The number of bytes actually used by each mini-page, which may be less
+  // than the configured mini-page size if it is not a multiple of the tuple
+  // length.
+  std::size_t minipage_stride_;
+  tuple_id max_tuples_;
+
+  // The offset of each attribute's minipartition from the start of a
+  // mini-page, and the length of each attribute's values, indexed by
+  // attribute ID.
+  std::vector<std::size_t> minipartition_offsets_;
+  std::vector<std::size_t> attribute_lengths_;
+
+  DISALLOW_COPY_AND_ASSIGN(PaxTupleStorageSubBlock);
+};
+
+/** @} */
+
+}  // namespace quickstep
+
+#endif  // QUICKSTEP_STORAGE_PAX_TUPLE_STORAGE_SUB_BLOCK_HPP_
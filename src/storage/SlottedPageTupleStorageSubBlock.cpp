@@ -0,0 +1,387 @@
+/*
+   This file copyright (c) 2011-2013, the Quickstep authors.
+   See file CREDITS.txt for details.
+  
+   This file is part of Quickstep.
+
+   Quickstep is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+  
+   Quickstep is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Quickstep.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "storage/SlottedPageTupleStorageSubBlock.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "catalog/CatalogAttribute.hpp"
+#include "catalog/CatalogRelation.hpp"
+#include "expressions/ComparisonPredicate.hpp"
+#include "expressions/Predicate.hpp"
+#include "expressions/Scalar.hpp"
+#include "storage/StorageBlockInfo.hpp"
+#include "storage/StorageBlockLayout.pb.h"
+#include "storage/StorageErrors.hpp"
+#include "storage/TupleIdSequence.hpp"
+#include "types/Comparison.hpp"
+#include "types/Tuple.hpp"
+#include "types/Type.hpp"
+#include "types/TypeInstance.hpp"
+#include "utility/CstdintCompat.hpp"
+#include "utility/Macros.hpp"
+#include "utility/PtrVector.hpp"
+#include "utility/ScopedBuffer.hpp"
+#include "utility/ScopedPtr.hpp"
+
+using std::memcpy;
+using std::memset;
+using std::min;
+using std::numeric_limits;
+using std::size_t;
+using std::uint32_t;
+using std::vector;
+
+namespace quickstep {
+
+SlottedPageTupleStorageSubBlock::SlottedPageTupleStorageSubBlock(
+    const CatalogRelation &relation,
+    const TupleStorageSubBlockDescription &description,
+    const bool new_block,
+    void *sub_block_memory,
+    const std::size_t sub_block_memory_size)
+    : TupleStorageSubBlock(relation,
+                           description,
+                           new_block,
+                           sub_block_memory,
+                           sub_block_memory_size),
+      heap_end_(min(sub_block_memory_size, static_cast<size_t>(numeric_limits<uint32_t>::max()))) {
+  if (!DescriptionIsValid(relation_, description_)) {
+    FATAL_ERROR("Attempted to construct a SlottedPageTupleStorageSubBlock from an invalid description.");
+  }
+
+  if (sub_block_memory_size < sizeof(SlottedPageHeader)) {
+    throw BlockMemoryTooSmall("SlottedPageTupleStorageSubBlock", sub_block_memory_size);
+  }
+
+  // Fixed-length attributes are at the same offsets as in a conventional
+  // row-store, followed by the offsets of variable-length values, then the
+  // NULL bits.
+  attribute_offsets_.resize(relation_.getMaxAttributeId() + 1, 0);
+  variable_length_attributes_.resize(relation_.getMaxAttributeId() + 1, false);
+  null_bit_numbers_.resize(relation_.getMaxAttributeId() + 1, -1);
+  record_prefix_length_ = relation_.getFixedByteLength();
+  int num_nullable_attributes = 0;
+  for (CatalogRelation::const_iterator attr_it = relation_.begin();
+       attr_it != relation_.end();
+       ++attr_it) {
+    if (attr_it->getType().isVariableLength()) {
+      attribute_offsets_[attr_it->getID()] = record_prefix_length_;
+      variable_length_attributes_[attr_it->getID()] = true;
+      record_prefix_length_ += sizeof(uint32_t);
+    } else {
+      attribute_offsets_[attr_it->getID()] = relation_.getFixedLengthAttributeOffset(attr_it->getID());
+    }
+    if (attr_it->getType().isNullable()) {
+      null_bit_numbers_[attr_it->getID()] = num_nullable_attributes++;
+    }
+  }
+  null_bits_offset_ = record_prefix_length_;
+  record_prefix_length_ += (num_nullable_attributes + 7) >> 3;
+
+  if (new_block) {
+    SlottedPageHeader *header = getHeaderPtr();
+    header->num_slots = 0;
+    header->num_tuples = 0;
+    header->heap_start = heap_end_;
+    header->garbage_bytes = 0;
+  }
+}
+
+bool SlottedPageTupleStorageSubBlock::DescriptionIsValid(
+    const CatalogRelation &relation,
+    const TupleStorageSubBlockDescription &description) {
+  // Make sure description is initialized and specifies SlottedPageStore.
+  if (!description.IsInitialized()) {
+    return false;
+  }
+  if (description.sub_block_type() != TupleStorageSubBlockDescription::SLOTTED_PAGE_STORE) {
+    return false;
+  }
+
+  return true;
+}
+
+std::size_t SlottedPageTupleStorageSubBlock::EstimateBytesPerTuple(
+    const CatalogRelation &relation,
+    const TupleStorageSubBlockDescription &description) {
+  DEBUG_ASSERT(DescriptionIsValid(relation, description));
+
+  size_t num_variable_length_attributes = 0;
+  size_t num_nullable_attributes = 0;
+  for (CatalogRelation::const_iterator attr_it = relation.begin();
+       attr_it != relation.end();
+       ++attr_it) {
+    if (attr_it->getType().isVariableLength()) {
+      ++num_variable_length_attributes;
+    }
+    if (attr_it->getType().isNullable()) {
+      ++num_nullable_attributes;
+    }
+  }
+
+  return relation.getEstimatedByteLength()
+         + sizeof(Slot)
+         + num_variable_length_attributes * sizeof(uint32_t)
+         + ((num_nullable_attributes + 7) >> 3);
+}
+
+TupleStorageSubBlock::InsertResult SlottedPageTupleStorageSubBlock::insertTuple(
+    const Tuple &tuple,
+    const AllowedTypeConversion atc) {
+#ifdef QUICKSTEP_DEBUG
+  paranoidInsertTypeCheck(tuple, atc);
+#endif
+
+  // Coerce values if necessary and determine the length of the record.
+  PtrVector<TypeInstance> coerced_values;
+  vector<const TypeInstance*> values;
+  values.reserve(tuple.size());
+  size_t record_length = record_prefix_length_;
+  Tuple::const_iterator value_it = tuple.begin();
+  for (CatalogRelation::const_iterator attr_it = relation_.begin();
+       attr_it != relation_.end();
+       ++attr_it, ++value_it) {
+    const TypeInstance *value = &(*value_it);
+    if ((atc != kNone) && !value->isNull() && !value->getType().equals(attr_it->getType())) {
+      coerced_values.push_back(value->makeCoercedCopy(attr_it->getType()));
+      value = &(coerced_values.back());
+    }
+    if (variable_length_attributes_[attr_it->getID()]) {
+      record_length += value->getInstanceByteLength();
+    }
+    values.push_back(value);
+  }
+
+  if (getContiguousFreeSpace() < record_length + sizeof(Slot)) {
+    if (getContiguousFreeSpace() + getHeaderPtr()->garbage_bytes < record_length + sizeof(Slot)) {
+      return InsertResult(-1, false);
+    }
+    // Reclaim the space left by deleted tuples. Tuple IDs are unchanged.
+    compact(false);
+  }
+
+  SlottedPageHeader *header = getHeaderPtr();
+  header->heap_start -= record_length;
+  char *record = static_cast<char*>(sub_block_memory_) + header->heap_start;
+  memset(record + null_bits_offset_, 0, record_prefix_length_ - null_bits_offset_);
+
+  size_t variable_length_position = record_prefix_length_;
+  vector<const TypeInstance*>::const_iterator values_it = values.begin();
+  for (CatalogRelation::const_iterator attr_it = relation_.begin();
+       attr_it != relation_.end();
+       ++attr_it, ++values_it) {
+    const attribute_id attr = attr_it->getID();
+    if (variable_length_attributes_[attr]) {
+      *reinterpret_cast<uint32_t*>(record + attribute_offsets_[attr]) = variable_length_position;
+    }
+
+    if ((*values_it)->isNull()) {
+      record[null_bits_offset_ + (null_bit_numbers_[attr] >> 3)] |= (0x1 << (null_bit_numbers_[attr] & 0x7));
+    } else if (variable_length_attributes_[attr]) {
+      (*values_it)->copyInto(record + variable_length_position);
+      variable_length_position += (*values_it)->getInstanceByteLength();
+    } else {
+      (*values_it)->copyInto(record + attribute_offsets_[attr]);
+    }
+  }
+  DEBUG_ASSERT(variable_length_position == record_length);
+
+  const tuple_id new_tuple = header->num_slots;
+  Slot &new_slot = getSlotsPtr()[new_tuple];
+  new_slot.offset = header->heap_start;
+  new_slot.length = record_length;
+  ++(header->num_slots);
+  ++(header->num_tuples);
+
+  return InsertResult(new_tuple, false);
+}
+
+const void* SlottedPageTupleStorageSubBlock::getAttributeValue(const tuple_id tuple,
+                                                               const attribute_id attr) const {
+  DEBUG_ASSERT(hasTupleWithID(tuple));
+  DEBUG_ASSERT(relation_.hasAttributeWithId(attr));
+  return getValuePtr(tuple, attr);
+}
+
+TypeInstance* SlottedPageTupleStorageSubBlock::getAttributeValueTyped(const tuple_id tuple,
+                                                                      const attribute_id attr) const {
+  return relation_.getAttributeById(attr).getType().makeReferenceTypeInstance(getAttributeValue(tuple, attr));
+}
+
+bool SlottedPageTupleStorageSubBlock::canSetAttributeValuesInPlaceTyped(
+    const tuple_id tuple,
+    const PtrMap<attribute_id, LiteralTypeInstance> &new_values) const {
+  DEBUG_ASSERT(hasTupleWithID(tuple));
+  for (PtrMap<attribute_id, LiteralTypeInstance>::const_iterator value_it = new_values.begin();
+       value_it != new_values.end();
+       ++value_it) {
+    if (variable_length_attributes_[value_it->first]) {
+      return false;
+    }
+    if (value_it->second->isNull() && (null_bit_numbers_[value_it->first] < 0)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void SlottedPageTupleStorageSubBlock::setAttributeValueInPlaceTyped(const tuple_id tuple,
+                                                                    const attribute_id attr,
+                                                                    const TypeInstance &value) {
+  DEBUG_ASSERT(hasTupleWithID(tuple));
+  DEBUG_ASSERT(relation_.hasAttributeWithId(attr));
+  DEBUG_ASSERT(!variable_length_attributes_[attr]);
+  char *record = static_cast<char*>(sub_block_memory_) + getSlotsPtr()[tuple].offset;
+  if (!value.isNull()) {
+    value.copyInto(record + attribute_offsets_[attr]);
+  }
+  if (null_bit_numbers_[attr] >= 0) {
+    char *null_byte = record + null_bits_offset_ + (null_bit_numbers_[attr] >> 3);
+    if (value.isNull()) {
+      *null_byte |= (0x1 << (null_bit_numbers_[attr] & 0x7));
+    } else {
+      *null_byte &= ~(0x1 << (null_bit_numbers_[attr] & 0x7));
+    }
+  }
+}
+
+bool SlottedPageTupleStorageSubBlock::deleteTuple(const tuple_id tuple) {
+  DEBUG_ASSERT(hasTupleWithID(tuple));
+
+  SlottedPageHeader *header = getHeaderPtr();
+  Slot *slots = getSlotsPtr();
+
+  if (slots[tuple].offset == header->heap_start) {
+    // The record is at the start of the heap, so simply shrink the heap.
+    header->heap_start += slots[tuple].length;
+  } else {
+    header->garbage_bytes += slots[tuple].length;
+  }
+  slots[tuple].offset = 0;
+  slots[tuple].length = 0;
+  --(header->num_tuples);
+
+  // Drop empty slots from the end of the directory.
+  while ((header->num_slots > 0) && (slots[header->num_slots - 1].offset == 0)) {
+    --(header->num_slots);
+  }
+  if (header->num_tuples == 0) {
+    header->heap_start = heap_end_;
+    header->garbage_bytes = 0;
+  }
+
+  return false;
+}
+
+TupleIdSequence* SlottedPageTupleStorageSubBlock::getMatchesForPredicate(const Predicate *predicate) const {
+  if ((predicate == NULL) || !predicate->isAttributeLiteralComparisonPredicate()) {
+    return TupleStorageSubBlock::getMatchesForPredicate(predicate);
+  }
+
+  const ComparisonPredicate &comparison_predicate = *static_cast<const ComparisonPredicate*>(predicate);
+  const bool left_literal = comparison_predicate.getLeftOperand().hasStaticValue();
+  const attribute_id comparison_attribute_id = GetComparisonAttributeID(comparison_predicate);
+  const LiteralTypeInstance &comparison_literal
+      = left_literal ? comparison_predicate.getLeftOperand().getStaticValue()
+                     : comparison_predicate.getRightOperand().getStaticValue();
+
+  TupleIdSequence *matches = new TupleIdSequence();
+  if (comparison_literal.isNull()) {
+    // Nothing compares with NULL.
+    return matches;
+  }
+
+  const Type &attr_type = relation_.getAttributeById(comparison_attribute_id).getType();
+  ScopedPtr<UncheckedComparator> comparator(
+      left_literal
+          ? comparison_predicate.getComparison().makeUncheckedComparatorForTypes(comparison_literal.getType(),
+                                                                                  attr_type)
+          : comparison_predicate.getComparison().makeUncheckedComparatorForTypes(attr_type,
+                                                                                  comparison_literal.getType()));
+
+  const Slot *slots = getSlotsPtr();
+  const tuple_id num_slots = getHeaderPtr()->num_slots;
+  for (tuple_id tid = 0; tid < num_slots; ++tid) {
+    if (slots[tid].offset == 0) {
+      continue;
+    }
+    const void *value = getValuePtr(tid, comparison_attribute_id);
+    if (value == NULL) {
+      continue;
+    }
+    if (left_literal ? comparator->compareTypeInstanceWithDataPtr(comparison_literal, value)
+                     : comparator->compareDataPtrWithTypeInstance(value, comparison_literal)) {
+      matches->append(tid);
+    }
+  }
+
+  return matches;
+}
+
+std::size_t SlottedPageTupleStorageSubBlock::getContiguousFreeSpace() const {
+  return getHeaderPtr()->heap_start
+         - sizeof(SlottedPageHeader)
+         - getHeaderPtr()->num_slots * sizeof(Slot);
+}
+
+void SlottedPageTupleStorageSubBlock::compact(const bool pack_slots) {
+  SlottedPageHeader *header = getHeaderPtr();
+  Slot *slots = getSlotsPtr();
+
+  // Copy live records into a temporary buffer, in the same order they will
+  // have in the compacted heap (the record in the first slot at the end).
+  const size_t live_bytes = heap_end_ - header->heap_start - header->garbage_bytes;
+  const size_t new_heap_start = heap_end_ - live_bytes;
+  ScopedBuffer live_records(live_bytes);
+  size_t record_start = heap_end_;
+  tuple_id dest_slot = 0;
+  for (tuple_id slot_num = 0; slot_num < header->num_slots; ++slot_num) {
+    if (slots[slot_num].offset == 0) {
+      continue;
+    }
+    record_start -= slots[slot_num].length;
+    memcpy(static_cast<char*>(live_records.get()) + (record_start - new_heap_start),
+           static_cast<const char*>(sub_block_memory_) + slots[slot_num].offset,
+           slots[slot_num].length);
+
+    // Slots are only ever moved toward the front of the directory, so this
+    // never overwrites a slot which hasn't been visited yet.
+    Slot &new_slot = slots[pack_slots ? dest_slot : slot_num];
+    new_slot.offset = record_start;
+    new_slot.length = slots[slot_num].length;
+    ++dest_slot;
+  }
+  DEBUG_ASSERT(record_start == new_heap_start);
+  DEBUG_ASSERT(dest_slot == header->num_tuples);
+
+  memcpy(static_cast<char*>(sub_block_memory_) + new_heap_start, live_records.get(), live_bytes);
+  header->heap_start = new_heap_start;
+  header->garbage_bytes = 0;
+  if (pack_slots) {
+    header->num_slots = header->num_tuples;
+  }
+}
+
+}  // namespace quickstep
@@ -0,0 +1,258 @@
+/*
+   This file copyright (c) 2011-2013, the Quickstep authors.
+   See file CREDITS.txt for details.
+  
+   This file is part of Quickstep.
+
+   Quickstep is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+  
+   Quickstep is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Quickstep.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICKSTEP_STORAGE_SLOTTED_PAGE_TUPLE_STORAGE_SUB_BLOCK_HPP_
+#define QUICKSTEP_STORAGE_SLOTTED_PAGE_TUPLE_STORAGE_SUB_BLOCK_HPP_
+
+#include <cstddef>
+#include <vector>
+
+#include "catalog/CatalogTypedefs.hpp"
+#include "storage/TupleStorageSubBlock.hpp"
+#include "utility/CstdintCompat.hpp"
+#include "utility/Macros.hpp"
+#include "utility/PtrMap.hpp"
+
+namespace quickstep {
+
+class TupleStorageSubBlockDescription;
+
+/** \addtogroup Storage
+ *  @{
+ */
+
+/**
+ * @brief An implementation of TupleStorageSubBlock as a slotted page, which
+ *        supports variable-length attributes with ad-hoc inserts. A directory
+ *        of slots grows forward from the start of the block, and a heap of
+ *        tuple records grows backward from the end. Each record stores the
+ *        tuple's fixed-length attributes at fixed offsets, followed by the
+ *        offset of each variable-length value within the record, the tuple's
+ *        NULL bits, and finally the variable-length values themselves.
+ * @note Deleting a tuple leaves an empty slot, so tuple IDs are stable but
+ *       this block may have holes. Space freed by deletes is reclaimed when
+ *       an insert would otherwise run out of space (without changing any
+ *       tuple IDs), and rebuild() compacts both the heap and the slot
+ *       directory (renumbering tuples to fill any holes).
+ **/
+class SlottedPageTupleStorageSubBlock : public TupleStorageSubBlock {
+ public:
+  SlottedPageTupleStorageSubBlock(const CatalogRelation &relation,
+                                  const TupleStorageSubBlockDescription &description,
+                                  const bool new_block,
+                                  void *sub_block_memory,
+                                  const std::size_t sub_block_memory_size);
+
+  ~SlottedPageTupleStorageSubBlock() {
+  }
+
+  /**
+   * @brief Determine whether a TupleStorageSubBlockDescription is valid for
+   *        this type of TupleStorageSubBlock.
+   *
+   * @param relation The relation a tuple store described by description would
+   *        belong to.
+   * @param description A description of the parameters for this type of
+   *        TupleStorageSubBlock, which will be checked for validity.
+   * @return Whether description is well-formed and valid for this type of
+   *         TupleStorageSubBlock belonging to relation (i.e. whether a
+   *         TupleStorageSubBlock of this type, belonging to relation, can be
+   *         constructed according to description).
+   **/
+  static bool DescriptionIsValid(const CatalogRelation &relation,
+                                 const TupleStorageSubBlockDescription &description);
+
+  /**
+   * @brief Estimate the average number of bytes (including any applicable
+   *        overhead) used to store a single tuple in this type of
+   *        TupleStorageSubBlock. Used by StorageBlockLayout::finalize() to
+   *        divide block memory amongst sub-blocks.
+   * @warning description must be valid. DescriptionIsValid() should be called
+   *          first if necessary.
+   *
+   * @param relation The relation tuples belong to.
+   * @param description A description of the parameters for this type of
+   *        TupleStorageSubBlock.
+   * @return The average/ammortized number of bytes used to store a single
+   *         tuple of relation in a TupleStorageSubBlock of this type described
+   *         by description.
+   **/
+  static std::size_t EstimateBytesPerTuple(const CatalogRelation &relation,
+                                           const TupleStorageSubBlockDescription &description);
+
+  bool supportsUntypedGetAttributeValue(const attribute_id attr) const {
+    return true;
+  }
+
+  bool supportsAdHocInsert() const {
+    return true;
+  }
+
+  bool adHocInsertIsEfficient() const {
+    return true;
+  }
+
+  TupleStorageSubBlockType getTupleStorageSubBlockType() const {
+    return kSlottedPageStore;
+  }
+
+  bool isEmpty() const {
+    return (getHeaderPtr()->num_tuples == 0);
+  }
+
+  bool isPacked() const {
+    return (getHeaderPtr()->num_tuples == getHeaderPtr()->num_slots);
+  }
+
+  tuple_id getMaxTupleID() const {
+    return getHeaderPtr()->num_slots - 1;
+  }
+
+  tuple_id numTuples() const {
+    return getHeaderPtr()->num_tuples;
+  }
+
+  bool hasTupleWithID(const tuple_id tuple) const {
+    return ((tuple >= 0)
+            && (tuple < getHeaderPtr()->num_slots)
+            && (getSlotsPtr()[tuple].offset != 0));
+  }
+
+  InsertResult insertTuple(const Tuple &tuple, const AllowedTypeConversion atc);
+
+  inline bool insertTupleInBatch(const Tuple &tuple, const AllowedTypeConversion atc) {
+    const InsertResult result = insertTuple(tuple, atc);
+    return (result.inserted_id >= 0);
+  }
+
+  // New tuples are always given new slots at the end of the directory, so
+  // rebuild() only renumbers tuples if there were holes before a batch.
+  bool batchInsertMutatesTupleIDs() const {
+    return !isPacked();
+  }
+
+  const void* getAttributeValue(const tuple_id tuple, const attribute_id attr) const;
+  TypeInstance* getAttributeValueTyped(const tuple_id tuple, const attribute_id attr) const;
+
+  // Only fixed-length attributes can be changed in place.
+  bool canSetAttributeValuesInPlaceTyped(const tuple_id tuple,
+                                         const PtrMap<attribute_id, LiteralTypeInstance> &new_values) const;
+  void setAttributeValueInPlaceTyped(const tuple_id tuple, const attribute_id attr, const TypeInstance &value);
+
+  bool deleteTuple(const tuple_id tuple);
+
+  // This override evaluates comparisons between an attribute and a literal
+  // value by comparing directly with pointers to each tuple's value.
+  TupleIdSequence* getMatchesForPredicate(const Predicate *predicate) const;
+
+  void rebuild() {
+    if (!isPacked() || (getHeaderPtr()->garbage_bytes > 0)) {
+      compact(true);
+    }
+  }
+
+ private:
+  struct SlottedPageHeader {
+    tuple_id num_slots;
+    tuple_id num_tuples;
+    // The offset, from the start of this sub-block's memory, of the
+    // lowest-addressed record in the heap.
+    std::uint32_t heap_start;
+    // The total length of records in the heap which belong to deleted tuples
+    // and can be reclaimed by compact().
+    std::uint32_t garbage_bytes;
+  };
+
+  // An entry in the slot directory. The offset of a record is never zero, so
+  // a slot with a zero offset is empty.
+  struct Slot {
+    std::uint32_t offset;
+    std::uint32_t length;
+  };
+
+  SlottedPageHeader* getHeaderPtr() {
+    return static_cast<SlottedPageHeader*>(sub_block_memory_);
+  }
+
+  const SlottedPageHeader* getHeaderPtr() const {
+    return static_cast<const SlottedPageHeader*>(sub_block_memory_);
+  }
+
+  Slot* getSlotsPtr() {
+    return reinterpret_cast<Slot*>(static_cast<char*>(sub_block_memory_) + sizeof(SlottedPageHeader));
+  }
+
+  const Slot* getSlotsPtr() const {
+    return reinterpret_cast<const Slot*>(static_cast<const char*>(sub_block_memory_)
+                                         + sizeof(SlottedPageHeader));
+  }
+
+  const char* getRecordPtr(const tuple_id tuple) const {
+    return static_cast<const char*>(sub_block_memory_) + getSlotsPtr()[tuple].offset;
+  }
+
+  inline const void* getValuePtr(const tuple_id tuple, const attribute_id attr) const {
+    const char *record = getRecordPtr(tuple);
+    if ((null_bit_numbers_[attr] >= 0)
+        && ((record[null_bits_offset_ + (null_bit_numbers_[attr] >> 3)] >> (null_bit_numbers_[attr] & 0x7)) & 0x1)) {
+      return NULL;
+    }
+    if (variable_length_attributes_[attr]) {
+      return record + *reinterpret_cast<const std::uint32_t*>(record + attribute_offsets_[attr]);
+    } else {
+      return record + attribute_offsets_[attr];
+    }
+  }
+
+  // The number of unused bytes between the end of the slot directory and the
+  // start of the heap.
+  std::size_t getContiguousFreeSpace() const;
+
+  // Move all live records to the end of the heap, reclaiming the space of
+  // deleted tuples. If 'pack_slots' is true, also renumber tuples to fill any
+  // empty slots.
+  void compact(const bool pack_slots);
+
+  // The end of the heap (the size of this sub-block's memory, limited to the
+  // range of a record offset).
+  std::size_t heap_end_;
+
+  // The number of bytes before the variable-length values in every record
+  // (the fixed-length attributes, variable-length offsets, and NULL bits).
+  std::size_t record_prefix_length_;
+  std::size_t null_bits_offset_;
+
+  // Indexed by attribute ID. For a fixed-length attribute, the offset of its
+  // value within a record. For a variable-length attribute, the offset within
+  // a record of the position of its value.
+  std::vector<std::size_t> attribute_offsets_;
+  std::vector<bool> variable_length_attributes_;
+  // The number of each nullable attribute's NULL bit, indexed by attribute
+  // ID (-1 for attributes which are not nullable).
+  std::vector<int> null_bit_numbers_;
+
+  DISALLOW_COPY_AND_ASSIGN(SlottedPageTupleStorageSubBlock);
+};
+
+/** @} */
+
+}  // namespace quickstep
+
+#endif  // QUICKSTEP_STORAGE_SLOTTED_PAGE_TUPLE_STORAGE_SUB_BLOCK_HPP_
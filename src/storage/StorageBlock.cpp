@@ -25,25 +25,36 @@
 
 #include "catalog/CatalogRelation.hpp"
 #include "expressions/Predicate.hpp"
+#include "expressions/PredicateWithList.hpp"
 #include "expressions/Scalar.hpp"
 #include "storage/BasicColumnStoreTupleStorageSubBlock.hpp"
+#include "storage/ColumnGroupTupleStorageSubBlock.hpp"
 #include "storage/CompressedColumnStoreTupleStorageSubBlock.hpp"
 #include "storage/CompressedPackedRowStoreTupleStorageSubBlock.hpp"
+#include "storage/CompressedTupleStorageSubBlock.hpp"
 #include "storage/CSBTreeIndexSubBlock.hpp"
 #include "storage/IndexSubBlock.hpp"
 #include "storage/InsertDestination.hpp"
 #include "storage/PackedRowStoreTupleStorageSubBlock.hpp"
+#include "storage/PaxTupleStorageSubBlock.hpp"
+#include "storage/SlottedPageTupleStorageSubBlock.hpp"
 #include "storage/StorageBlockLayout.hpp"
 #include "storage/StorageBlockLayout.pb.h"
 #include "storage/StorageConfig.h"
 #include "storage/StorageErrors.hpp"
 #include "storage/StorageManager.hpp"
+#include "storage/TupleBatch.hpp"
 #include "storage/TupleIdSequence.hpp"
 #include "storage/TupleStorageSubBlock.hpp"
+#include "threading/VersionedLatch.hpp"
 #include "types/Tuple.hpp"
+#include "types/Type.hpp"
 #include "types/TypeInstance.hpp"
+#include "utility/ContainerCompat.hpp"
 #include "utility/Macros.hpp"
 #include "utility/PtrList.hpp"
+#include "utility/PtrMap.hpp"
+#include "utility/PtrVector.hpp"
 #include "utility/ScopedPtr.hpp"
 
 using std::size_t;
@@ -51,6 +62,59 @@ using std::vector;
 
 namespace quickstep {
 
+namespace {
+
+// Find the first of 'indexes' which can evaluate 'predicate', or NULL if there
+// is none.
+const IndexSubBlock* FindIndexForPredicate(const vector<const IndexSubBlock*> &indexes,
+                                           const Predicate &predicate) {
+  for (vector<const IndexSubBlock*>::const_iterator index_it = indexes.begin();
+       index_it != indexes.end();
+       ++index_it) {
+    if ((*index_it)->canEvaluatePredicate(predicate)) {
+      return *index_it;
+    }
+  }
+  return NULL;
+}
+
+// Get the IDs of those tuples in 'candidates' which match all of 'predicates'.
+// The order of 'candidates' is preserved.
+TupleIdSequence* FilterMatches(const TupleStorageSubBlock &tuple_store,
+                               const TupleIdSequence &candidates,
+                               const vector<const Predicate*> &predicates) {
+  TupleIdSequence *matches = new TupleIdSequence();
+  for (TupleIdSequence::const_iterator tuple_it = candidates.begin();
+       tuple_it != candidates.end();
+       ++tuple_it) {
+    vector<const Predicate*>::const_iterator predicate_it = predicates.begin();
+    while ((predicate_it != predicates.end())
+           && (*predicate_it)->matchesForSingleTuple(tuple_store, *tuple_it)) {
+      ++predicate_it;
+    }
+    if (predicate_it == predicates.end()) {
+      matches->append(*tuple_it);
+    }
+  }
+  return matches;
+}
+
+// Look up 'predicate' in 'index', rechecking 'predicate' on the results if
+// 'index' only returns a superset of the matching tuples.
+TupleIdSequence* GetExactMatchesFromIndex(const TupleStorageSubBlock &tuple_store,
+                                          const IndexSubBlock &index,
+                                          const Predicate &predicate) {
+  IndexSearchResult result = index.getMatchesForPredicate(predicate);
+  if (!result.is_superset) {
+    return result.sequence;
+  }
+
+  ScopedPtr<TupleIdSequence> candidates(result.sequence);
+  return FilterMatches(tuple_store, *candidates, vector<const Predicate*>(1, &predicate));
+}
+
+}  // namespace
+
 StorageBlock::StorageBlock(const CatalogRelation &relation,
                            const block_id id,
                            const StorageBlockLayout &layout,
@@ -63,7 +127,9 @@ StorageBlock::StorageBlock(const CatalogRelation &relation,
       id_(id),
       dirty_(new_block),
       block_memory_(block_memory),
-      block_memory_size_(block_memory_size) {
+      block_memory_size_(block_memory_size),
+      batch_start_tuple_id_(-1),
+      retired_(false) {
   if (new_block) {
     if (block_memory_size_ < layout.getBlockHeaderSize()) {
       throw BlockMemoryTooSmall("StorageBlock", block_memory_size_);
@@ -172,6 +238,8 @@ StorageBlock::StorageBlock(const CatalogRelation &relation,
 	        block_header_.bloom_filter_size()));
 	  sub_block_address += block_header_.bloom_filter_size();
   }
+
+  publishVisibleTuples();
 }
 
 bool StorageBlock::insertTuple(const Tuple &tuple, const AllowedTypeConversion atc) {
@@ -179,11 +247,24 @@ bool StorageBlock::insertTuple(const Tuple &tuple, const AllowedTypeConversion a
     return false;
   }
 
+  // Appending a tuple doesn't disturb concurrent readers, which ignore tuples
+  // beyond the watermark published when the insert is finished.
+  VersionedLatchAppendLock lock(latch_);
+  if (retired_) {
+    // This block has been swapped out of the relation (possibly while we
+    // waited for the latch), so the tuple would be lost. Report it as full.
+    return false;
+  }
+  if (!tuple_store_->nextInsertAppends()) {
+    latch_.upgradeToWrite();
+  }
+
   const bool empty_before = tuple_store_->isEmpty();
 
   TupleStorageSubBlock::InsertResult tuple_store_insert_result = tuple_store_->insertTuple(tuple, atc);
   if (tuple_store_insert_result.inserted_id < 0) {
     DEBUG_ASSERT(tuple_store_insert_result.ids_mutated == false);
+    publishVisibleTuples();
     if (empty_before) {
       throw TupleTooLargeForBlock(tuple.getByteSize());
     } else {
@@ -213,8 +294,10 @@ bool StorageBlock::insertTuple(const Tuple &tuple, const AllowedTypeConversion a
     if (!bloom_filter_.empty()) {
     	bloom_filter_->addEntry(tuple);
     }
+    publishVisibleTuples();
     return true;
   } else {
+    publishVisibleTuples();
     if (empty_before) {
       throw TupleTooLargeForBlock(tuple.getByteSize());
     } else {
@@ -224,14 +307,37 @@ bool StorageBlock::insertTuple(const Tuple &tuple, const AllowedTypeConversion a
 }
 
 bool StorageBlock::insertTupleInBatch(const Tuple &tuple, const AllowedTypeConversion atc) {
+  // As in insertTuple(), only take the latch for a full write if existing
+  // tuples might be disturbed, and report a retired block as full.
+  VersionedLatchAppendLock lock(latch_);
+  if (retired_) {
+    return false;
+  }
+  if (!tuple_store_->nextInsertAppends()) {
+    latch_.upgradeToWrite();
+  }
+
+  // If this is the first tuple in a batch, and the indexes can be brought up
+  // to date by adding entries for only the new tuples, remember where the
+  // batch begins.
+  tuple_id batch_start_tuple_id = batch_start_tuple_id_;
+  if (all_indices_consistent_
+      && (!indices_.empty())
+      && (!tuple_store_->batchInsertMutatesTupleIDs())) {
+    batch_start_tuple_id = tuple_store_->getMaxTupleID() + 1;
+  }
+
   if (tuple_store_->insertTupleInBatch(tuple, atc)) {
+    batch_start_tuple_id_ = batch_start_tuple_id;
     invalidateAllIndexes();
     // add an entry for this tuple in the Bloom Filter sub-block, if initialized
     if (!bloom_filter_.empty()) {
     	bloom_filter_->addEntry(tuple);
     }
+    publishVisibleTuples();
     return true;
   } else {
+    publishVisibleTuples();
     if (tuple_store_->isEmpty()) {
       throw TupleTooLargeForBlock(tuple.getByteSize());
     } else {
@@ -240,19 +346,325 @@ bool StorageBlock::insertTupleInBatch(const Tuple &tuple, const AllowedTypeConve
   }
 }
 
+tuple_id StorageBlock::bulkInsertTuples(const TupleBatch &batch, const tuple_id first_tuple) {
+  // Unlike a single insert, a bulk insert compacts away deleted tuples if the
+  // whole batch does not fit in the free space, so only skip the full write
+  // latch if there are none.
+  VersionedLatchAppendLock lock(latch_);
+  if (retired_) {
+    return 0;
+  }
+  if (!(tuple_store_->nextInsertAppends() && tuple_store_->isPacked())) {
+    latch_.upgradeToWrite();
+  }
+
+  tuple_id batch_start_tuple_id = batch_start_tuple_id_;
+  if (all_indices_consistent_
+      && (!indices_.empty())
+      && (!tuple_store_->batchInsertMutatesTupleIDs())) {
+    batch_start_tuple_id = tuple_store_->getMaxTupleID() + 1;
+  }
+
+  const tuple_id num_inserted = tuple_store_->bulkInsertTuples(batch, first_tuple);
+  if (num_inserted > 0) {
+    batch_start_tuple_id_ = batch_start_tuple_id;
+    invalidateAllIndexes();
+    if (!bloom_filter_.empty()) {
+      bloom_filter_->addEntries(batch, first_tuple, num_inserted);
+    }
+  }
+  publishVisibleTuples();
+
+  if ((num_inserted == 0) && (first_tuple < batch.size()) && tuple_store_->isEmpty()) {
+    throw TupleTooLargeForBlock(batch.getRelation().getFixedByteLength());
+  }
+  return num_inserted;
+}
+
+bool StorageBlock::deleteTuples(const Predicate *predicate) {
+  VersionedLatchWriteLock lock(latch_);
+  if (retired_) {
+    throw BlockRetired();
+  }
+
+  ScopedPtr<TupleIdSequence> matches(getMatchesForPredicateHelper(predicate));
+  if (matches->empty()) {
+    return all_indices_consistent_;
+  }
+  matches->sort();
+
+  // Remove entries from the consistent indexes which support ad-hoc removal
+  // while the deleted tuples' values can still be read.
+  vector<bool> index_needs_rebuild(indices_.size(), false);
+  int index_num = 0;
+  for (PtrVector<IndexSubBlock>::iterator it = indices_.begin();
+       it != indices_.end();
+       ++it, ++index_num) {
+    if (!block_header_.index_consistent(index_num)) {
+      continue;
+    }
+    if (it->supportsAdHocRemove()) {
+      for (TupleIdSequence::const_iterator tuple_it = matches->begin();
+           tuple_it != matches->end();
+           ++tuple_it) {
+        it->removeEntry(*tuple_it);
+      }
+    } else {
+      index_needs_rebuild[index_num] = true;
+    }
+  }
+
+  // Delete in descending order, so that a TupleStorageSubBlock which does
+  // mutate tuple IDs leaves the IDs of the remaining matches unchanged.
+  bool ids_mutated = false;
+  for (TupleIdSequence::size_type match_num = matches->size(); match_num > 0; --match_num) {
+    if (tuple_store_->deleteTuple((*matches)[match_num - 1])) {
+      ids_mutated = true;
+    }
+  }
+  dirty_ = true;
+
+  // Entries for a pending batch can no longer simply be added to the indexes,
+  // since the indexes were not updated for the deleted tuples.
+  batch_start_tuple_id_ = -1;
+  publishVisibleTuples();
+
+  if (ids_mutated) {
+    return rebuildIndexes(false);
+  }
+
+  all_indices_consistent_ = true;
+  all_indices_inconsistent_ = true;
+  index_num = 0;
+  for (PtrVector<IndexSubBlock>::iterator it = indices_.begin();
+       it != indices_.end();
+       ++it, ++index_num) {
+    if (index_needs_rebuild[index_num]) {
+      block_header_.set_index_consistent(index_num, it->rebuild());
+    }
+    if (block_header_.index_consistent(index_num)) {
+      all_indices_inconsistent_ = false;
+    } else {
+      all_indices_consistent_ = false;
+    }
+  }
+  updateHeader();
+
+  return all_indices_consistent_;
+}
+
+StorageBlock::UpdateResult StorageBlock::update(const PtrMap<attribute_id, Scalar> &assignments,
+                                                const Predicate *predicate,
+                                                InsertDestination *relocation_destination) {
+  DEBUG_ASSERT(relocation_destination != NULL);
+  DEBUG_ASSERT(relocation_destination->getRelation().getID() == relation_.getID());
+
+  UpdateResult retval;
+  retval.relocation_destination_used = false;
+  retval.relocation_destination_indices_consistent = true;
+
+  // Copies of the updated tuples which could not be updated in place, to be
+  // inserted into 'relocation_destination' once this block is unlocked.
+  PtrVector<Tuple> relocated_tuples;
+  {
+    VersionedLatchWriteLock lock(latch_);
+    if (retired_) {
+      throw BlockRetired();
+    }
+
+    ScopedPtr<TupleIdSequence> matches(getMatchesForPredicateHelper(predicate));
+    if (matches->empty()) {
+      retval.indices_consistent = all_indices_consistent_;
+      return retval;
+    }
+    matches->sort();
+
+    vector<attribute_id> updated_attributes;
+    for (PtrMap<attribute_id, Scalar>::const_iterator assignment_it = assignments.begin();
+         assignment_it != assignments.end();
+         ++assignment_it) {
+      updated_attributes.push_back(assignment_it->first);
+    }
+
+    // Entries in the consistent indexes are kept up to date incrementally
+    // where possible. Indexes which can not be (or which run out of space)
+    // are rebuilt afterwards.
+    vector<bool> index_maintained(indices_.size(), false);
+    vector<bool> index_needs_rebuild(indices_.size(), false);
+    vector<bool> index_depends_on_update(indices_.size(), false);
+    int index_num = 0;
+    for (PtrVector<IndexSubBlock>::const_iterator it = indices_.begin();
+         it != indices_.end();
+         ++it, ++index_num) {
+      if (block_header_.index_consistent(index_num)) {
+        index_maintained[index_num] = true;
+        index_depends_on_update[index_num] = it->dependsOnAttributes(updated_attributes);
+      }
+    }
+
+    const CompatUnorderedMap<attribute_id, LiteralTypeInstance*>::unordered_map no_updated_values;
+    vector<tuple_id> relocated_ids;
+    for (TupleIdSequence::const_iterator match_it = matches->begin();
+         match_it != matches->end();
+         ++match_it) {
+      // Evaluate all the assignments against the original values of the
+      // tuple before changing any of them.
+      PtrMap<attribute_id, LiteralTypeInstance> new_values;
+      for (PtrMap<attribute_id, Scalar>::const_iterator assignment_it = assignments.begin();
+           assignment_it != assignments.end();
+           ++assignment_it) {
+        const Type &attr_type = relation_.getAttributeById(assignment_it->first).getType();
+        ScopedPtr<TypeInstance> value(assignment_it->second->getValueForSingleTuple(*tuple_store_, *match_it));
+        if (value->isNull() || value->getType().equals(attr_type)) {
+          new_values.insert(assignment_it->first, value->makeCopy());
+        } else {
+          new_values.insert(assignment_it->first, value->makeCoercedCopy(attr_type));
+        }
+      }
+
+      if (tuple_store_->canSetAttributeValuesInPlaceTyped(*match_it, new_values)) {
+        // Remove the entries which depend on the old values while they can
+        // still be read, and add them back once the new values are set.
+        index_num = 0;
+        for (PtrVector<IndexSubBlock>::iterator it = indices_.begin();
+             it != indices_.end();
+             ++it, ++index_num) {
+          if (index_maintained[index_num] && index_depends_on_update[index_num]) {
+            if (it->supportsAdHocRemove() && it->supportsAdHocAdd()) {
+              it->removeEntry(*match_it);
+            } else {
+              index_maintained[index_num] = false;
+              index_needs_rebuild[index_num] = true;
+            }
+          }
+        }
+
+        for (PtrMap<attribute_id, LiteralTypeInstance>::const_iterator value_it = new_values.begin();
+             value_it != new_values.end();
+             ++value_it) {
+          tuple_store_->setAttributeValueInPlaceTyped(*match_it, value_it->first, *(value_it->second));
+        }
+
+        index_num = 0;
+        for (PtrVector<IndexSubBlock>::iterator it = indices_.begin();
+             it != indices_.end();
+             ++it, ++index_num) {
+          if (index_maintained[index_num] && index_depends_on_update[index_num]) {
+            if (!it->addEntry(*match_it)) {
+              index_maintained[index_num] = false;
+              index_needs_rebuild[index_num] = true;
+            }
+          }
+        }
+
+        if (!bloom_filter_.empty()) {
+          Tuple updated_tuple(*tuple_store_, *match_it, no_updated_values);
+          bloom_filter_->addEntry(updated_tuple);
+        }
+      } else {
+        // Copy the tuple with its new values, and remove its entries from the
+        // indexes while its original values can still be read. The Tuple
+        // takes ownership of the copied values.
+        CompatUnorderedMap<attribute_id, LiteralTypeInstance*>::unordered_map updated_values;
+        for (PtrMap<attribute_id, LiteralTypeInstance>::const_iterator value_it = new_values.begin();
+             value_it != new_values.end();
+             ++value_it) {
+          updated_values[value_it->first] = value_it->second->makeCopy();
+        }
+        relocated_tuples.push_back(new Tuple(*tuple_store_, *match_it, updated_values));
+        relocated_ids.push_back(*match_it);
+
+        index_num = 0;
+        for (PtrVector<IndexSubBlock>::iterator it = indices_.begin();
+             it != indices_.end();
+             ++it, ++index_num) {
+          if (index_maintained[index_num]) {
+            if (it->supportsAdHocRemove()) {
+              it->removeEntry(*match_it);
+            } else {
+              index_maintained[index_num] = false;
+              index_needs_rebuild[index_num] = true;
+            }
+          }
+        }
+      }
+    }
+
+    // As in deleteTuples(), delete in descending order so that the IDs of the
+    // remaining relocated tuples are unchanged.
+    bool ids_mutated = false;
+    for (vector<tuple_id>::const_reverse_iterator it = relocated_ids.rbegin();
+         it != relocated_ids.rend();
+         ++it) {
+      if (tuple_store_->deleteTuple(*it)) {
+        ids_mutated = true;
+      }
+    }
+    dirty_ = true;
+
+    // Entries for a pending batch can no longer simply be added to the
+    // indexes, since entries for existing tuples may have changed.
+    batch_start_tuple_id_ = -1;
+    publishVisibleTuples();
+
+    if (ids_mutated) {
+      retval.indices_consistent = rebuildIndexes(false);
+    } else {
+      all_indices_consistent_ = true;
+      all_indices_inconsistent_ = true;
+      index_num = 0;
+      for (PtrVector<IndexSubBlock>::iterator it = indices_.begin();
+           it != indices_.end();
+           ++it, ++index_num) {
+        if (index_needs_rebuild[index_num]) {
+          block_header_.set_index_consistent(index_num, it->rebuild());
+        }
+        if (block_header_.index_consistent(index_num)) {
+          all_indices_inconsistent_ = false;
+        } else {
+          all_indices_consistent_ = false;
+        }
+      }
+      updateHeader();
+      retval.indices_consistent = all_indices_consistent_;
+    }
+  }
+
+  if (!relocated_tuples.empty()) {
+    retval.relocation_destination_used = true;
+    StorageBlock *relocation_block = relocation_destination->getBlockForInsertion();
+    for (PtrVector<Tuple>::const_iterator it = relocated_tuples.begin(); it != relocated_tuples.end(); ++it) {
+      while (!relocation_block->insertTupleInBatch(*it, kNone)) {
+        if (!relocation_block->rebuild()) {
+          retval.relocation_destination_indices_consistent = false;
+        }
+        relocation_destination->returnBlock(relocation_block, true);
+        relocation_block = relocation_destination->getBlockForInsertion();
+      }
+    }
+
+    if (relocation_block->rebuild()) {
+      relocation_destination->returnBlock(relocation_block, false);
+    } else {
+      retval.relocation_destination_indices_consistent = false;
+      relocation_destination->returnBlock(relocation_block, true);
+    }
+  }
+
+  return retval;
+}
+
 bool StorageBlock::select(const PtrList<Scalar> &selection,
                           const Predicate *predicate,
                           InsertDestination *destination) const {
   // NOTE(chasseur): When the set of matches is small, using the batch-insert
   // path may be suboptimal.
-  ScopedPtr<TupleIdSequence> matches(getMatchesForPredicate(predicate));
+  ScopedPtr<PtrVector<Tuple> > matched_tuples(copyMatchingTuples(selection, predicate));
   bool all_rebuilds_succeeded = true;
-  if (matches->size() > 0) {
+  if (matched_tuples->size() > 0) {
     StorageBlock *result_block = destination->getBlockForInsertion();
-    for (TupleIdSequence::const_iterator it = matches->begin(); it != matches->end(); ++it) {
-      Tuple matched_tuple(*tuple_store_, *it, selection);
-
-      while (!result_block->insertTupleInBatch(matched_tuple, kNone)) {
+    for (PtrVector<Tuple>::const_iterator it = matched_tuples->begin(); it != matched_tuples->end(); ++it) {
+      while (!result_block->insertTupleInBatch(*it, kNone)) {
         if (!result_block->rebuild()) {
           all_rebuilds_succeeded = false;
         }
@@ -278,16 +690,14 @@ bool StorageBlock::select(const PtrList<Scalar> &selection,
 bool StorageBlock::selectSimple(const std::vector<attribute_id> &selection,
                                 const Predicate *predicate,
                                 InsertDestination *destination) const {
-  ScopedPtr<TupleIdSequence> matches(getMatchesForPredicate(predicate));
+  ScopedPtr<PtrVector<Tuple> > matched_tuples(copyMatchingTuples(selection, predicate));
   bool all_rebuilds_succeeded = true;
-  if (matches->size() > 0) {
+  if (matched_tuples->size() > 0) {
     StorageBlock *result_block = destination->getBlockForInsertion();
 
-    for (TupleIdSequence::const_iterator it = matches->begin(); it != matches->end(); ++it) {
-      Tuple matched_tuple(*tuple_store_, *it, selection);
-
+    for (PtrVector<Tuple>::const_iterator it = matched_tuples->begin(); it != matched_tuples->end(); ++it) {
       // FIXME(chasseur): Deal with TupleTooLargeForBlock exception.
-      while (!result_block->insertTupleInBatch(matched_tuple, kNone)) {
+      while (!result_block->insertTupleInBatch(*it, kNone)) {
         if (!result_block->rebuild()) {
           all_rebuilds_succeeded = false;
         }
@@ -339,6 +749,24 @@ TupleStorageSubBlock* StorageBlock::CreateTupleStorageSubBlock(
                                                            new_block,
                                                            sub_block_memory,
                                                            sub_block_memory_size);
+    case TupleStorageSubBlockDescription::PAX_STORE:
+      return new PaxTupleStorageSubBlock(relation,
+                                         description,
+                                         new_block,
+                                         sub_block_memory,
+                                         sub_block_memory_size);
+    case TupleStorageSubBlockDescription::COLUMN_GROUP_STORE:
+      return new ColumnGroupTupleStorageSubBlock(relation,
+                                                 description,
+                                                 new_block,
+                                                 sub_block_memory,
+                                                 sub_block_memory_size);
+    case TupleStorageSubBlockDescription::SLOTTED_PAGE_STORE:
+      return new SlottedPageTupleStorageSubBlock(relation,
+                                                 description,
+                                                 new_block,
+                                                 sub_block_memory,
+                                                 sub_block_memory_size);
     default:
       if (new_block) {
         FATAL_ERROR("A StorageBlockLayout provided an unknown TupleStorageSubBlockType.");
@@ -411,10 +839,12 @@ bool StorageBlock::insertEntryInIndexes(const tuple_id new_tuple) {
       entry_added = it->rebuild();
     }
     if (!entry_added) {
-      // Roll back if index is full.
+      // Roll back if index is full. Concurrent readers ignore the new tuple,
+      // but removing it might disturb the others.
       //
       // NOTE(chasseur): For fragmented indexes, rebuilding might allow
       // success.
+      latch_.upgradeToWrite();
       bool rebuild_some_indices = false;
       for (PtrVector<IndexSubBlock>::iterator fixer_it = indices_.begin();
            fixer_it != it;
@@ -458,6 +888,7 @@ bool StorageBlock::insertEntryInIndexes(const tuple_id new_tuple) {
 }
 
 bool StorageBlock::rebuildIndexes(bool short_circuit) {
+  batch_start_tuple_id_ = -1;
   if (indices_.empty()) {
     return true;
   }
@@ -485,7 +916,60 @@ bool StorageBlock::rebuildIndexes(bool short_circuit) {
   return all_indices_consistent_;
 }
 
+bool StorageBlock::bulkAddEntriesToIndexes() {
+  DEBUG_ASSERT(batch_start_tuple_id_ >= 0);
+  DEBUG_ASSERT(!tuple_store_->batchInsertMutatesTupleIDs());
+
+  TupleIdSequence batch_tuples;
+  for (tuple_id tid = batch_start_tuple_id_; tid <= tuple_store_->getMaxTupleID(); ++tid) {
+    if (tuple_store_->hasTupleWithID(tid)) {
+      batch_tuples.append(tid);
+    }
+  }
+  batch_start_tuple_id_ = -1;
+
+  all_indices_consistent_ = true;
+  all_indices_inconsistent_ = true;
+
+  int index_num = 0;
+  for (PtrVector<IndexSubBlock>::iterator it = indices_.begin();
+       it != indices_.end();
+       ++it, ++index_num) {
+    // If adding entries fails, the index may be partially updated, so fall
+    // back to rebuilding it from scratch.
+    if (it->bulkAddEntries(batch_tuples) || it->rebuild()) {
+      all_indices_inconsistent_ = false;
+      block_header_.set_index_consistent(index_num, true);
+    } else {
+      all_indices_consistent_ = false;
+      block_header_.set_index_consistent(index_num, false);
+    }
+  }
+  updateHeader();
+
+  return all_indices_consistent_;
+}
+
+bool StorageBlock::tupleStoreNeedsMerge() const {
+  return tuple_store_->isCompressed()
+         && static_cast<const CompressedTupleStorageSubBlock&>(*tuple_store_).compressedDeltaNeedsMerge();
+}
+
 TupleIdSequence* StorageBlock::getMatchesForPredicate(const Predicate *predicate) const {
+  // Scan optimistically, and start over if a writer modified this block in
+  // the meantime.
+  for (;;) {
+    const size_t version = latch_.beginRegisteredRead();
+    const tuple_id watermark = getVisibleTupleWatermark();
+    ScopedPtr<TupleIdSequence> matches(getMatchesForPredicateHelper(predicate));
+    if (latch_.endRegisteredRead(version)) {
+      matches->removeAtOrAbove(watermark);
+      return matches.release();
+    }
+  }
+}
+
+TupleIdSequence* StorageBlock::getMatchesForPredicateHelper(const Predicate *predicate) const {
   // TODO(chasseur): Use indexes where possible.
 
   // check to see if bloom filters can allow us to skip this block altogether
@@ -499,6 +983,156 @@ TupleIdSequence* StorageBlock::getMatchesForPredicate(const Predicate *predicate
   return tuple_store_->getMatchesForPredicate(predicate);
 }
 
+TupleIdSequence* StorageBlock::getMatchesForPredicateWithIndexes(
+    const Predicate *predicate,
+    const std::vector<std::size_t> &index_nums) const {
+  if ((predicate == NULL) || predicate->hasStaticResult()) {
+    return getMatchesForPredicate(predicate);
+  }
+
+  for (;;) {
+    const size_t version = latch_.beginRegisteredRead();
+    const tuple_id watermark = getVisibleTupleWatermark();
+
+    vector<const IndexSubBlock*> usable_indexes;
+    for (vector<size_t>::const_iterator index_num_it = index_nums.begin();
+         index_num_it != index_nums.end();
+         ++index_num_it) {
+      DEBUG_ASSERT(*index_num_it < indices_.size());
+      if (block_header_.index_consistent(*index_num_it)) {
+        usable_indexes.push_back(&(indices_[*index_num_it]));
+      }
+    }
+
+    ScopedPtr<TupleIdSequence> matches(GetMatchesForPredicateWithIndexes(*tuple_store_,
+                                                                         usable_indexes,
+                                                                         *predicate));
+    if (matches.empty()) {
+      matches.reset(getMatchesForPredicateHelper(predicate));
+    }
+    if (latch_.endRegisteredRead(version)) {
+      matches->removeAtOrAbove(watermark);
+      return matches.release();
+    }
+  }
+}
+
+TupleIdSequence* StorageBlock::GetMatchesForPredicateWithIndexes(
+    const TupleStorageSubBlock &tuple_store,
+    const std::vector<const IndexSubBlock*> &indexes,
+    const Predicate &predicate) {
+  if (indexes.empty()) {
+    return NULL;
+  }
+
+  if (predicate.getPredicateType() == Predicate::kDisjunction) {
+    // Every disjunct must be evaluated with an index, otherwise a scan is
+    // needed anyway.
+    const PtrList<Predicate> &disjuncts = static_cast<const PredicateWithList&>(predicate).getOperands();
+    vector<const IndexSubBlock*> disjunct_indexes;
+    for (PtrList<Predicate>::const_iterator disjunct_it = disjuncts.begin();
+         disjunct_it != disjuncts.end();
+         ++disjunct_it) {
+      const IndexSubBlock *index = FindIndexForPredicate(indexes, *disjunct_it);
+      if (index == NULL) {
+        return NULL;
+      }
+      disjunct_indexes.push_back(index);
+    }
+
+    TupleIdSequence *matches = new TupleIdSequence();
+    vector<const IndexSubBlock*>::const_iterator index_it = disjunct_indexes.begin();
+    for (PtrList<Predicate>::const_iterator disjunct_it = disjuncts.begin();
+         disjunct_it != disjuncts.end();
+         ++disjunct_it, ++index_it) {
+      ScopedPtr<TupleIdSequence> disjunct_matches(GetExactMatchesFromIndex(tuple_store,
+                                                                          **index_it,
+                                                                          *disjunct_it));
+      matches->unionWith(disjunct_matches.get());
+    }
+    return matches;
+  }
+
+  vector<const Predicate*> conjuncts;
+  if (predicate.getPredicateType() == Predicate::kConjunction) {
+    const PtrList<Predicate> &operands = static_cast<const PredicateWithList&>(predicate).getOperands();
+    for (PtrList<Predicate>::const_iterator operand_it = operands.begin();
+         operand_it != operands.end();
+         ++operand_it) {
+      conjuncts.push_back(&(*operand_it));
+    }
+  } else {
+    conjuncts.push_back(&predicate);
+  }
+
+  // Narrow down the candidate set with each conjunct that can be evaluated by
+  // an index, and remember the rest to check afterwards.
+  ScopedPtr<TupleIdSequence> candidates;
+  vector<const Predicate*> residual_conjuncts;
+  for (vector<const Predicate*>::const_iterator conjunct_it = conjuncts.begin();
+       conjunct_it != conjuncts.end();
+       ++conjunct_it) {
+    const IndexSubBlock *index = FindIndexForPredicate(indexes, **conjunct_it);
+    if (index == NULL) {
+      residual_conjuncts.push_back(*conjunct_it);
+      continue;
+    }
+
+    if (!candidates.empty() && candidates->empty()) {
+      // Nothing left to narrow down.
+      continue;
+    }
+
+    IndexSearchResult result = index->getMatchesForPredicate(**conjunct_it);
+    if (result.is_superset) {
+      residual_conjuncts.push_back(*conjunct_it);
+    }
+    if (candidates.empty()) {
+      candidates.reset(result.sequence);
+    } else {
+      ScopedPtr<TupleIdSequence> conjunct_matches(result.sequence);
+      candidates->intersectWith(conjunct_matches.get());
+    }
+  }
+
+  if (candidates.empty()) {
+    return NULL;
+  }
+
+  if (residual_conjuncts.empty()) {
+    return candidates.release();
+  } else {
+    return FilterMatches(tuple_store, *candidates, residual_conjuncts);
+  }
+}
+
+template <typename SelectionT>
+PtrVector<Tuple>* StorageBlock::copyMatchingTuples(const SelectionT &selection,
+                                                   const Predicate *predicate) const {
+  for (;;) {
+    const size_t version = latch_.beginRegisteredRead();
+    const tuple_id watermark = getVisibleTupleWatermark();
+    ScopedPtr<TupleIdSequence> matches(getMatchesForPredicateHelper(predicate));
+    // Tuples beyond the watermark may still be in the midst of being
+    // appended, so don't copy them.
+    matches->removeAtOrAbove(watermark);
+    ScopedPtr<PtrVector<Tuple> > matched_tuples(new PtrVector<Tuple>());
+    for (TupleIdSequence::const_iterator it = matches->begin(); it != matches->end(); ++it) {
+      // Values in 'matched_tuple' may refer to memory in this block, so make
+      // a copy which is safe from subsequent writers.
+      Tuple matched_tuple(*tuple_store_, *it, selection);
+      matched_tuples->push_back(matched_tuple.clone());
+    }
+    if (latch_.endRegisteredRead(version)) {
+      return matched_tuples.release();
+    }
+  }
+}
+
+void StorageBlock::publishVisibleTuples() {
+  latch_.publishWatermark(static_cast<size_t>(tuple_store_->getMaxTupleID() + 1));
+}
+
 void StorageBlock::updateHeader() {
   DEBUG_ASSERT(*static_cast<const int*>(block_memory_) == block_header_.ByteSize());
 
@@ -21,6 +21,7 @@
 #ifndef QUICKSTEP_STORAGE_STORAGE_BLOCK_HPP_
 #define QUICKSTEP_STORAGE_STORAGE_BLOCK_HPP_
 
+#include <cstddef>
 #include <string>
 #include <vector>
 
@@ -30,11 +31,13 @@
 #include "storage/StorageBlockLayout.pb.h"
 #include "storage/TupleStorageSubBlock.hpp"
 #include "storage/BloomFilterSubBlock.hpp"
+#include "threading/VersionedLatch.hpp"
 #include "types/AllowedTypeConversion.hpp"
 #include "types/Tuple.hpp"
 #include "utility/ContainerCompat.hpp"
 #include "utility/Macros.hpp"
 #include "utility/PtrList.hpp"
+#include "utility/PtrMap.hpp"
 #include "utility/PtrVector.hpp"
 #include "utility/ScopedPtr.hpp"
 
@@ -49,6 +52,7 @@ class Scalar;
 class StorageBlockLayout;
 class StorageManager;
 class Tuple;
+class TupleBatch;
 class TupleIdSequence;
 
 namespace storage_explorer {
@@ -62,6 +66,23 @@ class BlockBasedQueryExecutor;
 /**
  * @brief Top-level storage block, which contains exactly one
  *        TupleStorageSubBlock and any number of IndexSubBlocks.
+ * @note Methods which modify a StorageBlock (insertTuple(),
+ *       insertTupleInBatch(), bulkInsertTuples(), deleteTuples(), update(),
+ *       and rebuild()) are serialized by a VersionedLatch, so that several
+ *       threads may insert into the same block. Methods which only read a
+ *       StorageBlock (getMatchesForPredicate(), select(), and selectSimple())
+ *       are registered readers of the latch (see
+ *       VersionedLatch::beginRegisteredRead()): they run concurrently with
+ *       inserts which only append, but a writer which modifies tuples in
+ *       place or rebuilds the block waits for them to finish, and new
+ *       readers wait for that writer. Accessing the sub-blocks directly (e.g.
+ *       via getTupleStorageSubBlock()) is not protected in this way.
+ * @note Readers see a snapshot of the tuples below the visible tuple
+ *       watermark (see getVisibleTupleWatermark()) as of when they began.
+ *       An insert which only appends a new tuple (see
+ *       TupleStorageSubBlock::nextInsertAppends()) raises the watermark once
+ *       it is finished, and does not make readers start over, so scans are
+ *       not starved by a steady stream of inserts.
  **/
 class StorageBlock {
  public:
@@ -199,6 +220,15 @@ class StorageBlock {
     return relation_;
   }
 
+  /**
+   * @brief Get the description of the layout this block was created with.
+   *
+   * @return This block's StorageBlockLayoutDescription.
+   **/
+  const StorageBlockLayoutDescription& getLayoutDescription() const {
+    return block_header_.layout();
+  }
+
   /**
    * @brief Get this block's TupleStorageSubBlock.
    *
@@ -218,7 +248,8 @@ class StorageBlock {
    *        debug builds, and in general should happen elsewhere (i.e in the
    *        query optimizer).
    * @return true if the tuple was successfully inserted, false if insertion
-   *         failed (e.g. because of not enough space).
+   *         failed (e.g. because of not enough space, or because this block
+   *         has been retired).
    * @exception TupleTooLargeForBlock Even though this block was initially
    *            empty, the tuple was too large to insert. Only thrown if block
    *            is initially empty, otherwise failure to insert simply returns
@@ -245,7 +276,8 @@ class StorageBlock {
    *        debug builds, and in general should happen elsewhere (i.e in the
    *        query optimizer).
    * @return true if the tuple was successfully inserted, false if insertion
-   *         failed (e.g. because of not enough space).
+   *         failed (e.g. because of not enough space, or because this block
+   *         has been retired).
    * @exception TupleTooLargeForBlock Even though this block was initially
    *            empty, the tuple was too large to insert. Only thrown if block
    *            is initially empty, otherwise failure to insert simply returns
@@ -253,6 +285,84 @@ class StorageBlock {
    **/
   bool insertTupleInBatch(const Tuple &tuple, const AllowedTypeConversion atc);
 
+  /**
+   * @brief Insert as many tuples from a TupleBatch as will fit into this
+   *        block as part of a batch, copying their values directly from the
+   *        batch's buffers rather than building a Tuple for each of them.
+   * @note The bloom filter, if any, is updated for all of the inserted tuples
+   *       at once, and they become visible to readers together.
+   * @warning The same restrictions apply as for insertTupleInBatch(), and
+   *          rebuild() MUST be called on this block once the batch is
+   *          finished.
+   *
+   * @param batch The tuples to insert, which must belong to this block's
+   *        relation.
+   * @param first_tuple The position in batch of the first tuple to insert.
+   * @return The number of tuples which were inserted, starting at
+   *         first_tuple. If it is less than batch.size() - first_tuple, this
+   *         block is full (or has been retired), and the remaining tuples
+   *         should be inserted into another block.
+   * @exception TupleTooLargeForBlock Even though this block was initially
+   *            empty, not even one tuple could be inserted.
+   **/
+  tuple_id bulkInsertTuples(const TupleBatch &batch, const tuple_id first_tuple);
+
+  /**
+   * @brief Delete all the tuples in this StorageBlock which match a
+   *        predicate.
+   * @note If the TupleStorageSubBlock does not mutate tuple IDs when deleting
+   *       (e.g. because it leaves deleted tuples in place until rebuild()),
+   *       the entries for the deleted tuples are simply removed from those
+   *       IndexSubBlocks which support ad-hoc removal, and only the others are
+   *       rebuilt. Otherwise, all IndexSubBlocks are rebuilt.
+   *
+   * @param predicate The predicate to match. NULL indicates that all tuples
+   *        should be deleted.
+   * @exception BlockRetired This block has been retired (see markRetired()),
+   *            so nothing was deleted.
+   *
+   * @return true if all IndexSubBlocks in this StorageBlock are consistent
+   *         afterwards, false otherwise (see indicesAreConsistent()).
+   **/
+  bool deleteTuples(const Predicate *predicate);
+
+  /**
+   * @brief Update some attribute values for all the tuples in this
+   *        StorageBlock which match a predicate.
+   * @note Tuples whose new values can be written in place (see
+   *       TupleStorageSubBlock::canSetAttributeValuesInPlaceTyped()) keep
+   *       their tuple IDs, and only their entries in those IndexSubBlocks
+   *       which depend on the updated attributes are removed and re-added.
+   *       Other tuples (e.g. those whose size or position in a sort order
+   *       would change) are deleted from this StorageBlock and inserted into
+   *       relocation_destination.
+   * @warning In some edge cases, this method may cause IndexSubBlocks in this
+   *          StorageBlock to become inconsistent (the TupleStorageSubBlock
+   *          will still be completely consistent, though). Check the
+   *          indices_consistent member of the return value.
+   *
+   * @param assignments A map from the IDs of the attributes to update to
+   *        Scalars which are evaluated (against the original values of each
+   *        matching tuple) to get the new values of those attributes.
+   * @param predicate A predicate for selection. NULL indicates that all tuples
+   *        should be matched.
+   * @param relocation_destination Where to insert updated tuples which can
+   *        not remain in this StorageBlock. Must insert into the same
+   *        relation as this StorageBlock.
+   * @exception TupleTooLargeForBlock A tuple which had to be relocated was too
+   *            large to insert into an empty block provided by
+   *            relocation_destination.
+   * @exception BlockRetired This block has been retired (see markRetired()),
+   *            so nothing was updated.
+   *
+   * @return An UpdateResult indicating whether the IndexSubBlocks in this
+   *         StorageBlock and in any blocks from relocation_destination are
+   *         consistent after the update.
+   **/
+  UpdateResult update(const PtrMap<attribute_id, Scalar> &assignments,
+                      const Predicate *predicate,
+                      InsertDestination *relocation_destination);
+
   /**
    * @brief Perform a SELECT query on this StorageBlock.
    *
@@ -304,21 +414,195 @@ class StorageBlock {
    * @brief Rebuild all SubBlocks in this StorageBlock, compacting storage
    *        and reordering tuples where applicable and rebuilding indexes from
    *        scratch.
+   * @note If the indexes were consistent before a batch of tuples was
+   *       inserted with insertTupleInBatch(), and the TupleStorageSubBlock
+   *       does not mutate tuple IDs when it is rebuilt (see
+   *       TupleStorageSubBlock::batchInsertMutatesTupleIDs()), then entries
+   *       for just the tuples in the batch are added to the existing indexes
+   *       with IndexSubBlock::bulkAddEntries() instead of rebuilding them.
    * @note This method may use an unbounded amount of out-of-band memory.
    * @note Even when rebuilding fails, the TupleStorageSubBlock will be
    *       consistent, and all tuples can be accessed via
    *       getTupleStorageSubBlock().
+   * @warning Rebuilding may free and reallocate structures of the
+   *          TupleStorageSubBlock (e.g. merging a compressed block's delta
+   *          region rebuilds its dictionaries). It waits for readers of this
+   *          block to finish and stalls new ones until it is done, but
+   *          clients which access the sub-blocks directly outside of a read
+   *          section (see beginRead()) must not run concurrently with it. A
+   *          block which is being scanned should preferably be rebuilt by
+   *          copying its tuples into a new block and swapping that into the
+   *          relation (as BlockPoolInsertDestination does).
    *
    * @return True if rebuilding succeeded, false if one of the IndexSubBlocks
    *         ran out of space.
    **/
   bool rebuild() {
+    VersionedLatchWriteLock lock(latch_);
+    if (tuple_store_->batchInsertMutatesTupleIDs()) {
+      // Rebuilding the TupleStorageSubBlock may compact away deleted tuples,
+      // renumbering the tuples in the batch.
+      batch_start_tuple_id_ = -1;
+    }
     tuple_store_->rebuild();
-    return rebuildIndexes(false);
+    publishVisibleTuples();
+    if (batch_start_tuple_id_ >= 0) {
+      return bulkAddEntriesToIndexes();
+    } else {
+      return rebuildIndexes(false);
+    }
+  }
+
+  /**
+   * @brief Check whether the TupleStorageSubBlock is compressed and has
+   *        enough tuples buffered in its uncompressed delta region that they
+   *        should be merged into the compressed tuples.
+   * @note This is cheap, so that an InsertDestination can check it each time
+   *       a block is returned and schedule the merge in the background.
+   * @note rebuild() merges the delta in place, stalling scans of this block
+   *       until it is done (see the warning on rebuild()).
+   *
+   * @return Whether the delta region should be merged.
+   **/
+  bool tupleStoreNeedsMerge() const;
+
+  /**
+   * @brief Get the visible tuple watermark, i.e. one more than the highest ID
+   *        of the tuples whose insertion has finished.
+   * @note A reader which accesses the TupleStorageSubBlock directly should
+   *       get the watermark before it begins, and ignore tuples with IDs at
+   *       or above it, which may be in the midst of being appended. The
+   *       tuples below the watermark are stable so long as only appends are
+   *       made to this block.
+   *
+   * @return The visible tuple watermark.
+   **/
+  tuple_id getVisibleTupleWatermark() const {
+    return static_cast<tuple_id>(latch_.getWatermark());
+  }
+
+  /**
+   * @brief Get the VersionedLatch which serializes writers of this block.
+   * @note A client which reads the sub-blocks directly (e.g. to copy this
+   *       block's tuples elsewhere) can hold it with a
+   *       VersionedLatchAppendLock to keep writers out without disturbing
+   *       concurrent readers. Methods of this block which modify it must not
+   *       be called while the latch is held.
+   *
+   * @return The latch which serializes writers of this block.
+   **/
+  VersionedLatch* getLatchMutable() {
+    return &latch_;
+  }
+
+  /**
+   * @brief Mark this block as retired, once it has been swapped out of its
+   *        relation (e.g. by a BlockCompactor or a BlockPoolInsertDestination
+   *        merging its delta region), so that no write to it is lost.
+   *        Afterwards, inserts fail as if this block were full, and
+   *        deleteTuples() and update() throw BlockRetired.
+   * @warning The caller must hold the latch (see getLatchMutable()), so that
+   *          a writer which is waiting for it sees the mark once it gets it.
+   **/
+  void markRetired() {
+    retired_ = true;
+  }
+
+  /**
+   * @brief Check whether this block has been retired (see markRetired()).
+   * @note Unless the latch is held, a block may be retired as soon as this
+   *       returns false. Writers check again once they have the latch.
+   *
+   * @return Whether this block has been retired.
+   **/
+  bool isRetired() const {
+    return retired_;
   }
 
+  /**
+   * @brief Begin a read section, in which the sub-blocks of this block may be
+   *        accessed directly (e.g. via getTupleStorageSubBlock()) without
+   *        being disturbed by writers which modify them in place or rebuild
+   *        them.
+   * @note Tuples at or above the visible tuple watermark (see
+   *       getVisibleTupleWatermark()) may be in the midst of being appended,
+   *       and should be ignored.
+   * @warning Every call must be matched by a call to endRead(), and nothing
+   *          may be written to any StorageBlock in between (see
+   *          VersionedLatch::beginRegisteredRead()).
+   *
+   * @return The version to pass to endRead().
+   **/
+  std::size_t beginRead() const {
+    return latch_.beginRegisteredRead();
+  }
+
+  /**
+   * @brief End a read section begun with beginRead().
+   *
+   * @param version The version returned by beginRead().
+   * @return Whether everything read in the section is consistent. If not,
+   *         the reads should be repeated in a new section.
+   **/
+  bool endRead(const std::size_t version) const {
+    return latch_.endRegisteredRead(version);
+  }
+
+  /**
+   * @brief Get the IDs of tuples in this StorageBlock which match a
+   *        predicate.
+   *
+   * @param predicate The predicate to match. NULL indicates that all tuples
+   *        should be matched.
+   * @return The IDs of tuples which match predicate. Caller takes ownership.
+   **/
   TupleIdSequence* getMatchesForPredicate(const Predicate *predicate) const;
 
+  /**
+   * @brief Get the IDs of tuples in this StorageBlock which match a
+   *        predicate, using some of this StorageBlock's IndexSubBlocks to
+   *        evaluate as much of the predicate as possible.
+   * @note See GetMatchesForPredicateWithIndexes() for how the predicate is
+   *       divided among indexes. Indexes which are not currently consistent
+   *       are skipped. If no usable index can evaluate any part of predicate,
+   *       this is the same as getMatchesForPredicate().
+   *
+   * @param predicate The predicate to match. NULL indicates that all tuples
+   *        should be matched.
+   * @param index_nums The positions of the IndexSubBlocks to use, in the
+   *        order they appear in this StorageBlock's layout.
+   * @return The IDs of tuples which match predicate. Caller takes ownership.
+   **/
+  TupleIdSequence* getMatchesForPredicateWithIndexes(const Predicate *predicate,
+                                                     const std::vector<std::size_t> &index_nums) const;
+
+  /**
+   * @brief Evaluate a predicate on a TupleStorageSubBlock with the help of
+   *        any number of IndexSubBlocks on it.
+   * @note If predicate is a ConjunctionPredicate, each conjunct which one of
+   *       indexes can evaluate is looked up in that index, and the resulting
+   *       sequences are intersected by a sort-merge. If predicate is a
+   *       DisjunctionPredicate and every disjunct can be evaluated by one of
+   *       indexes, the resulting sequences are merged into their union.
+   *       Conjuncts which no index can evaluate, and conjuncts or disjuncts
+   *       for which an index returned a superset of the matching tuples, are
+   *       then rechecked on the surviving tuples only. Any other predicate is
+   *       simply looked up in the first index which can evaluate it.
+   *
+   * @param tuple_store The TupleStorageSubBlock to find matching tuples in.
+   * @param indexes IndexSubBlocks on tuple_store which may be used. Each
+   *        part of predicate is evaluated by the first of indexes which can
+   *        evaluate it.
+   * @param predicate The predicate to match.
+   * @return The IDs of tuples in tuple_store which match predicate, or NULL if
+   *         none of indexes can evaluate any part of predicate (in which case
+   *         the caller should fall back to a scan). Caller takes ownership.
+   **/
+  static TupleIdSequence* GetMatchesForPredicateWithIndexes(
+      const TupleStorageSubBlock &tuple_store,
+      const std::vector<const IndexSubBlock*> &indexes,
+      const Predicate &predicate);
+
  private:
   static TupleStorageSubBlock* CreateTupleStorageSubBlock(
       const CatalogRelation &relation,
@@ -356,6 +640,28 @@ class StorageBlock {
   // StorageBlock's header.
   bool rebuildIndexes(bool short_circuit);
 
+  // Add entries for the batch of tuples from 'batch_start_tuple_id_' onwards
+  // to all IndexSubBlocks in this StorageBlock with bulkAddEntries(). Indexes
+  // which fail to add entries are rebuilt from scratch. Returns true if all
+  // indexes are consistent afterwards.
+  bool bulkAddEntriesToIndexes();
+
+  // Does the actual work of getMatchesForPredicate() without checking for
+  // concurrent writers.
+  TupleIdSequence* getMatchesForPredicateHelper(const Predicate *predicate) const;
+
+  // Make deep copies of the tuples matching 'predicate' (NULL matches all
+  // tuples), projected or evaluated according to 'selection'. Tuples are read
+  // optimistically, starting over if a writer intervened, so the copies may
+  // safely be used after this method returns. Caller takes ownership.
+  template <typename SelectionT>
+  PtrVector<Tuple>* copyMatchingTuples(const SelectionT &selection,
+                                       const Predicate *predicate) const;
+
+  // Publish the visible tuple watermark for readers after modifying the
+  // TupleStorageSubBlock. The caller must hold 'latch_'.
+  void publishVisibleTuples();
+
   void updateHeader();
   void invalidateAllIndexes();
 
@@ -377,6 +683,21 @@ class StorageBlock {
   bool ad_hoc_insert_supported_;
   bool ad_hoc_insert_efficient_;
 
+  // If a batch of tuples is being inserted via insertTupleInBatch(), the
+  // indexes were consistent before the batch, and the TupleStorageSubBlock
+  // does not mutate existing tuple IDs on rebuild(), then this is the ID of
+  // the first tuple in the batch. Otherwise -1.
+  tuple_id batch_start_tuple_id_;
+
+  // Held for writing by any method which modifies this block (or for
+  // appending, if it only appends a tuple). Readers validate against this
+  // latch's version, and its watermark is the visible tuple watermark.
+  VersionedLatch latch_;
+
+  // Set (with 'latch_' held) once this block has been swapped out of its
+  // relation. Writers check it once they hold 'latch_'.
+  volatile bool retired_;
+
   friend class storage_explorer::BlockBasedQueryExecutor;
 
   DISALLOW_COPY_AND_ASSIGN(StorageBlock);
@@ -26,7 +26,10 @@ const char *kTupleStorageSubBlockTypeNames[] = {
   "PackedRowStore",
   "BasicColumnStore",
   "CompressedPackedRowStore",
-  "CompressedColumnStore"
+  "CompressedColumnStore",
+  "PaxStore",
+  "ColumnGroupStore",
+  "SlottedPageStore"
 };
 
 const char *kIndexSubBlockTypeNames[] = {
@@ -52,6 +52,9 @@ enum TupleStorageSubBlockType {
   kBasicColumnStore,
   kCompressedPackedRowStore,
   kCompressedColumnStore,
+  kPaxStore,
+  kColumnGroupStore,
+  kSlottedPageStore,
   kNumTupleStorageSubBlockTypes  // Not an actual TupleStorageSubBlockType, exists for counting purposes.
 };
 
@@ -26,10 +26,13 @@
 
 #include "catalog/CatalogRelation.hpp"
 #include "storage/BasicColumnStoreTupleStorageSubBlock.hpp"
+#include "storage/ColumnGroupTupleStorageSubBlock.hpp"
 #include "storage/CompressedColumnStoreTupleStorageSubBlock.hpp"
 #include "storage/CompressedPackedRowStoreTupleStorageSubBlock.hpp"
 #include "storage/CSBTreeIndexSubBlock.hpp"
 #include "storage/PackedRowStoreTupleStorageSubBlock.hpp"
+#include "storage/PaxTupleStorageSubBlock.hpp"
+#include "storage/SlottedPageTupleStorageSubBlock.hpp"
 #include "storage/BloomFilterSubBlock.hpp"
 #include "storage/StorageBlockLayout.pb.h"
 #include "storage/StorageConstants.hpp"
@@ -99,6 +102,21 @@ void StorageBlockLayout::finalize() {
           = CompressedColumnStoreTupleStorageSubBlock::EstimateBytesPerTuple(relation_,
                                                                              tuple_store_description);
       break;
+    case TupleStorageSubBlockDescription::PAX_STORE:
+      tuple_store_size_factor
+          = PaxTupleStorageSubBlock::EstimateBytesPerTuple(relation_,
+                                                           tuple_store_description);
+      break;
+    case TupleStorageSubBlockDescription::COLUMN_GROUP_STORE:
+      tuple_store_size_factor
+          = ColumnGroupTupleStorageSubBlock::EstimateBytesPerTuple(relation_,
+                                                                   tuple_store_description);
+      break;
+    case TupleStorageSubBlockDescription::SLOTTED_PAGE_STORE:
+      tuple_store_size_factor
+          = SlottedPageTupleStorageSubBlock::EstimateBytesPerTuple(relation_,
+                                                                   tuple_store_description);
+      break;
     default:
       FATAL_ERROR("Unknown TupleStorageSubBlockType encountered in StorageBlockLayout::finalize()");
   }
@@ -221,6 +239,21 @@ bool StorageBlockLayout::DescriptionIsValid(const CatalogRelation &relation,
         return false;
       }
       break;
+    case TupleStorageSubBlockDescription::PAX_STORE:
+      if (!PaxTupleStorageSubBlock::DescriptionIsValid(relation, tuple_store_description)) {
+        return false;
+      }
+      break;
+    case TupleStorageSubBlockDescription::COLUMN_GROUP_STORE:
+      if (!ColumnGroupTupleStorageSubBlock::DescriptionIsValid(relation, tuple_store_description)) {
+        return false;
+      }
+      break;
+    case TupleStorageSubBlockDescription::SLOTTED_PAGE_STORE:
+      if (!SlottedPageTupleStorageSubBlock::DescriptionIsValid(relation, tuple_store_description)) {
+        return false;
+      }
+      break;
     default:
       return false;
   }
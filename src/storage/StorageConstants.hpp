@@ -32,10 +32,43 @@ namespace quickstep {
 const std::size_t kSlotSizeBytes = 0x100000;  // 1 MB
 const std::size_t kAllocationChunkSizeSlots = 256;
 
-// Should always be a power of two. 64 bytes is the cache-line size for most
-// modern CPUs.
+// The default node size for CSBTreeIndexSubBlocks. Should always be a power
+// of two. 64 bytes is the cache-line size for most modern CPUs.
 const std::size_t kCSBTreeNodeSizeBytes = 64;
 
+// Limits on the node size which may be specified for an individual
+// CSBTreeIndexSubBlock. Nodes should always span a whole number of cache
+// lines. Very large nodes make node groups too big to fit many of them in a
+// block.
+const std::size_t kCSBTreeMinNodeSizeBytes = 64;
+const std::size_t kCSBTreeMaxNodeSizeBytes = 1024;
+
+// The default mini-page size for PaxTupleStorageSubBlocks. Small enough that
+// all the values of a tuple are within a few KB of each other, but large
+// enough that scanning each column's minipartition uses whole cache lines.
+const std::size_t kPaxMinipageSizeBytes = 4096;
+
+// The maximum number of blocks whose compressed delta regions a
+// BlockPoolInsertDestination merges concurrently in the background.
+const std::size_t kMaxConcurrentDeltaMerges = 2;
+
+// A LayoutAdvisor recommends a column store if queries project at most this
+// fraction of a relation's attributes on average, and a row store otherwise.
+const double kLayoutAdvisorColumnarProjectionFraction = 0.5;
+
+// A LayoutAdvisor recommends a CSBTreeIndexSubBlock on the most frequently
+// filtered attribute if the average selectivity of predicates on it is at most
+// this (above it, scanning is typically faster than probing an index).
+const double kLayoutAdvisorIndexMaxSelectivity = 0.01;
+
+// A LayoutAdvisor recommends an uncompressed TupleStorageSubBlock if more than
+// this many tuples are inserted per query, since every rebuild() of a
+// compressed block recompresses all of its tuples. Below that, if there are
+// any inserts, it reserves kLayoutAdvisorDeltaRegionFraction of a compressed
+// TupleStorageSubBlock for an uncompressed delta region.
+const double kLayoutAdvisorMaxInsertsPerQueryForCompression = 1000.0;
+const double kLayoutAdvisorDeltaRegionFraction = 0.125;
+
 /** @} */
 
 }  // namespace quickstep
@@ -67,6 +67,18 @@ class MalformedBlock : public std::exception {
   }
 };
 
+/**
+ * @brief Exception thrown when attempting to modify a block which has been
+ *        retired (i.e. swapped out of its relation, see
+ *        StorageBlock::markRetired()).
+ **/
+class BlockRetired : public std::exception {
+ public:
+  virtual const char* what() const throw() {
+    return "BlockRetired: Attempted to modify a block which has been swapped out of its relation";
+  }
+};
+
 /**
  * @brief Exception thrown when attempting to insert a tuple which is so large
  *        that it can't fit in an empty block.
@@ -58,6 +58,8 @@ block_id StorageManager::createBlock(const CatalogRelation &relation,
 
   size_t num_slots = layout->getDescription().num_slots();
   DEBUG_ASSERT(num_slots > 0);
+
+  MutexLock lock(mutex_);
   size_t slot_index = getSlots(num_slots);
   void *new_block_mem = getSlotAddress(slot_index);
   ++block_index_;
@@ -77,6 +79,7 @@ block_id StorageManager::createBlock(const CatalogRelation &relation,
 }
 
 bool StorageManager::blockIsLoaded(const block_id block) const {
+  MutexLock lock(mutex_);
   if (blocks_.find(block) == blocks_.end()) {
     return false;
   } else {
@@ -85,6 +88,7 @@ bool StorageManager::blockIsLoaded(const block_id block) const {
 }
 
 void StorageManager::evictBlock(const block_id block) {
+  MutexLock lock(mutex_);
   CompatUnorderedMap<block_id, BlockHandle>::unordered_map::iterator block_it = blocks_.find(block);
 
   if (block_it == blocks_.end()) {
@@ -100,6 +104,7 @@ void StorageManager::evictBlock(const block_id block) {
 }
 
 StorageBlock* StorageManager::getBlockMutable(const block_id block) const {
+  MutexLock lock(mutex_);
   CompatUnorderedMap<block_id, BlockHandle>::unordered_map::const_iterator it = blocks_.find(block);
 
   if (it == blocks_.end()) {
@@ -25,6 +25,7 @@
 
 #include "storage/StorageBlockInfo.hpp"
 #include "storage/StorageConstants.hpp"
+#include "threading/Mutex.hpp"
 #include "utility/ContainerCompat.hpp"
 #include "utility/Macros.hpp"
 
@@ -41,6 +42,11 @@ class StorageBlockLayout;
 /**
  * @brief A class which manages block storage in memory and is responsible for
  *        creating, saving, and loading StorageBlock instances.
+ * @note Blocks may be created, evicted, and looked up concurrently from
+ *       multiple threads (e.g. by a BlockCompactor running in the background
+ *       while queries execute). Accessing the contents of a block is not
+ *       synchronized by the StorageManager, however, and a block must not be
+ *       evicted while any other thread may still be using it.
  **/
 class StorageManager {
  public:
@@ -64,6 +70,7 @@ class StorageManager {
    *         bytes.
    **/
   std::size_t getMemorySize() const {
+    MutexLock lock(mutex_);
     return kSlotSizeBytes * kAllocationChunkSizeSlots * alloc_chunks_.size();
   }
 
@@ -124,6 +131,9 @@ class StorageManager {
   std::size_t getSlots(std::size_t num_slots);
   void allocChunk();
 
+  // Protects all of the members below.
+  mutable Mutex mutex_;
+
   block_id block_index_;
 
   CompatUnorderedMap<block_id, BlockHandle>::unordered_map blocks_;
@@ -0,0 +1,83 @@
+/*
+   This file copyright (c) 2011-2013, the Quickstep authors.
+   See file CREDITS.txt for details.
+
+   This file is part of Quickstep.
+
+   Quickstep is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Quickstep is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Quickstep.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "storage/TupleBatch.hpp"
+
+#include <cstddef>
+#include <vector>
+
+#include "catalog/CatalogAttribute.hpp"
+#include "catalog/CatalogRelation.hpp"
+#include "storage/StorageBlockInfo.hpp"
+#include "types/Type.hpp"
+#include "utility/Macros.hpp"
+
+namespace quickstep {
+
+TupleBatch::TupleBatch(const CatalogRelation &relation, const tuple_id num_tuples)
+    : relation_(relation),
+      num_tuples_(num_tuples),
+      column_major_(true),
+      rows_(NULL),
+      row_null_flags_(NULL),
+      row_length_(0),
+      null_flags_per_row_(0),
+      column_values_(relation.getMaxAttributeId() + 1, NULL),
+      column_null_flags_(relation.getMaxAttributeId() + 1, NULL) {
+  initialize();
+}
+
+TupleBatch::TupleBatch(const CatalogRelation &relation,
+                       const tuple_id num_tuples,
+                       const void *rows,
+                       const bool *null_flags)
+    : relation_(relation),
+      num_tuples_(num_tuples),
+      column_major_(false),
+      rows_(static_cast<const char*>(rows)),
+      row_null_flags_(null_flags),
+      row_length_(relation.getFixedByteLength()),
+      null_flags_per_row_(relation.getMaxAttributeId() + 1) {
+  initialize();
+}
+
+void TupleBatch::setColumn(const attribute_id attr, const void *values, const bool *null_flags) {
+  DEBUG_ASSERT(column_major_);
+  DEBUG_ASSERT(relation_.hasAttributeWithId(attr));
+  column_values_[attr] = static_cast<const char*>(values);
+  column_null_flags_[attr] = null_flags;
+}
+
+void TupleBatch::initialize() {
+  if (relation_.isVariableLength()) {
+    FATAL_ERROR("Attempted to construct a TupleBatch for a variable-length relation.");
+  }
+
+  attribute_lengths_.resize(relation_.getMaxAttributeId() + 1, 0);
+  attribute_offsets_.resize(relation_.getMaxAttributeId() + 1, 0);
+  for (CatalogRelation::const_iterator attr_it = relation_.begin();
+       attr_it != relation_.end();
+       ++attr_it) {
+    attribute_lengths_[attr_it->getID()] = attr_it->getType().maximumByteLength();
+    attribute_offsets_[attr_it->getID()] = relation_.getFixedLengthAttributeOffset(attr_it->getID());
+  }
+}
+
+}  // namespace quickstep
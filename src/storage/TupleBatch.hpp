@@ -0,0 +1,211 @@
+/*
+   This file copyright (c) 2011-2013, the Quickstep authors.
+   See file CREDITS.txt for details.
+
+   This file is part of Quickstep.
+
+   Quickstep is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Quickstep is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Quickstep.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICKSTEP_STORAGE_TUPLE_BATCH_HPP_
+#define QUICKSTEP_STORAGE_TUPLE_BATCH_HPP_
+
+#include <cstddef>
+#include <vector>
+
+#include "catalog/CatalogTypedefs.hpp"
+#include "storage/StorageBlockInfo.hpp"
+#include "utility/Macros.hpp"
+
+namespace quickstep {
+
+class CatalogRelation;
+
+/** \addtogroup Storage
+ *  @{
+ */
+
+/**
+ * @brief A batch of tuples of a fixed-length relation, laid out in caller-
+ *        owned buffers, which can be bulk-inserted into a StorageBlock without
+ *        building a Tuple for each of them.
+ * @note A batch is either column-major, with one array of values per
+ *       attribute (each value taking the attribute type's maximumByteLength()
+ *       bytes), or row-major, with each tuple in the same format as a tuple
+ *       in a PackedRowStoreTupleStorageSubBlock (i.e. values at
+ *       CatalogRelation::getFixedLengthAttributeOffset() within rows of
+ *       CatalogRelation::getFixedByteLength() bytes).
+ * @note A TupleBatch does not copy or take ownership of the buffers, which
+ *       must remain valid for as long as it is used.
+ **/
+class TupleBatch {
+ public:
+  /**
+   * @brief Constructor for a column-major batch. setColumn() must be called
+   *        for every attribute of relation before the batch is used.
+   *
+   * @param relation The relation which the tuples belong to, which must not
+   *        be variable-length.
+   * @param num_tuples The number of tuples in the batch.
+   **/
+  TupleBatch(const CatalogRelation &relation, const tuple_id num_tuples);
+
+  /**
+   * @brief Constructor for a row-major batch.
+   *
+   * @param relation The relation which the tuples belong to, which must not
+   *        be variable-length.
+   * @param num_tuples The number of tuples in the batch.
+   * @param rows num_tuples rows in the relation's fixed-length row format.
+   * @param null_flags If not NULL, an array of
+   *        (relation.getMaxAttributeId() + 1) flags for each row, indexed by
+   *        attribute ID, which are true for NULL values. If NULL, no value in
+   *        the batch is NULL.
+   **/
+  TupleBatch(const CatalogRelation &relation,
+             const tuple_id num_tuples,
+             const void *rows,
+             const bool *null_flags);
+
+  /**
+   * @brief Destructor.
+   **/
+  ~TupleBatch() {
+  }
+
+  /**
+   * @brief Set the values of an attribute in a column-major batch.
+   *
+   * @param attr The ID of the attribute.
+   * @param values An array of size() values of attr.
+   * @param null_flags If not NULL, an array of size() flags which are true for
+   *        NULL values. If NULL, no value of attr in the batch is NULL.
+   **/
+  void setColumn(const attribute_id attr, const void *values, const bool *null_flags);
+
+  /**
+   * @brief Get the relation which the tuples in this batch belong to.
+   *
+   * @return The relation which the tuples in this batch belong to.
+   **/
+  const CatalogRelation& getRelation() const {
+    return relation_;
+  }
+
+  /**
+   * @brief Get the number of tuples in this batch.
+   *
+   * @return The number of tuples in this batch.
+   **/
+  tuple_id size() const {
+    return num_tuples_;
+  }
+
+  /**
+   * @brief Determine whether this batch is column-major or row-major.
+   *
+   * @return True if this batch is column-major, false if it is row-major.
+   **/
+  bool isColumnMajor() const {
+    return column_major_;
+  }
+
+  /**
+   * @brief Get the rows of a row-major batch.
+   *
+   * @return A pointer to the first row of this batch.
+   **/
+  const char* getRows() const {
+    DEBUG_ASSERT(!column_major_);
+    return rows_;
+  }
+
+  /**
+   * @brief Get the values of an attribute in a column-major batch.
+   *
+   * @param attr The ID of the attribute.
+   * @return A pointer to the value of attr in the first tuple of this batch.
+   **/
+  const char* getColumnValues(const attribute_id attr) const {
+    DEBUG_ASSERT(column_major_);
+    DEBUG_ASSERT(column_values_[attr] != NULL);
+    return column_values_[attr];
+  }
+
+  /**
+   * @brief Determine whether the value of an attribute in a tuple in this
+   *        batch is NULL.
+   *
+   * @param tuple The position of the tuple in this batch.
+   * @param attr The ID of the attribute.
+   * @return Whether the value of attr in tuple is NULL.
+   **/
+  inline bool isNull(const tuple_id tuple, const attribute_id attr) const {
+    DEBUG_ASSERT((tuple >= 0) && (tuple < num_tuples_));
+    if (column_major_) {
+      return (column_null_flags_[attr] != NULL) && column_null_flags_[attr][tuple];
+    } else {
+      return (row_null_flags_ != NULL) && row_null_flags_[tuple * null_flags_per_row_ + attr];
+    }
+  }
+
+  /**
+   * @brief Get the (untyped) value of an attribute in a tuple in this batch.
+   *
+   * @param tuple The position of the tuple in this batch.
+   * @param attr The ID of the attribute.
+   * @return A pointer to the value of attr in tuple, or NULL if it is NULL.
+   **/
+  inline const void* getValue(const tuple_id tuple, const attribute_id attr) const {
+    if (isNull(tuple, attr)) {
+      return NULL;
+    }
+    if (column_major_) {
+      return column_values_[attr] + tuple * attribute_lengths_[attr];
+    } else {
+      return rows_ + tuple * row_length_ + attribute_offsets_[attr];
+    }
+  }
+
+ private:
+  // Check that 'relation_' is fixed-length and cache the length and row
+  // offset of each attribute.
+  void initialize();
+
+  const CatalogRelation &relation_;
+  const tuple_id num_tuples_;
+  const bool column_major_;
+
+  // Indexed by attribute ID.
+  std::vector<std::size_t> attribute_lengths_;
+  std::vector<std::size_t> attribute_offsets_;
+
+  // Only used for a row-major batch.
+  const char *rows_;
+  const bool *row_null_flags_;
+  std::size_t row_length_;
+  std::size_t null_flags_per_row_;
+
+  // Only used for a column-major batch, indexed by attribute ID.
+  std::vector<const char*> column_values_;
+  std::vector<const bool*> column_null_flags_;
+
+  DISALLOW_COPY_AND_ASSIGN(TupleBatch);
+};
+
+/** @} */
+
+}  // namespace quickstep
+
+#endif  // QUICKSTEP_STORAGE_TUPLE_BATCH_HPP_
@@ -22,6 +22,7 @@
 #define QUICKSTEP_STORAGE_TUPLE_ID_SEQUENCE_HPP_
 
 #include <algorithm>
+#include <iterator>
 #include <vector>
 
 #include "storage/StorageBlockInfo.hpp"
@@ -110,6 +111,67 @@ class TupleIdSequence {
     }
   }
 
+  /**
+   * @brief Remove all tuple_ids from this sequence which do not also appear in
+   *        another sequence (i.e. set intersection).
+   * @note This is a sort-merge: both sequences are sorted first if necessary,
+   *       and this sequence is left sorted.
+   *
+   * @param other The sequence to intersect with. It is sorted in-place if it
+   *        isn't already.
+   **/
+  void intersectWith(TupleIdSequence *other) {
+    sort();
+    other->sort();
+
+    std::vector<tuple_id> merged;
+    merged.reserve(std::min(internal_vector_.size(), other->internal_vector_.size()));
+    std::set_intersection(internal_vector_.begin(), internal_vector_.end(),
+                          other->internal_vector_.begin(), other->internal_vector_.end(),
+                          std::back_inserter(merged));
+    internal_vector_.swap(merged);
+  }
+
+  /**
+   * @brief Add all tuple_ids from another sequence which do not already
+   *        appear in this sequence (i.e. set union).
+   * @note This is a sort-merge: both sequences are sorted first if necessary,
+   *       and this sequence is left sorted.
+   *
+   * @param other The sequence to union with. It is sorted in-place if it isn't
+   *        already.
+   **/
+  void unionWith(TupleIdSequence *other) {
+    sort();
+    other->sort();
+
+    std::vector<tuple_id> merged;
+    merged.reserve(internal_vector_.size() + other->internal_vector_.size());
+    std::set_union(internal_vector_.begin(), internal_vector_.end(),
+                   other->internal_vector_.begin(), other->internal_vector_.end(),
+                   std::back_inserter(merged));
+    internal_vector_.swap(merged);
+  }
+
+  /**
+   * @brief Remove all tuple_ids which are greater than or equal to a limit
+   *        (e.g. tuples beyond a StorageBlock's visible tuple watermark).
+   *
+   * @param limit The lowest tuple_id to remove.
+   **/
+  void removeAtOrAbove(const tuple_id limit) {
+    std::vector<tuple_id>::iterator kept_it = internal_vector_.begin();
+    for (std::vector<tuple_id>::const_iterator it = internal_vector_.begin();
+         it != internal_vector_.end();
+         ++it) {
+      if (*it < limit) {
+        *kept_it = *it;
+        ++kept_it;
+      }
+    }
+    internal_vector_.erase(kept_it, internal_vector_.end());
+  }
+
  private:
   std::vector<tuple_id> internal_vector_;
   bool sorted_;
@@ -24,21 +24,144 @@
 #include <cassert>
 #endif
 
+#include <algorithm>
+#include <cstddef>
+
+#include "catalog/CatalogAttribute.hpp"
+#include "expressions/ComparisonPredicate.hpp"
 #include "expressions/Predicate.hpp"
+#include "expressions/Scalar.hpp"
+#include "storage/TupleBatch.hpp"
 #include "storage/TupleIdSequence.hpp"
+#include "types/Comparison.hpp"
+#include "types/Tuple.hpp"
+#include "types/TypeInstance.hpp"
+#include "utility/BitManipulation.hpp"
 #include "utility/Macros.hpp"
+#include "utility/ScopedPtr.hpp"
+#include "utility/UtilityConfig.h"
 
 #ifdef QUICKSTEP_DEBUG
-#include "catalog/CatalogAttribute.hpp"
 #include "catalog/CatalogRelation.hpp"
 #include "storage/StorageBlock.hpp"
-#include "types/Tuple.hpp"
 #include "types/Type.hpp"
-#include "types/TypeInstance.hpp"
 #endif
 
+using std::max;
+using std::min;
+using std::size_t;
+
 namespace quickstep {
 
+namespace {
+
+static const size_t kBitsPerNullWord = sizeof(size_t) << 3;
+
+inline int TrailingZeroCount(const size_t word) {
+#ifdef QUICKSTEP_SIZE_T_64BIT
+  return trailing_zero_count_64(word);
+#else
+  return trailing_zero_count_32(word);
+#endif
+}
+
+inline int PopulationCount(const size_t word) {
+#ifdef QUICKSTEP_SIZE_T_64BIT
+  return population_count_64(word);
+#else
+  return population_count_32(word);
+#endif
+}
+
+// Append the tuple IDs for the bits set in 'bits', where the lowest bit
+// stands for 'word_start'.
+inline void AppendSetBits(const tuple_id word_start,
+                          size_t bits,
+                          TupleIdSequence *matches) {
+  while (bits) {
+    matches->append(word_start + TrailingZeroCount(bits));
+    bits &= bits - 1;
+  }
+}
+
+// Check the values for the tuples in a single word of a NULL bitmap, ignoring
+// those whose bits are not set in 'candidate_bits' (i.e. NULL or deleted
+// tuples). The literal is on the left side of the comparison if
+// 'left_literal' is true.
+//
+// Unless most of the word's values are NULL or deleted, every value in the
+// word is compared and the results are accumulated into a word of match bits,
+// which is then ANDed with 'candidate_bits'. This keeps the loop free of
+// per-tuple bitmap tests and data-dependent branches. Sparse words only
+// compare the candidate values, since comparing the rest would be wasted work.
+template <bool left_literal>
+inline void MatchValuesInNullWord(const UncheckedComparator &comparator,
+                                  const TypeInstance &literal,
+                                  const char *first_value,
+                                  const size_t stride,
+                                  const tuple_id word_start,
+                                  const tuple_id word_end,
+                                  const size_t candidate_bits,
+                                  TupleIdSequence *matches) {
+  if (PopulationCount(candidate_bits) >= static_cast<int>(kBitsPerNullWord / 2)) {
+    size_t match_bits = 0;
+    const char *value = first_value + word_start * stride;
+    for (tuple_id tid = word_start; tid < word_end; ++tid, value += stride) {
+      const bool match = left_literal ? comparator.compareTypeInstanceWithDataPtr(literal, value)
+                                      : comparator.compareDataPtrWithTypeInstance(value, literal);
+      match_bits |= static_cast<size_t>(match) << (tid - word_start);
+    }
+    AppendSetBits(word_start, match_bits & candidate_bits, matches);
+  } else {
+    // Only visit the values which are neither NULL nor deleted.
+    size_t remaining_bits = candidate_bits;
+    while (remaining_bits) {
+      const tuple_id tid = word_start + TrailingZeroCount(remaining_bits);
+      if (tid >= word_end) {
+        break;
+      }
+      const char *value = first_value + tid * stride;
+      if (left_literal ? comparator.compareTypeInstanceWithDataPtr(literal, value)
+                       : comparator.compareDataPtrWithTypeInstance(value, literal)) {
+        matches->append(tid);
+      }
+      remaining_bits &= remaining_bits - 1;
+    }
+  }
+}
+
+template <bool left_literal>
+void MatchStridedValues(const UncheckedComparator &comparator,
+                        const TypeInstance &literal,
+                        const char *first_value,
+                        const size_t stride,
+                        const tuple_id num_tuples,
+                        const size_t *null_words,
+                        const size_t *deleted_words,
+                        TupleIdSequence *matches) {
+  for (tuple_id word_start = 0; word_start < num_tuples; word_start += kBitsPerNullWord) {
+    size_t candidate_bits = (null_words == NULL) ? ~static_cast<size_t>(0)
+                                                 : ~null_words[word_start / kBitsPerNullWord];
+    if (deleted_words != NULL) {
+      candidate_bits &= ~deleted_words[word_start / kBitsPerNullWord];
+    }
+    if (candidate_bits == 0) {
+      // Every value in this word is NULL or deleted.
+      continue;
+    }
+    MatchValuesInNullWord<left_literal>(comparator,
+                                        literal,
+                                        first_value,
+                                        stride,
+                                        word_start,
+                                        min(static_cast<tuple_id>(word_start + kBitsPerNullWord), num_tuples),
+                                        candidate_bits,
+                                        matches);
+  }
+}
+
+}  // anonymous namespace
+
 tuple_id TupleStorageSubBlock::numTuples() const {
   if (isEmpty()) {
     return 0;
@@ -94,6 +217,88 @@ TupleIdSequence* TupleStorageSubBlock::getMatchesForPredicate(const Predicate *p
   return matches;
 }
 
+tuple_id TupleStorageSubBlock::bulkInsertTuples(const TupleBatch &batch, const tuple_id first_tuple) {
+  DEBUG_ASSERT(&batch.getRelation() == &relation_);
+  tuple_id num_inserted = 0;
+  for (tuple_id tuple = first_tuple; tuple < batch.size(); ++tuple) {
+    if (!insertTupleInBatch(Tuple(batch, tuple), kNone)) {
+      break;
+    }
+    ++num_inserted;
+  }
+  return num_inserted;
+}
+
+tuple_id TupleStorageSubBlock::estimateTupleCapacity() const {
+  const size_t estimated_tuple_bytes = relation_.getEstimatedByteLength();
+  if (estimated_tuple_bytes == 0) {
+    return 1;
+  }
+  return max(static_cast<tuple_id>(sub_block_memory_size_ / estimated_tuple_bytes),
+             static_cast<tuple_id>(1));
+}
+
+attribute_id TupleStorageSubBlock::GetComparisonAttributeID(const ComparisonPredicate &predicate) {
+  DEBUG_ASSERT(predicate.isAttributeLiteralComparisonPredicate());
+  const Scalar &attribute_operand = predicate.getLeftOperand().hasStaticValue() ? predicate.getRightOperand()
+                                                                                : predicate.getLeftOperand();
+  DEBUG_ASSERT(attribute_operand.getDataSource() == Scalar::kAttribute);
+  return static_cast<const ScalarAttribute&>(attribute_operand).getAttribute().getID();
+}
+
+TupleIdSequence* TupleStorageSubBlock::GetMatchesForComparisonOnStridedValues(
+    const ComparisonPredicate &predicate,
+    const void *first_value,
+    const size_t stride,
+    const tuple_id num_tuples,
+    const size_t *null_words,
+    const size_t *deleted_words) {
+  DEBUG_ASSERT(predicate.isAttributeLiteralComparisonPredicate());
+  const bool left_literal = predicate.getLeftOperand().hasStaticValue();
+  const Scalar &attribute_operand = left_literal ? predicate.getRightOperand()
+                                                 : predicate.getLeftOperand();
+  const Scalar &literal_operand = left_literal ? predicate.getLeftOperand()
+                                               : predicate.getRightOperand();
+  const CatalogAttribute &comparison_attribute
+      = static_cast<const ScalarAttribute&>(attribute_operand).getAttribute();
+  const LiteralTypeInstance &comparison_literal = literal_operand.getStaticValue();
+
+  TupleIdSequence *matches = new TupleIdSequence();
+  if (comparison_literal.isNull()) {
+    // Nothing compares with NULL.
+    return matches;
+  }
+
+  ScopedPtr<UncheckedComparator> comparator;
+  if (left_literal) {
+    comparator.reset(predicate.getComparison().makeUncheckedComparatorForTypes(
+        comparison_literal.getType(),
+        comparison_attribute.getType()));
+    MatchStridedValues<true>(*comparator,
+                             comparison_literal,
+                             static_cast<const char*>(first_value),
+                             stride,
+                             num_tuples,
+                             null_words,
+                             deleted_words,
+                             matches);
+  } else {
+    comparator.reset(predicate.getComparison().makeUncheckedComparatorForTypes(
+        comparison_attribute.getType(),
+        comparison_literal.getType()));
+    MatchStridedValues<false>(*comparator,
+                              comparison_literal,
+                              static_cast<const char*>(first_value),
+                              stride,
+                              num_tuples,
+                              null_words,
+                              deleted_words,
+                              matches);
+  }
+
+  return matches;
+}
+
 void TupleStorageSubBlock::paranoidInsertTypeCheck(const Tuple &tuple, const AllowedTypeConversion atc) {
 #ifdef QUICKSTEP_DEBUG
   assert(relation_.size() == tuple.size());
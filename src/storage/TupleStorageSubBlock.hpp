@@ -21,6 +21,7 @@
 #ifndef QUICKSTEP_STORAGE_TUPLE_STORAGE_SUB_BLOCK_HPP_
 #define QUICKSTEP_STORAGE_TUPLE_STORAGE_SUB_BLOCK_HPP_
 
+#include <cstddef>
 #include <vector>
 
 #include "catalog/CatalogTypedefs.hpp"
@@ -28,13 +29,16 @@
 #include "storage/TupleIdSequence.hpp"
 #include "types/AllowedTypeConversion.hpp"
 #include "utility/Macros.hpp"
+#include "utility/PtrMap.hpp"
 
 namespace quickstep {
 
 class CatalogRelation;
+class ComparisonPredicate;
 class LiteralTypeInstance;
 class Predicate;
 class Tuple;
+class TupleBatch;
 class TupleStorageSubBlockDescription;
 class TypeInstance;
 
@@ -178,6 +182,20 @@ class TupleStorageSubBlock {
    **/
   virtual tuple_id numTuples() const;
 
+  /**
+   * @brief Estimate the total number of tuples this SubBlock can hold, for
+   *        judging how full it is relative to numTuples().
+   * @note The default implementation divides the size of this SubBlock's
+   *       memory by the relation's estimated tuple length. Implementations
+   *       with a fixed capacity should override this to return it exactly.
+   *       For compressed implementations the estimate is conservative, since
+   *       compressed tuples are usually smaller than the estimate.
+   *
+   * @return An estimate of the maximum number of tuples in this SubBlock
+   *         (always at least 1).
+   **/
+  virtual tuple_id estimateTupleCapacity() const;
+
   /**
    * @brief Determine whether a tuple with the given id exists in this
    *        SubBlock.
@@ -224,6 +242,66 @@ class TupleStorageSubBlock {
    **/
   virtual bool insertTupleInBatch(const Tuple &tuple, const AllowedTypeConversion atc) = 0;
 
+  /**
+   * @brief Insert as many tuples from a TupleBatch as will fit into this
+   *        TupleStorageSubBlock, as part of a batch of inserts (the same as
+   *        calling insertTupleInBatch() for each of them).
+   * @note The default implementation builds a Tuple for each tuple in batch
+   *       and calls insertTupleInBatch(). Implementations which store
+   *       fixed-length values contiguously should override it to copy whole
+   *       runs of values at once.
+   * @warning The same restrictions apply as for insertTupleInBatch(), and
+   *          rebuild() must be called once the batch of inserts is finished.
+   *
+   * @param batch The tuples to insert, which must belong to this
+   *        TupleStorageSubBlock's relation.
+   * @param first_tuple The position in batch of the first tuple to insert.
+   *        Tuples before it (e.g. which were already inserted into another
+   *        block) are skipped.
+   * @return The number of tuples which were inserted, starting at
+   *         first_tuple (less than batch.size() - first_tuple if this
+   *         TupleStorageSubBlock filled up).
+   **/
+  virtual tuple_id bulkInsertTuples(const TupleBatch &batch, const tuple_id first_tuple);
+
+  /**
+   * @brief Determine whether calling rebuild() after inserting a batch of
+   *        tuples via insertTupleInBatch() may change the IDs of tuples
+   *        which were already present before the batch.
+   * @note If this method returns false, then the IDs of existing tuples are
+   *       stable, and each tuple in the batch is assigned an ID greater than
+   *       the value of getMaxTupleID() from before the batch, so indices can
+   *       be updated by adding entries for only the new tuples instead of
+   *       being rebuilt from scratch.
+   * @note The default implementation conservatively returns true.
+   *
+   * @return Whether rebuild() may mutate the IDs of tuples after a batch
+   *         insert.
+   **/
+  virtual bool batchInsertMutatesTupleIDs() const {
+    return true;
+  }
+
+  /**
+   * @brief Determine whether the next call to insertTuple() or
+   *        insertTupleInBatch() will leave all existing tuples untouched, at
+   *        most appending the new tuple with an ID greater than
+   *        getMaxTupleID().
+   * @note If this method returns true, readers may access the existing tuples
+   *       while the insert is in progress, so long as they ignore tuples with
+   *       higher IDs (see StorageBlock::getVisibleTupleWatermark()). A reader
+   *       scanning all tuples may still see the partially-written new tuple,
+   *       so a TupleStorageSubBlock should only return true if doing so can
+   *       not lead a reader astray (e.g. it stores only fixed-length
+   *       values).
+   * @note The default implementation conservatively returns false.
+   *
+   * @return Whether the next insert will only append a new tuple.
+   **/
+  virtual bool nextInsertAppends() const {
+    return false;
+  }
+
   /**
    * @brief Get the (untyped) value of an attribute in a tuple in this buffer.
    * @warning This method may not be supported for all implementations of
@@ -258,6 +336,47 @@ class TupleStorageSubBlock {
    **/
   virtual TypeInstance* getAttributeValueTyped(const tuple_id tuple, const attribute_id attr) const = 0;
 
+  /**
+   * @brief Determine whether new values for some attributes of a tuple can be
+   *        written in place with setAttributeValueInPlaceTyped(), without
+   *        changing the size of the tuple, its position relative to other
+   *        tuples (e.g. in a sort order), or the ID of any tuple.
+   * @note The default implementation always returns false, in which case a
+   *       tuple must be deleted and reinserted to change its values.
+   *
+   * @param tuple The tuple to update, which must exist.
+   * @param new_values A map from attribute IDs to new values for those
+   *        attributes, each of which must be NULL or exactly the Type of the
+   *        corresponding attribute.
+   * @return Whether all of new_values can be set in place for tuple.
+   **/
+  virtual bool canSetAttributeValuesInPlaceTyped(
+      const tuple_id tuple,
+      const PtrMap<attribute_id, LiteralTypeInstance> &new_values) const {
+    return false;
+  }
+
+  /**
+   * @brief Overwrite the value of an attribute of a tuple in place.
+   * @warning canSetAttributeValuesInPlaceTyped() MUST be called first (with
+   *          all the new values for tuple) to determine whether this is
+   *          possible.
+   * @warning Any IndexSubBlocks which index attr must have the entry for
+   *          tuple removed before calling this method, and re-added
+   *          afterwards.
+   *
+   * @param tuple The tuple to update.
+   * @param attr The ID of the attribute to overwrite.
+   * @param value The new value for attr, which must be NULL or exactly the
+   *        Type of attr.
+   **/
+  virtual void setAttributeValueInPlaceTyped(const tuple_id tuple,
+                                             const attribute_id attr,
+                                             const TypeInstance &value) {
+    FATAL_ERROR("Called TupleStorageSubBlock::setAttributeValueInPlaceTyped() "
+                "on a TupleStorageSubBlock which does not support in-place updates.");
+  }
+
   /**
    * @brief Delete a single tuple from this TupleStorageSubBlock.
    * @warning For debug builds, an assertion checks whether the specified tuple
@@ -314,6 +433,46 @@ class TupleStorageSubBlock {
    **/
   void paranoidInsertTypeCheck(const Tuple &tuple, AllowedTypeConversion atc);
 
+  /**
+   * @brief Get the ID of the attribute which an attribute-literal
+   *        ComparisonPredicate compares (the literal may be on either side).
+   *
+   * @param predicate A ComparisonPredicate which compares an attribute of
+   *        this TupleStorageSubBlock's relation with a literal.
+   * @return The ID of the attribute compared by predicate.
+   **/
+  static attribute_id GetComparisonAttributeID(const ComparisonPredicate &predicate);
+
+  /**
+   * @brief Evaluate an attribute-literal ComparisonPredicate over values
+   *        which are laid out at a fixed stride from one another (e.g. a
+   *        column stripe, or an attribute of every tuple in a packed
+   *        row-store), for tuples numbered 0 through num_tuples - 1.
+   *
+   * @param predicate A ComparisonPredicate which compares an attribute of
+   *        this TupleStorageSubBlock's relation with a literal.
+   * @param first_value The attribute's value for tuple 0.
+   * @param stride The distance in bytes between consecutive values.
+   * @param num_tuples The number of tuples to check.
+   * @param null_words The words of the attribute's NULL bitmap (see
+   *        NullBitmaps), or NULL if the attribute is not nullable. NULL
+   *        values never match. Whole words of NULL values are skipped
+   *        without examining any values. Otherwise, a word's values are
+   *        compared into a word of match bits which is masked with the
+   *        bitmap, unless most of them are NULL.
+   * @param deleted_words The words of a bitmap with a bit set for each
+   *        deleted tuple, or NULL if there are no deleted tuples. Deleted
+   *        tuples never match, and are masked out a word at a time along with
+   *        NULL values.
+   * @return The IDs of the tuples which match predicate.
+   **/
+  static TupleIdSequence* GetMatchesForComparisonOnStridedValues(const ComparisonPredicate &predicate,
+                                                                 const void *first_value,
+                                                                 const std::size_t stride,
+                                                                 const tuple_id num_tuples,
+                                                                 const std::size_t *null_words,
+                                                                 const std::size_t *deleted_words);
+
   const CatalogRelation &relation_;
   const TupleStorageSubBlockDescription &description_;
 
@@ -0,0 +1,241 @@
+/*
+   This file copyright (c) 2011-2013, the Quickstep authors.
+   See file CREDITS.txt for details.
+  
+   This file is part of Quickstep.
+
+   Quickstep is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+  
+   Quickstep is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Quickstep.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICKSTEP_THREADING_VERSIONED_LATCH_HPP_
+#define QUICKSTEP_THREADING_VERSIONED_LATCH_HPP_
+
+#include <cstddef>
+
+#include "threading/ThreadingConfig.h"
+#include "utility/Macros.hpp"
+
+namespace quickstep {
+
+/** \addtogroup Threading
+ *  @{
+ */
+
+/**
+ * @brief A VersionedLatch (also known as a sequence lock) protects a data
+ *        structure which is read much more often than it is written, using
+ *        optimistic concurrency control for readers. Writers are serialized
+ *        with respect to each other, and increment a version counter both
+ *        when they begin and when they finish writing (so the version is odd
+ *        exactly when a write is in progress). Readers never block writers,
+ *        and never block each other: a reader gets the version with
+ *        beginRead() before it reads, and then checks with validateRead()
+ *        that no writer intervened before it uses anything it read. If
+ *        validation fails, the reader should discard what it read and
+ *        retry.
+ * @note A structure which grows by appending can also let writers append
+ *       without invalidating readers: an appending writer locks with
+ *       lockAppend() instead of lockWrite(), and publishes a watermark with
+ *       publishWatermark() once the appended data is complete. Readers get
+ *       the watermark after beginRead(), and ignore anything beyond it.
+ * @note Readers which can not tolerate a writer freeing or moving what they
+ *       are reading may register with beginRegisteredRead() instead. Writers
+ *       (but not appenders) wait for registered readers to finish.
+ * @warning Because a reader may observe a structure while a writer is in the
+ *          midst of modifying it, readers must be written so that they do not
+ *          crash or loop forever on inconsistent data (e.g. by checking
+ *          that offsets and references are in bounds before following
+ *          them).
+ * @note This interface exists to provide a central point of documentation for
+ *       platform-specific VersionedLatch implementations, you should never use
+ *       it directly. Instead, simply use the VersionedLatch class, which will
+ *       be typedefed to the appropriate implementation.
+ **/
+class VersionedLatchInterface {
+ public:
+  /**
+   * @brief Virtual destructor.
+   **/
+  virtual ~VersionedLatchInterface() = 0;
+
+  /**
+   * @brief Begin an optimistic read. If a write is in progress, spins until it
+   *        is finished.
+   *
+   * @return The current version, which should be passed to validateRead()
+   *         when the read is finished.
+   **/
+  virtual std::size_t beginRead() const = 0;
+
+  /**
+   * @brief Check whether an optimistic read which began with beginRead() is
+   *        valid (i.e. no writer has locked this VersionedLatch since).
+   *
+   * @param version The version returned by beginRead().
+   * @return Whether everything read since the call to beginRead() which
+   *         returned version is consistent.
+   **/
+  virtual bool validateRead(const std::size_t version) const = 0;
+
+  /**
+   * @brief Check whether a write is currently in progress. Readers may use
+   *        this to abandon a read early, rather than waiting for
+   *        validateRead() to fail.
+   *
+   * @return Whether some writer holds this VersionedLatch.
+   **/
+  virtual bool writeInProgress() const = 0;
+
+  /**
+   * @brief Begin an optimistic read as a registered reader. This is like
+   *        beginRead(), except that a writer which locks this VersionedLatch
+   *        with lockWrite() (or upgrades with upgradeToWrite()) waits until
+   *        every registered reader has called endRegisteredRead(), and new
+   *        registered readers wait until the write is finished. A registered
+   *        reader therefore never observes a write in progress (only appends
+   *        beyond the watermark), and writers may free or move anything which
+   *        registered readers use.
+   * @warning Every call must be matched by a call to endRegisteredRead(). A
+   *          registered reader must not write to any structure protected by
+   *          a VersionedLatch until it has ended its read, since it may
+   *          deadlock with a writer which is waiting for it.
+   *
+   * @return The current version, which should be passed to
+   *         endRegisteredRead() when the read is finished.
+   **/
+  virtual std::size_t beginRegisteredRead() const = 0;
+
+  /**
+   * @brief Finish a read which began with beginRegisteredRead(), and check
+   *        whether it is valid, as with validateRead().
+   *
+   * @param version The version returned by beginRegisteredRead().
+   * @return Whether everything read since the call to beginRegisteredRead()
+   *         which returned version is consistent.
+   **/
+  virtual bool endRegisteredRead(const std::size_t version) const = 0;
+
+  /**
+   * @brief Lock this VersionedLatch for writing. If another writer holds it,
+   *        execution will block until it becomes available. Any optimistic
+   *        reads in progress will fail validation, and execution will block
+   *        until registered readers (see beginRegisteredRead()) have
+   *        finished.
+   * @note It is an error to call lockWrite() while already holding the
+   *       VersionedLatch.
+   **/
+  virtual void lockWrite() = 0;
+
+  /**
+   * @brief Lock this VersionedLatch for a write which only appends to the
+   *        protected structure, beyond the watermark which readers respect
+   *        (see getWatermark()). Other writers are excluded just as with
+   *        lockWrite(), but the version is not changed, so optimistic reads
+   *        in progress remain valid. If the writer finds that it must modify
+   *        anything below the watermark after all, it must call
+   *        upgradeToWrite() first.
+   * @note It is an error to call lockAppend() while already holding the
+   *       VersionedLatch.
+   **/
+  virtual void lockAppend() = 0;
+
+  /**
+   * @brief Upgrade a VersionedLatch locked with lockAppend() to a full write
+   *        lock, so that any optimistic reads in progress will fail
+   *        validation (and waits for registered readers, as lockWrite()
+   *        does). Does nothing if this VersionedLatch is already locked with
+   *        lockWrite() or has already been upgraded.
+   **/
+  virtual void upgradeToWrite() = 0;
+
+  /**
+   * @brief Unlock this VersionedLatch after writing (or appending). It is an
+   *        error to unlock a VersionedLatch which is not locked by the
+   *        current thread.
+   **/
+  virtual void unlockWrite() = 0;
+
+  /**
+   * @brief Get the watermark most recently published by a writer. Everything
+   *        which a writer appended before publishing the watermark is visible
+   *        to a reader which gets it afterwards.
+   *
+   * @return The current watermark (0 if none has been published).
+   **/
+  virtual std::size_t getWatermark() const = 0;
+
+  /**
+   * @brief Publish a new watermark for readers. Only a thread which holds
+   *        this VersionedLatch (in either mode) should call this.
+   *
+   * @param watermark The new watermark, typically the extent of the protected
+   *        structure which is complete and safe for readers to access.
+   **/
+  virtual void publishWatermark(const std::size_t watermark) = 0;
+};
+
+/**
+ * @brief A scoped lock-holder for writers of a VersionedLatch. Locks a
+ *        VersionedLatch for writing when it is constructed, and unlocks it
+ *        when it goes out of scope.
+ * @note This interface exists to provide a central point of documentation
+ *       for platform-specific VersionedLatchWriteLock implementations, you
+ *       should never use it directly. Instead, simply use the
+ *       VersionedLatchWriteLock class, which will be typedefed to the
+ *       appropriate implementation.
+ **/
+class VersionedLatchWriteLockInterface {
+ public:
+  /**
+   * @brief Virtual destructor. Unlocks the held VersionedLatch.
+   **/
+  virtual ~VersionedLatchWriteLockInterface() = 0;
+};
+
+/**
+ * @brief A scoped lock-holder for appending writers of a VersionedLatch. Locks
+ *        a VersionedLatch with lockAppend() when it is constructed, and
+ *        unlocks it (whether or not it was upgraded with upgradeToWrite())
+ *        when it goes out of scope.
+ * @note This interface exists to provide a central point of documentation
+ *       for platform-specific VersionedLatchAppendLock implementations, you
+ *       should never use it directly. Instead, simply use the
+ *       VersionedLatchAppendLock class, which will be typedefed to the
+ *       appropriate implementation.
+ **/
+class VersionedLatchAppendLockInterface {
+ public:
+  /**
+   * @brief Virtual destructor. Unlocks the held VersionedLatch.
+   **/
+  virtual ~VersionedLatchAppendLockInterface() = 0;
+};
+
+/** @} */
+
+}  // namespace quickstep
+
+#ifdef QUICKSTEP_HAVE_CPP11_THREADS
+#include "threading/cpp11/VersionedLatch.hpp"
+#endif
+
+#ifdef QUICKSTEP_HAVE_POSIX_THREADS
+#include "threading/posix/VersionedLatch.hpp"
+#endif
+
+#ifdef QUICKSTEP_HAVE_WINDOWS_THREADS
+#include "threading/windows/VersionedLatch.hpp"
+#endif
+
+#endif  // QUICKSTEP_THREADING_VERSIONED_LATCH_HPP_
@@ -0,0 +1,191 @@
+/*
+   This file copyright (c) 2011-2013, the Quickstep authors.
+   See file CREDITS.txt for details.
+  
+   This file is part of Quickstep.
+
+   Quickstep is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+  
+   Quickstep is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Quickstep.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICKSTEP_THREADING_CPP11_VERSIONED_LATCH_HPP_
+#define QUICKSTEP_THREADING_CPP11_VERSIONED_LATCH_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+
+#include "threading/VersionedLatch.hpp"
+#include "utility/Macros.hpp"
+
+namespace quickstep {
+
+/** \addtogroup Threading
+ *  @{
+ */
+
+/**
+ * @brief Implementation of VersionedLatch using C++11 threads and atomics.
+ **/
+class VersionedLatchImplCPP11 : public VersionedLatchInterface {
+ public:
+  inline VersionedLatchImplCPP11()
+      : version_(0),
+        watermark_(0),
+        num_registered_readers_(0) {
+  }
+
+  inline ~VersionedLatchImplCPP11() {
+  }
+
+  inline std::size_t beginRead() const {
+    std::size_t version = version_.load(std::memory_order_acquire);
+    while (version & 0x1) {
+      std::this_thread::yield();
+      version = version_.load(std::memory_order_acquire);
+    }
+    return version;
+  }
+
+  inline bool validateRead(const std::size_t version) const {
+    // Make sure that all the reads since beginRead() are ordered before
+    // checking the version again.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return version_.load(std::memory_order_relaxed) == version;
+  }
+
+  inline bool writeInProgress() const {
+    return version_.load(std::memory_order_acquire) & 0x1;
+  }
+
+  inline std::size_t beginRegisteredRead() const {
+    for (;;) {
+      num_registered_readers_.fetch_add(1, std::memory_order_seq_cst);
+      const std::size_t version = version_.load(std::memory_order_seq_cst);
+      if (!(version & 0x1)) {
+        return version;
+      }
+      // A writer is waiting for registered readers (or has already started),
+      // so get out of its way until it is finished.
+      num_registered_readers_.fetch_sub(1, std::memory_order_seq_cst);
+      beginRead();
+    }
+  }
+
+  inline bool endRegisteredRead(const std::size_t version) const {
+    const bool valid = validateRead(version);
+    num_registered_readers_.fetch_sub(1, std::memory_order_release);
+    return valid;
+  }
+
+  inline void lockWrite() {
+    write_mutex_.lock();
+    beginWrite();
+  }
+
+  inline void lockAppend() {
+    write_mutex_.lock();
+  }
+
+  inline void upgradeToWrite() {
+    if (!(version_.load(std::memory_order_relaxed) & 0x1)) {
+      beginWrite();
+    }
+  }
+
+  inline void unlockWrite() {
+    const std::size_t version = version_.load(std::memory_order_relaxed);
+    if (version & 0x1) {
+      version_.store(version + 1, std::memory_order_release);
+    }
+    write_mutex_.unlock();
+  }
+
+  inline std::size_t getWatermark() const {
+    return watermark_.load(std::memory_order_acquire);
+  }
+
+  inline void publishWatermark(const std::size_t watermark) {
+    watermark_.store(watermark, std::memory_order_release);
+  }
+
+ private:
+  // Make the version odd, then wait for registered readers to finish. The
+  // sequentially-consistent increment also makes sure that the odd version
+  // is visible before any of the writes which follow.
+  inline void beginWrite() {
+    version_.fetch_add(1, std::memory_order_seq_cst);
+    while (num_registered_readers_.load(std::memory_order_seq_cst) != 0) {
+      std::this_thread::yield();
+    }
+  }
+
+  std::atomic<std::size_t> version_;
+  std::atomic<std::size_t> watermark_;
+  mutable std::atomic<std::size_t> num_registered_readers_;
+  std::mutex write_mutex_;
+
+  DISALLOW_COPY_AND_ASSIGN(VersionedLatchImplCPP11);
+};
+typedef VersionedLatchImplCPP11 VersionedLatch;
+
+/**
+ * @brief Implementation of VersionedLatchWriteLock using C++11 threads and
+ *        atomics.
+ **/
+class VersionedLatchWriteLockImplCPP11 : public VersionedLatchWriteLockInterface {
+ public:
+  explicit inline VersionedLatchWriteLockImplCPP11(VersionedLatchImplCPP11 &latch)  // NOLINT - C++11-style interface
+      : latch_ptr_(&latch) {
+    latch_ptr_->lockWrite();
+  }
+
+  inline ~VersionedLatchWriteLockImplCPP11() {
+    latch_ptr_->unlockWrite();
+  }
+
+ private:
+  VersionedLatchImplCPP11 *latch_ptr_;
+
+  DISALLOW_COPY_AND_ASSIGN(VersionedLatchWriteLockImplCPP11);
+};
+typedef VersionedLatchWriteLockImplCPP11 VersionedLatchWriteLock;
+
+/**
+ * @brief Implementation of VersionedLatchAppendLock using C++11 threads and
+ *        atomics.
+ **/
+class VersionedLatchAppendLockImplCPP11 : public VersionedLatchAppendLockInterface {
+ public:
+  explicit inline VersionedLatchAppendLockImplCPP11(VersionedLatchImplCPP11 &latch)  // NOLINT - C++11-style interface
+      : latch_ptr_(&latch) {
+    latch_ptr_->lockAppend();
+  }
+
+  inline ~VersionedLatchAppendLockImplCPP11() {
+    latch_ptr_->unlockWrite();
+  }
+
+ private:
+  VersionedLatchImplCPP11 *latch_ptr_;
+
+  DISALLOW_COPY_AND_ASSIGN(VersionedLatchAppendLockImplCPP11);
+};
+typedef VersionedLatchAppendLockImplCPP11 VersionedLatchAppendLock;
+
+/** @} */
+
+}  // namespace quickstep
+
+#endif  // QUICKSTEP_THREADING_CPP11_VERSIONED_LATCH_HPP_
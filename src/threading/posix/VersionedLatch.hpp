@@ -0,0 +1,198 @@
+/*
+   This file copyright (c) 2011-2013, the Quickstep authors.
+   See file CREDITS.txt for details.
+  
+   This file is part of Quickstep.
+
+   Quickstep is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+  
+   Quickstep is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Quickstep.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICKSTEP_THREADING_POSIX_VERSIONED_LATCH_HPP_
+#define QUICKSTEP_THREADING_POSIX_VERSIONED_LATCH_HPP_
+
+#include <sched.h>
+
+#include <cstddef>
+
+#include "threading/Mutex.hpp"
+#include "threading/VersionedLatch.hpp"
+#include "utility/Macros.hpp"
+
+namespace quickstep {
+
+/** \addtogroup Threading
+ *  @{
+ */
+
+/**
+ * @brief Implementation of VersionedLatch using POSIX threads and GCC-style
+ *        atomic builtins.
+ **/
+class VersionedLatchImplPosix : public VersionedLatchInterface {
+ public:
+  inline VersionedLatchImplPosix()
+      : version_(0),
+        watermark_(0),
+        num_registered_readers_(0) {
+  }
+
+  inline ~VersionedLatchImplPosix() {
+  }
+
+  inline std::size_t beginRead() const {
+    std::size_t version = version_;
+    __sync_synchronize();
+    while (version & 0x1) {
+      sched_yield();
+      version = version_;
+      __sync_synchronize();
+    }
+    return version;
+  }
+
+  inline bool validateRead(const std::size_t version) const {
+    __sync_synchronize();
+    return version_ == version;
+  }
+
+  inline bool writeInProgress() const {
+    __sync_synchronize();
+    return version_ & 0x1;
+  }
+
+  inline std::size_t beginRegisteredRead() const {
+    for (;;) {
+      // __sync_fetch_and_add() is a full memory barrier.
+      __sync_fetch_and_add(&num_registered_readers_, 1);
+      const std::size_t version = version_;
+      if (!(version & 0x1)) {
+        return version;
+      }
+      // A writer is waiting for registered readers (or has already started),
+      // so get out of its way until it is finished.
+      __sync_fetch_and_sub(&num_registered_readers_, 1);
+      beginRead();
+    }
+  }
+
+  inline bool endRegisteredRead(const std::size_t version) const {
+    const bool valid = validateRead(version);
+    __sync_fetch_and_sub(&num_registered_readers_, 1);
+    return valid;
+  }
+
+  inline void lockWrite() {
+    write_mutex_.lock();
+    beginWrite();
+  }
+
+  inline void lockAppend() {
+    write_mutex_.lock();
+  }
+
+  inline void upgradeToWrite() {
+    if (!(version_ & 0x1)) {
+      beginWrite();
+    }
+  }
+
+  inline void unlockWrite() {
+    if (version_ & 0x1) {
+      __sync_fetch_and_add(&version_, 1);
+    }
+    write_mutex_.unlock();
+  }
+
+  inline std::size_t getWatermark() const {
+    const std::size_t watermark = watermark_;
+    __sync_synchronize();
+    return watermark;
+  }
+
+  inline void publishWatermark(const std::size_t watermark) {
+    // Make sure that everything written so far is visible before the new
+    // watermark.
+    __sync_synchronize();
+    watermark_ = watermark;
+  }
+
+ private:
+  // Make the version odd, then wait for registered readers to finish.
+  inline void beginWrite() {
+    // __sync_fetch_and_add() is a full memory barrier.
+    __sync_fetch_and_add(&version_, 1);
+    while (num_registered_readers_ != 0) {
+      sched_yield();
+    }
+    __sync_synchronize();
+  }
+
+  volatile std::size_t version_;
+  volatile std::size_t watermark_;
+  mutable volatile std::size_t num_registered_readers_;
+  Mutex write_mutex_;
+
+  DISALLOW_COPY_AND_ASSIGN(VersionedLatchImplPosix);
+};
+typedef VersionedLatchImplPosix VersionedLatch;
+
+/**
+ * @brief Implementation of VersionedLatchWriteLock using POSIX threads and
+ *        GCC-style atomic builtins.
+ **/
+class VersionedLatchWriteLockImplPosix : public VersionedLatchWriteLockInterface {
+ public:
+  explicit inline VersionedLatchWriteLockImplPosix(VersionedLatchImplPosix &latch)  // NOLINT - c++11-style interface
+      : latch_ptr_(&latch) {
+    latch_ptr_->lockWrite();
+  }
+
+  inline ~VersionedLatchWriteLockImplPosix() {
+    latch_ptr_->unlockWrite();
+  }
+
+ private:
+  VersionedLatchImplPosix *latch_ptr_;
+
+  DISALLOW_COPY_AND_ASSIGN(VersionedLatchWriteLockImplPosix);
+};
+typedef VersionedLatchWriteLockImplPosix VersionedLatchWriteLock;
+
+/**
+ * @brief Implementation of VersionedLatchAppendLock using POSIX threads and
+ *        GCC-style atomic builtins.
+ **/
+class VersionedLatchAppendLockImplPosix : public VersionedLatchAppendLockInterface {
+ public:
+  explicit inline VersionedLatchAppendLockImplPosix(VersionedLatchImplPosix &latch)  // NOLINT - c++11-style interface
+      : latch_ptr_(&latch) {
+    latch_ptr_->lockAppend();
+  }
+
+  inline ~VersionedLatchAppendLockImplPosix() {
+    latch_ptr_->unlockWrite();
+  }
+
+ private:
+  VersionedLatchImplPosix *latch_ptr_;
+
+  DISALLOW_COPY_AND_ASSIGN(VersionedLatchAppendLockImplPosix);
+};
+typedef VersionedLatchAppendLockImplPosix VersionedLatchAppendLock;
+
+/** @} */
+
+}  // namespace quickstep
+
+#endif  // QUICKSTEP_THREADING_POSIX_VERSIONED_LATCH_HPP_
@@ -0,0 +1,94 @@
+/*
+   This file copyright (c) 2011-2013, the Quickstep authors.
+   See file CREDITS.txt for details.
+  
+   This file is part of Quickstep.
+
+   Quickstep is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+  
+   Quickstep is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Quickstep.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "threading/windows/VersionedLatch.hpp"
+
+#include <windows.h>
+
+#include <cstddef>
+
+namespace quickstep {
+
+std::size_t VersionedLatchImplWindows::beginRead() const {
+  LONG version = version_;
+  MemoryBarrier();
+  while (version & 0x1) {
+    SwitchToThread();
+    version = version_;
+    MemoryBarrier();
+  }
+  return static_cast<std::size_t>(version);
+}
+
+bool VersionedLatchImplWindows::validateRead(const std::size_t version) const {
+  MemoryBarrier();
+  return static_cast<std::size_t>(version_) == version;
+}
+
+bool VersionedLatchImplWindows::writeInProgress() const {
+  MemoryBarrier();
+  return version_ & 0x1;
+}
+
+std::size_t VersionedLatchImplWindows::beginRegisteredRead() const {
+  for (;;) {
+    // InterlockedIncrement() is a full memory barrier.
+    InterlockedIncrement(&num_registered_readers_);
+    const LONG version = version_;
+    if (!(version & 0x1)) {
+      return static_cast<std::size_t>(version);
+    }
+    // A writer is waiting for registered readers (or has already started),
+    // so get out of its way until it is finished.
+    InterlockedDecrement(&num_registered_readers_);
+    beginRead();
+  }
+}
+
+bool VersionedLatchImplWindows::endRegisteredRead(const std::size_t version) const {
+  const bool valid = validateRead(version);
+  InterlockedDecrement(&num_registered_readers_);
+  return valid;
+}
+
+std::size_t VersionedLatchImplWindows::getWatermark() const {
+  const std::size_t watermark = watermark_;
+  MemoryBarrier();
+  return watermark;
+}
+
+void VersionedLatchImplWindows::publishWatermark(const std::size_t watermark) {
+  MemoryBarrier();
+  watermark_ = watermark;
+}
+
+void VersionedLatchImplWindows::incrementVersion() {
+  InterlockedIncrement(&version_);
+}
+
+void VersionedLatchImplWindows::beginWrite() {
+  incrementVersion();
+  while (num_registered_readers_ != 0) {
+    SwitchToThread();
+  }
+  MemoryBarrier();
+}
+
+}  // namespace quickstep
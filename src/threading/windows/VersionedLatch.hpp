@@ -0,0 +1,148 @@
+/*
+   This file copyright (c) 2011-2013, the Quickstep authors.
+   See file CREDITS.txt for details.
+  
+   This file is part of Quickstep.
+
+   Quickstep is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+  
+   Quickstep is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Quickstep.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef QUICKSTEP_THREADING_WINDOWS_VERSIONED_LATCH_HPP_
+#define QUICKSTEP_THREADING_WINDOWS_VERSIONED_LATCH_HPP_
+
+#include <cstddef>
+
+#include "threading/Mutex.hpp"
+#include "threading/VersionedLatch.hpp"
+#include "utility/Macros.hpp"
+
+namespace quickstep {
+
+/** \addtogroup Threading
+ *  @{
+ */
+
+/**
+ * @brief Implementation of VersionedLatch using MS Windows threads and
+ *        interlocked operations.
+ **/
+class VersionedLatchImplWindows : public VersionedLatchInterface {
+ public:
+  VersionedLatchImplWindows()
+      : version_(0),
+        watermark_(0),
+        num_registered_readers_(0) {
+  }
+
+  ~VersionedLatchImplWindows() {
+  }
+
+  std::size_t beginRead() const;
+  bool validateRead(const std::size_t version) const;
+  bool writeInProgress() const;
+  std::size_t beginRegisteredRead() const;
+  bool endRegisteredRead(const std::size_t version) const;
+
+  inline void lockWrite() {
+    write_mutex_.lock();
+    beginWrite();
+  }
+
+  inline void lockAppend() {
+    write_mutex_.lock();
+  }
+
+  inline void upgradeToWrite() {
+    if (!(version_ & 0x1)) {
+      beginWrite();
+    }
+  }
+
+  inline void unlockWrite() {
+    if (version_ & 0x1) {
+      incrementVersion();
+    }
+    write_mutex_.unlock();
+  }
+
+  std::size_t getWatermark() const;
+  void publishWatermark(const std::size_t watermark);
+
+ private:
+  // Atomically increment 'version_' with a full memory barrier. This is not
+  // inline so that windows.h need not be included in this header.
+  void incrementVersion();
+
+  // Make the version odd, then wait for registered readers to finish.
+  void beginWrite();
+
+  // Same as the LONG type from windows.h.
+  volatile long version_;
+  volatile std::size_t watermark_;
+  mutable volatile long num_registered_readers_;
+  Mutex write_mutex_;
+
+  DISALLOW_COPY_AND_ASSIGN(VersionedLatchImplWindows);
+};
+typedef VersionedLatchImplWindows VersionedLatch;
+
+/**
+ * @brief Implementation of VersionedLatchWriteLock using MS Windows threads
+ *        and interlocked operations.
+ **/
+class VersionedLatchWriteLockImplWindows : public VersionedLatchWriteLockInterface {
+ public:
+  explicit inline VersionedLatchWriteLockImplWindows(VersionedLatchImplWindows &latch)  // NOLINT - c++11-style interface
+      : latch_ptr_(&latch) {
+    latch_ptr_->lockWrite();
+  }
+
+  inline ~VersionedLatchWriteLockImplWindows() {
+    latch_ptr_->unlockWrite();
+  }
+
+ private:
+  VersionedLatchImplWindows *latch_ptr_;
+
+  DISALLOW_COPY_AND_ASSIGN(VersionedLatchWriteLockImplWindows);
+};
+typedef VersionedLatchWriteLockImplWindows VersionedLatchWriteLock;
+
+/**
+ * @brief Implementation of VersionedLatchAppendLock using MS Windows threads
+ *        and interlocked operations.
+ **/
+class VersionedLatchAppendLockImplWindows : public VersionedLatchAppendLockInterface {
+ public:
+  explicit inline VersionedLatchAppendLockImplWindows(VersionedLatchImplWindows &latch)  // NOLINT - c++11-style interface
+      : latch_ptr_(&latch) {
+    latch_ptr_->lockAppend();
+  }
+
+  inline ~VersionedLatchAppendLockImplWindows() {
+    latch_ptr_->unlockWrite();
+  }
+
+ private:
+  VersionedLatchImplWindows *latch_ptr_;
+
+  DISALLOW_COPY_AND_ASSIGN(VersionedLatchAppendLockImplWindows);
+};
+typedef VersionedLatchAppendLockImplWindows VersionedLatchAppendLock;
+
+/** @} */
+
+}  // namespace quickstep
+
+#endif  // QUICKSTEP_THREADING_WINDOWS_VERSIONED_LATCH_HPP_
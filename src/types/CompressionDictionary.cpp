@@ -22,20 +22,24 @@
 
 #include <algorithm>
 #include <cstddef>
+#include <cstring>
 #include <iterator>
 #include <utility>
 
 #include "types/Comparison.hpp"
 #include "types/Type.hpp"
 #include "types/TypeInstance.hpp"
+#include "types/strnlen.hpp"
 #include "utility/CstdintCompat.hpp"
 #include "utility/Macros.hpp"
 #include "utility/ScopedPtr.hpp"
 
 using std::lower_bound;
+using std::memcmp;
 using std::pair;
 using std::size_t;
 using std::uint32_t;
+using std::uint64_t;
 using std::upper_bound;
 
 namespace quickstep {
@@ -175,8 +179,71 @@ class CompressionDictionaryIterator : public std::iterator<std::random_access_it
   uint32_t code_;
 };
 
+// Predicate for EytzingerSearch() which finds the first value which is not
+// less than a given value, like std::lower_bound().
+class LowerBoundPredicate {
+ public:
+  LowerBoundPredicate(const UncheckedComparator &less_comparator, const void *value)
+      : less_comparator_(less_comparator),
+        value_(value) {
+  }
+
+  inline bool operator() (const void *entry) const {
+    return less_comparator_.compareDataPtrs(entry, value_);
+  }
+
+ private:
+  const UncheckedComparator &less_comparator_;
+  const void *value_;
+};
+
+// Predicate for EytzingerSearch() which finds the first value which is
+// greater than a given value, like std::upper_bound().
+class UpperBoundPredicate {
+ public:
+  UpperBoundPredicate(const UncheckedComparator &less_comparator, const void *value)
+      : less_comparator_(less_comparator),
+        value_(value) {
+  }
+
+  inline bool operator() (const void *entry) const {
+    return !less_comparator_.compareDataPtrs(value_, entry);
+  }
+
+ private:
+  const UncheckedComparator &less_comparator_;
+  const void *value_;
+};
+
+// Search the codes of 'dictionary' laid out in Eytzinger order for the first
+// code whose value does not satisfy 'before_target' (which must be true for a
+// prefix of the codes in sorted order). Returns numberOfCodes() if every
+// value satisfies 'before_target'. The top levels of the implicit search
+// tree are stored contiguously at the front of 'eytzinger_codes', so they
+// stay in cache across searches.
+template <typename CompressionDictionaryT, typename PredicateT>
+uint32_t EytzingerSearch(const CompressionDictionaryT &dictionary,
+                         const uint32_t *eytzinger_codes,
+                         const PredicateT &before_target) {
+  const uint64_t num_codes = dictionary.numberOfCodes();
+  uint64_t node = 1;
+  while (node <= num_codes) {
+    node = 2 * node
+           + (before_target(dictionary.getUntypedValueForCode(eytzinger_codes[node - 1])) ? 1 : 0);
+  }
+  // The answer is the last node where the search went left. Strip the
+  // trailing right turns, then the final left turn, to get back to it.
+  while (node & 1) {
+    node >>= 1;
+  }
+  node >>= 1;
+  return (node == 0) ? num_codes : eytzinger_codes[node - 1];
+}
+
 }  // anonymous namespace
 
+const std::uint32_t CompressionDictionary::kMinEntriesForLookupTables;
+const std::uint32_t CompressionDictionary::kHashBucketSlots;
 
 CompressionDictionary::CompressionDictionary(
     const Type &type,
@@ -184,7 +251,11 @@ CompressionDictionary::CompressionDictionary(
     const std::size_t dictionary_memory_size)
     : type_(type),
       dictionary_memory_(dictionary_memory),
-      dictionary_memory_size_(dictionary_memory_size) {
+      dictionary_memory_size_(dictionary_memory_size),
+      eytzinger_codes_(NULL),
+      hash_slots_(NULL),
+      num_hash_buckets_(0),
+      hash_seed_(0) {
   uint32_t num_codes = numberOfCodes();
   for (code_length_bits_ = 32; code_length_bits_ > 0; --code_length_bits_) {
     if (num_codes >> (code_length_bits_ - 1)) {
@@ -199,7 +270,100 @@ CompressionDictionary::CompressionDictionary(
   less_comparator_.reset(less_comparison.makeUncheckedComparatorForTypes(type_, type_));
 }
 
+bool CompressionDictionary::TypeSupportsHashLookup(const Type &type) {
+  switch (type.getTypeID()) {
+    case Type::kInt:
+    case Type::kLong:
+    case Type::kChar:
+    case Type::kVarChar:
+      return true;
+    default:
+      // Floating-point values may compare equal with different
+      // representations (e.g. positive and negative zero).
+      return false;
+  }
+}
+
+size_t CompressionDictionary::LookupTablesSizeBytes(const Type &type,
+                                                    const std::size_t base_dictionary_size,
+                                                    const std::size_t num_entries) {
+  if (num_entries < kMinEntriesForLookupTables) {
+    return 0;
+  }
+
+  size_t tables_size = LookupTablesOffset(base_dictionary_size) - base_dictionary_size
+                       + num_entries * sizeof(uint32_t)  // Eytzinger codes.
+                       + 2 * sizeof(uint32_t);  // Hash table bucket count and seed.
+  if (TypeSupportsHashLookup(type)) {
+    tables_size += NumHashBucketsForEntries(num_entries) * kHashBucketSlots * sizeof(uint32_t);
+  }
+  return tables_size;
+}
+
+uint64_t CompressionDictionary::HashUntypedValue(const Type &type,
+                                                 const void *value,
+                                                 const std::uint32_t seed) {
+  const unsigned char *bytes = static_cast<const unsigned char*>(value);
+  size_t length;
+  if ((type.getTypeID() == Type::kChar) || (type.getTypeID() == Type::kVarChar)) {
+    length = strnlen(static_cast<const char*>(value), type.maximumByteLength());
+  } else {
+    length = type.maximumByteLength();
+  }
+
+  // FNV-1a, seeded by perturbing the offset basis, followed by the 64-bit
+  // finalizer from MurmurHash3 so that both halves of the hash are well
+  // mixed.
+  uint64_t hash = 14695981039346656037ULL ^ (static_cast<uint64_t>(seed) * 0x9E3779B97F4A7C15ULL);
+  for (size_t i = 0; i < length; ++i) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCDULL;
+  hash ^= hash >> 33;
+  hash *= 0xC4CEB9FE1A85EC53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+bool CompressionDictionary::UntypedValuesEqualForHashLookup(const Type &type,
+                                                            const void *left,
+                                                            const void *right) {
+  if ((type.getTypeID() == Type::kChar) || (type.getTypeID() == Type::kVarChar)) {
+    const size_t left_length = strnlen(static_cast<const char*>(left), type.maximumByteLength());
+    return (left_length == strnlen(static_cast<const char*>(right), type.maximumByteLength()))
+           && (memcmp(left, right, left_length) == 0);
+  } else {
+    return memcmp(left, right, type.maximumByteLength()) == 0;
+  }
+}
+
+void CompressionDictionary::initializeLookupTables(const std::size_t base_dictionary_size) {
+  const uint32_t num_codes = numberOfCodes();
+  const size_t tables_size = LookupTablesSizeBytes(type_, base_dictionary_size, num_codes);
+  if ((tables_size == 0) || (dictionary_memory_size_ < base_dictionary_size + tables_size)) {
+    return;
+  }
+
+  eytzinger_codes_ = reinterpret_cast<const uint32_t*>(
+      static_cast<const char*>(dictionary_memory_) + LookupTablesOffset(base_dictionary_size));
+
+  const uint32_t *hash_header = eytzinger_codes_ + num_codes;
+  num_hash_buckets_ = hash_header[0];
+  hash_seed_ = hash_header[1];
+  hash_slots_ = hash_header + 2;
+  if ((num_hash_buckets_ != 0)
+      && (!TypeSupportsHashLookup(type_) || (num_hash_buckets_ != NumHashBucketsForEntries(num_codes)))) {
+    FATAL_ERROR("Attempted to create a CompressionDictionary with a malformed hash table.");
+  }
+}
+
 uint32_t CompressionDictionary::getCodeForUntypedValue(const void *value) const {
+  if (num_hash_buckets_ != 0) {
+    return getCodeForUntypedValueFromHashTable(value);
+  }
+
   uint32_t candidate_code = getLowerBoundCodeForUntypedValue(value);
   if (candidate_code == numberOfCodes()) {
     return candidate_code;
@@ -212,6 +376,21 @@ uint32_t CompressionDictionary::getCodeForUntypedValue(const void *value) const
   }
 }
 
+uint32_t CompressionDictionary::getCodeForUntypedValueFromHashTable(const void *value) const {
+  const uint64_t hash = HashUntypedValue(type_, value, hash_seed_);
+  for (int choice = 0; choice < 2; ++choice) {
+    const uint32_t *bucket = hash_slots_
+                             + HashBucketForHash(hash, num_hash_buckets_, choice == 1) * kHashBucketSlots;
+    for (uint32_t slot = 0; slot < kHashBucketSlots; ++slot) {
+      if ((bucket[slot] != 0)
+          && UntypedValuesEqualForHashLookup(type_, value, getUntypedValueForCode(bucket[slot] - 1))) {
+        return bucket[slot] - 1;
+      }
+    }
+  }
+  return numberOfCodes();
+}
+
 std::pair<uint32_t, uint32_t> CompressionDictionary::getLimitCodesForComparisonUntyped(
     const Comparison::ComparisonID comp,
     const void *value) const {
@@ -313,17 +492,22 @@ FixedLengthTypeCompressionDictionary::FixedLengthTypeCompressionDictionary(
     FATAL_ERROR("Attempted to create a FixedLengthTypeCompressionDictionary for a variable-length Type.");
   }
 
-  if (numberOfCodes() * type_byte_length_ + sizeof(uint32_t) < dictionary_memory_size_) {
+  const size_t base_dictionary_size = numberOfCodes() * type_byte_length_ + sizeof(uint32_t);
+  if (dictionary_memory_size_ < base_dictionary_size) {
     FATAL_ERROR("Attempted to create a FixedLengthTypeCompressionDictionary with "
                 << dictionary_memory_size_ << " bytes of memory, which is insufficient for "
                 << numberOfCodes() << " entries of type " << type_.getName() << ".");
   }
   // NOTE(chasseur): If dictionary_memory_size_ is larger than the required
   // amount of memory, it's not strictly an error, but there will be wasted
-  // space.
+  // space (unless the extra space holds lookup tables).
+  initializeLookupTables(base_dictionary_size);
 }
 
 uint32_t FixedLengthTypeCompressionDictionary::getLowerBoundCodeForUntypedValue(const void *value) const {
+  if (eytzinger_codes_ != NULL) {
+    return EytzingerSearch(*this, eytzinger_codes_, LowerBoundPredicate(*less_comparator_, value));
+  }
   return lower_bound(CompressionDictionaryIterator<FixedLengthTypeCompressionDictionary>(*this, 0),
                      CompressionDictionaryIterator<FixedLengthTypeCompressionDictionary>(*this, numberOfCodes()),
                      value,
@@ -331,6 +515,9 @@ uint32_t FixedLengthTypeCompressionDictionary::getLowerBoundCodeForUntypedValue(
 }
 
 uint32_t FixedLengthTypeCompressionDictionary::getUpperBoundCodeForUntypedValue(const void *value) const {
+  if (eytzinger_codes_ != NULL) {
+    return EytzingerSearch(*this, eytzinger_codes_, UpperBoundPredicate(*less_comparator_, value));
+  }
   return upper_bound(CompressionDictionaryIterator<FixedLengthTypeCompressionDictionary>(*this, 0),
                      CompressionDictionaryIterator<FixedLengthTypeCompressionDictionary>(*this, numberOfCodes()),
                      value,
@@ -345,6 +532,9 @@ uint32_t FixedLengthTypeCompressionDictionary::getLowerBoundCodeForDifferentType
       Comparison::GetComparison(Comparison::kLess).makeUncheckedComparatorForTypes(
           type_,
           value.getType()));
+  if (eytzinger_codes_ != NULL) {
+    return EytzingerSearch(*this, eytzinger_codes_, LowerBoundPredicate(*comp, value.getDataPtr()));
+  }
   return lower_bound(CompressionDictionaryIterator<FixedLengthTypeCompressionDictionary>(*this, 0),
                      CompressionDictionaryIterator<FixedLengthTypeCompressionDictionary>(*this, numberOfCodes()),
                      value.getDataPtr(),
@@ -359,6 +549,9 @@ uint32_t FixedLengthTypeCompressionDictionary::getUpperBoundCodeForDifferentType
       Comparison::GetComparison(Comparison::kLess).makeUncheckedComparatorForTypes(
           value.getType(),
           type_));
+  if (eytzinger_codes_ != NULL) {
+    return EytzingerSearch(*this, eytzinger_codes_, UpperBoundPredicate(*comp, value.getDataPtr()));
+  }
   return upper_bound(CompressionDictionaryIterator<FixedLengthTypeCompressionDictionary>(*this, 0),
                      CompressionDictionaryIterator<FixedLengthTypeCompressionDictionary>(*this, numberOfCodes()),
                      value.getDataPtr(),
@@ -382,9 +575,19 @@ VariableLengthTypeCompressionDictionary::VariableLengthTypeCompressionDictionary
                                  + (num_codes + 1) * sizeof(uint32_t);
 
   DEBUG_ASSERT(paranoidOffsetsCheck());
+
+  if (num_codes > 0) {
+    const void *last_value = getUntypedValueForCode(num_codes - 1);
+    initializeLookupTables(static_cast<const char*>(last_value)
+                           + type_.determineByteLength(last_value)
+                           - static_cast<const char*>(dictionary_memory_));
+  }
 }
 
 uint32_t VariableLengthTypeCompressionDictionary::getLowerBoundCodeForUntypedValue(const void *value) const {
+  if (eytzinger_codes_ != NULL) {
+    return EytzingerSearch(*this, eytzinger_codes_, LowerBoundPredicate(*less_comparator_, value));
+  }
   return lower_bound(CompressionDictionaryIterator<VariableLengthTypeCompressionDictionary>(*this, 0),
                      CompressionDictionaryIterator<VariableLengthTypeCompressionDictionary>(*this, numberOfCodes()),
                      value,
@@ -392,6 +595,9 @@ uint32_t VariableLengthTypeCompressionDictionary::getLowerBoundCodeForUntypedVal
 }
 
 uint32_t VariableLengthTypeCompressionDictionary::getUpperBoundCodeForUntypedValue(const void *value) const {
+  if (eytzinger_codes_ != NULL) {
+    return EytzingerSearch(*this, eytzinger_codes_, UpperBoundPredicate(*less_comparator_, value));
+  }
   return upper_bound(CompressionDictionaryIterator<VariableLengthTypeCompressionDictionary>(*this, 0),
                      CompressionDictionaryIterator<VariableLengthTypeCompressionDictionary>(*this, numberOfCodes()),
                      value,
@@ -406,6 +612,9 @@ uint32_t VariableLengthTypeCompressionDictionary::getLowerBoundCodeForDifferentT
       Comparison::GetComparison(Comparison::kLess).makeUncheckedComparatorForTypes(
           type_,
           value.getType()));
+  if (eytzinger_codes_ != NULL) {
+    return EytzingerSearch(*this, eytzinger_codes_, LowerBoundPredicate(*comp, value.getDataPtr()));
+  }
   return lower_bound(CompressionDictionaryIterator<VariableLengthTypeCompressionDictionary>(*this, 0),
                      CompressionDictionaryIterator<VariableLengthTypeCompressionDictionary>(*this, numberOfCodes()),
                      value.getDataPtr(),
@@ -420,6 +629,9 @@ uint32_t VariableLengthTypeCompressionDictionary::getUpperBoundCodeForDifferentT
       Comparison::GetComparison(Comparison::kLess).makeUncheckedComparatorForTypes(
           value.getType(),
           type_));
+  if (eytzinger_codes_ != NULL) {
+    return EytzingerSearch(*this, eytzinger_codes_, UpperBoundPredicate(*comp, value.getDataPtr()));
+  }
   return upper_bound(CompressionDictionaryIterator<VariableLengthTypeCompressionDictionary>(*this, 0),
                      CompressionDictionaryIterator<VariableLengthTypeCompressionDictionary>(*this, numberOfCodes()),
                      value.getDataPtr(),
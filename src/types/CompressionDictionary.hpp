@@ -43,9 +43,31 @@ namespace quickstep {
  *        fixed-length and variable-length types.
  * @note Codes in a CompressionDictionary compare in the same order as the
  *       underlying values.
+ * @note A physical dictionary may optionally be followed by lookup tables
+ *       (see CompressionDictionaryBuilder), which are detected from the size
+ *       of the dictionary memory. The lookup tables begin at the first 4-byte
+ *       aligned offset after the values and consist of the codes laid out in
+ *       Eytzinger (breadth-first) order for lower/upper-bound searches,
+ *       followed by the number of buckets and seed of a bucketized cuckoo
+ *       hash table for equality lookups and then the table itself, which
+ *       has kHashBucketSlots slots per bucket containing codes plus one (or
+ *       zero for an empty slot). The lookup tables contain only offsets and
+ *       codes, so they remain valid wherever the dictionary is stored.
  **/
 class CompressionDictionary {
  public:
+  /**
+   * @brief The minimum number of entries a dictionary must have for lookup
+   *        tables to be built for it. Smaller dictionaries are cheap enough
+   *        to search directly.
+   **/
+  static const std::uint32_t kMinEntriesForLookupTables = 64;
+
+  /**
+   * @brief The number of slots in each bucket of the hash table.
+   **/
+  static const std::uint32_t kHashBucketSlots = 4;
+
   /**
    * @brief Constructor.
    *
@@ -62,6 +84,117 @@ class CompressionDictionary {
   virtual ~CompressionDictionary() {
   }
 
+  /**
+   * @brief Determine whether equality lookups for values of a Type can use a
+   *        hash table, i.e. whether two values of the Type are equal exactly
+   *        when the significant bytes of their representations are equal.
+   *
+   * @param type The Type to check.
+   * @return Whether a hash table can be built for dictionaries of type.
+   **/
+  static bool TypeSupportsHashLookup(const Type &type);
+
+  /**
+   * @brief Get the number of buckets in the hash table for a dictionary with
+   *        the specified number of entries.
+   *
+   * @param num_entries The number of entries in a dictionary.
+   * @return The number of hash buckets for the dictionary.
+   **/
+  static std::uint32_t NumHashBucketsForEntries(const std::size_t num_entries) {
+    // Targets a load factor of about 80%, which a bucketized cuckoo hash
+    // table with two choices of bucket reliably achieves.
+    return num_entries * 5 / (4 * kHashBucketSlots) + 1;
+  }
+
+  /**
+   * @brief Get the offset of the lookup tables from the start of a physical
+   *        dictionary.
+   *
+   * @param base_dictionary_size The size, in bytes, of the physical
+   *        dictionary without lookup tables.
+   * @return The offset, in bytes, of the lookup tables.
+   **/
+  static std::size_t LookupTablesOffset(const std::size_t base_dictionary_size) {
+    return (base_dictionary_size + sizeof(std::uint32_t) - 1) & ~(sizeof(std::uint32_t) - 1);
+  }
+
+  /**
+   * @brief Get the number of bytes occupied by the lookup tables for a
+   *        dictionary, including any padding between the values and the
+   *        lookup tables.
+   *
+   * @param type The Type of values in the dictionary.
+   * @param base_dictionary_size The size, in bytes, of the physical
+   *        dictionary without lookup tables.
+   * @param num_entries The number of entries in the dictionary.
+   * @return The size, in bytes, of the lookup tables, or 0 if a dictionary
+   *         of num_entries doesn't get lookup tables.
+   **/
+  static std::size_t LookupTablesSizeBytes(const Type &type,
+                                           const std::size_t base_dictionary_size,
+                                           const std::size_t num_entries);
+
+  /**
+   * @brief Hash a value for the hash table of a dictionary.
+   *
+   * @param type The Type of value, which must support hash lookups.
+   * @param value An untyped pointer to a value of type.
+   * @param seed The seed for the hash function.
+   * @return The hash of value.
+   **/
+  static std::uint64_t HashUntypedValue(const Type &type,
+                                        const void *value,
+                                        const std::uint32_t seed);
+
+  /**
+   * @brief Get the hash bucket for a hash value.
+   *
+   * @param hash A hash value from HashUntypedValue().
+   * @param num_buckets The number of buckets in the hash table.
+   * @param second If true, get the second choice of bucket instead of the
+   *        first.
+   * @return The index of the bucket for hash.
+   **/
+  static std::uint32_t HashBucketForHash(const std::uint64_t hash,
+                                         const std::uint32_t num_buckets,
+                                         const bool second) {
+    const std::uint64_t half = second ? (hash >> 32) : (hash & 0xFFFFFFFFu);
+    return static_cast<std::uint32_t>((half * num_buckets) >> 32);
+  }
+
+  /**
+   * @brief Check whether two values of a Type which supports hash lookups are
+   *        equal.
+   *
+   * @param type The Type of the values.
+   * @param left An untyped pointer to a value of type.
+   * @param right An untyped pointer to a value of type.
+   * @return Whether left and right are equal.
+   **/
+  static bool UntypedValuesEqualForHashLookup(const Type &type,
+                                              const void *left,
+                                              const void *right);
+
+  /**
+   * @brief Determine whether this dictionary has lookup tables.
+   *
+   * @return Whether this dictionary has lookup tables.
+   **/
+  inline bool hasLookupTables() const {
+    return eytzinger_codes_ != NULL;
+  }
+
+  /**
+   * @brief Determine whether this dictionary has a hash table for equality
+   *        lookups.
+   *
+   * @return Whether this dictionary has a hash table.
+   **/
+  inline bool hasHashTable() const {
+    return num_hash_buckets_ != 0;
+  }
+
   /**
    * @brief Get the number of code/value mappings in this dictionary.
    *
@@ -172,8 +305,9 @@ class CompressionDictionary {
   /**
    * @brief Get the compressed code that represents the specified untyped
    *        value.
-   * @note This uses a binary search to find the appropriate code. It runs in
-   *       O(log(n)) time.
+   * @note This probes the hash table if this dictionary has one, which takes
+   *       constant time. Otherwise, this uses a binary search to find the
+   *       appropriate code, which runs in O(log(n)) time.
    *
    * @param value An untyped pointer to a value, which must be of the exact
    *        same Type as the Type used to construct this dictionary.
@@ -310,6 +444,11 @@ class CompressionDictionary {
   virtual std::uint32_t getLowerBoundCodeForDifferentTypedValue(const TypeInstance &value) const = 0;
   virtual std::uint32_t getUpperBoundCodeForDifferentTypedValue(const TypeInstance &value) const = 0;
 
+  // Locate the lookup tables (if any) which follow the physical dictionary.
+  // Called by the constructors of subclasses, which know the size of the
+  // physical dictionary without lookup tables.
+  void initializeLookupTables(const std::size_t base_dictionary_size);
+
   const Type &type_;
   const void *dictionary_memory_;
   const std::size_t dictionary_memory_size_;
@@ -317,7 +456,18 @@ class CompressionDictionary {
 
   ScopedPtr<UncheckedComparator> less_comparator_;
 
+  // Codes in Eytzinger order (the code at index i is the (i+1)-th node of an
+  // implicit binary search tree), or NULL if there are no lookup tables.
+  const std::uint32_t *eytzinger_codes_;
+  // The slots of the hash table. Only valid if 'num_hash_buckets_' is
+  // nonzero.
+  const std::uint32_t *hash_slots_;
+  std::uint32_t num_hash_buckets_;
+  std::uint32_t hash_seed_;
+
  private:
+  std::uint32_t getCodeForUntypedValueFromHashTable(const void *value) const;
+
   std::uint32_t getCodeForDifferentTypedValue(const TypeInstance &value) const;
 
   std::pair<std::uint32_t, std::uint32_t> getLimitCodesForComparisonDifferentTyped(
@@ -20,211 +20,387 @@
 
 #include "types/CompressionDictionaryBuilder.hpp"
 
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
 #include <limits>
-#include <map>
-#include <utility>
+#include <vector>
 
 #include "types/Comparison.hpp"
+#include "types/CompressionDictionary.hpp"
 #include "types/Type.hpp"
-#include "types/TypeInstance.hpp"
 #include "utility/CstdintCompat.hpp"
 #include "utility/Macros.hpp"
-#include "utility/PtrVector.hpp"
 
+using std::int64_t;
+using std::lower_bound;
+using std::memcpy;
+using std::memset;
 using std::numeric_limits;
-using std::map;
-using std::pair;
+using std::size_t;
+using std::sort;
+using std::swap;
+using std::uint8_t;
 using std::uint32_t;
+using std::uint64_t;
+using std::unique;
+using std::vector;
 
 namespace quickstep {
 
-CompressionDictionaryBuilder::CompressionDictionaryBuilder(const Type &type)
+namespace {
+
+// The number of different hash seeds to try when building a hash table before
+// giving up and leaving the dictionary without one.
+const uint32_t kMaxHashSeeds = 8;
+
+// The number of entries that may be displaced while inserting a single entry
+// into a cuckoo hash table before the insertion is considered to have failed.
+const int kMaxCuckooKicks = 500;
+
+// Recursively fill 'eytzinger_codes' with the codes of a sorted dictionary
+// of 'num_codes' entries in Eytzinger order, visiting the subtree rooted at
+// 'node' (1-based) in order. Returns the next code to be assigned.
+uint32_t FillEytzingerCodes(uint32_t *eytzinger_codes,
+                            const size_t num_codes,
+                            const size_t node,
+                            uint32_t next_code) {
+  if (node <= num_codes) {
+    next_code = FillEytzingerCodes(eytzinger_codes, num_codes, 2 * node, next_code);
+    eytzinger_codes[node - 1] = next_code++;
+    next_code = FillEytzingerCodes(eytzinger_codes, num_codes, 2 * node + 1, next_code);
+  }
+  return next_code;
+}
+
+// Functor which compares pointers to values of a numeric type directly,
+// avoiding a virtual call for each comparison when sorting.
+template <typename CppType>
+class NumericDataPtrLess {
+ public:
+  inline bool operator() (const void *left, const void *right) const {
+    return *static_cast<const CppType*>(left) < *static_cast<const CppType*>(right);
+  }
+};
+
+// Functor which checks whether two values are equal, assuming that 'left'
+// is not greater than 'right' (i.e. that they are adjacent in a sorted
+// sequence).
+template <typename LessComparatorT>
+class AdjacentValuesEqual {
+ public:
+  explicit AdjacentValuesEqual(const LessComparatorT &less_comparator)
+      : less_comparator_(less_comparator) {
+  }
+
+  inline bool operator() (const void *left, const void *right) const {
+    return !less_comparator_(left, right);
+  }
+
+ private:
+  const LessComparatorT &less_comparator_;
+};
+
+}  // anonymous namespace
+
+CompressionDictionaryBuilder::CompressionDictionaryBuilder(const Type &type,
+                                                           const bool build_lookup_tables)
     : type_(type),
-      last_value_by_reference_(NULL),
-      code_length_bits_(0) {
+      build_lookup_tables_(build_lookup_tables),
+      total_value_size_(0),
+      last_insert_position_(0),
+      last_insert_valid_(false) {
   const Comparison &less_comparison = Comparison::GetComparison(Comparison::kLess);
   if (!less_comparison.canCompareTypes(type_, type_)) {
     FATAL_ERROR("Attempted to create a CompressionDictionaryBuilder for a Type "
                 "which can not be compared by LessComparison.");
   }
   less_comparator_.reset(less_comparison.makeUncheckedComparatorForTypes(type_, type_));
-
-  value_map_.reset(new map<const void*,
-                           const TypeInstance*,
-                           STLUncheckedComparatorWrapper>(
-                               STLUncheckedComparatorWrapper(*less_comparator_)));
 }
 
-bool CompressionDictionaryBuilder::insertEntry(const TypeInstance &value) {
-  DEBUG_ASSERT(value.getType().equals(type_));
-  if (value.isNull()) {
-    FATAL_ERROR("Attempted to insert a NULL value into a CompressionDictionaryBuilder.");
-  }
-  if (value_map_->size() == numeric_limits<uint32_t>::max()) {
-    FATAL_ERROR("Attempted to insert a value into a CompressionDictionaryBuilder which "
-                "would cause it to overflow the limit of " << numeric_limits<uint32_t>::max() << " entries.");
+uint8_t CompressionDictionaryBuilder::CodeLengthBitsForEntries(const std::size_t num_entries) {
+  // Even a dictionary with a single entry uses 1-bit codes.
+  uint8_t code_length_bits = 1;
+  while ((code_length_bits < 32) && ((static_cast<uint64_t>(1) << code_length_bits) < num_entries)) {
+    ++code_length_bits;
   }
+  return (num_entries == 0) ? 0 : code_length_bits;
+}
 
-  pair<map<const void*, const TypeInstance*, STLUncheckedComparatorWrapper>::iterator, bool>
-      insertion_result = value_map_->insert(pair<const void*, const TypeInstance*>(value.getDataPtr(), &value));
-  if (!insertion_result.second) {
-    // This value has already been inserted.
-    return false;
+size_t CompressionDictionaryBuilder::dictionarySizeBytesFor(const std::size_t num_entries,
+                                                           const std::size_t total_value_size) const {
+  const size_t base_dictionary_size = baseDictionarySizeBytesFor(num_entries, total_value_size);
+  if (build_lookup_tables_) {
+    return base_dictionary_size
+           + CompressionDictionary::LookupTablesSizeBytes(type_, base_dictionary_size, num_entries);
+  } else {
+    return base_dictionary_size;
   }
+}
 
-  // Make a copy of 'value'.
-  value_copies_.push_back(value.makeCopy());
+void CompressionDictionaryBuilder::buildDictionary(void *location) const {
+  buildBaseDictionary(location);
+  if (build_lookup_tables_) {
+    buildLookupTables(location, baseDictionarySizeBytesFor(entries_.size(), total_value_size_));
+  }
+}
 
-  // Modify the newly-inserted entry in 'value_map_' to point to the copy
-  // instead of the original 'value', which might be deleted by the caller.
-  //
-  // This const_cast hack is safe, because although we are modifying the key
-  // of an entry in the map, we are changing the pointer to refer to a copy of
-  // the same value, so the ordering/position of the changed key will be
-  // exactly the same as the original.
-  const_cast<const void *&>(insertion_result.first->first) = value_copies_.back().getDataPtr();
-  insertion_result.first->second = &(value_copies_.back());
+bool CompressionDictionaryBuilder::containsUntypedValue(const void *value) const {
+  vector<const void*>::const_iterator it = lower_bound(entries_.begin(),
+                                                       entries_.end(),
+                                                       value,
+                                                       STLUncheckedComparatorWrapper(*less_comparator_));
+  return (it != entries_.end()) && !less_comparator_->compareDataPtrs(value, *it);
+}
 
-  if ((code_length_bits_ == 0) || (value_map_->size() == (1u << code_length_bits_) + 1)) {
-    ++code_length_bits_;
+void CompressionDictionaryBuilder::insertEntriesByReference(vector<const void*> *values) {
+  last_insert_valid_ = false;
+  if (values->empty()) {
+    return;
   }
-  last_value_by_reference_ = NULL;
 
-  return true;
+  switch (type_.getTypeID()) {
+    case Type::kInt:
+      insertEntriesByReferenceWithComparator(NumericDataPtrLess<int>(), values);
+      break;
+    case Type::kLong:
+      insertEntriesByReferenceWithComparator(NumericDataPtrLess<int64_t>(), values);
+      break;
+    case Type::kFloat:
+      insertEntriesByReferenceWithComparator(NumericDataPtrLess<float>(), values);
+      break;
+    case Type::kDouble:
+      insertEntriesByReferenceWithComparator(NumericDataPtrLess<double>(), values);
+      break;
+    default:
+      insertEntriesByReferenceWithComparator(STLUncheckedComparatorWrapper(*less_comparator_), values);
+      break;
+  }
 }
 
-bool CompressionDictionaryBuilder::insertEntryByReference(const TypeInstance &value) {
-  DEBUG_ASSERT(value.getType().equals(type_));
-  if (value.isNull()) {
-    FATAL_ERROR("Attempted to insert a NULL value into a CompressionDictionaryBuilder.");
+template <typename LessComparatorT>
+void CompressionDictionaryBuilder::insertEntriesByReferenceWithComparator(
+    const LessComparatorT &less_comparator,
+    vector<const void*> *values) {
+  // Sort and deduplicate the new values.
+  sort(values->begin(), values->end(), less_comparator);
+  values->erase(unique(values->begin(), values->end(), AdjacentValuesEqual<LessComparatorT>(less_comparator)),
+                values->end());
+
+  // Merge them with the existing entries, skipping values which are already
+  // present.
+  vector<const void*> merged_entries;
+  merged_entries.reserve(entries_.size() + values->size());
+  vector<const void*>::const_iterator entry_it = entries_.begin();
+  vector<const void*>::const_iterator value_it = values->begin();
+  while ((entry_it != entries_.end()) && (value_it != values->end())) {
+    if (less_comparator(*entry_it, *value_it)) {
+      merged_entries.push_back(*entry_it);
+      ++entry_it;
+    } else {
+      if (less_comparator(*value_it, *entry_it)) {
+        merged_entries.push_back(*value_it);
+        total_value_size_ += valueByteLength(*value_it);
+      }
+      ++value_it;
+    }
   }
-  if (value_map_->size() == numeric_limits<uint32_t>::max()) {
-    FATAL_ERROR("Attempted to insert a value into a CompressionDictionaryBuilder which "
+  for (; entry_it != entries_.end(); ++entry_it) {
+    merged_entries.push_back(*entry_it);
+  }
+  for (; value_it != values->end(); ++value_it) {
+    merged_entries.push_back(*value_it);
+    total_value_size_ += valueByteLength(*value_it);
+  }
+
+  if (merged_entries.size() > numeric_limits<uint32_t>::max()) {
+    FATAL_ERROR("Attempted to insert values into a CompressionDictionaryBuilder which "
                 "would cause it to overflow the limit of " << numeric_limits<uint32_t>::max() << " entries.");
   }
+  if (total_value_size_ > numeric_limits<uint32_t>::max()) {
+    FATAL_ERROR("Attempted to insert values into a CompressionDictionaryBuilder "
+                "which would overflow the limit of " << numeric_limits<uint32_t>::max() << " total bytes.");
+  }
 
-  pair<map<const void*, const TypeInstance*, STLUncheckedComparatorWrapper>::iterator, bool>
-      insertion_result = value_map_->insert(pair<const void*, const TypeInstance*>(value.getDataPtr(), &value));
-  if (insertion_result.second) {
-    if ((code_length_bits_ == 0) || (value_map_->size() == (1u << code_length_bits_) + 1)) {
-      ++code_length_bits_;
-    }
-    last_value_by_reference_ = &value;
+  entries_.swap(merged_entries);
+}
 
-    return true;
-  } else {
+bool CompressionDictionaryBuilder::insertEntryByReference(const void *value) {
+  last_insert_valid_ = false;
+  vector<const void*>::iterator it = lower_bound(entries_.begin(),
+                                                 entries_.end(),
+                                                 value,
+                                                 STLUncheckedComparatorWrapper(*less_comparator_));
+  if ((it != entries_.end()) && !less_comparator_->compareDataPtrs(value, *it)) {
     // This value has already been inserted.
     return false;
   }
+
+  if (entries_.size() == numeric_limits<uint32_t>::max()) {
+    FATAL_ERROR("Attempted to insert a value into a CompressionDictionaryBuilder which "
+                "would cause it to overflow the limit of " << numeric_limits<uint32_t>::max() << " entries.");
+  }
+  const size_t value_size = valueByteLength(value);
+  if (total_value_size_ + value_size > numeric_limits<uint32_t>::max()) {
+    FATAL_ERROR("Attempted to insert a value into a CompressionDictionaryBuilder "
+                "which would overflow the limit of " << numeric_limits<uint32_t>::max() << " total bytes.");
+  }
+
+  last_insert_position_ = it - entries_.begin();
+  last_insert_valid_ = true;
+  entries_.insert(it, value);
+  total_value_size_ += value_size;
+  return true;
 }
 
 void CompressionDictionaryBuilder::undoLastInsert() {
-  if (last_value_by_reference_ == NULL) {
-    if (value_copies_.empty()) {
-      FATAL_ERROR("Called undoLastInsert() on an empty CompressionDictionaryBuilder.");
+  if (!last_insert_valid_) {
+    FATAL_ERROR("Called undoLastInsert() on a CompressionDictionaryBuilder "
+                "without a single preceding insert to undo.");
+  }
+
+  total_value_size_ -= valueByteLength(entries_[last_insert_position_]);
+  entries_.erase(entries_.begin() + last_insert_position_);
+  last_insert_valid_ = false;
+}
+
+void CompressionDictionaryBuilder::buildLookupTables(void *location,
+                                                     const std::size_t base_dictionary_size) const {
+  const size_t num_entries = entries_.size();
+  const size_t tables_size = CompressionDictionary::LookupTablesSizeBytes(type_,
+                                                                          base_dictionary_size,
+                                                                          num_entries);
+  if (tables_size == 0) {
+    return;
+  }
+  memset(static_cast<char*>(location) + base_dictionary_size, 0, tables_size);
+
+  uint32_t *eytzinger_codes = reinterpret_cast<uint32_t*>(
+      static_cast<char*>(location) + CompressionDictionary::LookupTablesOffset(base_dictionary_size));
+  FillEytzingerCodes(eytzinger_codes, num_entries, 1, 0);
+
+  // The hash table header and slots are left zeroed (i.e. no hash table) if
+  // the Type doesn't support hashing or no seed yields a valid table.
+  uint32_t *hash_header = eytzinger_codes + num_entries;
+  if (!CompressionDictionary::TypeSupportsHashLookup(type_)) {
+    return;
+  }
+  vector<uint32_t> slots;
+  for (uint32_t seed = 0; seed < kMaxHashSeeds; ++seed) {
+    if (fillHashTable(seed, &slots)) {
+      hash_header[0] = CompressionDictionary::NumHashBucketsForEntries(num_entries);
+      hash_header[1] = seed;
+      memcpy(hash_header + 2, &(slots[0]), slots.size() * sizeof(uint32_t));
+      return;
     }
+  }
+}
 
-    value_map_->erase(value_copies_.back().getDataPtr());
-    value_copies_.removeBack();
-  } else {
-    value_map_->erase(last_value_by_reference_->getDataPtr());
-    last_value_by_reference_ = NULL;
+bool CompressionDictionaryBuilder::fillHashTable(const std::uint32_t seed,
+                                                 std::vector<std::uint32_t> *slots) const {
+  const uint32_t num_buckets = CompressionDictionary::NumHashBucketsForEntries(entries_.size());
+  const uint32_t bucket_slots = CompressionDictionary::kHashBucketSlots;
+  slots->assign(num_buckets * bucket_slots, 0);
+
+  vector<uint64_t> hashes;
+  hashes.reserve(entries_.size());
+  for (vector<const void*>::const_iterator it = entries_.begin();
+       it != entries_.end();
+       ++it) {
+    hashes.push_back(CompressionDictionary::HashUntypedValue(type_, *it, seed));
   }
 
-  if (value_map_->empty()) {
-    code_length_bits_ = 0;
-  } else if ((code_length_bits_ > 1) && (value_map_->size() == (1u << (code_length_bits_ - 1)))) {
-    --code_length_bits_;
+  for (uint32_t code = 0; code < entries_.size(); ++code) {
+    // Slots hold codes plus one, so that zero marks an empty slot.
+    uint32_t entry = code + 1;
+    uint32_t bucket = CompressionDictionary::HashBucketForHash(hashes[code], num_buckets, false);
+    bool placed = false;
+    for (int kick = 0; !placed && (kick < kMaxCuckooKicks); ++kick) {
+      // Look for an empty slot in either of the entry's buckets.
+      for (int choice = 0; !placed && (choice < 2); ++choice) {
+        uint32_t *candidate_bucket = &((*slots)[CompressionDictionary::HashBucketForHash(hashes[entry - 1],
+                                                                                         num_buckets,
+                                                                                         choice == 1)
+                                                * bucket_slots]);
+        for (uint32_t slot = 0; slot < bucket_slots; ++slot) {
+          if (candidate_bucket[slot] == 0) {
+            candidate_bucket[slot] = entry;
+            placed = true;
+            break;
+          }
+        }
+      }
+      if (placed) {
+        break;
+      }
+
+      // Both buckets are full, so displace an entry from the current bucket
+      // and move it to its other bucket.
+      swap(entry, (*slots)[bucket * bucket_slots + kick % bucket_slots]);
+      const uint32_t first_bucket = CompressionDictionary::HashBucketForHash(hashes[entry - 1],
+                                                                             num_buckets,
+                                                                             false);
+      bucket = (first_bucket == bucket)
+               ? CompressionDictionary::HashBucketForHash(hashes[entry - 1], num_buckets, true)
+               : first_bucket;
+    }
+    if (!placed) {
+      return false;
+    }
   }
+  return true;
 }
 
-FixedLengthTypeCompressionDictionaryBuilder::FixedLengthTypeCompressionDictionaryBuilder(const Type &type)
-    : CompressionDictionaryBuilder(type) {
+FixedLengthTypeCompressionDictionaryBuilder::FixedLengthTypeCompressionDictionaryBuilder(
+    const Type &type,
+    const bool build_lookup_tables)
+    : CompressionDictionaryBuilder(type, build_lookup_tables) {
   if (type_.isVariableLength()) {
     FATAL_ERROR("Attempted to create a FixedLengthTypeCompressionDictionaryBuilder "
                 "for a variable-length Type.");
   }
 }
 
-void FixedLengthTypeCompressionDictionaryBuilder::buildDictionary(void *location) const {
-  *static_cast<uint32_t*>(location) = value_map_->size();
+void FixedLengthTypeCompressionDictionaryBuilder::buildBaseDictionary(void *location) const {
+  *static_cast<uint32_t*>(location) = entries_.size();
 
+  const size_t value_length = type_.maximumByteLength();
   char *copy_location = static_cast<char*>(location) + sizeof(uint32_t);
-  for (map<const void*, const TypeInstance*, STLUncheckedComparatorWrapper>::const_iterator
-           it = value_map_->begin();
-       it != value_map_->end();
+  for (vector<const void*>::const_iterator it = entries_.begin();
+       it != entries_.end();
        ++it) {
-    it->second->copyInto(copy_location);
-    copy_location += type_.maximumByteLength();
+    memcpy(copy_location, *it, value_length);
+    copy_location += value_length;
   }
 }
 
-VariableLengthTypeCompressionDictionaryBuilder::VariableLengthTypeCompressionDictionaryBuilder(const Type &type)
-    : CompressionDictionaryBuilder(type),
-      total_value_size_(0) {
+VariableLengthTypeCompressionDictionaryBuilder::VariableLengthTypeCompressionDictionaryBuilder(
+    const Type &type,
+    const bool build_lookup_tables)
+    : CompressionDictionaryBuilder(type, build_lookup_tables) {
   if (!type_.isVariableLength()) {
     FATAL_ERROR("Attempted to create a VariableLengthTypeCompressionDictionaryBuilder "
                 "for a variable-length Type.");
   }
 }
 
-void VariableLengthTypeCompressionDictionaryBuilder::buildDictionary(void *location) const {
-  *static_cast<uint32_t*>(location) = value_map_->size();
+void VariableLengthTypeCompressionDictionaryBuilder::buildBaseDictionary(void *location) const {
+  *static_cast<uint32_t*>(location) = entries_.size();
 
   uint32_t *offset_array_ptr = static_cast<uint32_t*>(location) + 1;
   char *values_location = static_cast<char*>(location)
-                          + (value_map_->size() + 1) * sizeof(uint32_t);
+                          + (entries_.size() + 1) * sizeof(uint32_t);
   uint32_t value_offset = 0;
-  for (map<const void*, const TypeInstance*, STLUncheckedComparatorWrapper>::const_iterator
-           it = value_map_->begin();
-       it != value_map_->end();
+  for (vector<const void*>::const_iterator it = entries_.begin();
+       it != entries_.end();
        ++it) {
     *offset_array_ptr = value_offset;
-    it->second->copyInto(values_location + value_offset);
+    const size_t value_length = type_.determineByteLength(*it);
+    memcpy(values_location + value_offset, *it, value_length);
 
     ++offset_array_ptr;
-    value_offset += it->second->getInstanceByteLength();
+    value_offset += value_length;
   }
 }
 
-bool VariableLengthTypeCompressionDictionaryBuilder::insertEntry(const TypeInstance &value) {
-  if (total_value_size_ + value.getInstanceByteLength() > numeric_limits<uint32_t>::max()) {
-    FATAL_ERROR("Attempted to insert a value into a "
-                "VariableLengthTypeCompressionDictionaryBuilder which would "
-                "overflow the limit of " << numeric_limits<uint32_t>::max() << " total bytes.");
-  }
-
-  if (CompressionDictionaryBuilder::insertEntry(value)) {
-    total_value_size_ += value_copies_.back().getInstanceByteLength();
-    return true;
-  } else {
-    return false;
-  }
-}
-
-bool VariableLengthTypeCompressionDictionaryBuilder::insertEntryByReference(const TypeInstance &value) {
-  if (total_value_size_ + value.getInstanceByteLength() > numeric_limits<uint32_t>::max()) {
-    FATAL_ERROR("Attempted to insert a value into a "
-                "VariableLengthTypeCompressionDictionaryBuilder which would "
-                "overflow the limit of " << numeric_limits<uint32_t>::max() << " total bytes.");
-  }
-
-  if (CompressionDictionaryBuilder::insertEntryByReference(value)) {
-    total_value_size_ += value.getInstanceByteLength();
-    return true;
-  } else {
-    return false;
-  }
-}
-
-void VariableLengthTypeCompressionDictionaryBuilder::undoLastInsert() {
-  if (last_value_by_reference_ == NULL) {
-    total_value_size_ -= value_copies_.back().getInstanceByteLength();
-  } else {
-    total_value_size_ -= last_value_by_reference_->getInstanceByteLength();
-  }
-
-  CompressionDictionaryBuilder::undoLastInsert();
-}
-
 }  // namespace quickstep
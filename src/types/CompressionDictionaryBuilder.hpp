@@ -22,14 +22,12 @@
 #define QUICKSTEP_TYPES_COMPRESSION_DICTIONARY_BUILDER_HPP_
 
 #include <cstddef>
-#include <map>
+#include <vector>
 
 #include "types/Comparison.hpp"
 #include "types/Type.hpp"
-#include "types/TypeInstance.hpp"
 #include "utility/CstdintCompat.hpp"
 #include "utility/Macros.hpp"
-#include "utility/PtrVector.hpp"
 #include "utility/ScopedPtr.hpp"
 
 namespace quickstep {
@@ -39,13 +37,23 @@ namespace quickstep {
  */
 
 /**
- * @brief An object which accumulates typed values and builds a physical
+ * @brief An object which accumulates untyped values and builds a physical
  *        dictionary for a CompressionDictionary object. This class defines a
  *        common interface which has an implementation for fixed-length Types,
  *        FixedLengthTypeCompressionDictionaryBuilder (for use with
  *        FixedLengthTypeCompressionDictionary), and an implementation for
  *        variable-length Types, VariableLengthTypeCompressionDictionaryBuilder
  *        (for use with VariableLengthTypeCompressionDictionary).
+ * @note Values are not copied, so the caller must keep every value inserted
+ *       into a CompressionDictionaryBuilder at a fixed address until done
+ *       using the CompressionDictionaryBuilder. Entries are kept as a sorted
+ *       array of pointers to distinct values, and batches of values are added
+ *       by sorting and deduplicating them, then merging them into the
+ *       existing entries.
+ * @note A builder may optionally append lookup tables (an Eytzinger-ordered
+ *       array of codes and a cuckoo hash table) to the physical dictionary,
+ *       which speed up code lookups at the cost of extra space. See
+ *       CompressionDictionary for their layout.
  **/
 class CompressionDictionaryBuilder {
  public:
@@ -53,8 +61,11 @@ class CompressionDictionaryBuilder {
    * @brief Constructor.
    *
    * @param type The Type to build a CompressionDictionary for.
+   * @param build_lookup_tables Whether to append lookup tables to the
+   *        physical dictionary (only done for dictionaries with at least
+   *        CompressionDictionary::kMinEntriesForLookupTables entries).
    **/
-  explicit CompressionDictionaryBuilder(const Type &type);
+  CompressionDictionaryBuilder(const Type &type, const bool build_lookup_tables);
 
   /**
    * @brief Destructor.
@@ -62,6 +73,46 @@ class CompressionDictionaryBuilder {
   virtual ~CompressionDictionaryBuilder() {
   }
 
+  /**
+   * @brief Get the number of bits needed to represent codes in a dictionary
+   *        with the specified number of entries.
+   *
+   * @param num_entries The number of entries in a dictionary.
+   * @return The length, in bits, of codes for the dictionary.
+   **/
+  static std::uint8_t CodeLengthBitsForEntries(const std::size_t num_entries);
+
+  /**
+   * @brief Determine whether lookup tables are worth building for
+   *        dictionaries of the specified Type, i.e. whether comparing values
+   *        is expensive enough that avoiding comparisons is worth the extra
+   *        space.
+   *
+   * @param type The Type of values in a dictionary.
+   * @return Whether lookup tables should be built for dictionaries of type.
+   **/
+  static bool LookupTablesRecommendedForType(const Type &type) {
+    return (type.getTypeID() == Type::kChar) || (type.getTypeID() == Type::kVarChar);
+  }
+
+  /**
+   * @brief Get the number of bytes used to represent a code of the specified
+   *        length when codes are padded up to the next power-of-two number of
+   *        bytes.
+   *
+   * @param code_length_bits The length of codes, in bits.
+   * @return The length, in bytes, of codes padded up to a power-of-two bytes.
+   **/
+  static std::uint8_t CodeLengthPaddedBytes(const std::uint8_t code_length_bits) {
+    if (code_length_bits < 9) {
+      return 1;
+    } else if (code_length_bits < 17) {
+      return 2;
+    } else {
+      return 4;
+    }
+  }
+
   /**
    * @brief Get the number of entries (unique values/codes) in the dictionary
    *        being built.
@@ -69,7 +120,7 @@ class CompressionDictionaryBuilder {
    * @return The number of entries in the dictionary.
    **/
   std::uint32_t numberOfEntries() const {
-    return value_map_->size();
+    return entries_.size();
   }
 
   /**
@@ -79,7 +130,7 @@ class CompressionDictionaryBuilder {
    * @return The length, in bits, of codes for the dictionary.
    **/
   std::uint8_t codeLengthBits() const {
-    return code_length_bits_;
+    return CodeLengthBitsForEntries(entries_.size());
   }
 
   /**
@@ -90,13 +141,17 @@ class CompressionDictionaryBuilder {
    * @return The length, in bytes, of codes padded up to a power-of-two bytes.
    **/
   std::uint8_t codeLengthPaddedBytes() const {
-    if (code_length_bits_ < 9) {
-      return 1;
-    } else if (code_length_bits_ < 17) {
-      return 2;
-    } else {
-      return 4;
-    }
+    return CodeLengthPaddedBytes(codeLengthBits());
+  }
+
+  /**
+   * @brief Get the total length of all the distinct values in the dictionary
+   *        being built.
+   *
+   * @return The total size, in bytes, of the values in the dictionary.
+   **/
+  std::size_t totalValueSizeBytes() const {
+    return total_value_size_;
   }
 
   /**
@@ -105,17 +160,39 @@ class CompressionDictionaryBuilder {
    *
    * @return The size, in bytes, of the dictionary.
    **/
-  virtual std::size_t dictionarySizeBytes() const = 0;
+  std::size_t dictionarySizeBytes() const {
+    return dictionarySizeBytesFor(entries_.size(), total_value_size_);
+  }
 
   /**
+   * @brief Get the number of bytes needed to store a physical dictionary of
+   *        this builder's Type with the specified number of entries.
    *
+   * @param num_entries The number of entries in a dictionary.
+   * @param total_value_size The total size, in bytes, of all the values in
+   *        the dictionary.
+   * @return The size, in bytes, of the dictionary, including lookup tables
+   *         if this builder builds them.
    **/
-  bool containsValue(const TypeInstance &value) const {
-    DEBUG_ASSERT(value.getType().equals(type_));
-    if (value.isNull()) {
-      return false;
-    }
-    return value_map_->find(value.getDataPtr()) != value_map_->end();
+  std::size_t dictionarySizeBytesFor(const std::size_t num_entries,
+                                     const std::size_t total_value_size) const;
+
+  /**
+   * @brief Determine whether a value is already in the dictionary being built.
+   *
+   * @param value An untyped pointer to a value of this builder's Type.
+   * @return Whether value is in the dictionary.
+   **/
+  bool containsUntypedValue(const void *value) const;
+
+  /**
+   * @brief Get the distinct values in the dictionary being built.
+   *
+   * @return Untyped pointers to the values in the dictionary, in sorted
+   *         order.
+   **/
+  const std::vector<const void*>& getEntriesByReference() const {
+    return entries_;
   }
 
   /**
@@ -125,50 +202,82 @@ class CompressionDictionaryBuilder {
    *        be built. Must have dictionarySizeBytes() available to write at
    *        location.
    **/
-  virtual void buildDictionary(void *location) const = 0;
+  void buildDictionary(void *location) const;
 
   /**
-   * @brief Add a value to the dictionary being built.
-   * @note This method makes a copy of the value passed in. If the caller can
-   *       guarantee that value remains in existence for the life of this
-   *       CompressionDictionaryBuilder, it is more memory-efficient to use
-   *       insertEntryByReference() instead.
+   * @brief Add a batch of values to the dictionary being built. The values
+   *        are sorted and deduplicated, then merged with the existing
+   *        entries.
+   * @warning The caller must ensure that the values are not moved or deleted
+   *          until after done using this CompressionDictionaryBuilder.
    *
-   * @param value A typed value to add to the dictionary.
-   * @return True if value has been added, false if it was already present and
-   *         the dictionary was not modified.
+   * @param values Untyped pointers to values of this builder's Type, which
+   *        may contain duplicates and values already in the dictionary. The
+   *        contents of values are reordered and otherwise modified by this
+   *        method.
    **/
-  virtual bool insertEntry(const TypeInstance &value);
+  void insertEntriesByReference(std::vector<const void*> *values);
 
   /**
-   * @brief Add a value to the dictionary being built without copying it.
-   * @warning The caller must ensure that value is not deleted until after
-   *          done using this CompressionDictionaryBuilder.
+   * @brief Add a single value to the dictionary being built without copying
+   *        it.
+   * @warning The caller must ensure that value is not moved or deleted until
+   *          after done using this CompressionDictionaryBuilder.
    *
-   * @param value A typed value to add to the dictionary.
+   * @param value An untyped pointer to a value of this builder's Type.
    * @return True if value has been added, false if it was already present and
    *         the dictionary was not modified.
    **/
-  virtual bool insertEntryByReference(const TypeInstance &value);
+  bool insertEntryByReference(const void *value);
 
   /**
    * @brief Remove the last entry successfully added to the dictionary via
-   *        insertEntry(), reducing the dictionary size and potentially
-   *        reducing the code length in bits.
+   *        insertEntryByReference(), reducing the dictionary size and
+   *        potentially reducing the code length in bits.
    **/
-  virtual void undoLastInsert();
+  void undoLastInsert();
 
  protected:
+  // Get the size of a physical dictionary without lookup tables.
+  virtual std::size_t baseDictionarySizeBytesFor(const std::size_t num_entries,
+                                                 const std::size_t total_value_size) const = 0;
+
+  // Build the physical dictionary without lookup tables at 'location'.
+  virtual void buildBaseDictionary(void *location) const = 0;
+
+  // Implementation of insertEntriesByReference() with a specific functor to
+  // compare data pointers.
+  template <typename LessComparatorT>
+  void insertEntriesByReferenceWithComparator(const LessComparatorT &less_comparator,
+                                              std::vector<const void*> *values);
+
+  // Get the length of a value of 'type_'.
+  inline std::size_t valueByteLength(const void *value) const {
+    return type_.isVariableLength() ? type_.determineByteLength(value)
+                                    : type_.maximumByteLength();
+  }
+
   const Type &type_;
+  const bool build_lookup_tables_;
 
   ScopedPtr<UncheckedComparator> less_comparator_;
-  ScopedPtr<std::map<const void*, const TypeInstance*, STLUncheckedComparatorWrapper> > value_map_;
-  PtrVector<LiteralTypeInstance> value_copies_;
-  const TypeInstance *last_value_by_reference_;
-
-  std::uint8_t code_length_bits_;
+  // Pointers to the distinct values in the dictionary, in sorted order.
+  std::vector<const void*> entries_;
+  std::size_t total_value_size_;
+  // The position in 'entries_' of the last value added by
+  // insertEntryByReference(), if it may be undone.
+  std::size_t last_insert_position_;
+  bool last_insert_valid_;
 
  private:
+  // Build the lookup tables for a physical dictionary whose size without
+  // lookup tables is 'base_dictionary_size' at 'location'.
+  void buildLookupTables(void *location, const std::size_t base_dictionary_size) const;
+
+  // Attempt to fill the hash table 'slots' using 'seed', returning false if
+  // some entry could not be placed.
+  bool fillHashTable(const std::uint32_t seed, std::vector<std::uint32_t> *slots) const;
+
   DISALLOW_COPY_AND_ASSIGN(CompressionDictionaryBuilder);
 };
 
@@ -178,13 +287,16 @@ class CompressionDictionaryBuilder {
  **/
 class FixedLengthTypeCompressionDictionaryBuilder : public CompressionDictionaryBuilder {
  public:
-  explicit FixedLengthTypeCompressionDictionaryBuilder(const Type &type);
+  explicit FixedLengthTypeCompressionDictionaryBuilder(const Type &type,
+                                                       const bool build_lookup_tables = false);
 
-  std::size_t dictionarySizeBytes() const {
-    return sizeof(std::uint32_t) + value_map_->size() * type_.maximumByteLength();
+ protected:
+  std::size_t baseDictionarySizeBytesFor(const std::size_t num_entries,
+                                         const std::size_t total_value_size) const {
+    return sizeof(std::uint32_t) + num_entries * type_.maximumByteLength();
   }
 
-  void buildDictionary(void *location) const;
+  void buildBaseDictionary(void *location) const;
 
  private:
   DISALLOW_COPY_AND_ASSIGN(FixedLengthTypeCompressionDictionaryBuilder);
@@ -196,25 +308,21 @@ class FixedLengthTypeCompressionDictionaryBuilder : public CompressionDictionary
  **/
 class VariableLengthTypeCompressionDictionaryBuilder : public CompressionDictionaryBuilder {
  public:
-  explicit VariableLengthTypeCompressionDictionaryBuilder(const Type &type);
+  explicit VariableLengthTypeCompressionDictionaryBuilder(const Type &type,
+                                                          const bool build_lookup_tables = false);
 
   virtual ~VariableLengthTypeCompressionDictionaryBuilder() {
   }
 
-  std::size_t dictionarySizeBytes() const {
-    return (value_map_->size() + 1) * sizeof(std::uint32_t) + total_value_size_;
+ protected:
+  std::size_t baseDictionarySizeBytesFor(const std::size_t num_entries,
+                                         const std::size_t total_value_size) const {
+    return (num_entries + 1) * sizeof(std::uint32_t) + total_value_size;
   }
 
-  void buildDictionary(void *location) const;
-
-  bool insertEntry(const TypeInstance &value);
-  bool insertEntryByReference(const TypeInstance &value);
-
-  void undoLastInsert();
+  void buildBaseDictionary(void *location) const;
 
  private:
-  std::size_t total_value_size_;
-
   DISALLOW_COPY_AND_ASSIGN(VariableLengthTypeCompressionDictionaryBuilder);
 };
 
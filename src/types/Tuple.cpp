@@ -28,6 +28,7 @@
 #include "catalog/CatalogAttribute.hpp"
 #include "catalog/CatalogRelation.hpp"
 #include "expressions/Scalar.hpp"
+#include "storage/TupleBatch.hpp"
 #include "storage/TupleStorageSubBlock.hpp"
 #include "types/Type.hpp"
 #include "types/TypeInstance.hpp"
@@ -97,6 +98,15 @@ Tuple::Tuple(const TupleStorageSubBlock &tuple_store,
   }
 }
 
+Tuple::Tuple(const TupleBatch &batch, const tuple_id tuple) {
+  const CatalogRelation &relation = batch.getRelation();
+  attributes_.reserve(relation.size());
+
+  for (CatalogRelation::const_iterator attr_it = relation.begin(); attr_it != relation.end(); ++attr_it) {
+    attributes_.push_back(attr_it->getType().makeReferenceTypeInstance(batch.getValue(tuple, attr_it->getID())));
+  }
+}
+
 Tuple* Tuple::clone() const {
   ScopedPtr<Tuple> clone(new Tuple());
   clone->attributes_.reserve(attributes_.size());
@@ -38,8 +38,13 @@ namespace quickstep {
 
 class CatalogRelation;
 class Scalar;
+class TupleBatch;
 class TupleStorageSubBlock;
 
+namespace csbtree_internal {
+class KeyValueMatchCollector;
+}
+
 namespace storage_explorer {
 class DataGenerator;
 }
@@ -128,6 +133,17 @@ class Tuple {
         const tuple_id tid,
         const CompatUnorderedMap<attribute_id, LiteralTypeInstance*>::unordered_map &updated_values);
 
+  /**
+   * @brief Constructor which builds a Tuple which refers to the values of a
+   *        tuple in a TupleBatch.
+   * @warning The Tuple's values are ReferenceTypeInstances which point into
+   *          the TupleBatch's buffers, so it must not outlive them.
+   *
+   * @param batch The TupleBatch which contains the tuple.
+   * @param tuple The position of the tuple in batch.
+   **/
+  Tuple(const TupleBatch &batch, const tuple_id tuple);
+
   /**
    * @brief Destructor.
    **/
@@ -205,7 +221,8 @@ class Tuple {
   /**
    * @brief Constructor which does not create any attributes, nor pre-reserve
    *        space.
-   * @warning This is only used by clone(), and should not otherwise be used.
+   * @warning This is only used by clone() and by index-only scans in
+   *          CSBTreeIndexSubBlock, and should not otherwise be used.
    **/
   Tuple() {
   }
@@ -221,8 +238,9 @@ class Tuple {
 
   /**
    * @brief Append a value to this Tuple.
-   * @warning This is only used by TextScanWorkUnit and
-   *          CSBTreeIndexSubBlockTest and should not otherwise be used.
+   * @warning This is only used by TextScanWorkUnit,
+   *          CSBTreeIndexSubBlockTest, and index-only scans in
+   *          CSBTreeIndexSubBlock, and should not otherwise be used.
    **/
   void append(TypeInstance *item) {
     attributes_.push_back(item);
@@ -230,6 +248,7 @@ class Tuple {
 
   PtrVector<TypeInstance> attributes_;
 
+  friend class csbtree_internal::KeyValueMatchCollector;
   friend class storage_explorer::DataGenerator;
 
   DISALLOW_COPY_AND_ASSIGN(Tuple);
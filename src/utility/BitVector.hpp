@@ -118,6 +118,60 @@ class BitVector {
     }
   }
 
+  /**
+   * @brief Remove a single bit, shifting all of the bits after it forward by
+   *        one position. The last bit in this BitVector becomes zero.
+   *
+   * @param bit_num The bit to remove.
+   **/
+  void shiftTailForward(const std::size_t bit_num) {
+    DEBUG_ASSERT(bit_num < num_bits_);
+    const std::size_t first_word = bit_num >> kHigherOrderShift;
+    const std::size_t low_mask = (static_cast<std::size_t>(0x1) << (bit_num & kLowerOrderMask)) - 1;
+
+    data_array_[first_word] = (data_array_[first_word] & low_mask)
+                              | ((data_array_[first_word] >> 1) & ~low_mask);
+    for (std::size_t word = first_word + 1; word < data_array_size_; ++word) {
+      data_array_[word - 1] |= data_array_[word] << (kSizeTBits - 1);
+      data_array_[word] >>= 1;
+    }
+  }
+
+  /**
+   * @brief Insert a single zero bit, shifting the bit at that position and
+   *        all of the bits after it back by one position. The last bit in
+   *        this BitVector is discarded.
+   *
+   * @param bit_num The position to insert a zero bit at.
+   **/
+  void shiftTailBackward(const std::size_t bit_num) {
+    DEBUG_ASSERT(bit_num < num_bits_);
+    const std::size_t first_word = bit_num >> kHigherOrderShift;
+    const std::size_t bit_mask = static_cast<std::size_t>(0x1) << (bit_num & kLowerOrderMask);
+
+    for (std::size_t word = data_array_size_ - 1; word > first_word; --word) {
+      data_array_[word] = (data_array_[word] << 1) | (data_array_[word - 1] >> (kSizeTBits - 1));
+    }
+    data_array_[first_word] = (data_array_[first_word] & (bit_mask - 1))
+                              | ((data_array_[first_word] << 1) & ~((bit_mask - 1) | bit_mask));
+
+    // Keep the unused bits in the last word zeroed.
+    if (num_bits_ & kLowerOrderMask) {
+      data_array_[data_array_size_ - 1]
+          &= (static_cast<std::size_t>(0x1) << (num_bits_ & kLowerOrderMask)) - 1;
+    }
+  }
+
+  /**
+   * @brief Get the words of memory which store this BitVector. Bit n is bit
+   *        (n % (8 * sizeof(size_t))) of word (n / (8 * sizeof(size_t))).
+   *
+   * @return The words of this BitVector.
+   **/
+  inline const std::size_t* getWords() const {
+    return data_array_;
+  }
+
   /**
    * @brief Count the total number of 1-bits in this BitVector.
    *